@@ -0,0 +1,211 @@
+/* axisCalibration.cpp
+ *
+ * Resampling of electron analyser images onto uniform kinetic or binding
+ * energy and emission angle axes.
+ *
+ */
+
+#include <stddef.h>
+
+#include "axisCalibration.h"
+
+/**
+ * AxisCalibration constructor
+ */
+AxisCalibration::AxisCalibration() :
+  mode(CalibrationOff),
+  valid(false)
+{
+  channelTable.start = channelTable.step = 0.0;
+  sliceTable.start = sliceTable.step = 0.0;
+}
+
+/**
+ * Build the interpolation tables for the scales of a region.
+ *
+ * \param[in] mode Energy axis of the calibrated images, CalibrationOff invalidates the tables.
+ * \param[in] channelScale Kinetic energy of each channel.
+ * \param[in] sliceScale Angle of each slice.
+ * \param[in] excitationEnergy Excitation energy used for binding energies.
+ */
+void AxisCalibration::build(calibrationMode_t mode, const std::vector<double> &channelScale,
+                            const std::vector<double> &sliceScale, double excitationEnergy)
+{
+  this->mode = mode;
+  valid = false;
+  if (mode == CalibrationOff || channelScale.empty() || sliceScale.empty()) {
+    return;
+  }
+
+  /* Binding energy is measured down from the excitation energy */
+  if (mode == CalibrationBinding) {
+    buildAxis(channelScale, excitationEnergy, -1.0, channelTable);
+  } else {
+    buildAxis(channelScale, 0.0, 1.0, channelTable);
+  }
+  buildAxis(sliceScale, 0.0, 1.0, sliceTable);
+  rows.resize(channelScale.size() * sliceScale.size());
+  valid = true;
+}
+
+/**
+ * Forget the tables, the next image needs a build().
+ */
+void AxisCalibration::invalidate()
+{
+  valid = false;
+}
+
+/**
+ * \return true if the tables match a region.
+ */
+bool AxisCalibration::isValid() const
+{
+  return valid;
+}
+
+/**
+ * \return The energy axis the tables were built for.
+ */
+calibrationMode_t AxisCalibration::getMode() const
+{
+  return mode;
+}
+
+/**
+ * \return The number of channels of the region the tables were built for.
+ */
+int AxisCalibration::getChannels() const
+{
+  return (int)channelTable.weight.size();
+}
+
+/**
+ * \return The number of slices of the region the tables were built for.
+ */
+int AxisCalibration::getSlices() const
+{
+  return (int)sliceTable.weight.size();
+}
+
+/**
+ * Resample an image of getChannels() x rows, rows is either getSlices() or 1
+ * for a spectrum.  pIn and pOut may be the same buffer.
+ */
+void AxisCalibration::apply(const double *pIn, double *pOut, int rows)
+{
+  int channels = getChannels();
+  const int *pIndex0 = &channelTable.index0[0];
+  const int *pIndex1 = &channelTable.index1[0];
+  const double *pWeight = &channelTable.weight[0];
+  double *pRows = &this->rows[0];
+  int i, j;
+
+  /* Resample along the channels of each slice, gathering from the source channels */
+  for (j = 0; j < rows; j++) {
+    const double *pRow = pIn + (size_t)j * channels;
+    double *pTmp = pRows + (size_t)j * channels;
+    for (i = 0; i < channels; i++) {
+      double a = pRow[pIndex0[i]];
+      pTmp[i] = a + pWeight[i] * (pRow[pIndex1[i]] - a);
+    }
+  }
+
+  if (rows == 1) {
+    for (i = 0; i < channels; i++) {
+      pOut[i] = pRows[i];
+    }
+    return;
+  }
+
+  /* Then between slices, a whole row at a time so the inner loop is contiguous */
+  for (j = 0; j < rows; j++) {
+    const double *pA = pRows + (size_t)sliceTable.index0[j] * channels;
+    const double *pB = pRows + (size_t)sliceTable.index1[j] * channels;
+    double weight = sliceTable.weight[j];
+    double *pDest = pOut + (size_t)j * channels;
+    for (i = 0; i < channels; i++) {
+      pDest[i] = pA[i] + weight * (pB[i] - pA[i]);
+    }
+  }
+}
+
+/**
+ * \return The energy of the first calibrated channel.
+ */
+double AxisCalibration::energyStart() const
+{
+  return channelTable.start;
+}
+
+/**
+ * \return The energy step between calibrated channels.
+ */
+double AxisCalibration::energyStep() const
+{
+  return channelTable.step;
+}
+
+/**
+ * \return The angle of the first calibrated slice.
+ */
+double AxisCalibration::angleStart() const
+{
+  return sliceTable.start;
+}
+
+/**
+ * \return The angle step between calibrated slices.
+ */
+double AxisCalibration::angleStep() const
+{
+  return sliceTable.step;
+}
+
+/**
+ * Build the table of one axis.  The values offset + sign * scale[i] are mapped
+ * onto a uniform, increasing grid from their minimum to their maximum with the
+ * same number of points.  The scale must be monotonic, in either direction.
+ */
+void AxisCalibration::buildAxis(const std::vector<double> &scale, double offset, double sign, AxisTable &table)
+{
+  int n = (int)scale.size();
+  bool reversed;
+  double first, last, target;
+  int k, p;
+
+  table.index0.assign(n, 0);
+  table.index1.assign(n, 0);
+  table.weight.assign(n, 0.0);
+  first = offset + sign * scale[0];
+  last = offset + sign * scale[n - 1];
+  reversed = (first > last);
+  table.start = reversed ? last : first;
+  table.step = (n > 1) ? ((reversed ? first : last) - table.start) / (n - 1) : 0.0;
+  if (n == 1) {
+    return;
+  }
+
+  /* Walk the increasing grid and the source scale together, in increasing value order */
+  p = 0;
+  for (k = 0; k < n; k++) {
+    target = table.start + k * table.step;
+    while (p < n - 2) {
+      int next = reversed ? n - 2 - p : p + 1;
+      if (offset + sign * scale[next] >= target) {
+        break;
+      }
+      p++;
+    }
+    int s0 = reversed ? n - 1 - p : p;
+    int s1 = reversed ? n - 2 - p : p + 1;
+    double v0 = offset + sign * scale[s0];
+    double v1 = offset + sign * scale[s1];
+    double weight = (v1 != v0) ? (target - v0) / (v1 - v0) : 0.0;
+    if (weight < 0.0) weight = 0.0;
+    if (weight > 1.0) weight = 1.0;
+    table.index0[k] = s0;
+    table.index1[k] = s1;
+    table.weight[k] = weight;
+  }
+}
@@ -0,0 +1,66 @@
+/* axisCalibration.h
+ *
+ * Resampling of electron analyser images onto uniform kinetic or binding
+ * energy and emission angle axes.
+ *
+ */
+
+#ifndef AXISCALIBRATION_H
+#define AXISCALIBRATION_H
+
+#include <vector>
+
+/** Energy axis of a calibrated image */
+typedef enum {
+  CalibrationOff,
+  CalibrationKinetic,
+  CalibrationBinding
+} calibrationMode_t;
+
+/**
+ * Interpolation tables that map the channel (energy) and slice (angle) scales
+ * reported by SES onto uniform grids with the same number of points.  The
+ * tables are separable, so an image is resampled along the channels of each
+ * slice and then between slices.  The tables only depend on the scales and the
+ * excitation energy, so they are built once per region and reused for every
+ * image.
+ */
+class AxisCalibration
+{
+  public:
+    AxisCalibration();
+
+    void build(calibrationMode_t mode, const std::vector<double> &channelScale,
+               const std::vector<double> &sliceScale, double excitationEnergy);
+    void invalidate();
+    bool isValid() const;
+    calibrationMode_t getMode() const;
+    int getChannels() const;
+    int getSlices() const;
+    void apply(const double *pIn, double *pOut, int rows);
+    double energyStart() const;
+    double energyStep() const;
+    double angleStart() const;
+    double angleStep() const;
+
+  private:
+    /** Linear interpolation of one axis: point i is index0[i] + weight[i] * (index1[i] - index0[i]) */
+    struct AxisTable
+    {
+      std::vector<int> index0;
+      std::vector<int> index1;
+      std::vector<double> weight;
+      double start;
+      double step;
+    };
+
+    static void buildAxis(const std::vector<double> &scale, double offset, double sign, AxisTable &table);
+
+    calibrationMode_t mode;
+    bool valid;
+    AxisTable channelTable;
+    AxisTable sliceTable;
+    std::vector<double> rows;
+};
+
+#endif
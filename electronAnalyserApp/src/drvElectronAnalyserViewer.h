@@ -5,7 +5,7 @@
 extern "C"
 {
 #endif
-int electronAnalyserViewerConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize);
+int electronAnalyserViewerConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxStreams);
 #ifdef __cplusplus
 }
 #endif
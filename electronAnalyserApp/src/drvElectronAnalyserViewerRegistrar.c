@@ -21,6 +21,7 @@ static const iocshArg electronAnalyserViewerConfigArg1 = {"max number of NDArray
 static const iocshArg electronAnalyserViewerConfigArg2 = {"maxMemory", iocshArgInt};
 static const iocshArg electronAnalyserViewerConfigArg3 = {"priority", iocshArgInt};
 static const iocshArg electronAnalyserViewerConfigArg4 = {"stackSize", iocshArgInt};
+static const iocshArg electronAnalyserViewerConfigArg5 = {"maxStreams", iocshArgInt};
 /*static const iocshArg * const electronAnalyserViewerConfigArgs[] =  {&electronAnalyserViewerConfigArg0,
                                                           &electronAnalyserViewerConfigArg1,
                                                           &electronAnalyserViewerConfigArg2,
@@ -32,12 +33,13 @@ static const iocshArg * const electronAnalyserViewerConfigArgs[] =  {&electronAn
                                                           &electronAnalyserViewerConfigArg1,
                                                           &electronAnalyserViewerConfigArg2,
                                                           &electronAnalyserViewerConfigArg3,
-                                                          &electronAnalyserViewerConfigArg4};
-static const iocshFuncDef configelectronAnalyserViewer = {"electronAnalyserViewerConfig", 5, electronAnalyserViewerConfigArgs};
+                                                          &electronAnalyserViewerConfigArg4,
+                                                          &electronAnalyserViewerConfigArg5};
+static const iocshFuncDef configelectronAnalyserViewer = {"electronAnalyserViewerConfig", 6, electronAnalyserViewerConfigArgs};
 static void configelectronAnalyserViewerCallFunc(const iocshArgBuf *args)
 {
     //electronAnalyserViewerConfig(args[0].sval, args[1].sval, args[2].sval, args[3].ival, args[4].ival, args[5].ival, args[6].ival);
-    electronAnalyserViewerConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+    electronAnalyserViewerConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival, args[5].ival);
 }
 
 static void electronAnalyserViewerRegister(void)
@@ -36,11 +36,17 @@
 /* Device Specific API */
 #include "wseswrappermain.h"
 #include "werror.h"
+#include "axisCalibration.h"
+#include "momentumMap.h"
+#include "wsnapshot.h"
+#include "wcallstats.h"
 
 #define MAX_MESSAGE_SIZE 256
 #define MAX_FILENAME_LEN 256
 /* MAX_STRING_SIZE is defined in epicsTypes.h (as 32) */
 #define MAX_MEMORY_SIZE 5000000
+#define MAX_ENUM_STATES 16		/* the number of states of an mbbo record */
+#define CALL_STATS_FIELDS 5		/* calls, total ms, max ms, p50 ms and p99 ms of each SES library function */
 #define AD_STATUS_EXTENSION_START_POINT ADStatusWaiting+1
 
 using namespace std;
@@ -52,11 +58,97 @@ typedef enum
 	AddDimension
 } runMode_t;
 
+/** Progress of the initialisation of the SES library, which runs on a thread of its own */
+typedef enum
+{
+	InitLoadingLibrary,
+	InitInitialising,
+	InitLoadingInstrument,
+	InitReady,
+	InitFailed
+} initState_t;
+
+/** A write received before the SES library was ready, replayed once it is */
+typedef struct
+{
+	asynUser *pasynUser;		/* duplicate of the asynUser of the write, freed after the replay */
+	asynParamType type;
+	epicsInt32 intValue;
+	epicsFloat64 doubleValue;
+	std::string stringValue;
+	epicsInt32 previousIntValue;	/* value the parameter had before the write was queued */
+	epicsFloat64 previousDoubleValue;
+} pendingWrite_t;
+
+/** Asyn addresses of the NDArrays published by the driver */
+typedef enum
+{
+	ImageAddr = 0,		/**< the acquired image */
+	RawImageAddr,		/**< raw detector frames from the raw image producer */
+	IOArrayAddr,		/**< external IO data, one row of steps per port */
+	SpectrumAddr,		/**< the summed spectrum of the acquired image */
+	IterationImageAddr,	/**< the image of each iteration */
+	MomentumImageAddr,	/**< the image converted to energy and parallel momentum */
+	NUM_ARRAY_ADDR
+} arrayAddr_t;
+
 typedef std::vector<std::string> NameVector;
 typedef std::vector<double> DoubleVector;
 
+/** Settings that determine the channel and slice scales of a region */
+typedef struct
+{
+	SESWrapperNS::WAnalyzerRegion analyzer;
+	SESWrapperNS::WDetectorRegion detector;
+	int channels;
+	int energyMode;
+	int elementSet;
+	int lensMode;
+	int passEnergy;
+	double excitationEnergy;
+} axisKey_t;
+
+/** Channel and slice axes of a region, read from SES once per region */
+typedef struct
+{
+	axisKey_t key;
+	bool valid;
+	int generation;				/* incremented every time the axes are read from SES */
+	DoubleVector channelScale;
+	DoubleVector sliceScale;
+	std::string intensityUnit;
+	std::string channelUnit;
+	std::string sliceUnit;
+	double channelStart;
+	double channelStep;			/* only meaningful if channelLinear */
+	bool channelLinear;			/* true if every value of channelScale lies on channelStart + i * channelStep */
+	double sliceStart;
+	double sliceStep;			/* only meaningful if sliceLinear */
+	bool sliceLinear;			/* true if every value of sliceScale lies on sliceStart + i * sliceStep */
+} axisCache_t;
+
 static const char *driverName = "electronAnalyser";
 
+/** Get the start and step of a scale.
+ * \return true if every value lies within a thousandth of a step of start + i * step.
+ */
+static bool linearScale(const DoubleVector &scale, double &start, double &step)
+{
+	size_t n = scale.size();
+	size_t i;
+
+	start = scale[0];
+	step = (n > 1) ? (scale[n - 1] - scale[0]) / (n - 1) : 0.0;
+	for (i = 1; i + 1 < n; i++)
+	{
+		if (fabs(scale[i] - (start + i * step)) > 1.0e-3 * fabs(step))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 /** Strings defining parameters that affect the behaviour of the electron analyser detector.
   * These are the values passed to drvUserCreate.
   * The driver will place in pasynUser->reason an integer to be used when the standard asyn interface methods are called. */
@@ -156,6 +248,24 @@ static const char *driverName = "electronAnalyser";
 #define StopNextIterationString		"STOP_NEXT_ITERATION"
 /* Metadata used by GDA */
 #define NumExposuresLastImageString	"NEXPOSURES_LAST"
+/* Raw detector frames */
+#define RawEnableString				"RAW_ENABLE"
+#define RawRateString				"RAW_RATE"
+#define RawErrorsString				"RAW_ERRORS"
+/* Axis calibration */
+#define CalibrationModeString		"CALIBRATION_MODE"
+/* Momentum conversion */
+#define MomentumEnableString		"KSPACE_ENABLE"
+#define MomentumThreadsString		"KSPACE_THREADS"
+/* Initialisation of the SES library */
+#define InitStateString				"INIT_STATE"
+/* SES library call statistics */
+#define CallStatsEnableString		"CALL_STATS_ENABLE"
+#define CallStatsResetString		"CALL_STATS_RESET"
+#define CallStatsString				"CALL_STATS"
+#define CallStatsNamesString		"CALL_STATS_NAMES"
+/* Capture of the SES library calls for replay */
+#define CaptureFileString			"CAPTURE_FILE"
 
 /**
  * Driver class for VG Scienta Electron Analyzer EW4000 System. It uses SESWrapper to communicate to the instrument library, which
@@ -174,6 +284,8 @@ class ElectronAnalyser: public ADDriver
 		virtual asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
 		void report(FILE *fp, int details);
 		void electronAnalyserTask();
+		void rawImageTask();
+		void initTask();
 
 	protected:
 		/* Properties */
@@ -274,7 +386,27 @@ class ElectronAnalyser: public ADDriver
         int StopNextIteration;		/**< (asynInt32, 		r/w) return an image after the current iteration has completed. If there are further images, they will continue as before. */
         /* Metadata used by GDA */
         int NumExposuresLastImage;	/**< (asynInt32,    	r) number of exposures for the last completed image*/
-		#define LAST_ELECTRONANALYZER_PARAM NumExposuresLastImage
+		/* Raw detector frames */
+		int RawEnable;				/**< (asynInt32,    	r/w) publish raw detector frames on RawImageAddr (0=No, 1=YES)*/
+		int RawRate;				/**< (asynFloat64,  	r/w) raw frames per second, 0 or above the detector frame rate for the detector frame rate*/
+		int RawErrors;				/**< (asynInt32,    	r/o) number of raw frames that could not be read from the detector*/
+		/* Axis calibration */
+		int CalibrationMode;		/**< (asynInt32,    	r/w) resample the published images onto uniform axes (0=Off, 1=Kinetic energy, 2=Binding energy).
+									 * Only the NDArrays are resampled, the AcqImageLast and AcqSpectrumLast waveforms stay on the
+									 * SES scales of AcqChannelScale and AcqSliceScale*/
+		/* Momentum conversion */
+		int MomentumEnable;			/**< (asynInt32,    	r/w) publish the image converted to parallel momentum on MomentumImageAddr (0=No, 1=YES)*/
+		int MomentumThreads;		/**< (asynInt32,    	r/w) number of threads used to convert each image*/
+		/* Initialisation of the SES library */
+		int InitState;				/**< (asynInt32,    	r/o) progress of the initialisation of the SES library (see initState_t)*/
+		/* SES library call statistics */
+		int CallStatsEnable;		/**< (asynInt32,    	r/w) time every call into the SES library (0=No, 1=YES)*/
+		int CallStatsReset;			/**< (asynInt32,    	w) clear the call statistics*/
+		int CallStats;				/**< (asynFloat64Array, r/o) CALL_STATS_FIELDS values for each function in CallStatsNames*/
+		int CallStatsNames;			/**< (asynOctet,    	r/o) the SES library functions of CallStats, separated by spaces*/
+		/* Capture of the SES library calls for replay */
+		int CaptureFile;			/**< (asynOctet,    	r/w) the file the SES library calls are captured to, empty when not capturing*/
+		#define LAST_ELECTRONANALYZER_PARAM CaptureFile
 
 	private:
 		WSESWrapperMain *ses;
@@ -283,18 +415,48 @@ class ElectronAnalyser: public ADDriver
         SESWrapperNS::WDetectorRegion old_detector;
 		SESWrapperNS::WDetectorInfo detectorInfo;
 		asynStatus acquireData(void *pData, double *pSpectrumLast, int NumSteps);
+		asynStatus publishIOData(int &capacity);
+		void updateAxes(int channels);
+		asynStatus getEnumChoices(int function, char *strings[], int values[], int severities[], size_t nElements, size_t *nIn);
+		void updateEnumChoices(int function);
+		void publishCallStatistics();
+		const WCapabilities &currentCapabilities(int &lensMode);
+		void reconcileSnapshot();
+		void snapshotSettings();
+		void saveSnapshot();
+		bool calibrate(NDArray *pArray);
+		void addAxes(NDArray *pArray, bool calibrated);
+		void publishMomentum(NDArray *pImage, bool calibrated);
+		NDArray *allocArray(int ndims, size_t *dims, const double *pData);
+		void publishArray(int addr, NDArray *pArray);
 		virtual void init_device(const char *workingDir, const char *instrumentFile);
 		void delete_device();
 		virtual void updateStatus();
+		void setInitState(initState_t state);
+		void readSettings();
+		int publishSettings();
+		asynStatus queueWrite(asynUser *pasynUser, asynParamType type, epicsInt32 intValue, epicsFloat64 doubleValue, const char *stringValue);
+		void replayWrites();
+		void dropWrites();
 
 		double *spectrum;
 		double *acq_image;
 		double *acq_data;
-		double *channel_scale;
-		double *slice_scale;
+		int ioDataSize;				/* number of elements of external IO data in acq_data, 0 if none has been read */
+		axisCache_t axes;
+		AxisCalibration calibration;
+		int calibrationGeneration;	/* generation of the axes the calibration tables were built for */
+		MomentumMap *momentum;
+		int momentumGeneration;		/* generation of the axes the momentum map was built for */
+		int momentumCalibration;	/* calibration mode of the images the momentum map was built for */
 
 		epicsEventId startEventId;
 		epicsEventId stopEventId;
+		epicsEventId rawEventId;
+
+		/* uniqueId and timestamp shared by all arrays of the image being acquired */
+		int arrayUniqueId;
+		double arrayTimeStamp;
 
 		/* Analyser specific parameters */
 		virtual asynStatus getExcitationEnergy(double *excitationEnergy);
@@ -393,15 +555,20 @@ class ElectronAnalyser: public ADDriver
 		WError *werror;
 		string sesWorkingDirectory;
 		string instrumentFilePath;
+		string snapshotFilePath;
+		string snapshotInstrumentFile;
+		WSnapshot snapshot;			/**< capabilities and settings of the instrument saved by the last run */
+		bool snapshotLoaded;
+		WSnapshot pendingSnapshot;	/**< settings to save once the acquisition task is idle */
+		bool snapshotPending;
 		string instrumentDLLPath;
+		initState_t initState;		/**< progress of initTask(), read and written with the port locked */
+		std::vector<pendingWrite_t> pendingWrites;	/**< writes received before the SES library was ready */
 
 		float m_dTemperature;
 		bool m_bAllowIOWithDetector;
 		bool m_bAlwaysDelayRegion;
 		runMode_t m_RunMode;
-		NameVector m_Elementsets;
-		NameVector m_LensModes;
-		DoubleVector m_PassEnergies;
 		char * m_sCurrentElementSet;
 		char * m_sCurrentLensMode;
 		double m_dCurrentPassEnergy;
@@ -424,6 +591,18 @@ static void electronAnalyserTaskC(void *drvPvt)
 	pPvt->electronAnalyserTask();
 }
 
+static void rawImageTaskC(void *drvPvt)
+{
+	ElectronAnalyser *pPvt = (ElectronAnalyser *) drvPvt;
+	pPvt->rawImageTask();
+}
+
+static void initTaskC(void *drvPvt)
+{
+	ElectronAnalyser *pPvt = (ElectronAnalyser *) drvPvt;
+	pPvt->initTask();
+}
+
 
 /* Number of asyn parameters (asyn commands) this driver supports*/
 #define NUM_ELECTRONANALYZER_PARAMS (&LAST_ELECTRONANALYZER_PARAM - &FIRST_ELECTRONANALYZER_PARAM + 1)
@@ -434,26 +613,36 @@ ElectronAnalyser::~ElectronAnalyser()
 	free(spectrum);
 	free(acq_image);
 	free(acq_data);
-	free(channel_scale);
-	free(slice_scale);
+	delete momentum;
 	this->delete_device();
 }
 
 /* ElectronAnalyser constructor */
 ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize) :
-	ADDriver(portName, 1, NUM_ELECTRONANALYZER_PARAMS, maxBuffers, maxMemory, asynEnumMask | asynFloat64ArrayMask, asynEnumMask | asynFloat64ArrayMask, /* No interfaces beyond those set in ADDriver.cpp */
-	ASYN_CANBLOCK, 1, //asynflags (CANBLOCK means separate thread for this driver)
+	ADDriver(portName, NUM_ARRAY_ADDR, NUM_ELECTRONANALYZER_PARAMS, maxBuffers, maxMemory, asynEnumMask | asynFloat64ArrayMask, asynEnumMask | asynFloat64ArrayMask, /* No interfaces beyond those set in ADDriver.cpp */
+	ASYN_CANBLOCK | ASYN_MULTIDEVICE, 1, //asynflags (CANBLOCK means separate thread for this driver, MULTIDEVICE for the NDArray addresses)
 			priority, stackSize) // thread priority and stack size (0=default)
 {
 	int status = asynSuccess;
 	const char *functionName = "ElectronAnalyser";
-	char message[MAX_MESSAGE_SIZE];
-	char value[MAX_MESSAGE_SIZE];
-	int size = 0;
 	char *pWorkingDirEnvVar;
 	char *pInstrumentFileEnvVar;
 
 	werror = WError::instance();
+	this->ioDataSize = 0;
+	this->arrayUniqueId = 0;
+	this->arrayTimeStamp = 0.0;
+	this->axes.valid = false;
+	this->axes.generation = 0;
+	this->calibrationGeneration = -1;
+	this->momentum = NULL;
+	this->momentumGeneration = -1;
+	this->momentumCalibration = CalibrationOff;
+	this->snapshotLoaded = false;
+	this->snapshotPending = false;
+	this->initState = InitLoadingLibrary;
+	/* The SES library is loaded by initTask, until then the driver only holds the wrapper */
+	this->ses = WSESWrapperMain::instance();
         
 	/* Create the epicsEvents for signalling to the Electron Analyser task when acquisition starts */
 	this->startEventId = epicsEventCreate(epicsEventEmpty);
@@ -471,8 +660,13 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 		return;
 	}
 
-	/* Initialise the SES library - load from instrument file */
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Initialising the SES library....\n", driverName, functionName);
+	/* Create the epicsEvent for signalling to the raw image task when raw frames are enabled */
+	this->rawEventId = epicsEventCreate(epicsEventEmpty);
+	if (!this->rawEventId)
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: epicsEventCreate failure for raw image event\n", driverName, functionName);
+		return;
+	}
 
 	/* Find out the location and name of the instrument file from environment variables */
 	/* This used to be passed in as a parameter to the electronAnalyzer config call */
@@ -482,7 +676,16 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: SES Working directory = %s\n", driverName, functionName, pWorkingDirEnvVar);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: SES Instrument file = %s\n", driverName, functionName, pInstrumentFileEnvVar);
 
-	this->init_device(pWorkingDirEnvVar, pInstrumentFileEnvVar);
+	/* Load the capabilities and settings saved by the last run, so that the enums and defaults are
+	 * available without the SES library.  The snapshot belongs to one version of the instrument file. */
+	if (pWorkingDirEnvVar != NULL && pInstrumentFileEnvVar != NULL)
+	{
+		const char *pSnapshotEnvVar = getenv("SES_SNAPSHOT_FILE");
+		snapshotFilePath = pSnapshotEnvVar != NULL ? pSnapshotEnvVar : std::string(pWorkingDirEnvVar) + "/ini/electronAnalyser.snapshot";
+		snapshotInstrumentFile = std::string(pWorkingDirEnvVar) + pInstrumentFileEnvVar;
+		snapshotLoaded = snapshot.load(snapshotFilePath.c_str(), snapshotInstrumentFile.c_str());
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Instrument snapshot %s %s\n", driverName, functionName, snapshotFilePath.c_str(), snapshotLoaded ? "loaded" : "not available");
+	}
 
 	createParam(LibDescriptionString, asynParamOctet, &LibDescription);
 	createParam(LibVersionString, asynParamOctet, &LibVersion);
@@ -580,19 +783,37 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
     createParam(StopNextIterationString, asynParamInt32, &StopNextIteration);
 	/* Metadata used by GDA */
     createParam(NumExposuresLastImageString, asynParamInt32, &NumExposuresLastImage);
-
-	/* Initialise state variables from SES library */
-	getAllowIOWithDetector(&m_bAllowIOWithDetector);
-	getAlwaysDelayRegion(&m_bAlwaysDelayRegion);
-	getDetectorInfo(&detectorInfo);
-	getDetectorRegion(&detector);
-	getAnalyzerRegion(&analyzer);
+	/* Raw detector frames */
+	createParam(RawEnableString, asynParamInt32, &RawEnable);
+	createParam(RawRateString, asynParamFloat64, &RawRate);
+	createParam(RawErrorsString, asynParamInt32, &RawErrors);
+	/* Axis calibration */
+	createParam(CalibrationModeString, asynParamInt32, &CalibrationMode);
+	/* Momentum conversion */
+	createParam(MomentumEnableString, asynParamInt32, &MomentumEnable);
+	createParam(MomentumThreadsString, asynParamInt32, &MomentumThreads);
+	/* Initialisation of the SES library */
+	createParam(InitStateString, asynParamInt32, &InitState);
+	/* SES library call statistics */
+	createParam(CallStatsEnableString, asynParamInt32, &CallStatsEnable);
+	createParam(CallStatsResetString, asynParamInt32, &CallStatsReset);
+	createParam(CallStatsString, asynParamFloat64Array, &CallStats);
+	createParam(CallStatsNamesString, asynParamOctet, &CallStatsNames);
+	/* Capture of the SES library calls for replay */
+	createParam(CaptureFileString, asynParamOctet, &CaptureFile);
+
+	/* Start from the settings of the last run until the SES library has read those of the instrument.
+	 * The snapshot is empty if there was none. */
+	detectorInfo = snapshot.detectorInfo_;
+	detector = snapshot.detectorRegion_;
+	analyzer = snapshot.analyzerRegion_;
 	m_RunMode = Normal;
-	getLensModeList(&m_LensModes);						/* glitch? */
-	getElementSetLlist(&m_Elementsets);					/* glitch? */
-	getPassEnergyList(&m_PassEnergies);
-	getPassEnergy(-1,m_dCurrentPassEnergy);
-	getUseExternalIO(&m_bUseExternalIO);
+	m_bAllowIOWithDetector = false;
+	m_bAlwaysDelayRegion = false;
+	m_dCurrentPassEnergy = 0.0;
+	m_bUseExternalIO = true;
+	m_bUseDetector = false;
+	m_bResetDataBetweenIterations = false;
 
 	std::string iniLocation = std::string(getenv("SES_BASE_DIR")) + std::string("/ini/Ses.ini");
 	const char *iniLocationStr = iniLocation.c_str();
@@ -602,91 +823,23 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 	int ElementIndex = atoi(keyValue);
 	setIntegerParam(ElementSet, ElementIndex);
 
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n\n%s:%s: Use external IO = %d\n\n", driverName, functionName, m_bUseExternalIO);
-	m_bUseExternalIO = true;
-	setUseExternalIO(&m_bUseExternalIO);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n\n%s:%s: Use external IO = %d\n\n", driverName, functionName, m_bUseExternalIO);
-	getUseDetector(&m_bUseDetector);
-	getResetDataBetweenIterations(&m_bResetDataBetweenIterations);
-
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Timer Controlled = %d\n", driverName, functionName, detectorInfo.timerControlled_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: ADC Present = %d\n", driverName, functionName, detectorInfo.adcPresent_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Discriminator Present = %d\n", driverName, functionName, detectorInfo.discPresent_);
-
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s X Channels = %d\n", driverName, functionName, detectorInfo.xChannels_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Y Channels = %d\n", driverName, functionName, detectorInfo.yChannels_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Max Channels = %d\n", driverName, functionName, detectorInfo.maxChannels_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Max Slices = %d\n", driverName, functionName, detectorInfo.maxSlices_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Maximum Frame Rate = %d\n\n", driverName, functionName, detectorInfo.frameRate_);
-
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: First X Channel = %d\n", driverName, functionName, detector.firstXChannel_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Last X Channel = %d\n", driverName, functionName, detector.lastXChannel_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: First Y Channel = %d\n", driverName, functionName, detector.firstYChannel_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Last Y Channel = %d\n", driverName, functionName, detector.lastYChannel_);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Slices = %d\n\n", driverName, functionName, detector.slices_);
-
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Detector Mode = %d\n\n", driverName, functionName, detector.adcMode_);
-	detector.adcMode_ = true;
-
-	updateDetectorRegion();
-	//ses->setProperty("detector_region", 0, &detector);
-
 	/* Set some default values for parameters (the setup panel parameters) */
 	status |= setStringParam(ADManufacturer, "VG Scienta");
 
-	size = MAX_MESSAGE_SIZE;
-	getInstrumentModel(value, size);
-	status |= setStringParam(ADModel, value);
-
-	size = MAX_MESSAGE_SIZE;
-	getLibDescription(value, size);
-	status |= setStringParam(LibDescription, value);
-        
-	size = MAX_MESSAGE_SIZE;
-	getLibVersion(value, size);
-	status |= setStringParam(LibVersion, value);
-        
-	size = MAX_MESSAGE_SIZE;
-	getLibWorkingDir(value, size);
-	status |= setStringParam(LibWorkingDir, value);
-
-	size = MAX_MESSAGE_SIZE;
-	getInstrumentSerialNo(value, size);
-	status |= setStringParam(InstrumentSerialNo, value);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Instrument serial number = %s\n", driverName, functionName, value);
-
-	/* Find the maximum frame rate available */
-	status |= setIntegerParam(FrameRate, detectorInfo.frameRate_);
-
-	/* Readout panel parameters */
-	status |= setIntegerParam(ADMaxSizeX, detectorInfo.maxChannels_);
-	status |= setIntegerParam(ADMaxSizeY, detectorInfo.maxSlices_);
-	status |= setIntegerParam(ADMinX, detector.firstXChannel_);
-	status |= setIntegerParam(ADMinY, detector.firstYChannel_);
-	status |= setIntegerParam(ADSizeX, detector.lastXChannel_ - (detector.firstXChannel_ - 1));
-	status |= setIntegerParam(ADSizeY, detector.lastYChannel_ - (detector.firstYChannel_ - 1));
-
-	/* Set NDArray parameters */
-	status |= setIntegerParam(NDArraySizeX, detector.lastXChannel_ - (detector.firstXChannel_ - 1));
-	status |= setIntegerParam(NDArraySizeY, detector.lastYChannel_ - (detector.firstYChannel_ - 1));
+	status |= publishSettings();
 	status |= setIntegerParam(NDDataType, NDFloat64);
 
 	/* The Collect panel */
-	status |= setDoubleParam(ADAcquireTime, analyzer.dwellTime_/1000.0);
 	status |= setDoubleParam(ADAcquirePeriod, 0.0);
 	status |= setIntegerParam(ADNumImages, 1);
 	status |= setIntegerParam(ADNumExposures, 1); // number of frames per image
 	status |= setIntegerParam(ADImageMode, ADImageSingle);
 	status |= setIntegerParam(ADTriggerMode, ADTriggerInternal);
-	status |= setStringParam(ADStatusMessage, message);
+	status |= setStringParam(ADStatusMessage, "Initialising the SES library");
 	status |= setIntegerParam(NDAutoIncrement, 1);
 	status |= setDoubleParam(ADTemperature, m_dTemperature);
 
 	/* Electron analyser specific parameters */
-	status |= setIntegerParam(AlwaysDelayRegion, m_bAlwaysDelayRegion?1:0);
-	status |= setIntegerParam(AllowIOWithDetector, m_bAllowIOWithDetector?1:0);
-	status |= setIntegerParam(UseDetector, m_bUseDetector?1:0);
-	status |= setIntegerParam(UseExternalIO, m_bUseExternalIO?1:0);
 	status |= setIntegerParam(DetectorSlices, 10);
 
 	/* Setting initial values for the progress statuses */
@@ -707,7 +860,41 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 	/* Set the number of last exposures to 0 */
 	status |= setIntegerParam(NumExposuresLastImage, 0);
 
-	updateStatus();
+	/* Raw frames are off until requested, the size and type follow the detector */
+	status |= setIntegerParam(RawEnable, 0);
+	status |= setDoubleParam(RawRate, 0.0);
+	status |= setIntegerParam(RawErrors, 0);
+	status |= setIntegerParam(CalibrationMode, CalibrationOff);
+	status |= setIntegerParam(MomentumEnable, 0);
+	status |= setIntegerParam(MomentumThreads, 1);
+	status |= setIntegerParam(CallStatsEnable, ses->callStatistics() ? 1 : 0);
+	status |= setIntegerParam(CallStatsReset, 0);
+	status |= setStringParam(CallStatsNames, "");
+	status |= setStringParam(CaptureFile, ses->capture() ? getenv("SES_CAPTURE_FILE") : "");
+	status |= setIntegerParam(RawImageAddr, NDArrayCounter, 0);
+	status |= setIntegerParam(RawImageAddr, NDArraySize, 0);
+	status |= setIntegerParam(RawImageAddr, NDDataType, NDUInt8);
+	callParamCallbacks(RawImageAddr, RawImageAddr);
+
+	/* External IO data is published as a Float64 array of ports x steps */
+	status |= setIntegerParam(AcqIOPortIndex, 0);
+	status |= setIntegerParam(IOArrayAddr, NDArrayCounter, 0);
+	status |= setIntegerParam(IOArrayAddr, NDDataType, NDFloat64);
+	callParamCallbacks(IOArrayAddr, IOArrayAddr);
+
+	/* The spectrum and the iteration images are Float64 arrays like the image */
+	status |= setIntegerParam(SpectrumAddr, NDArrayCounter, 0);
+	status |= setIntegerParam(SpectrumAddr, NDDataType, NDFloat64);
+	callParamCallbacks(SpectrumAddr, SpectrumAddr);
+	status |= setIntegerParam(IterationImageAddr, NDArrayCounter, 0);
+	status |= setIntegerParam(IterationImageAddr, NDDataType, NDFloat64);
+	callParamCallbacks(IterationImageAddr, IterationImageAddr);
+	status |= setIntegerParam(MomentumImageAddr, NDArrayCounter, 0);
+	status |= setIntegerParam(MomentumImageAddr, NDDataType, NDFloat64);
+	callParamCallbacks(MomentumImageAddr, MomentumImageAddr);
+
+	status |= setIntegerParam(InitState, InitLoadingLibrary);
+	callParamCallbacks();
 
 	int mytemp;
 	getIntegerParam(NDArraySizeX, &mytemp);
@@ -725,6 +912,9 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 		return;
 	}
 
+	/* Load the SES library in the background, the rest of the IOC does not wait for it */
+	this->init_device(pWorkingDirEnvVar, pInstrumentFileEnvVar);
+
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Starting up polling task....\n", driverName, functionName);
 	/* Create the thread that updates the images */
 	status = (epicsThreadCreate("ElectronAnalyserTask",
@@ -736,7 +926,164 @@ ElectronAnalyser::ElectronAnalyser(const char *portName, int maxBuffers, size_t
 		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: epicsTheadCreate failure for image task\n", driverName, functionName);
 		return;
 	}
+
+	/* Create the thread that publishes the raw detector frames */
+	status = (epicsThreadCreate("ElectronAnalyserRawTask",
+			epicsThreadPriorityMedium, epicsThreadGetStackSize(
+					epicsThreadStackMedium),
+			(EPICSTHREADFUNC) rawImageTaskC, this) == NULL);
+	if (status)
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: epicsTheadCreate failure for raw image task\n", driverName, functionName);
+		return;
+	}
+}
+/** Task to publish raw detector frames while RawEnable is set.
+ *
+ *  Frames are read with GDS_GetRawImage at RawRate, limited to the detector frame rate, into NDArrays
+ *  from the driver's pool and published on RawImageAddr as UInt8 or UInt16 depending on the byte size
+ *  reported by the detector.  The port lock is not held while the frame is read or while the plugins
+ *  are called.  It is started in the class constructor and must not return until the IOC stops.
+ */
+void ElectronAnalyser::rawImageTask()
+{
+	int enable;
+	int frameRate;
+	int arrayCallbacks;
+	int imageCounter;
+	int errors;
+	int size;
+	int err;
+	double rate;
+	double delay;
+	epicsTimeStamp startTime, endTime;
+	size_t dims[2];
+	size_t pixels;
+	size_t bytes;
+	NDArray *pImage;
+	const char *functionName = "rawImageTask";
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Raw image thread started\n", driverName, functionName);
+
+	this->lock();
+	while (1)
+	{
+		getIntegerParam(RawEnable, &enable);
+		if (!enable)
+		{
+			/* Release the lock while we wait for raw frames to be enabled */
+			this->unlock();
+			epicsEventWait(this->rawEventId);
+			this->lock();
+			continue;
+		}
+		epicsTimeGetCurrent(&startTime);
+
+		/* Never poll faster than the detector produces frames */
+		getDoubleParam(RawRate, &rate);
+		getIntegerParam(FrameRate, &frameRate);
+		if (frameRate > 0 && (rate <= 0.0 || rate > frameRate))
+		{
+			rate = frameRate;
+		}
+		else if (rate <= 0.0)
+		{
+			rate = 1.0;
+		}
+
+		/* The wrapper caches the frame size, derived from the detector info as the dimensions are, so asking
+		 * for it does not call the library.  It gives the pixel type the NDArray is allocated with */
+		dims[0] = detectorInfo.xChannels_;
+		dims[1] = detectorInfo.yChannels_;
+		pixels = dims[0] * dims[1];
+		this->unlock();
+		size = 0;
+		err = ses->getAcquiredData(WSESWrapperMain::ACQ_RAW_IMAGE, 0, (void *)0, size);
+		this->lock();
+		bytes = (err == WError::ERR_OK && size > 0) ? (size_t)size : 0;
+		pImage = NULL;
+		if (pixels > 0 && (bytes == pixels || bytes == 2 * pixels))
+		{
+			pImage = this->pNDArrayPool->alloc(2, dims, (bytes == pixels) ? NDUInt8 : NDUInt16, 0, NULL);
+		}
+		else if (bytes > 0)
+		{
+			/* The detector changed under us, take the geometry the wrapper now uses */
+			getDetectorInfo(&detectorInfo);
+		}
+		if (pImage == NULL)
+		{
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Unable to allocate a %dx%d raw frame of %d bytes\n", driverName, functionName,
+					(int)dims[0], (int)dims[1], (int)bytes);
+			getIntegerParam(RawErrors, &errors);
+			setIntegerParam(RawErrors, errors + 1);
+			callParamCallbacks();
+		}
+		else
+		{
+			/* Read the frame straight into the NDArray without holding the lock */
+			this->unlock();
+			size = (int)pImage->dataSize;
+			err = ses->getAcquiredData(WSESWrapperMain::ACQ_RAW_IMAGE, 0, pImage->pData, size);
+			this->lock();
+
+			if (err != WError::ERR_OK)
+			{
+				getIntegerParam(RawErrors, &errors);
+				setIntegerParam(RawErrors, errors + 1);
+				callParamCallbacks();
+				pImage->release();
+				pImage = NULL;
+			}
+			else if ((size_t)size != bytes)
+			{
+				/* The first frame tells the wrapper the pixel depth, the next one is allocated with it */
+				asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Raw frame is %d bytes, not %d\n", driverName, functionName,
+						size, (int)bytes);
+				pImage->release();
+				pImage = NULL;
+			}
+		}
+
+		if (pImage != NULL)
+		{
+			getIntegerParam(RawImageAddr, NDArrayCounter, &imageCounter);
+			imageCounter++;
+			setIntegerParam(RawImageAddr, NDArrayCounter, imageCounter);
+			setIntegerParam(RawImageAddr, NDArraySizeX, (int)dims[0]);
+			setIntegerParam(RawImageAddr, NDArraySizeY, (int)dims[1]);
+			setIntegerParam(RawImageAddr, NDArraySize, size);
+			setIntegerParam(RawImageAddr, NDDataType, pImage->dataType);
+			callParamCallbacks(RawImageAddr, RawImageAddr);
+
+			pImage->uniqueId = imageCounter;
+			pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+			this->getAttributes(pImage->pAttributeList);
+
+			getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+			if (arrayCallbacks)
+			{
+				/* Must release the lock here, or we can get into a deadlock, because we can
+				 * block on the plugin lock, and the plugin can be calling us */
+				this->unlock();
+				doCallbacksGenericPointer(pImage, NDArrayData, RawImageAddr);
+				this->lock();
+			}
+			pImage->release();
+		}
+
+		/* Wait for the rest of the frame period, a change of RawEnable ends the wait early */
+		epicsTimeGetCurrent(&endTime);
+		delay = 1.0 / rate - epicsTimeDiffInSeconds(&endTime, &startTime);
+		if (delay > 0.0)
+		{
+			this->unlock();
+			epicsEventWaitWithTimeout(this->rawEventId, delay);
+			this->lock();
+		}
+	}
 }
+
 /** Task to grab image off the Frame Grabber and send them up to areaDetector.
  *
  *  This function runs the polling thread.
@@ -755,9 +1102,13 @@ void ElectronAnalyser::electronAnalyserTask()
 	epicsTimeStamp startTime, endTime;
 	double elapsedTime;
 	NDArray *pImage;
+	NDArray *pArray;
     double *pSpectrumLast;
 	size_t dims[2];
+	size_t arrayDims[2];
 	int intdims[2];
+	int ioPorts;
+	bool calibrated;
 	NDDataType_t dataType;
 	//float temperature;
 	const char *functionName = "electronAnalyserTask";
@@ -796,6 +1147,8 @@ void ElectronAnalyser::electronAnalyserTask()
 			setIntegerParam(ADNumImagesCounter, 0);
 			callParamCallbacks();
 
+			/* Save the settings of the last acquisition while idle, it does not delay the next one */
+			saveSnapshot();
 			/* Release the lock while we wait for an event that says acquire has started, then lock again */
 			this->unlock();
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: waiting for acquire to start\n", driverName, functionName);
@@ -845,6 +1198,8 @@ void ElectronAnalyser::electronAnalyserTask()
 			setIntegerParam(ADAcquire, acquire);
 			continue;
 		}
+		/* Remember the regions for the defaults of the next start of the IOC */
+		snapshotSettings();
 
 		int channels;
 		this->getAcqChannels(channels);
@@ -868,6 +1223,11 @@ void ElectronAnalyser::electronAnalyserTask()
 		pImage = this->pNDArrayPool->alloc(2, dims, dataType, 0, NULL);
         /* Allocate for last spectrum */
 		pSpectrumLast = (double *)calloc(dims[0], sizeof(epicsFloat64));
+		/* All arrays published for this image share its uniqueId and timestamp */
+		getIntegerParam(NDArrayCounter, &imageCounter);
+		this->arrayUniqueId = imageCounter + 1;
+		this->arrayTimeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+
 		/* We release the mutex when acquire image, because this may take a long time and
 		 * we need to allow abort operations to get through */
 		this->unlock();
@@ -916,15 +1276,15 @@ void ElectronAnalyser::electronAnalyserTask()
 		getIntegerParam(ADNumImages, &numImages);
 		getIntegerParam(ADImageMode, &imageMode);
 		getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
-		getIntegerParam(NDArrayCounter, &imageCounter);
 		getIntegerParam(ADNumImagesCounter, &numImagesCounter);
 		getIntegerParam(ADNumExposuresCounter, &numExposuresCounter);
-		imageCounter++;
+		imageCounter = this->arrayUniqueId;
 		numImagesCounter++;
 		setIntegerParam(NDArrayCounter, imageCounter);
 		setIntegerParam(ADNumImagesCounter, numImagesCounter);
 
 		// If no images, doCallbacks with zeroed data (give size of 0)
+		// The waveforms are the SES data on AcqChannelScale and AcqSliceScale, before any calibration of the NDArrays
 		if (numExposuresCounter)
 		{
             doCallbacksFloat64Array((double *) pImage->pData, dims[0] * dims[1], AcqImageLast, 0);
@@ -941,10 +1301,12 @@ void ElectronAnalyser::electronAnalyserTask()
 		//setIntegerParam(NDArraySize, nbytes);
 
 		pImage->uniqueId = imageCounter;
-		pImage->timeStamp = startTime.secPastEpoch + startTime.nsec / 1.e9;
+		pImage->timeStamp = this->arrayTimeStamp;
 
 		/* Get any attributes that have been defined for this driver */
 		this->getAttributes(pImage->pAttributeList);
+		calibrated = this->calibrate(pImage);
+		this->addAxes(pImage, calibrated);
 
 		pImage->pAttributeList->add(ADNumExposuresCounterString, "Exposure count", \
                                     NDAttrUInt32, &numExposuresCounter);
@@ -966,15 +1328,44 @@ void ElectronAnalyser::electronAnalyserTask()
 			this->lock();
 		}
 
+		/* Publish the spectrum, the external IO data and the momentum image on their own addresses */
+		if (numExposuresCounter)
+		{
+			this->publishMomentum(pImage, calibrated);
+			arrayDims[0] = dims[0];
+			pArray = this->allocArray(1, arrayDims, pSpectrumLast);
+			if (pArray != NULL)
+			{
+				calibrated = this->calibrate(pArray);
+				this->addAxes(pArray, calibrated);
+				this->publishArray(SpectrumAddr, pArray);
+			}
+			getIntegerParam(AcqIOPorts, &ioPorts);
+			if (this->ioDataSize > 0 && ioPorts > 0)
+			{
+				arrayDims[0] = this->ioDataSize / ioPorts;
+				arrayDims[1] = ioPorts;
+				pArray = this->allocArray(2, arrayDims, this->acq_data);
+				if (pArray != NULL)
+				{
+					this->publishArray(IOArrayAddr, pArray);
+				}
+			}
+		}
+
 		pImage->release();
 		free(pSpectrumLast);
 		free(spectrum);
 		free(acq_image);
 		free(acq_data);
-		free(channel_scale);
-		free(slice_scale);
 		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW,"\n\n%s:%s: Spectrum, image and ExtIO memory freed\n\n", driverName, functionName);
 
+		/* Update the SES library call statistics once per image */
+		if (ses->callStatistics())
+		{
+			this->publishCallStatistics();
+		}
+
 		/* Check to see if acquisition is complete */
 		if ((imageMode == ADImageSingle) || ((imageMode == ADImageMultiple)
 				&& (numImagesCounter >= numImages)))
@@ -1015,7 +1406,6 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 	asynStatus status = asynSuccess;
 	const char *functionName = "acquireData";
 	int ImageSize = 0;
-	int IOSize = 0;
 	int channels = 0;
 	int waitTimeout = 0;
 	int PercentCompleteVal = 0;
@@ -1033,6 +1423,10 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 	double TotalAcqTime;
 	int extIOPorts = 0;
 	int extIOSize = 0;
+	int extIOCapacity = 0;
+	int iteration;
+	size_t imageDims[2];
+	NDArray *pIterationImage;
 //	int check_var;
 	int stopIterations = 0;
 
@@ -1051,11 +1445,15 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 
 	/* The image size is always channels * slices whether in fixed or swept mode */
 	ImageSize = channels*detector.slices_;
-	IOSize = 8 * sizeof(epicsFloat64);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n%s:%s: Image Size = %d\n", driverName, functionName, ImageSize);
 	this->acq_image = (double *)calloc(ImageSize, sizeof(epicsFloat64));
-	//this->acq_data = (double *)calloc(IOSize, sizeof(epicsFloat64));
-	this->acq_data = (double *)calloc((extIOPorts * extIOSize), sizeof(epicsFloat64));
+	/* The steps of the external IO data can grow to the number of steps of a swept region,
+	 * publishIOData() grows the buffer if the library reports more */
+	extIOCapacity = extIOPorts * ((extIOSize > NumSteps) ? extIOSize : NumSteps);
+	this->acq_data = (double *)calloc((extIOCapacity > 0) ? extIOCapacity : 1, sizeof(epicsFloat64));
+	setIntegerParam(AcqIOPorts, extIOPorts);
+	setIntegerParam(AcqIOSize, extIOSize);
+	this->ioDataSize = 0;
 	this->spectrum = (double *)calloc(channels, sizeof(epicsFloat64));
 
 	/* Find out how many iterations to work with */
@@ -1089,38 +1487,13 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 		waitTimeout = analyzer.dwellTime_ + 3000;
 	}*/
 
-	/* Read out units and scale for scan that is about to run */
-	int size = MAX_STRING_SIZE;
-	char intensity_unit[MAX_STRING_SIZE];
-	ses->getAcqIntensityUnit(0, intensity_unit, size);
-	setStringParam(AcqIntensityUnit, intensity_unit);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Intensity Units = %s\n", driverName, functionName, intensity_unit);
-
-	size = MAX_STRING_SIZE;
-	char channel_unit[MAX_STRING_SIZE];
-	ses->getAcqChannelUnit(0,channel_unit, size);
-	setStringParam(AcqChannelUnit, channel_unit);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Channel Units = %s\n", driverName, functionName, channel_unit);
-
-	size = MAX_STRING_SIZE;
-	char slice_unit[MAX_STRING_SIZE];
-	ses->getAcqSliceUnit(0,slice_unit, size);
-	setStringParam(AcqSliceUnit, slice_unit);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Slice Units = %s\n", driverName, functionName, slice_unit);
-
-	size = MAX_STRING_SIZE;
-	this->channel_scale = (double *)calloc(channels, sizeof(epicsFloat64));
-	ses->getAcqChannelScale(0, this->channel_scale, size);
-	status = doCallbacksFloat64Array(this->channel_scale, channels, AcqChannelScale, 0);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Channel scale: %f, %f, %f\n", driverName, functionName,
-			  this->channel_scale[0], this->channel_scale[1], this->channel_scale[2]);
-
-	size = MAX_STRING_SIZE;
-	this->slice_scale = (double *)calloc(detector.slices_, sizeof(epicsFloat64));
-	ses->getAcqSliceScale(0, this->slice_scale, size);
-	status = doCallbacksFloat64Array(this->slice_scale, detector.slices_, AcqSliceScale, 0);
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Channel scale: %f, %f, %f\n", driverName, functionName,
-		  this->slice_scale[0], this->slice_scale[1], this->slice_scale[2]);
+	/* Read out units and scale for scan that is about to run, unless the region has not changed */
+	this->updateAxes(channels);
+	setStringParam(AcqIntensityUnit, this->axes.intensityUnit.c_str());
+	setStringParam(AcqChannelUnit, this->axes.channelUnit.c_str());
+	setStringParam(AcqSliceUnit, this->axes.sliceUnit.c_str());
+	status = doCallbacksFloat64Array(&this->axes.channelScale[0], this->axes.channelScale.size(), AcqChannelScale, 0);
+	status = doCallbacksFloat64Array(&this->axes.sliceScale[0], this->axes.sliceScale.size(), AcqSliceScale, 0);
 
 	/* Reset the StopNextIteration flag */
 	setIntegerParam(StopNextIteration, 0);
@@ -1233,19 +1606,19 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 						real_point++;
 						this->getAcqSpectrum(this->spectrum, channels);
 						this->getAcqImage(this->acq_image, ImageSize);
-						/*if ((extIOPorts > 0) && (extIOSize > 0)){
-							asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n%s:%s: Acquiring IO Data\n\n", driverName, functionName);
-							//this->getAcqIOData(this->acq_data, IOSize);
-						}*/
 
 						this->lock();
 						status = doCallbacksFloat64Array(this->spectrum, channels, AcqSpectrum, 0);
 						status = doCallbacksFloat64Array(this->acq_image, ImageSize, AcqImage, 0);
-						/*if ((extIOPorts > 0) && (extIOSize > 0)){
-							//status = doCallbacksFloat64Array(this->acq_data, IOSize, AcqIOData, 0);
-						}*/
 						callParamCallbacks();
 						this->unlock();
+
+						/* External IO data is updated at every point */
+						if (use_extio && extIOPorts > 0)
+						{
+							asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Acquiring IO Data\n", driverName, functionName);
+							this->publishIOData(extIOCapacity);
+						}
 					}
 					else
 					{
@@ -1335,11 +1708,30 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
             status = doCallbacksFloat64Array(this->acq_image, ImageSize, AcqImage, 0);
 			callParamCallbacks();
 			this->unlock();
+
+			if (use_extio && extIOPorts > 0)
+			{
+				this->publishIOData(extIOCapacity);
+			}
 		}
 
 		// Only update NDArray every iteration, so we can retain this data.
 		memcpy(pData, this->acq_image, ImageSize*sizeof(double));
 		memcpy(pSpectrumLast, this->spectrum, channels*sizeof(double));
+
+		/* Publish the image of this iteration, with the uniqueId and timestamp of the image being acquired */
+		imageDims[0] = channels;
+		imageDims[1] = detector.slices_;
+		this->lock();
+		pIterationImage = this->allocArray(2, imageDims, this->acq_image);
+		if (pIterationImage != NULL)
+		{
+			iteration = i + 1;
+			pIterationImage->pAttributeList->add("Iteration", "Iteration of the image", NDAttrInt32, &iteration);
+			this->addAxes(pIterationImage, this->calibrate(pIterationImage));
+			this->publishArray(IterationImageAddr, pIterationImage);
+		}
+		this->unlock();
 		// Set exposure count AFTER iteration completed.
 		setIntegerParam(ADNumExposuresCounter, i+1);
 
@@ -1384,15 +1776,550 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
 	//asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Intensity Units = %s\n", driverName, functionName, intensity_unit);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Slices = %d\n\n", driverName, functionName, detector.slices_);
 
-	if (epicsEventTryWait(this->stopEventId) == epicsEventWaitOK)
+	if (epicsEventTryWait(this->stopEventId) == epicsEventWaitOK)
+	{
+		/* EPICS Stop event */
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: EPICS Stop event triggered abort of waitForRegionReady\n", driverName, functionName);
+		setIntegerParam(ADStatus, ADStatusAborted);
+		ses->stopAcquisition();
+		status = asynError;
+	}
+	return status;
+}
+
+/** Read the external IO data of the current acquisition and publish it.
+ * The data of all ports is read into acq_data in one call, as consecutive rows of steps, and published as
+ * AcqIOData and as AcqIOSpectrum for the port selected by AcqIOPortIndex.  The electron analyser task
+ * publishes the last data read as an NDArray on IOArrayAddr with the image.
+ * acq_data is grown if the library has more data than \p capacity elements.
+ * This function expects the driver to be unlocked by the caller.
+ *
+ * \param[in,out] capacity The number of elements allocated for acq_data.
+ */
+asynStatus ElectronAnalyser::publishIOData(int &capacity)
+{
+	const char *functionName = "publishIOData";
+	int ports = 0;
+	int size = 0;
+	int steps;
+	int portIndex;
+	double *pData;
+
+	if (this->getAcqIOPorts(ports) != asynSuccess || ports <= 0)
+	{
+		return asynError;
+	}
+	/* Read into the current buffer, and only if the region has grown beyond it, enlarge it and read again */
+	WSpan<double> ioData(this->acq_data, this->acq_data != NULL ? capacity : 0);
+	int err = ses->getAcquiredData<WSESWrapperMain::ACQ_IO_DATA>(0, ioData);
+	if (err == WError::ERR_WRONG_SIZE && ioData.size() > capacity)
+	{
+		size = ioData.size();
+		pData = (double *)realloc(this->acq_data, size * sizeof(epicsFloat64));
+		if (pData == NULL)
+		{
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Unable to allocate %d elements for IO data\n", driverName, functionName, size);
+			return asynError;
+		}
+		this->acq_data = pData;
+		capacity = size;
+		ioData = WSpan<double>(this->acq_data, capacity);
+		err = ses->getAcquiredData<WSESWrapperMain::ACQ_IO_DATA>(0, ioData);
+	}
+	if (isError(err, functionName) || ioData.size() <= 0)
+	{
+		return asynError;
+	}
+	size = ioData.size();
+	steps = size / ports;
+
+	this->lock();
+	this->ioDataSize = size;
+	setIntegerParam(AcqIOPorts, ports);
+	setIntegerParam(AcqIOSize, steps);
+	doCallbacksFloat64Array(this->acq_data, size, AcqIOData, 0);
+	getIntegerParam(AcqIOPortIndex, &portIndex);
+	if (portIndex >= 0 && portIndex < ports)
+	{
+		doCallbacksFloat64Array(this->acq_data + portIndex * steps, steps, AcqIOSpectrum, 0);
+	}
+	callParamCallbacks();
+	this->unlock();
+	return asynSuccess;
+}
+
+/** Publish the choices of an enum parameter, after the lens mode has changed the pass energies
+ * or the instrument has replaced the snapshot they were read from.
+ */
+void ElectronAnalyser::updateEnumChoices(int function)
+{
+	char *strings[MAX_ENUM_STATES];
+	int values[MAX_ENUM_STATES];
+	int severities[MAX_ENUM_STATES];
+	size_t count = 0;
+	size_t i;
+
+	for (i = 0; i < MAX_ENUM_STATES; i++)
+	{
+		strings[i] = NULL;
+	}
+	if (getEnumChoices(function, strings, values, severities, MAX_ENUM_STATES, &count) == asynSuccess)
+	{
+		doCallbacksEnum(strings, values, severities, count, function, 0);
+	}
+	for (i = 0; i < count; i++)
+	{
+		free(strings[i]);
+	}
+}
+
+/** Publish the SES library call statistics on CallStats, CALL_STATS_FIELDS values for each function
+ * in the order of CallStatsNames: the number of calls, the total, maximum, median and 99th percentile
+ * latency in milliseconds.  Must be called with the port locked.
+ */
+void ElectronAnalyser::publishCallStatistics()
+{
+	WCallStats::Function function;
+	int count = WCallStats::count();
+	std::vector<double> values(count * CALL_STATS_FIELDS + 1, 0.0);
+	std::string names;
+	int i;
+
+	for (i = 0; i < count && WCallStats::get(i, function); i++)
+	{
+		double *row = &values[i * CALL_STATS_FIELDS];
+		row[0] = (double)function.calls;
+		row[1] = function.totalTime * 1.0e3;
+		row[2] = function.maxTime * 1.0e3;
+		row[3] = function.percentile(50.0) * 1.0e3;
+		row[4] = function.percentile(99.0) * 1.0e3;
+		if (i > 0)
+		{
+			names += " ";
+		}
+		names += function.name;
+	}
+	setStringParam(CallStatsNames, names.c_str());
+	doCallbacksFloat64Array(&values[0], i * CALL_STATS_FIELDS, CallStats, 0);
+	callParamCallbacks();
+}
+
+/** The element sets, lens modes and pass energies to serve, with the index of the current lens mode.
+ * They come from the capability cache of the wrapper once initTask has loaded the instrument, and
+ * until then from the snapshot saved by the last run, which is empty if there was none.  Neither
+ * makes library calls.  Must be called with the port locked.
+ */
+const WCapabilities &ElectronAnalyser::currentCapabilities(int &lensMode)
+{
+	if (initState == InitReady)
+	{
+		lensMode = ses->lensModeIndex();
+		return ses->capabilities();
+	}
+	lensMode = snapshot.lensMode_;
+	return snapshot.capabilities_;
+}
+
+/** Bring the snapshot loaded at construction in line with the instrument once the SES library
+ * has loaded it.  The enum choices served from the snapshot are republished if there was no
+ * snapshot or the instrument differs from it, and the snapshot is marked for saving if anything changed.
+ */
+void ElectronAnalyser::reconcileSnapshot()
+{
+	const char *functionName = "reconcileSnapshot";
+
+	if (!ses->isInstrumentLoaded())
+	{
+		return;
+	}
+	if (!snapshotLoaded || snapshot.capabilities_ != ses->capabilities() || snapshot.lensMode_ != ses->lensModeIndex())
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Instrument differs from the snapshot, updating the choices\n", driverName, functionName);
+		updateEnumChoices(ElementSet);
+		updateEnumChoices(LensMode);
+		updateEnumChoices(PassEnergy);
+	}
+	snapshotSettings();
+}
+
+/** Take the capabilities of the instrument and the current detector and analyzer regions as the
+ * snapshot for the next start of the IOC.  They are only marked for saving when they differ from
+ * the snapshot loaded or saved last, so repeated acquisitions of a region do not rewrite the file.
+ * Called with the port locked.
+ */
+void ElectronAnalyser::snapshotSettings()
+{
+	WSnapshot &current = pendingSnapshot;
+
+	if (!ses->isInstrumentLoaded() || snapshotFilePath.empty())
+	{
+		return;
+	}
+	current.instrumentFile_ = snapshotInstrumentFile;
+	if (!WSnapshot::instrumentTime(snapshotInstrumentFile.c_str(), current.instrumentTime_))
+	{
+		return;
+	}
+	current.capabilities_ = ses->capabilities();
+	current.detectorInfo_ = detectorInfo;
+	current.detectorRegion_ = detector;
+	current.analyzerRegion_ = analyzer;
+	current.lensMode_ = ses->lensModeIndex();
+	snapshotPending = !current.sameSettings(snapshot);
+}
+
+/** Write the settings taken by snapshotSettings() to the snapshot file if they changed.  Called
+ * with the port locked, the lock is released while the file is written.
+ */
+void ElectronAnalyser::saveSnapshot()
+{
+	const char *functionName = "saveSnapshot";
+	bool saved;
+
+	if (!snapshotPending)
+	{
+		return;
+	}
+	WSnapshot current = pendingSnapshot;
+	snapshotPending = false;
+	this->unlock();
+	saved = current.save(snapshotFilePath.c_str());
+	this->lock();
+	if (saved)
+	{
+		snapshot = current;
+		snapshotLoaded = true;
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Saved the instrument snapshot to %s\n", driverName, functionName, snapshotFilePath.c_str());
+	}
+	else
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Unable to save the instrument snapshot to %s\n", driverName, functionName, snapshotFilePath.c_str());
+	}
+}
+
+/** Read the units and the channel and slice scales of the region that is about to run.
+ * SES is only queried when the region or the settings that change the scales differ from
+ * those of the cached axes, repeated images of the same region reuse them.
+ * This function expects the driver to be unlocked by the caller.
+ */
+void ElectronAnalyser::updateAxes(int channels)
+{
+	const char *functionName = "updateAxes";
+	axisKey_t key;
+	int size;
+	WSESWrapperBase::Name intensityUnit, channelUnit, sliceUnit;
+
+	key.analyzer = analyzer;
+	key.detector = detector;
+	key.channels = channels;
+	getIntegerParam(EnergyMode, &key.energyMode);
+	getIntegerParam(ElementSet, &key.elementSet);
+	getIntegerParam(LensMode, &key.lensMode);
+	getIntegerParam(PassEnergy, &key.passEnergy);
+	getDoubleParam(ExcitationEnergy, &key.excitationEnergy);
+
+	if (this->axes.valid &&
+		key.analyzer.fixed_ == this->axes.key.analyzer.fixed_ &&
+		key.analyzer.highEnergy_ == this->axes.key.analyzer.highEnergy_ &&
+		key.analyzer.lowEnergy_ == this->axes.key.analyzer.lowEnergy_ &&
+		key.analyzer.centerEnergy_ == this->axes.key.analyzer.centerEnergy_ &&
+		key.analyzer.energyStep_ == this->axes.key.analyzer.energyStep_ &&
+		key.detector.firstXChannel_ == this->axes.key.detector.firstXChannel_ &&
+		key.detector.lastXChannel_ == this->axes.key.detector.lastXChannel_ &&
+		key.detector.firstYChannel_ == this->axes.key.detector.firstYChannel_ &&
+		key.detector.lastYChannel_ == this->axes.key.detector.lastYChannel_ &&
+		key.detector.slices_ == this->axes.key.detector.slices_ &&
+		key.channels == this->axes.key.channels &&
+		key.energyMode == this->axes.key.energyMode &&
+		key.elementSet == this->axes.key.elementSet &&
+		key.lensMode == this->axes.key.lensMode &&
+		key.passEnergy == this->axes.key.passEnergy &&
+		key.excitationEnergy == this->axes.key.excitationEnergy)
+	{
+		return;
+	}
+
+	ses->getAcquiredData<WSESWrapperMain::ACQ_INTENSITY_UNIT>(0, intensityUnit);
+	this->axes.intensityUnit = intensityUnit.c_str();
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Intensity Units = %s\n", driverName, functionName, intensityUnit.c_str());
+
+	ses->getAcquiredData<WSESWrapperMain::ACQ_CHANNEL_UNIT>(0, channelUnit);
+	this->axes.channelUnit = channelUnit.c_str();
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Channel Units = %s\n", driverName, functionName, channelUnit.c_str());
+
+	ses->getAcquiredData<WSESWrapperMain::ACQ_SLICE_UNIT>(0, sliceUnit);
+	this->axes.sliceUnit = sliceUnit.c_str();
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Slice Units = %s\n", driverName, functionName, sliceUnit.c_str());
+
+	this->axes.channelScale.assign((channels > 0) ? channels : 1, 0.0);
+	size = (int)this->axes.channelScale.size();
+	ses->getAcqChannelScale(0, &this->axes.channelScale[0], size);
+	this->axes.channelLinear = linearScale(this->axes.channelScale, this->axes.channelStart, this->axes.channelStep);
+
+	this->axes.sliceScale.assign((detector.slices_ > 0) ? detector.slices_ : 1, 0.0);
+	size = (int)this->axes.sliceScale.size();
+	ses->getAcqSliceScale(0, &this->axes.sliceScale[0], size);
+	this->axes.sliceLinear = linearScale(this->axes.sliceScale, this->axes.sliceStart, this->axes.sliceStep);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Channel axis start = %f, step = %f%s, Slice axis start = %f, step = %f%s\n", driverName, functionName,
+			this->axes.channelStart, this->axes.channelStep, this->axes.channelLinear ? "" : " (not linear)",
+			this->axes.sliceStart, this->axes.sliceStep, this->axes.sliceLinear ? "" : " (not linear)");
+
+	this->axes.key = key;
+	this->axes.valid = true;
+	this->axes.generation++;
+}
+
+/** Resample a Float64 image or spectrum onto the uniform energy and angle axes selected by CalibrationMode.
+ * The interpolation tables are only rebuilt when the axes of the region or the calibration mode change.
+ * \return true if the array was resampled.
+ */
+bool ElectronAnalyser::calibrate(NDArray *pArray)
+{
+	int mode;
+	int rows;
+
+	getIntegerParam(CalibrationMode, &mode);
+	if (mode == CalibrationOff || !this->axes.valid || pArray->dataType != NDFloat64)
+	{
+		return false;
+	}
+	if (!this->calibration.isValid() || this->calibration.getMode() != mode || this->calibrationGeneration != this->axes.generation)
+	{
+		this->calibration.build((calibrationMode_t)mode, this->axes.channelScale, this->axes.sliceScale, this->axes.key.excitationEnergy);
+		this->calibrationGeneration = this->axes.generation;
+	}
+
+	rows = (pArray->ndims > 1) ? (int)pArray->dims[1].size : 1;
+	if (!this->calibration.isValid() || (int)pArray->dims[0].size != this->calibration.getChannels() ||
+		(rows != 1 && rows != this->calibration.getSlices()))
+	{
+		return false;
+	}
+	this->calibration.apply((double *)pArray->pData, (double *)pArray->pData, rows);
+	return true;
+}
+
+/** Attach the cached axes of the region to an image or spectrum.
+ * The dimensions of an uncalibrated array get the detector offset and binning of the region.  The AxesGeneration attribute refers to
+ * the cached scales, which are published with their units on AcqChannelScale and AcqSliceScale at the start
+ * of every acquisition.  The start and step of an axis are only attached when the axis is linear, which the slice axis of
+ * the SES scales often is not.
+ */
+void ElectronAnalyser::addAxes(NDArray *pArray, bool calibrated)
+{
+	const SESWrapperNS::WDetectorRegion &region = this->axes.key.detector;
+	int width;
+	double channelStart = this->axes.channelStart;
+	double channelStep = this->axes.channelStep;
+	bool channelLinear = this->axes.channelLinear;
+	double sliceStart = this->axes.sliceStart;
+	double sliceStep = this->axes.sliceStep;
+	bool sliceLinear = this->axes.sliceLinear;
+	const char *energyScale = "Kinetic";
+	int calibratedFlag = calibrated ? 1 : 0;
+
+	if (!this->axes.valid)
+	{
+		return;
+	}
+
+	/* In swept mode the channels are energy steps rather than detector columns, and a calibrated array
+	 * is on the uniform axes rather than on detector pixels */
+	if (!calibrated && this->axes.key.analyzer.fixed_ && this->axes.key.channels > 0)
+	{
+		width = region.lastXChannel_ - region.firstXChannel_ + 1;
+		pArray->dims[0].offset = region.firstXChannel_;
+		pArray->dims[0].binning = (width >= this->axes.key.channels) ? width / this->axes.key.channels : 1;
+	}
+	if (!calibrated && pArray->ndims > 1 && region.slices_ > 0)
+	{
+		width = region.lastYChannel_ - region.firstYChannel_ + 1;
+		pArray->dims[1].offset = region.firstYChannel_;
+		pArray->dims[1].binning = (width >= region.slices_) ? width / region.slices_ : 1;
+	}
+
+	/* A calibrated array is on uniform axes, the cached axes are the SES scales */
+	if (calibrated)
+	{
+		channelStart = this->calibration.energyStart();
+		channelStep = this->calibration.energyStep();
+		channelLinear = true;
+		sliceStart = this->calibration.angleStart();
+		sliceStep = this->calibration.angleStep();
+		sliceLinear = true;
+		if (this->calibration.getMode() == CalibrationBinding)
+		{
+			energyScale = "Binding";
+		}
+	}
+
+	pArray->pAttributeList->add("AxesGeneration", "Generation of the scales on ACQ_CHANNEL_SCALE and ACQ_SLICE_SCALE", NDAttrInt32, &this->axes.generation);
+	pArray->pAttributeList->add("Calibrated", "Resampled onto uniform axes", NDAttrInt32, &calibratedFlag);
+	if (channelLinear)
+	{
+		pArray->pAttributeList->add("ChannelStart", "First value of the channel axis", NDAttrFloat64, &channelStart);
+		pArray->pAttributeList->add("ChannelStep", "Step of the channel axis", NDAttrFloat64, &channelStep);
+	}
+	if (sliceLinear && pArray->ndims > 1)
+	{
+		pArray->pAttributeList->add("SliceStart", "First value of the slice axis", NDAttrFloat64, &sliceStart);
+		pArray->pAttributeList->add("SliceStep", "Step of the slice axis", NDAttrFloat64, &sliceStep);
+	}
+	if (calibrated)
+	{
+		pArray->pAttributeList->add("EnergyScale", "Kinetic or binding energy channel axis", NDAttrString, (void *)energyScale);
+	}
+}
+
+/** Convert an image to energy and parallel momentum and publish it on MomentumImageAddr.
+ * The gather map is only rebuilt when the axes of the region or the calibration of the image change.
+ * This function expects the driver to be locked by the caller, the lock is released during the conversion.
+ */
+void ElectronAnalyser::publishMomentum(NDArray *pImage, bool calibrated)
+{
+	int enable;
+	int threads;
+	int mode;
+	int i;
+	size_t dims[2];
+	double kStart;
+	double kStep;
+	NDArray *pArray;
+	DoubleVector kineticEnergy;
+	DoubleVector angle;
+
+	getIntegerParam(MomentumEnable, &enable);
+	if (!enable || !this->axes.valid || pImage->dataType != NDFloat64 || pImage->ndims < 2)
+	{
+		return;
+	}
+
+	/* (Re)create the map if the number of threads has changed */
+	getIntegerParam(MomentumThreads, &threads);
+	if (threads < 1)
+	{
+		threads = 1;
+	}
+	if (this->momentum == NULL || this->momentum->numThreads() != threads)
+	{
+		delete this->momentum;
+		this->momentum = new MomentumMap(threads);
+		this->momentumGeneration = -1;
+	}
+
+	mode = calibrated ? this->calibration.getMode() : CalibrationOff;
+	if (this->momentumGeneration != this->axes.generation || this->momentumCalibration != mode)
+	{
+		/* The axes of the image, a calibrated image is on the uniform grids */
+		if (calibrated)
+		{
+			for (i = 0; i < this->calibration.getChannels(); i++)
+			{
+				kineticEnergy.push_back(this->calibration.energyStart() + i * this->calibration.energyStep());
+				if (mode == CalibrationBinding)
+				{
+					kineticEnergy[i] = this->axes.key.excitationEnergy - kineticEnergy[i];
+				}
+			}
+			for (i = 0; i < this->calibration.getSlices(); i++)
+			{
+				angle.push_back(this->calibration.angleStart() + i * this->calibration.angleStep());
+			}
+		}
+		else
+		{
+			kineticEnergy = this->axes.channelScale;
+			angle = this->axes.sliceScale;
+		}
+		this->momentum->build(kineticEnergy, angle);
+		this->momentumGeneration = this->axes.generation;
+		this->momentumCalibration = mode;
+	}
+	if (!this->momentum->isValid() || (int)pImage->dims[0].size != this->momentum->getChannels() ||
+		(int)pImage->dims[1].size != this->momentum->getSlices())
+	{
+		return;
+	}
+
+	dims[0] = pImage->dims[0].size;
+	dims[1] = pImage->dims[1].size;
+	pArray = this->allocArray(2, dims, NULL);
+	if (pArray == NULL)
+	{
+		return;
+	}
+	this->unlock();
+	this->momentum->apply((double *)pImage->pData, (double *)pArray->pData);
+	this->lock();
+
+	/* Same channel axis as the image, the slices are now parallel momentum */
+	this->addAxes(pArray, calibrated);
+	kStart = this->momentum->kStart();
+	kStep = this->momentum->kStep();
+	pArray->pAttributeList->add("SliceStart", "First value of the slice axis", NDAttrFloat64, &kStart);
+	pArray->pAttributeList->add("SliceStep", "Step of the slice axis", NDAttrFloat64, &kStep);
+	pArray->pAttributeList->add("SliceUnit", "Unit of the slice axis", NDAttrString, (void *)"1/Angstrom");
+	this->publishArray(MomentumImageAddr, pArray);
+}
+
+/** Allocate a Float64 NDArray from the pool, fill it with a copy of the data, unless pData is NULL, and the driver attributes.
+ * Returns NULL without allocating if array callbacks are disabled.
+ * This function expects the driver to be locked by the caller.
+ */
+NDArray *ElectronAnalyser::allocArray(int ndims, size_t *dims, const double *pData)
+{
+	const char *functionName = "allocArray";
+	int arrayCallbacks;
+	NDArray *pArray;
+	NDArrayInfo_t arrayInfo;
+
+	getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+	if (!arrayCallbacks)
 	{
-		/* EPICS Stop event */
-		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: EPICS Stop event triggered abort of waitForRegionReady\n", driverName, functionName);
-		setIntegerParam(ADStatus, ADStatusAborted);
-		ses->stopAcquisition();
-		status = asynError;
+		return NULL;
 	}
-	return status;
+	pArray = this->pNDArrayPool->alloc(ndims, dims, NDFloat64, 0, NULL);
+	if (pArray == NULL)
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Unable to allocate a %d dimensional array\n", driverName, functionName, ndims);
+		return NULL;
+	}
+	if (pData != NULL)
+	{
+		pArray->getInfo(&arrayInfo);
+		memcpy(pArray->pData, pData, arrayInfo.totalBytes);
+	}
+	this->getAttributes(pArray->pAttributeList);
+	return pArray;
+}
+
+/** Publish an array on one of the array addresses and release it.
+ * The array gets the uniqueId and timestamp of the image being acquired, so plugins saving
+ * several addresses can match the arrays to the image.
+ * This function expects the driver to be locked by the caller, the lock is released while the plugins are called.
+ */
+void ElectronAnalyser::publishArray(int addr, NDArray *pArray)
+{
+	int arrayCounter;
+
+	getIntegerParam(addr, NDArrayCounter, &arrayCounter);
+	arrayCounter++;
+	setIntegerParam(addr, NDArrayCounter, arrayCounter);
+	setIntegerParam(addr, NDArraySizeX, (int)pArray->dims[0].size);
+	setIntegerParam(addr, NDArraySizeY, (pArray->ndims > 1) ? (int)pArray->dims[1].size : 1);
+	setIntegerParam(addr, NDArraySize, (int)pArray->dataSize);
+	callParamCallbacks(addr, addr);
+
+	pArray->uniqueId = this->arrayUniqueId;
+	pArray->timeStamp = this->arrayTimeStamp;
+
+	/* Must release the lock here, or we can get into a deadlock, because we can
+	 * block on the plugin lock, and the plugin can be calling us */
+	this->unlock();
+	doCallbacksGenericPointer(pArray, NDArrayData, addr);
+	this->lock();
+	pArray->release();
 }
 
 /* Provided by Xiaoqiang Wang of PSI */
@@ -1407,20 +2334,29 @@ asynStatus ElectronAnalyser::acquireData(void *pData, double *pSpectrumLast, int
   * \param[out] nIn Number of elements actually returned */
 asynStatus ElectronAnalyser::readEnum(asynUser *pasynUser, char *strings[], int values[], int severities[], size_t nElements, size_t *nIn)
 {
-	int function = pasynUser->reason;
+	return getEnumChoices(pasynUser->reason, strings, values, severities, nElements, nIn);
+}
+
+/** Fill the choices of an enum parameter, as readEnum() does for asyn clients.
+ * The choices come from currentCapabilities(), no library calls are made.
+ */
+asynStatus ElectronAnalyser::getEnumChoices(int function, char *strings[], int values[], int severities[], size_t nElements, size_t *nIn)
+{
 	const char *functionName = "readEnum";
+	int lensMode;
+	const WCapabilities &capabilities = currentCapabilities(lensMode);
 	size_t i;
-	char buf[5];
+	char buf[16];
 
 	if (function == PassEnergy)
 	{
-		for (i=0; ((i<m_PassEnergies.size()) && (i<(int)nElements)); i++)
+		for (i=0; ((i<(size_t)capabilities.passEnergyCount(lensMode)) && (i<nElements)); i++)
 		{
 			if (strings[i])
 			{
 				free(strings[i]);
 			}
-			sprintf(buf, "%d", (int)m_PassEnergies.at(i));
+			epicsSnprintf(buf, sizeof(buf), "%d", (int)capabilities.passEnergy(lensMode, i));
 			strings[i] = epicsStrDup(buf);
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Reading pass energy of %s\n", driverName, functionName, strings[i]);
 			values[i] = i;
@@ -1429,13 +2365,13 @@ asynStatus ElectronAnalyser::readEnum(asynUser *pasynUser, char *strings[], int
 	}
 	else if (function == ElementSet)
 	{
-		for (i=0; ((i<m_Elementsets.size()) && (i<(int)nElements)); i++)
+		for (i=0; ((i<(size_t)capabilities.elementSetCount()) && (i<nElements)); i++)
 		{
 			if (strings[i])
 			{
 				free(strings[i]);
 			}
-			strings[i] = epicsStrDup(m_Elementsets.at(i).c_str());
+			strings[i] = epicsStrDup(capabilities.elementSet(i));
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Reading element set of %s\n", driverName, functionName, strings[i]);
 			values[i] = i;
 			severities[i] = 0;
@@ -1443,13 +2379,13 @@ asynStatus ElectronAnalyser::readEnum(asynUser *pasynUser, char *strings[], int
 	}
 	else if (function == LensMode)
 	{
-		for (i=0; ((i<m_LensModes.size()) && (i<(int)nElements)); i++)
+		for (i=0; ((i<(size_t)capabilities.lensModeCount()) && (i<nElements)); i++)
 		{
 			if (strings[i])
 			{
 				free(strings[i]);
 			}
-			strings[i] = epicsStrDup(m_LensModes.at(i).c_str());
+			strings[i] = epicsStrDup(capabilities.lensMode(i));
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Reading lens mode of %s\n", driverName, functionName, strings[i]);
 			values[i]  = i;
 			severities[i] = 0;
@@ -1489,6 +2425,11 @@ asynStatus ElectronAnalyser::writeInt32(asynUser *pasynUser, epicsInt32 value)
 	// parameters for functions
 	int adstatus;
 
+	if (initState != InitReady)
+	{
+		return queueWrite(pasynUser, asynParamInt32, value, 0.0, NULL);
+	}
+
 	getIntegerParam(function, &OldValue);
 	status = setIntegerParam(function, value);
 	getIntegerParam(ADStatus, &adstatus);
@@ -1661,10 +2602,10 @@ asynStatus ElectronAnalyser::writeInt32(asynUser *pasynUser, epicsInt32 value)
 			const char * readElement;
 			for(int eli = 0; eli < size; eli++)
 			{
-				readElement = m_Elementsets.at(eli).c_str();
+				readElement = ses->capabilities().elementSet(eli);
 				asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\nElement at %d is = %s\n", eli, readElement);
 			}
-			const char * elementSet = m_Elementsets.at(value).c_str();
+			const char * elementSet = ses->capabilities().elementSet(value);
 			// set element set to Library
 			this->setElementSet(elementSet);
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Setting element set to %s\n", driverName, functionName, elementSet);
@@ -1694,9 +2635,11 @@ asynStatus ElectronAnalyser::writeInt32(asynUser *pasynUser, epicsInt32 value)
 		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: %d lenses are available to use\n", driverName, functionName, size);
 		if (value <size)
 		{
-			const char * lensMode = m_LensModes.at(value).c_str();
+			const char * lensMode = ses->capabilities().lensMode(value);
 			this->setLensMode(lensMode);
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Setting lens mode to %s\n", driverName, functionName, lensMode);
+			/* The pass energies depend on the lens mode */
+			updateEnumChoices(PassEnergy);
 		}
 		else
 		{
@@ -1711,7 +2654,7 @@ asynStatus ElectronAnalyser::writeInt32(asynUser *pasynUser, epicsInt32 value)
 		getPassEnergyCount(size);
 		if (value < size)
 		{
-			const double passEnergy = m_PassEnergies.at(value);
+			const double passEnergy = ses->capabilities().passEnergy(ses->lensModeIndex(), value);
 			this->setPassEnergy(&passEnergy);
 			asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Setting pass energy to %f eV\n", driverName, functionName, passEnergy);
 		}
@@ -1767,6 +2710,34 @@ asynStatus ElectronAnalyser::writeInt32(asynUser *pasynUser, epicsInt32 value)
 	{
 		// no action, value used by get IO spectrum call and get port name call.
 	}
+	else if (function == RawEnable)
+	{
+		/* Wake up the raw image task, it reads RawEnable itself */
+		epicsEventSignal(this->rawEventId);
+	}
+	else if (function == CallStatsEnable)
+	{
+		/* The calls can only be timed through thunks that were put in place when the library was loaded */
+		if (value != 0 && !ses->interposed())
+		{
+			epicsSnprintf(message, sizeof(message), "Call statistics need SES_CALL_STATISTICS or SES_CAPTURE_FILE set at start up");
+			setStringParam(ADStatusMessage, message);
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, message);
+			setIntegerParam(CallStatsEnable, 0);
+			status = asynError;
+		}
+		else
+		{
+			ses->setCallStatistics(value != 0);
+			this->publishCallStatistics();
+		}
+	}
+	else if (function == CallStatsReset)
+	{
+		WCallStats::reset();
+		setIntegerParam(CallStatsReset, 0);
+		this->publishCallStatistics();
+	}
 	else if (function == ADMinX)
 	{
 		if (value < 1 || value > detectorInfo.maxChannels_)
@@ -2000,6 +2971,11 @@ asynStatus ElectronAnalyser::writeFloat64(asynUser *pasynUser,
 	char message[MAX_MESSAGE_SIZE];
 	int adstatus;
 
+	if (initState != InitReady)
+	{
+		return queueWrite(pasynUser, asynParamFloat64, 0, value, NULL);
+	}
+
 	double OldValue;
 	getDoubleParam(function, &OldValue);
 
@@ -2088,6 +3064,13 @@ asynStatus ElectronAnalyser::writeOctet(asynUser *pasynUser, const char *value,
 	char message[MAX_MESSAGE_SIZE];
 	int adstatus;
 
+	if (initState != InitReady)
+	{
+		status = queueWrite(pasynUser, asynParamOctet, 0, 0.0, string(value, nChars).c_str());
+		*nActual = status == asynSuccess ? nChars : 0;
+		return status;
+	}
+
 	/* Set the parameter in the parameter library. */
 	status = (asynStatus) setStringParam(function, (char *) value);
 	getIntegerParam(ADStatus, &adstatus);
@@ -2137,6 +3120,25 @@ asynStatus ElectronAnalyser::writeOctet(asynUser *pasynUser, const char *value,
 			status = this->setTempFileName(value);
 		}
 	}
+	else if (function == CaptureFile)
+	{
+		/* An empty name stops the capture, which can only record the calls through thunks that were put in
+		 * place when the library was loaded */
+		if (*value != 0 && !ses->interposed())
+		{
+			epicsSnprintf(message, sizeof(message), "Capture needs SES_CALL_STATISTICS or SES_CAPTURE_FILE set at start up");
+			setStringParam(ADStatusMessage, message);
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, message);
+			setStringParam(CaptureFile, "");
+		}
+		else if (!ses->setCapture(value))
+		{
+			epicsSnprintf(message, sizeof(message), "Cannot capture the SES library calls to %s\n", value);
+			setStringParam(ADStatusMessage, message);
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, message);
+			setStringParam(CaptureFile, "");
+		}
+	}
 	else
 	{
 		/* If this parameter belongs to a base class call its method */
@@ -2173,6 +3175,11 @@ void ElectronAnalyser::report(FILE *fp, int details)
 		getIntegerParam(NDDataType, &dataType);
 		fprintf(fp, "  NX, NY:            %d  %d\n", nx, ny);
 		fprintf(fp, "  Data type:         %d\n", dataType);
+		if (ses->callStatistics())
+		{
+			fprintf(fp, "  SES library calls:\n");
+			WCallStats::report(fp);
+		}
 	}
 	/* Invoke the base class method */
 	ADDriver::report(fp, details);
@@ -2235,12 +3242,13 @@ void ElectronAnalyser::delete_device()
 }
 
 /**
- * create and initialise the device and instrument software library. Must be called in constructor.
+ * create the device and start the initialisation of the instrument software library. Must be called in constructor,
+ * after the parameters have been created.  The library is loaded and initialised by initTask, which reports its
+ * progress in InitState, so that the IOC does not wait for it.
  */
 void ElectronAnalyser::init_device(const char *workingDir, const char *instrumentFile)
 {
 	const char * functionName = "init_device()";
-	char message[MAX_MESSAGE_SIZE];
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: create device\n", driverName, functionName);
 	// Initialise variables to default values
 	sesWorkingDirectory = workingDir;
@@ -2251,48 +3259,327 @@ void ElectronAnalyser::init_device(const char *workingDir, const char *instrumen
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: SES Working directory: %s\n", driverName, functionName, sesWorkingDirectory.c_str());
 	instrumentFilePath = sesWorkingDirectory.append(instrumentFile);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Instrument file path: %s\n", driverName, functionName, instrumentFilePath.c_str());
-	// Get connection to the SES wrapper
-	ses = WSESWrapperMain::instance();
-	ses->setProperty("lib_working_dir", strlen(workingDir), workingDir);
-	int err = ses->setProperty("instrument_library", strlen(pSESInstrumentEnvVar), pSESInstrumentEnvVar);
-	err |= ses->initialize(0);
+	// Configure the SES wrapper, the library itself is loaded by initTask
+	ses->setProperty(WSESWrapperBase::PROPERTY_LIB_WORKING_DIR, strlen(workingDir), workingDir);
+	ses->setProperty(WSESWrapperBase::PROPERTY_INSTRUMENT_LIBRARY, strlen(pSESInstrumentEnvVar), pSESInstrumentEnvVar);
+
+	if (epicsThreadCreate("ElectronAnalyserInitTask",
+			epicsThreadPriorityMedium, epicsThreadGetStackSize(
+					epicsThreadStackMedium),
+			(EPICSTHREADFUNC) initTaskC, this) == NULL)
+	{
+		setInitState(InitFailed);
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: epicsTheadCreate failure for initialisation task\n", driverName, functionName);
+	}
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: - out\n", driverName, functionName);
+}
+
+/** Task to load and initialise the SES library and to load the instrument file.
+ *
+ *  Each step can take several seconds, they are made without the port lock and reported in InitState.
+ *  Once the instrument is loaded the settings are read from the library, published, and the writes
+ *  received in the meantime are replayed in the order they arrived.  If a step fails the queued
+ *  writes are dropped.  It is started by init_device and returns when the initialisation is over.
+ */
+void ElectronAnalyser::initTask()
+{
+	const char *functionName = "initTask";
+	char message[MAX_MESSAGE_SIZE];
+	int err;
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Initialising the SES library....\n", driverName, functionName);
+	err = ses->loadLibrary();
+	if (!err)
+	{
+		setInitState(InitInitialising);
+		err = ses->initialize(0);
+	}
 	if (err)
 	{
-		this->setIntegerParam(ADStatus, ADStatusError);
 		epicsSnprintf(message, sizeof(message), "SES library initialisation failed: %d, %s\n", err, werror->message(err).c_str());
-		this->setStringParam(ADStatusMessage,message);
-		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, message);
 	}
 	else
 	{
-	    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Loading instrument file from path %s\n", driverName, functionName, instrumentFilePath.c_str());
+		setInitState(InitLoadingInstrument);
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Loading instrument file from path %s\n", driverName, functionName, instrumentFilePath.c_str());
 		err = ses->loadInstrument(instrumentFilePath.c_str());
 		if (err)
 		{
-			this->setIntegerParam(ADStatus, ADStatusError);
 			epicsSnprintf(message, sizeof(message), "Load Instrument file: %s failed; %s\n", instrumentFilePath.c_str(), werror->message(err).c_str());
-			this->setStringParam(ADStatusMessage, message);
-			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s. \n", driverName, functionName, message);
 		}
-		else
+	}
+
+	this->lock();
+	if (err)
+	{
+		this->setIntegerParam(ADStatus, ADStatusError);
+		this->setStringParam(ADStatusMessage, message);
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, message);
+		initState = InitFailed;
+		setIntegerParam(InitState, InitFailed);
+		dropWrites();
+	}
+	else
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: SES librabry initialisation successful\n", driverName, functionName);
+		readSettings();
+		if (publishSettings())
+		{
+			asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Unable to set detector parameters\n", driverName, functionName);
+		}
+		updateStatus();
+		initState = InitReady;
+		setIntegerParam(InitState, InitReady);
+		reconcileSnapshot();
+		replayWrites();
+	}
+	callParamCallbacks();
+	/* After the queued writes, so they are not overtaken while the file is written */
+	saveSnapshot();
+	this->unlock();
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: - out\n", driverName, functionName);
+}
+
+/** Publish a step of the initialisation of the SES library.  Takes the port lock. */
+void ElectronAnalyser::setInitState(initState_t state)
+{
+	this->lock();
+	initState = state;
+	setIntegerParam(InitState, state);
+	callParamCallbacks();
+	this->unlock();
+}
+
+/** Read the state variables and the description of the instrument from the SES library once it
+ * has loaded the instrument file.
+ */
+void ElectronAnalyser::readSettings()
+{
+	const char *functionName = "readSettings";
+	char value[MAX_MESSAGE_SIZE];
+	int size = 0;
+
+	getAllowIOWithDetector(&m_bAllowIOWithDetector);
+	getAlwaysDelayRegion(&m_bAlwaysDelayRegion);
+	getDetectorInfo(&detectorInfo);
+	getDetectorRegion(&detector);
+	getAnalyzerRegion(&analyzer);
+	getPassEnergy(-1,m_dCurrentPassEnergy);
+	getUseExternalIO(&m_bUseExternalIO);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n\n%s:%s: Use external IO = %d\n\n", driverName, functionName, m_bUseExternalIO);
+	m_bUseExternalIO = true;
+	setUseExternalIO(&m_bUseExternalIO);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "\n\n%s:%s: Use external IO = %d\n\n", driverName, functionName, m_bUseExternalIO);
+	getUseDetector(&m_bUseDetector);
+	getResetDataBetweenIterations(&m_bResetDataBetweenIterations);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Timer Controlled = %d\n", driverName, functionName, detectorInfo.timerControlled_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: ADC Present = %d\n", driverName, functionName, detectorInfo.adcPresent_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Discriminator Present = %d\n", driverName, functionName, detectorInfo.discPresent_);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s X Channels = %d\n", driverName, functionName, detectorInfo.xChannels_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Y Channels = %d\n", driverName, functionName, detectorInfo.yChannels_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Max Channels = %d\n", driverName, functionName, detectorInfo.maxChannels_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Max Slices = %d\n", driverName, functionName, detectorInfo.maxSlices_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s Maximum Frame Rate = %d\n\n", driverName, functionName, detectorInfo.frameRate_);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: First X Channel = %d\n", driverName, functionName, detector.firstXChannel_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Last X Channel = %d\n", driverName, functionName, detector.lastXChannel_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: First Y Channel = %d\n", driverName, functionName, detector.firstYChannel_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Last Y Channel = %d\n", driverName, functionName, detector.lastYChannel_);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Slices = %d\n\n", driverName, functionName, detector.slices_);
+
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Detector Mode = %d\n\n", driverName, functionName, detector.adcMode_);
+	detector.adcMode_ = true;
+
+	updateDetectorRegion();
+	//ses->setProperty("detector_region", 0, &detector);
+
+	size = MAX_MESSAGE_SIZE;
+	getInstrumentModel(value, size);
+	setStringParam(ADModel, value);
+
+	size = MAX_MESSAGE_SIZE;
+	getLibDescription(value, size);
+	setStringParam(LibDescription, value);
+        
+	size = MAX_MESSAGE_SIZE;
+	getLibVersion(value, size);
+	setStringParam(LibVersion, value);
+        
+	size = MAX_MESSAGE_SIZE;
+	getLibWorkingDir(value, size);
+	setStringParam(LibWorkingDir, value);
+
+	size = MAX_MESSAGE_SIZE;
+	getInstrumentSerialNo(value, size);
+	setStringParam(InstrumentSerialNo, value);
+	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Instrument serial number = %s\n", driverName, functionName, value);
+}
+
+/** Set the parameters that follow the detector information, the detector and analyzer regions and
+ * the state variables, from the snapshot at construction and from the SES library once it is ready.
+ * @return 0 if all parameters were set.
+ */
+int ElectronAnalyser::publishSettings()
+{
+	int status = asynSuccess;
+
+	/* Find the maximum frame rate available */
+	status |= setIntegerParam(FrameRate, detectorInfo.frameRate_);
+
+	/* Readout panel parameters */
+	status |= setIntegerParam(ADMaxSizeX, detectorInfo.maxChannels_);
+	status |= setIntegerParam(ADMaxSizeY, detectorInfo.maxSlices_);
+	status |= setIntegerParam(ADMinX, detector.firstXChannel_);
+	status |= setIntegerParam(ADMinY, detector.firstYChannel_);
+	status |= setIntegerParam(ADSizeX, detector.lastXChannel_ - (detector.firstXChannel_ - 1));
+	status |= setIntegerParam(ADSizeY, detector.lastYChannel_ - (detector.firstYChannel_ - 1));
+
+	/* Set NDArray parameters */
+	status |= setIntegerParam(NDArraySizeX, detector.lastXChannel_ - (detector.firstXChannel_ - 1));
+	status |= setIntegerParam(NDArraySizeY, detector.lastYChannel_ - (detector.firstYChannel_ - 1));
+	status |= setDoubleParam(ADAcquireTime, analyzer.dwellTime_/1000.0);
+
+	/* Electron analyser specific parameters */
+	status |= setIntegerParam(AlwaysDelayRegion, m_bAlwaysDelayRegion?1:0);
+	status |= setIntegerParam(AllowIOWithDetector, m_bAllowIOWithDetector?1:0);
+	status |= setIntegerParam(UseDetector, m_bUseDetector?1:0);
+	status |= setIntegerParam(UseExternalIO, m_bUseExternalIO?1:0);
+
+	/* The raw frames are the full detector */
+	status |= setIntegerParam(RawImageAddr, NDArraySizeX, detectorInfo.xChannels_);
+	status |= setIntegerParam(RawImageAddr, NDArraySizeY, detectorInfo.yChannels_);
+	callParamCallbacks(RawImageAddr, RawImageAddr);
+	return status;
+}
+
+/** Hold a write received before the SES library is ready.  The write completes at once, it is made
+ * by replayWrites() when initTask has loaded the instrument.  The value is set in the parameter library
+ * straight away, so that the readbacks show it rather than the settings of the snapshot.  Writes are
+ * rejected once the initialisation has failed, as the SES library will never be ready.  Must be called
+ * with the port locked.
+ */
+asynStatus ElectronAnalyser::queueWrite(asynUser *pasynUser, asynParamType type, epicsInt32 intValue, epicsFloat64 doubleValue, const char *stringValue)
+{
+	const char *functionName = "queueWrite";
+	pendingWrite_t write;
+
+	if (initState == InitFailed)
+	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "%s:%s: SES library initialisation failed, write of function %d rejected",
+				driverName, functionName, pasynUser->reason);
+		return asynError;
+	}
+	write.pasynUser = pasynManager->duplicateAsynUser(pasynUser, 0, 0);
+	if (write.pasynUser == NULL)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s:%s: Unable to queue the write of function %d\n", driverName, functionName, pasynUser->reason);
+		return asynError;
+	}
+	write.type = type;
+	write.intValue = intValue;
+	write.doubleValue = doubleValue;
+	write.stringValue = stringValue != NULL ? stringValue : "";
+	write.previousIntValue = 0;
+	write.previousDoubleValue = 0.0;
+	switch (type)
+	{
+	case asynParamInt32:
+		getIntegerParam(pasynUser->reason, &write.previousIntValue);
+		setIntegerParam(pasynUser->reason, intValue);
+		break;
+	case asynParamFloat64:
+		getDoubleParam(pasynUser->reason, &write.previousDoubleValue);
+		setDoubleParam(pasynUser->reason, doubleValue);
+		break;
+	default:
+		setStringParam(pasynUser->reason, write.stringValue.c_str());
+		break;
+	}
+	callParamCallbacks();
+	pendingWrites.push_back(write);
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s:%s: SES library not ready, queued the write of function %d\n", driverName, functionName, pasynUser->reason);
+	return asynSuccess;
+}
+
+/** Make the writes queued while the SES library was initialising, in the order they arrived.
+ * The numbers queueWrite() set are first put back, newest first, wherever the initialisation has not
+ * read the parameter since, so that a write that fails returns to the value before it.
+ * Must be called with the port locked, after initState has become InitReady.
+ */
+void ElectronAnalyser::replayWrites()
+{
+	const char *functionName = "replayWrites";
+	asynStatus status;
+	size_t nActual;
+	size_t i;
+	epicsInt32 intValue;
+	epicsFloat64 doubleValue;
+
+	for (i = pendingWrites.size(); i > 0; i--)
+	{
+		pendingWrite_t &write = pendingWrites[i - 1];
+		if (write.type == asynParamInt32 && getIntegerParam(write.pasynUser->reason, &intValue) == asynSuccess && intValue == write.intValue)
+		{
+			setIntegerParam(write.pasynUser->reason, write.previousIntValue);
+		}
+		else if (write.type == asynParamFloat64 && getDoubleParam(write.pasynUser->reason, &doubleValue) == asynSuccess && doubleValue == write.doubleValue)
+		{
+			setDoubleParam(write.pasynUser->reason, write.previousDoubleValue);
+		}
+	}
+
+	for (i = 0; i < pendingWrites.size(); i++)
+	{
+		pendingWrite_t &write = pendingWrites[i];
+		switch (write.type)
 		{
-			if (ses->isInitialized())
+		case asynParamInt32:
+			status = writeInt32(write.pasynUser, write.intValue);
+			if (status != asynSuccess)
 			{
-				this->setIntegerParam(ADStatus, ADStatusIdle);
-				this->setStringParam(ADStatusMessage,"SES library initialisation completed.");
-				asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: SES librabry initialisation successful\n", driverName, functionName);
+				asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Queued write of function %d = %d failed: %s\n", driverName, functionName,
+						write.pasynUser->reason, write.intValue, write.pasynUser->errorMessage);
 			}
-			else
+			break;
+		case asynParamFloat64:
+			status = writeFloat64(write.pasynUser, write.doubleValue);
+			if (status != asynSuccess)
 			{
-				this->setIntegerParam(ADStatus, ADStatusError);
-				this->setStringParam(ADStatusMessage,"SES initialisation failed");
-				asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: SES initialisation failed\n", driverName, functionName);
+				asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Queued write of function %d = %g failed: %s\n", driverName, functionName,
+						write.pasynUser->reason, write.doubleValue, write.pasynUser->errorMessage);
 			}
+			break;
+		default:
+			status = writeOctet(write.pasynUser, write.stringValue.c_str(), write.stringValue.length(), &nActual);
+			if (status != asynSuccess)
+			{
+				asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Queued write of function %d = \"%s\" failed: %s\n", driverName, functionName,
+						write.pasynUser->reason, write.stringValue.c_str(), write.pasynUser->errorMessage);
+			}
+			break;
 		}
+		pasynManager->freeAsynUser(write.pasynUser);
 	}
+	pendingWrites.clear();
+}
 
-	callParamCallbacks();
-	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: - out\n", driverName, functionName);
+/** Discard the writes queued while the SES library was initialising, after it has failed.
+ * Must be called with the port locked.
+ */
+void ElectronAnalyser::dropWrites()
+{
+	const char *functionName = "dropWrites";
+	size_t i;
+
+	for (i = 0; i < pendingWrites.size(); i++)
+	{
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: SES library failed, dropped the write of function %d\n", driverName, functionName, pendingWrites[i].pasynUser->reason);
+		pasynManager->freeAsynUser(pendingWrites[i].pasynUser);
+	}
+	pendingWrites.clear();
 }
 
 /**
@@ -2620,7 +3907,7 @@ asynStatus ElectronAnalyser::getLensModeList(NameVector *pLensModeList)
 
 	int i;
 	int NumLens = 0;
-	int err = ses->getProperty("lens_mode_count", 0, &NumLens);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_LENS_MODE_COUNT, 0, NumLens);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2628,17 +3915,16 @@ asynStatus ElectronAnalyser::getLensModeList(NameVector *pLensModeList)
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Available Lens:\n", driverName, functionName);
 	for(i = 0; i < NumLens; i++)
 	{
-		char lens[MAX_STRING_SIZE];
-		int size = 30;
+		WSESWrapperBase::Name lens;
 
-		err = ses->getProperty("lens_mode", i, lens, size); // ther is not @c lens_mode_from_index defined in the wrapper
+		err = ses->getProperty<WSESWrapperBase::PROPERTY_LENS_MODE>(i, lens); // ther is not @c lens_mode_from_index defined in the wrapper
 		if (isError(err, functionName))
 		{
 			return asynError;
 		}
-		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Lens #%d = %s\n", driverName, functionName, i+1, lens);
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Lens #%d = %s\n", driverName, functionName, i+1, lens.c_str());
 
-		pLensModeList->push_back(lens);
+		pLensModeList->push_back(lens.c_str());
 	}
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exit....\n", driverName, functionName);
 	return asynSuccess;
@@ -2656,7 +3942,7 @@ asynStatus ElectronAnalyser::getElementSetLlist(NameVector *pElementSetList)
 
 	int i;
 	int NumElements = 0;
-	int err = ses->getProperty("element_set_count", 0, &NumElements);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ELEMENT_SET_COUNT, 0, NumElements);
 	if (isError(err, functionName))
 	{
 		return asynError;
@@ -2665,17 +3951,16 @@ asynStatus ElectronAnalyser::getElementSetLlist(NameVector *pElementSetList)
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Available Elements:\n", driverName, functionName);
 	for(i = 0; i < NumElements; i++)
 	{
-		char set[MAX_STRING_SIZE];
-		int size = 30;
+		WSESWrapperBase::Name set;
 
-		err = ses->getProperty("element_set",i , set, size);
+		err = ses->getProperty<WSESWrapperBase::PROPERTY_ELEMENT_SET>(i, set);
 		if (isError(err, functionName))
 		{
 			return asynError;
 		}
-		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Element set #%d = %s\n", driverName, functionName, i, set);
+		asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Element set #%d = %s\n", driverName, functionName, i, set.c_str());
 
-		pElementSetList->push_back(set);
+		pElementSetList->push_back(set.c_str());
 	}
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exit....\n", driverName, functionName);
 	return asynSuccess;
@@ -2692,7 +3977,7 @@ asynStatus ElectronAnalyser::getPassEnergyList(DoubleVector *pPassEnergyList)
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
 	int max =0;
-	int err = ses->getProperty("pass_energy_count",0,&max);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_PASS_ENERGY_COUNT, 0, max);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2700,7 +3985,7 @@ asynStatus ElectronAnalyser::getPassEnergyList(DoubleVector *pPassEnergyList)
 	for(int i=0; i<max;i++)
 	{
 		double passE = 0;
-		err = ses->getProperty("pass_energy",i,&passE); // there is no @c pass_energy_from_index defined in wrapper
+		err = ses->getProperty(WSESWrapperBase::PROPERTY_PASS_ENERGY, i, passE); // there is no @c pass_energy_from_index defined in wrapper
 		if (isError(err, functionName)) {
 			return asynError;
 		}
@@ -2729,7 +4014,7 @@ asynStatus ElectronAnalyser::getLibDescription(char *value, int &size)
 	const char * functionName = "getLibDescription(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	ses->getProperty("lib_description", 0, value, size);
+	ses->getProperty(WSESWrapperBase::PROPERTY_LIB_DESCRIPTION, 0, value, size);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exit....\n", driverName, functionName);
 	return asynSuccess;
 }
@@ -2751,7 +4036,7 @@ asynStatus ElectronAnalyser::getLibVersion(char *value, int &size)
 	const char * functionName = "getLibVersion(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	ses->getProperty("lib_version", 0, value, size);
+	ses->getProperty(WSESWrapperBase::PROPERTY_LIB_VERSION, 0, value, size);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exit....\n", driverName, functionName);
 	return asynSuccess;
 }
@@ -2774,7 +4059,7 @@ asynStatus ElectronAnalyser::getLibError(int index, char *value, int &size)
 	const char * functionName = "getLibError(int index, char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	ses->getProperty("lib_error", index, value, size);
+	ses->getProperty(WSESWrapperBase::PROPERTY_LIB_ERROR, index, value, size);
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exit....\n", driverName, functionName);
 	return asynSuccess;
 }
@@ -2801,7 +4086,7 @@ asynStatus ElectronAnalyser::getLibWorkingDir(char *value, int &size)
 	/* Wondering whether the compiler used at PSI (Visual C++ Express 2008) */
 	/* is not recognising the overload? */
 	/* int err = ses->getProperty("lib_working_dir", 0, value);*/
-	int err = ses->getProperty("lib_working_dir", 0, value, size);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_LIB_WORKING_DIR, 0, value, size);
 	if (isError(err, functionName))
 	{
 		return asynError;
@@ -2822,7 +4107,7 @@ asynStatus ElectronAnalyser::setLibWorkingDir(const char *value)
 {
 	const char * functionName = "setLibWorkingDir(const char *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("lib_working_dir", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_LIB_WORKING_DIR, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -2841,7 +4126,7 @@ asynStatus ElectronAnalyser::getInstrumentStatus(int *value)
 	const char * functionName = "getInstrumentStatus(int *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("instrument_status", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_INSTRUMENT_STATUS, 0, value);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2863,7 +4148,7 @@ asynStatus ElectronAnalyser::getAlwaysDelayRegion(bool *value)
 	const char * functionName = "getAlwaysDelayRegion(bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("always_delay_region", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ALWAYS_DELAY_REGION, 0, value);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2883,7 +4168,7 @@ asynStatus ElectronAnalyser::setAlwaysDelayRegion(const bool *value)
 {
 	const char * functionName = "setAlwaysDelayRegion(const bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("always_delay_region", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_ALWAYS_DELAY_REGION, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -2906,7 +4191,7 @@ asynStatus ElectronAnalyser::getAllowIOWithDetector(bool *value)
 	const char * functionName = "getAllowIOWithDetector(bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("allow_io_with_detector", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ALLOW_IO_WITH_DETECTOR, 0, value);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2924,7 +4209,7 @@ asynStatus ElectronAnalyser::setAllowIOWithDetector(const bool *value)
 {
 	const char * functionName = "setAllowIOWithDetector(const bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("allow_io_with_detector", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_ALLOW_IO_WITH_DETECTOR, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -2948,7 +4233,7 @@ asynStatus ElectronAnalyser::getInstrumentModel(char *value, int &size)
 	const char * functionName = "getInstrumentModel(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("instrument_model", 0, value, size);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_INSTRUMENT_MODEL, 0, value, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2972,7 +4257,7 @@ asynStatus ElectronAnalyser::getInstrumentSerialNo(char *value, int &size)
 	const char * functionName = "getInstrumentSerialNo(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("instrument_serial_no", 0, value, size);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_INSTRUMENT_SERIAL_NO, 0, value, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -2991,7 +4276,7 @@ asynStatus ElectronAnalyser::getDetectorInfo(SESWrapperNS::DetectorInfo *value)
 	const char * functionName = "getDetectorInfo(SESWrapperNS::DetectorInfo *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
 
-	int err = ses->getProperty("detector_info", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_DETECTOR_INFO, 0, value);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3010,7 +4295,7 @@ asynStatus ElectronAnalyser::getDetectorRegion(SESWrapperNS::DetectorRegion *val
 {
 	const char * functionName = "getDetectorRegion(SESWrapperNS::DetectorRegion *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("detector_region", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_DETECTOR_REGION, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3031,7 +4316,7 @@ asynStatus ElectronAnalyser::setDetectorRegion(const SESWrapperNS::DetectorRegio
 {
 	const char * functionName = "setDetectorRegion(const SESWrapperNS::DetectorRegion *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("detector_region", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_DETECTOR_REGION, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3076,7 +4361,7 @@ asynStatus ElectronAnalyser::getElementSetCount(int & value)
 {
 	const char * functionName = "getElementSetCount(int & value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("element_set_count", 0, &value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ELEMENT_SET_COUNT, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3100,7 +4385,7 @@ asynStatus ElectronAnalyser::getElementSet(int index, char * elementSet, int & s
 {
 	const char * functionName = "getElementSet(int index, char * elementSet, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("element_set", index, elementSet);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ELEMENT_SET, index, elementSet);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3119,7 +4404,7 @@ asynStatus ElectronAnalyser::setElementSet(const char * elementSet)
 {
 	const char * functionName = "setElementSet(const char * elementSet)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("element_set", -1, elementSet);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_ELEMENT_SET, -1, elementSet);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3141,7 +4426,7 @@ asynStatus ElectronAnalyser::getLensModeCount(int & value)
 {
 	const char * functionName = "getLensModeCount(int & value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("lens_mode_count", 0, &value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_LENS_MODE_COUNT, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3165,7 +4450,7 @@ asynStatus ElectronAnalyser::getLensMode(int index, char * lensMode, int & size)
 {
 	const char * functionName = "getLensMode(int index, char * lensMode, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("lens_mode", index, lensMode);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_LENS_MODE, index, lensMode);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3187,7 +4472,7 @@ asynStatus ElectronAnalyser::setLensMode(const char * lensMode)
 {
 	const char * functionName = "setLensMode(const char * lensMode)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("lens_mode", -1, lensMode);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_LENS_MODE, -1, lensMode);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3210,7 +4495,7 @@ asynStatus ElectronAnalyser::getPassEnergyCount(int & value)
 {
 	const char * functionName = "getPassEnergyCount(int & value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("pass_energy_count", 0, &value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_PASS_ENERGY_COUNT, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3230,7 +4515,7 @@ asynStatus ElectronAnalyser::getPassEnergy(int index, double &passEnergy )
 {
 	const char * functionName = "getPassEnergy(int index, double &passEnergy )";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("pass_energy", index, &passEnergy);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_PASS_ENERGY, index, passEnergy);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3252,7 +4537,7 @@ asynStatus ElectronAnalyser::setPassEnergy(const double * passEnergy)
 {
 	const char * functionName = "setPassEnergy(const double * passEnergy)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("pass_energy", -1, passEnergy);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_PASS_ENERGY, -1, passEnergy);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3270,7 +4555,7 @@ asynStatus ElectronAnalyser::getAnalyzerRegion(SESWrapperNS::WAnalyzerRegion *va
 {
 	const char * functionName = "getUseExternalIO(bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("analyzer_region", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_ANALYZER_REGION, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3296,7 +4581,7 @@ asynStatus ElectronAnalyser::setAnalyzerRegion(const SESWrapperNS::WAnalyzerRegi
 {
 	const char * functionName = "setAnalyzerRegion(const SESWrapperNS::WAnalyzerRegion *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("analyzer_region", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_ANALYZER_REGION, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3317,7 +4602,7 @@ asynStatus ElectronAnalyser::getUseExternalIO(bool *value)
 {
 	const char * functionName = "getUseExternalIO(bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("use_external_io", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_USE_EXTERNAL_IO, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3339,7 +4624,7 @@ asynStatus ElectronAnalyser::setUseExternalIO(const bool *value)
 {
 	const char * functionName = "setUseExternalIO(const bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("use_external_io", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_USE_EXTERNAL_IO, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3358,7 +4643,7 @@ asynStatus ElectronAnalyser::getUseDetector(bool *value)
 {
 	const char * functionName = "getUseDetector(bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("use_detector", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_USE_DETECTOR, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3378,7 +4663,7 @@ asynStatus ElectronAnalyser::setUseDetector(const bool *value)
 {
 	const char * functionName = "setUseDetector(const bool *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("use_detector", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_USE_DETECTOR, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3398,7 +4683,7 @@ asynStatus ElectronAnalyser::getRegionName(char *value, int &size)
 {
 	const char * functionName = "getRegionName(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("region_name", 0, value, size);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_REGION_NAME, 0, value, size);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3417,7 +4702,7 @@ asynStatus ElectronAnalyser::setRegionName(const char *value)
 {
 	const char * functionName = "setRegionName(const char *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("region_name", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_REGION_NAME, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3438,7 +4723,7 @@ asynStatus ElectronAnalyser::getTempFileName(char *value, int &size)
 {
 	const char * functionName = "getTempFileName(char *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("temp_file_name", 0, value, size);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_TEMP_FILE_NAME, 0, value, size);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3456,7 +4741,7 @@ asynStatus ElectronAnalyser::setTempFileName(const char *value)
 {
 	const char * functionName = "setTempFileName(const char *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("temp_file_name", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_TEMP_FILE_NAME, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3477,7 +4762,7 @@ asynStatus ElectronAnalyser::getResetDataBetweenIterations(bool * value)
 {
 	const char * functionName = "getResetDataBetweenIterations(bool * value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("reset_data_between_iterations", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_RESET_DATA_BETWEEN_ITERATIONS, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3500,7 +4785,7 @@ asynStatus ElectronAnalyser::setResetDataBetweenIterations(const bool * value)
 {
 	const char * functionName = "setResetDataBetweenIterations(const bool * value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("reset_data_between_iterations", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_RESET_DATA_BETWEEN_ITERATIONS, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -3523,8 +4808,7 @@ asynStatus ElectronAnalyser::getAcqChannels(int & channels)
 {
 	const char * functionName = "getAcqChannels(int & channels)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int dummy = 0;
-	int err = ses->getAcquiredData("acq_channels", 0, &channels,dummy);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_CHANNELS, channels);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3543,8 +4827,7 @@ asynStatus ElectronAnalyser::getAcqSlices(int & slices)
 {
 	const char * functionName = "getAcqSlices(int & slices)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int dummy = 0;
-	int err = ses->getAcquiredData("acq_slices", 0, &slices, dummy);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_SLICES, slices);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3568,8 +4851,7 @@ asynStatus ElectronAnalyser::getAcqIterations(int & iterations)
 {
 	const char * functionName = "getAcqIterations(int & iterations)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int dummy = 0;
-	int err = ses->getAcquiredData("acq_iterations", 0, &iterations, dummy);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_ITERATIONS, iterations);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3592,7 +4874,7 @@ asynStatus ElectronAnalyser::getAcqIntensityUnit(char * intensityUnit, int & siz
 {
 	const char * functionName = "getAcqIntensityUnit(char * intensityUnit, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_intensity_unit", 0, intensityUnit, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_INTENSITY_UNIT, 0, intensityUnit, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3615,7 +4897,7 @@ asynStatus ElectronAnalyser::getAcqChannelUnit(char * channelUnit, int & size)
 {
 	const char * functionName = "getAcqChannelUnit(char * channelUnit, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_channel_unit", 0, channelUnit, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_CHANNEL_UNIT, 0, channelUnit, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3638,7 +4920,7 @@ asynStatus ElectronAnalyser::getAcqSliceUnit(char * sliceUnit, int & size)
 {
 	const char * functionName = "getAcqSliceUnit(char * sliceUnit, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_slice_unit", 0, sliceUnit, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_SLICE_UNIT, 0, sliceUnit, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3660,7 +4942,7 @@ asynStatus ElectronAnalyser::getAcqSpectrum(double * pSumData, int & size)
 {
 	const char * functionName = "getAcqSpectrum(double * pSumData, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_spectrum", 0, pSumData, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_SPECTRUM, 0, pSumData, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3682,7 +4964,7 @@ asynStatus ElectronAnalyser::getAcqImage(double * pData, int & size)
 {
 	const char * functionName = "getAcqImage(double * pData, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_image", 0, pData, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IMAGE, 0, pData, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3705,7 +4987,7 @@ asynStatus ElectronAnalyser::getAcqSlice(int index, double * pSliceData, int siz
 {
 	const char * functionName = "getAcqSlice(int index, double * pSliceData, int size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_slice", index, pSliceData, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_SLICE, index, pSliceData, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3726,7 +5008,7 @@ asynStatus ElectronAnalyser::getAcqChannelScale(double * pSpectrum, int & size)
 {
 	const char * functionName = "getAcqChannelScale(double * pSpectrum, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_channel_scale", 0, pSpectrum, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_CHANNEL_SCALE, 0, pSpectrum, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3746,7 +5028,7 @@ asynStatus ElectronAnalyser::getAcqSliceScale(double * pSpectrum, int & size)
 {
 	const char * functionName = "getAcqSliceScale(double * pSpectrum, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_slice_scale", 0, pSpectrum, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_SLICE_SCALE, 0, pSpectrum, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3771,7 +5053,7 @@ asynStatus ElectronAnalyser::getAcqRawImage(int * pImage, int &size)
 {
 	const char * functionName = "getAcqRawImage(int * pImage, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_raw_image", 0, pImage, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_RAW_IMAGE, 0, pImage, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3788,8 +5070,7 @@ asynStatus ElectronAnalyser::getAcqCurrentStep(int &currentStep)
 {
 	const char * functionName = "getAcqCurrentStep(int &currentStep)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int size = 0;
-	int err = ses->getAcquiredData("acq_current_step", 0, &currentStep, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_CURRENT_STEP, currentStep);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3799,16 +5080,18 @@ asynStatus ElectronAnalyser::getAcqCurrentStep(int &currentStep)
 /**
  * @brief get the time in milliseconds that have passed since the last call of startAcquisition().
  *
- * @param [out] elapsedTime - A pointer to a 32-bit unsigned integer that will be modified to the number of millisecondes elapsed
+ * @param [out] elapsedTime - A double that will be modified to the number of milliseconds elapsed
  *             	since the last call of startAcquisition().
- * @return always return asynSuccess
+ * @return asynError if @p acq_elapsed_time can not be read, otherwise asynSuccess
  */
 asynStatus ElectronAnalyser::getAcqElapsedTime(double &elapsedTime)
 {
 	const char * functionName = "getAcqElapsedTime(double &elapsedTime)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int size = 0;
-	ses->getAcquiredData("acq_elapsed_time", 0, &elapsedTime, size);
+	int err = ses->getAcquiredData<WSESWrapperMain::ACQ_ELAPSED_TIME>(0, elapsedTime);
+	if (isError(err, functionName)) {
+		return asynError;
+	}
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Exiting....\n", driverName, functionName);
 	return asynSuccess;
 }
@@ -3822,8 +5105,7 @@ asynStatus ElectronAnalyser::getAcqIOPorts(int &ports)
 {
 	const char * functionName = "getAcqIOPorts(int &ports)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int size = 0;
-	int err = ses->getAcquiredData("acq_io_ports", 0, &ports, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_PORTS, ports);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3842,8 +5124,7 @@ asynStatus ElectronAnalyser::getAcqIOSize(int &dataSize)
 {
 	const char * functionName = "getAcqIOSize(int &dataSize)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int size = 0;
-	int err = ses->getAcquiredData("acq_io_size", 0, &dataSize, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_SIZE, dataSize);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3862,8 +5143,7 @@ asynStatus ElectronAnalyser::getAcqIOIterations(int &iterations)
 {
 	const char * functionName = "getAcqIOIterations(int &iterations)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int size = 0;
-	int err = ses->getAcquiredData("acq_io_iterations", 0, &iterations, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_ITERATIONS, iterations);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3885,7 +5165,7 @@ asynStatus ElectronAnalyser::getAcqIOUnit(char * unit, int & size)
 {
 	const char * functionName = "getAcqIOUnit(char * unit, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_io_unit", 0, unit, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_UNIT, 0, unit, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3906,7 +5186,7 @@ asynStatus ElectronAnalyser::getAcqIOScale(double * scale, int & size)
 {
 	const char * functionName = "getAcqIOScale(double * scale, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_io_scale", 0, scale, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_SCALE, 0, scale, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3931,7 +5211,7 @@ asynStatus ElectronAnalyser::getAcqIOSpectrum(int index, double * pSpectrum, int
 {
 	const char * functionName = "getAcqIOSpectrum(int index, double * pSpectrum, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_io_spectrum", index, pSpectrum, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_SPECTRUM, index, pSpectrum, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3953,7 +5233,7 @@ asynStatus ElectronAnalyser::getAcqIOData(double * pData, int & size)
 {
 	const char * functionName = "getAcqIOData(double * pData, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_io_data", 0, pData, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_DATA, 0, pData, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -3974,7 +5254,7 @@ asynStatus ElectronAnalyser::getAcqIOPortName(int index, char * pName, int & siz
 {
 	const char * functionName = "getAcqIOPortName(int index, char * name, int & size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering....\n", driverName, functionName);
-	int err = ses->getAcquiredData("acq_io_port_name", index, pName, size);
+	int err = ses->getAcquiredData(WSESWrapperMain::ACQ_IO_PORT_NAME, index, pName, size);
 	if (isError(err, functionName)) {
 		return asynError;
 	}
@@ -4065,7 +5345,7 @@ asynStatus ElectronAnalyser::setUseBindingEnergy(int index, const void *value)
 {
 	const char * functionName = "setUseBindingEnergy(int index, const void *value)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->setProperty("use_binding_energy", 0, value);
+	int err = ses->setProperty(WSESWrapperBase::PROPERTY_USE_BINDING_ENERGY, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
@@ -4086,7 +5366,7 @@ asynStatus ElectronAnalyser::getUseBindingEnergy(int index, void *value, int &si
 {
 	const char * functionName = "getUseBindingEnergy(int index, void *value, int &size)";
 	asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Entering...\n", driverName, functionName);
-	int err = ses->getProperty("use_binding_energy", 0, value);
+	int err = ses->getProperty(WSESWrapperBase::PROPERTY_USE_BINDING_ENERGY, 0, value);
 	if(isError(err, functionName)){
 		return asynError;
 	}
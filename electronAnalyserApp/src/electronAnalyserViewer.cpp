@@ -29,6 +29,12 @@
 #include "ADDriver.h"
 #include <epicsExport.h>
 
+#include "electronCounter.h"
+#include "spectrumProjector.h"
+#include "frameRecorder.h"
+#include "latencyHistogram.h"
+#include "frameCorrector.h"
+
 #include "zmq.hpp"
 #include <QtCore/QByteArray>
 #include <QtCore/QJsonObject>
@@ -41,9 +47,100 @@
 
 #define SesVersionString "SES_VERSION"
 #define SesConnectionString "SES_CONNECTION"
+#define CountEnableString "COUNT_ENABLE"
+#define CountThresholdString "COUNT_THRESHOLD"
+#define CountMinSizeString "COUNT_MIN_SIZE"
+#define CountMaxSizeString "COUNT_MAX_SIZE"
+#define CountScaleString "COUNT_SCALE"
+#define CountThreadsString "COUNT_THREADS"
+#define CountResetString "COUNT_RESET"
+#define CountHitsString "COUNT_HITS"
+#define CountTotalString "COUNT_TOTAL"
+#define CountMeanHitsString "COUNT_MEAN_HITS"
+#define CountMeanSizeString "COUNT_MEAN_SIZE"
+#define ProjEnableString "PROJ_ENABLE"
+#define ProjFirstXChannelString "FIRST_X_CHANNEL"
+#define ProjLastXChannelString "LAST_X_CHANNEL"
+#define ProjFirstYChannelString "FIRST_Y_CHANNELS"
+#define ProjLastYChannelString "LAST_Y_CHANNELS"
+#define ProjSlicesString "DETECTOR_SLICES"
+#define ProjEnergyString "PROJ_ENERGY"
+#define ProjAngleString "PROJ_ANGLE"
+#define GeometryChangesString "GEOMETRY_CHANGES"
+#define DroppedFramesString "DROPPED_FRAMES"
+#define RecFileString "REC_FILE"
+#define RecSlotsString "REC_SLOTS"
+#define RecSlotSizeString "REC_SLOT_SIZE"
+#define RecEnableString "REC_ENABLE"
+#define RecFramesString "REC_FRAMES"
+#define RecMessageString "REC_MESSAGE"
+#define ReplayEndpointString "REPLAY_ENDPOINT"
+#define ReplayRateString "REPLAY_RATE"
+#define ReplayLoopString "REPLAY_LOOP"
+#define ReplayEnableString "REPLAY_ENABLE"
+#define ReplayFramesString "REPLAY_FRAMES"
+#define RecvModeString "RECV_MODE"
+#define RecvHwmString "RECV_HWM"
+#define RecvBufferString "RECV_BUFFER"
+#define RecvSkippedString "RECV_SKIPPED"
+#define RecvFrameRateString "RECV_FRAME_RATE"
+#define SesCodeString "SES_CODE"
+#define SesCodeGapsString "SES_CODE_GAPS"
+#define LatProcessP50String "LAT_PROCESS_P50"
+#define LatProcessP99String "LAT_PROCESS_P99"
+#define LatCallbackP50String "LAT_CALLBACK_P50"
+#define LatCallbackP99String "LAT_CALLBACK_P99"
+#define LatTotalP50String "LAT_TOTAL_P50"
+#define LatTotalP99String "LAT_TOTAL_P99"
+#define LatTotalMaxString "LAT_TOTAL_MAX"
+#define LatResetString "LAT_RESET"
+#define ConnStateString "CONN_STATE"
+#define ConnReconnectsString "CONN_RECONNECTS"
+#define ConnTimeoutString "CONN_TIMEOUT"
+#define ConnBackoffMinString "CONN_BACKOFF_MIN"
+#define ConnBackoffMaxString "CONN_BACKOFF_MAX"
+#define ConnBackoffString "CONN_BACKOFF"
+#define CorrEnableString "CORR_ENABLE"
+#define CorrFileString "CORR_FILE"
+#define CorrFramesString "CORR_FRAMES"
+#define CorrCaptureDarkString "CORR_CAPTURE_DARK"
+#define CorrCaptureFlatString "CORR_CAPTURE_FLAT"
+#define CorrCapturedString "CORR_CAPTURED"
+#define CorrDarkValidString "CORR_DARK_VALID"
+#define CorrFlatValidString "CORR_FLAT_VALID"
+#define CorrMessageString "CORR_MESSAGE"
+
+/** Receive modes for the live image socket */
+typedef enum {
+  RecvModeLive,    /**< Publish only the newest frame, older queued frames are skipped */
+  RecvModeCapture  /**< Publish every frame in order */
+} RecvMode_t;
+
+/** States of the connection to the SES publishers */
+typedef enum {
+  ConnStateDisconnected, /**< Not acquiring, no sockets are open */
+  ConnStateConnecting,   /**< Sockets are open, waiting for the first frame */
+  ConnStateConnected,    /**< Frames are arriving */
+  ConnStateBackoff       /**< Sockets are closed, waiting before the next attempt */
+} ConnState_t;
 
 static const char *driverName = "electronAnalyserViewer";
 
+/**
+ * Socket and frame geometry of one SES live image stream.  Stream 0 is the
+ * primary stream handled by the acquisition loop, the other streams are
+ * published as they arrive on the asyn address with the same index.
+ */
+struct ViewerStream
+{
+  zmq::socket_t *socket;
+  std::string cachedHeader;
+  int width;
+  int height;
+  int length;
+  int code;
+};
+
 /**
  * VG Scienta Electron Analyser Viewer driver.
  *
@@ -53,21 +150,116 @@ static const char *driverName = "electronAnalyserViewer";
 class ElectronAnalyserViewer : public ADDriver
 {
   public:
-    ElectronAnalyserViewer(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize);
+    ElectronAnalyserViewer(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxStreams);
     ~ElectronAnalyserViewer();
     void electronAnalyserViewerTask();
     asynStatus writeInt32(asynUser *pasynUser, epicsInt32 value);
+    asynStatus writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual);
     void report(FILE *fp, int details);
 
   protected:
     int SesVersion;
     #define FIRST_EEVIEWER_PARAM SesVersion
     int SesConnection;
-    #define LAST_EEVIEWER_PARAM SesConnection
+    int CountEnable;
+    int CountThreshold;
+    int CountMinSize;
+    int CountMaxSize;
+    int CountScale;
+    int CountThreads;
+    int CountReset;
+    int CountHits;
+    int CountTotal;
+    int CountMeanHits;
+    int CountMeanSize;
+    int ProjEnable;
+    int ProjFirstXChannel;
+    int ProjLastXChannel;
+    int ProjFirstYChannel;
+    int ProjLastYChannel;
+    int ProjSlices;
+    int ProjEnergy;
+    int ProjAngle;
+    int GeometryChanges;
+    int DroppedFrames;
+    int RecFile;
+    int RecSlots;
+    int RecSlotSize;
+    int RecEnable;
+    int RecFrames;
+    int RecMessage;
+    int ReplayEndpoint;
+    int ReplayRate;
+    int ReplayLoop;
+    int ReplayEnable;
+    int ReplayFrames;
+    int RecvMode;
+    int RecvHwm;
+    int RecvBuffer;
+    int RecvSkipped;
+    int RecvFrameRate;
+    int SesCode;
+    int SesCodeGaps;
+    int LatProcessP50;
+    int LatProcessP99;
+    int LatCallbackP50;
+    int LatCallbackP99;
+    int LatTotalP50;
+    int LatTotalP99;
+    int LatTotalMax;
+    int LatReset;
+    int ConnState;
+    int ConnReconnects;
+    int ConnTimeout;
+    int ConnBackoffMin;
+    int ConnBackoffMax;
+    int ConnBackoff;
+    int CorrEnable;
+    int CorrFile;
+    int CorrFrames;
+    int CorrCaptureDark;
+    int CorrCaptureFlat;
+    int CorrCaptured;
+    int CorrDarkValid;
+    int CorrFlatValid;
+    int CorrMessage;
+    #define LAST_EEVIEWER_PARAM CorrMessage
 
   private:
+    NDArray *countElectrons(NDArray *pImage);
+    void projectSpectrum(NDArray *pImage);
+    bool checkHeader(int addr, zmq::message_t &msgHeader);
+    bool openStreams();
+    void closeStreams();
+    void waitBackoff();
+    zmq::socket_t *connectStream(int addr, int recvHwm, int recvBuffer);
+    int receiveFrame(zmq::socket_t *socket, zmq::message_t &msgHeader, zmq::message_t &msgData);
+    void receiveStream(int addr);
+    void updateRecorderStatus();
+    void updateCorrectorStatus();
+    void updateLatency(const epicsTimeStamp *pReceive, const epicsTimeStamp *pPublish, const epicsTimeStamp *pReturn);
+
     epicsEventId startEventId;
     epicsEventId stopEventId;
+    ElectronCounter *counter;
+    bool countResetPending;
+    SpectrumProjector projector;
+    std::vector<ViewerStream> streams;
+    zmq::context_t *context;
+    std::vector<zmq::pollitem_t> pollItems;
+    std::vector<int> pollAddr;
+    double backoff;
+    FrameRecorder recorder;
+    FrameReplayer replayer;
+    FrameCorrector corrector;
+    LatencyHistogram processLatency;
+    LatencyHistogram callbackLatency;
+    LatencyHistogram totalLatency;
+    epicsTimeStamp lastReceiveTime;
+    double frameRate;
+    int frameCode;
+    int lastFrameCode;
+    bool latencyResetPending;
     //WFrameLoader *framePtr;
     NDArray *pRaw;
 };
@@ -76,9 +268,13 @@ class ElectronAnalyserViewer : public ADDriver
 /**
  * A bit of C glue to make the config function available in the startup script (ioc shell)
  */
-extern "C" int electronAnalyserViewerConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize)
+extern "C" int electronAnalyserViewerConfig(const char *portName, int maxBuffers, size_t maxMemory, int priority, int stackSize, int maxStreams)
 {
-  new ElectronAnalyserViewer(portName, maxBuffers, maxMemory, priority, stackSize);
+  // Older startup scripts do not pass the number of streams
+  if (maxStreams < 1){
+    maxStreams = 1;
+  }
+  new ElectronAnalyserViewer(portName, maxBuffers, maxMemory, priority, stackSize, maxStreams);
   return asynSuccess;
 }
 
@@ -102,27 +298,42 @@ static void electronAnalyserViewerTaskC(void *drvPvt)
  */
 ElectronAnalyserViewer::~ElectronAnalyserViewer()
 {
+  this->closeStreams();
+  delete context;
+  delete counter;
 }
 
 /**
  * ElectronAnalyserViewer constructor
+ *
+ * Each stream is a separate SES connection published on the asyn address
+ * of the same index, all streams share one receive thread and NDArray pool.
  */
 ElectronAnalyserViewer::ElectronAnalyserViewer(const char *portName,
                                                int maxBuffers,
                                                size_t maxMemory,
                                                int priority,
-                                               int stackSize) :
+                                               int stackSize,
+                                               int maxStreams) :
                         ADDriver(portName,
-                                 1,
+                                 maxStreams,
                                  NUM_EEVIEWER_PARAMS,
                                  maxBuffers,
                                  maxMemory,
                                  asynEnumMask | asynFloat64ArrayMask,
                                  asynEnumMask | asynFloat64ArrayMask, // No interfaces beyond those set in ADDriver.cpp
-                                 ASYN_CANBLOCK,                       // CANBLOCK means separate thread for this driver
+                                 ASYN_CANBLOCK | (maxStreams > 1 ? ASYN_MULTIDEVICE : 0), // CANBLOCK means separate thread for this driver
                                  1,
                                  priority,                            // Thread priority (0 = default)
-                                 stackSize)                           // Stack size (0 = default)
+                                 stackSize),                          // Stack size (0 = default)
+                        counter(0),
+                        countResetPending(false),
+                        context(0),
+                        backoff(0.0),
+                        frameRate(0.0),
+                        frameCode(-1),
+                        lastFrameCode(-1),
+                        latencyResetPending(false)
 {
   int status = asynSuccess;
   const char *functionName = "ElectronAnalyserViewer";
@@ -149,6 +360,68 @@ ElectronAnalyserViewer::ElectronAnalyserViewer(const char *portName,
     // Create version string
     status |= createParam(SesVersionString, asynParamOctet, &SesVersion);
     status |= createParam(SesConnectionString, asynParamOctet, &SesConnection);
+    status |= createParam(CountEnableString, asynParamInt32, &CountEnable);
+    status |= createParam(CountThresholdString, asynParamFloat64, &CountThreshold);
+    status |= createParam(CountMinSizeString, asynParamInt32, &CountMinSize);
+    status |= createParam(CountMaxSizeString, asynParamInt32, &CountMaxSize);
+    status |= createParam(CountScaleString, asynParamInt32, &CountScale);
+    status |= createParam(CountThreadsString, asynParamInt32, &CountThreads);
+    status |= createParam(CountResetString, asynParamInt32, &CountReset);
+    status |= createParam(CountHitsString, asynParamInt32, &CountHits);
+    status |= createParam(CountTotalString, asynParamFloat64, &CountTotal);
+    status |= createParam(CountMeanHitsString, asynParamFloat64, &CountMeanHits);
+    status |= createParam(CountMeanSizeString, asynParamFloat64, &CountMeanSize);
+    status |= createParam(ProjEnableString, asynParamInt32, &ProjEnable);
+    status |= createParam(ProjFirstXChannelString, asynParamInt32, &ProjFirstXChannel);
+    status |= createParam(ProjLastXChannelString, asynParamInt32, &ProjLastXChannel);
+    status |= createParam(ProjFirstYChannelString, asynParamInt32, &ProjFirstYChannel);
+    status |= createParam(ProjLastYChannelString, asynParamInt32, &ProjLastYChannel);
+    status |= createParam(ProjSlicesString, asynParamInt32, &ProjSlices);
+    status |= createParam(ProjEnergyString, asynParamFloat64Array, &ProjEnergy);
+    status |= createParam(ProjAngleString, asynParamFloat64Array, &ProjAngle);
+    status |= createParam(GeometryChangesString, asynParamInt32, &GeometryChanges);
+    status |= createParam(DroppedFramesString, asynParamInt32, &DroppedFrames);
+    status |= createParam(RecFileString, asynParamOctet, &RecFile);
+    status |= createParam(RecSlotsString, asynParamInt32, &RecSlots);
+    status |= createParam(RecSlotSizeString, asynParamInt32, &RecSlotSize);
+    status |= createParam(RecEnableString, asynParamInt32, &RecEnable);
+    status |= createParam(RecFramesString, asynParamFloat64, &RecFrames);
+    status |= createParam(RecMessageString, asynParamOctet, &RecMessage);
+    status |= createParam(ReplayEndpointString, asynParamOctet, &ReplayEndpoint);
+    status |= createParam(ReplayRateString, asynParamFloat64, &ReplayRate);
+    status |= createParam(ReplayLoopString, asynParamInt32, &ReplayLoop);
+    status |= createParam(ReplayEnableString, asynParamInt32, &ReplayEnable);
+    status |= createParam(ReplayFramesString, asynParamFloat64, &ReplayFrames);
+    status |= createParam(RecvModeString, asynParamInt32, &RecvMode);
+    status |= createParam(RecvHwmString, asynParamInt32, &RecvHwm);
+    status |= createParam(RecvBufferString, asynParamInt32, &RecvBuffer);
+    status |= createParam(RecvSkippedString, asynParamFloat64, &RecvSkipped);
+    status |= createParam(RecvFrameRateString, asynParamFloat64, &RecvFrameRate);
+    status |= createParam(SesCodeString, asynParamInt32, &SesCode);
+    status |= createParam(SesCodeGapsString, asynParamFloat64, &SesCodeGaps);
+    status |= createParam(LatProcessP50String, asynParamFloat64, &LatProcessP50);
+    status |= createParam(LatProcessP99String, asynParamFloat64, &LatProcessP99);
+    status |= createParam(LatCallbackP50String, asynParamFloat64, &LatCallbackP50);
+    status |= createParam(LatCallbackP99String, asynParamFloat64, &LatCallbackP99);
+    status |= createParam(LatTotalP50String, asynParamFloat64, &LatTotalP50);
+    status |= createParam(LatTotalP99String, asynParamFloat64, &LatTotalP99);
+    status |= createParam(LatTotalMaxString, asynParamFloat64, &LatTotalMax);
+    status |= createParam(LatResetString, asynParamInt32, &LatReset);
+    status |= createParam(ConnStateString, asynParamInt32, &ConnState);
+    status |= createParam(ConnReconnectsString, asynParamInt32, &ConnReconnects);
+    status |= createParam(ConnTimeoutString, asynParamFloat64, &ConnTimeout);
+    status |= createParam(ConnBackoffMinString, asynParamFloat64, &ConnBackoffMin);
+    status |= createParam(ConnBackoffMaxString, asynParamFloat64, &ConnBackoffMax);
+    status |= createParam(ConnBackoffString, asynParamFloat64, &ConnBackoff);
+    status |= createParam(CorrEnableString, asynParamInt32, &CorrEnable);
+    status |= createParam(CorrFileString, asynParamOctet, &CorrFile);
+    status |= createParam(CorrFramesString, asynParamInt32, &CorrFrames);
+    status |= createParam(CorrCaptureDarkString, asynParamInt32, &CorrCaptureDark);
+    status |= createParam(CorrCaptureFlatString, asynParamInt32, &CorrCaptureFlat);
+    status |= createParam(CorrCapturedString, asynParamInt32, &CorrCaptured);
+    status |= createParam(CorrDarkValidString, asynParamInt32, &CorrDarkValid);
+    status |= createParam(CorrFlatValidString, asynParamInt32, &CorrFlatValid);
+    status |= createParam(CorrMessageString, asynParamOctet, &CorrMessage);
 
     // Setup values for the collect panel
     status |= setDoubleParam(ADAcquireTime, 0.0);
@@ -161,6 +434,100 @@ ElectronAnalyserViewer::ElectronAnalyserViewer(const char *portName,
     status |= setStringParam(ADModel, "Live Viewer");
     //status |= setStringParam(ADStatusMessage, message);
     status |= setIntegerParam(NDAutoIncrement, 1);
+
+    // Electron counting is off by default
+    status |= setIntegerParam(CountEnable, 0);
+    status |= setDoubleParam(CountThreshold, 0.0);
+    status |= setIntegerParam(CountMinSize, 1);
+    status |= setIntegerParam(CountMaxSize, 0);
+    status |= setIntegerParam(CountScale, 1);
+    status |= setIntegerParam(CountThreads, 4);
+    status |= setIntegerParam(CountHits, 0);
+    status |= setDoubleParam(CountTotal, 0.0);
+    status |= setDoubleParam(CountMeanHits, 0.0);
+    status |= setDoubleParam(CountMeanSize, 0.0);
+
+    // The projection region defaults to the full frame in a single slice
+    status |= setIntegerParam(ProjEnable, 0);
+    status |= setIntegerParam(ProjFirstXChannel, 1);
+    status |= setIntegerParam(ProjLastXChannel, 0);
+    status |= setIntegerParam(ProjFirstYChannel, 1);
+    status |= setIntegerParam(ProjLastYChannel, 0);
+    status |= setIntegerParam(ProjSlices, 1);
+
+    status |= setIntegerParam(GeometryChanges, 0);
+    status |= setIntegerParam(DroppedFrames, 0);
+
+    // Recorder and replay defaults, 1000 frames of up to 4 MB
+    status |= setStringParam(RecFile, "/tmp/electronAnalyserViewer.rec");
+    status |= setIntegerParam(RecSlots, 1000);
+    status |= setIntegerParam(RecSlotSize, 4194304);
+    status |= setIntegerParam(RecEnable, 0);
+    status |= setDoubleParam(RecFrames, 0.0);
+    status |= setStringParam(RecMessage, "");
+    status |= setStringParam(ReplayEndpoint, "tcp://127.0.0.1:5556");
+    status |= setDoubleParam(ReplayRate, 1.0);
+    status |= setIntegerParam(ReplayLoop, 0);
+    status |= setIntegerParam(ReplayEnable, 0);
+    status |= setDoubleParam(ReplayFrames, 0.0);
+
+    // Live mode with a short queue, the buffer size 0 keeps the operating system default
+    status |= setIntegerParam(RecvMode, RecvModeLive);
+    status |= setIntegerParam(RecvHwm, 4);
+    status |= setIntegerParam(RecvBuffer, 0);
+    status |= setDoubleParam(RecvSkipped, 0.0);
+
+    status |= setDoubleParam(RecvFrameRate, 0.0);
+    status |= setIntegerParam(SesCode, -1);
+    status |= setDoubleParam(SesCodeGaps, 0.0);
+    memset(&lastReceiveTime, 0, sizeof(lastReceiveTime));
+
+    // Reconnect after 5 s without frames, retrying after 0.5 s and doubling up to 30 s
+    status |= setIntegerParam(ConnState, ConnStateDisconnected);
+    status |= setIntegerParam(ConnReconnects, 0);
+    status |= setDoubleParam(ConnTimeout, 5.0);
+    status |= setDoubleParam(ConnBackoffMin, 0.5);
+    status |= setDoubleParam(ConnBackoffMax, 30.0);
+    status |= setDoubleParam(ConnBackoff, 0.0);
+
+    // Correction is off until maps are captured or loaded
+    status |= setIntegerParam(CorrEnable, 0);
+    status |= setStringParam(CorrFile, "");
+    status |= setIntegerParam(CorrFrames, 10);
+    status |= setIntegerParam(CorrCaptureDark, 0);
+    status |= setIntegerParam(CorrCaptureFlat, 0);
+    status |= setIntegerParam(CorrCaptured, 0);
+    status |= setIntegerParam(CorrDarkValid, 0);
+    status |= setIntegerParam(CorrFlatValid, 0);
+    status |= setStringParam(CorrMessage, "");
+
+    // Parameters used by the additional streams on their own addresses
+    ViewerStream stream;
+    stream.socket = 0;
+    stream.width = 0;
+    stream.height = 0;
+    stream.length = 0;
+    stream.code = -1;
+    streams.assign(maxStreams, stream);
+    for (int addr = 1; addr < maxStreams; addr++){
+      status |= setStringParam(addr, SesConnection, "");
+      status |= setIntegerParam(addr, NDDataType, NDUInt8);
+      status |= setIntegerParam(addr, NDArrayCounter, 0);
+      status |= setIntegerParam(addr, ADMaxSizeX, 0);
+      status |= setIntegerParam(addr, ADMaxSizeY, 0);
+      status |= setIntegerParam(addr, ADMinX, 0);
+      status |= setIntegerParam(addr, ADMinY, 0);
+      status |= setIntegerParam(addr, ADSizeX, 0);
+      status |= setIntegerParam(addr, ADSizeY, 0);
+      status |= setIntegerParam(addr, NDArraySizeX, 0);
+      status |= setIntegerParam(addr, NDArraySizeY, 0);
+      status |= setIntegerParam(addr, NDArraySize, 0);
+      status |= setIntegerParam(addr, GeometryChanges, 0);
+      status |= setIntegerParam(addr, DroppedFrames, 0);
+      status |= setDoubleParam(addr, RecvSkipped, 0.0);
+      status |= setIntegerParam(addr, SesCode, -1);
+      callParamCallbacks(addr, addr);
+    }
   }
 
   if (status == asynSuccess){
@@ -201,16 +568,31 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
   double elapsedTime;
   epicsTimeStamp startTime;
   epicsTimeStamp endTime;
+  epicsTimeStamp receiveTime;
+  epicsTimeStamp publishTime;
+  epicsTimeStamp returnTime;
+  double receiveSeconds;
+  double processSeconds;
   NDArray *pImage;
   size_t dims[2];
   NDDataType_t dataType;
-  char connectionString[128];
-  zmq::context_t *ctx;
-  zmq::socket_t *frameSocket = 0;
-  zmq::pollitem_t *items = 0;
+  epicsTimeStamp lastFrameTime;
+  double connTimeout;
+  bool stopped;
+  bool connectionLost;
+  int connState;
   zmq::message_t msgHeader;
   zmq::message_t msgData;
-  int length = 0, height = 0, width = 0;
+  int droppedFrames;
+  int recvMode = RecvModeLive;
+  int skipped = 0;
+  int malformed = 0;
+  int received = 0;
+  double totalSkipped;
+  int countEnable;
+  int projEnable;
+  int corrEnable;
+  bool captured;
 
   asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Polling thread started\n", driverName, functionName);
 
@@ -220,11 +602,9 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
     // If we are not acquiring or encountered a problem then wait for a semaphore that is given when acquisition is started
     if (!acquire){
       // Check in case we were acquiring and have stopped, if so we need to clear up
-      if (frameSocket != 0){
-        frameSocket->setsockopt(ZMQ_UNSUBSCRIBE, "", 0);
-        delete(frameSocket);
-        frameSocket = 0;
-      }
+      this->closeStreams();
+      setIntegerParam(ConnState, ConnStateDisconnected);
+      setDoubleParam(ConnBackoff, 0.0);
       // Only set the status message if we didn't encounter a problem last time, so we don't overwrite the error mesage
       if(!status){
         asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Waiting for the acquire command\n", driverName, functionName);
@@ -243,81 +623,33 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       this->lock();
       getIntegerParam(ADAcquire, &acquire);
       if (acquire){
-        setStringParam(ADStatusMessage, "Waiting for header information");
+        setStringParam(ADStatusMessage, "Connecting to SES");
         setIntegerParam(ADStatus, ADStatusInitializing);
         callParamCallbacks();
-        // The acquisition has started, create the new zmq context
-        ctx = new zmq::context_t;
-        frameSocket = new zmq::socket_t(*ctx, ZMQ_SUB);
-        // Readout the connection string
-        getStringParam(SesConnection, sizeof(connectionString), connectionString);
-        //std::string address = "tcp://172.23.12.96:55555";
-        try
-        {
-          frameSocket->connect(connectionString);
-          frameSocket->setsockopt(ZMQ_SUBSCRIBE, "", 0);
-          items = (zmq::pollitem_t *)malloc(sizeof(zmq::pollitem_t));
-          items[0].socket = *frameSocket;
-          items[0].fd = 0;
-          items[0].events = ZMQ_POLLIN;
-          items[0].revents = 0;
-          this->unlock();
-          int p = zmq::poll(items, 1, 1000);
-          this->lock();
-          if (p > 0){
-            if (items[0].revents == ZMQ_POLLIN){
-              //printf("Received test frame for header information\n");
-              if (frameSocket->recv(&msgHeader, ZMQ_RCVMORE) && frameSocket->recv(&msgData)){
-                QByteArray header = QByteArray::fromRawData((const char *)msgHeader.data(), msgHeader.size());
-                QJsonObject jHeader = QJsonDocument::fromBinaryData(header).object();
-                width = jHeader["width"].toInt();
-                height = jHeader["height"].toInt();
-                length = jHeader["length"].toInt();
-//                code = jHeader["code"].toInt();
-
-                dims[0] = width;
-                dims[1] = height;
-                nbytes = length;
-
-                setIntegerParam(ADMaxSizeX, width);
-                setIntegerParam(ADMaxSizeY, height);
-                setIntegerParam(ADMinX, 0);
-                setIntegerParam(ADMinY, 0);
-                setIntegerParam(ADSizeX, width);
-                setIntegerParam(ADSizeY, height);
-                setIntegerParam(NDArraySizeX, width);
-                setIntegerParam(NDArraySizeY, height);
-                setIntegerParam(NDArraySize, (height*width));
-                callParamCallbacks();
-              } else {
-                acquire = 0;
-                status = 1;
-                setIntegerParam(ADAcquire, 0);
-                setIntegerParam(ADStatus, ADStatusError);
-                setStringParam(ADStatusMessage, "Error retrieving header information");
-              }
-            } else {
-              acquire = 0;
-              status = 1;
-              setIntegerParam(ADAcquire, 0);
-              setIntegerParam(ADStatus, ADStatusError);
-              setStringParam(ADStatusMessage, "Error retrieving header information");
-            }
-          } else {
-            acquire = 0;
-            status = 1;
-            setIntegerParam(ADAcquire, 0);
-            setIntegerParam(ADStatus, ADStatusError);
-            setStringParam(ADStatusMessage, "Error retrieving header information");
-          }
-        }  catch (zmq::error_t &e)
-        {
-          acquire = 0;
-          status = 1;
-          setIntegerParam(ADAcquire, 0);
-          setIntegerParam(ADStatus, ADStatusError);
-          setStringParam(ADStatusMessage, "Error retrieving header information");
+        // (Re)create the electron counter if the number of threads has changed
+        int countThreads;
+        getIntegerParam(CountThreads, &countThreads);
+        if (countThreads < 1){
+          countThreads = 1;
         }
+        if (counter == 0 || counter->numThreads() != countThreads){
+          delete counter;
+          counter = new ElectronCounter(countThreads);
+        }
+        // Forget the previous geometry so that the first header is always applied
+        for (size_t addr = 0; addr < streams.size(); addr++){
+          streams[addr].cachedHeader.clear();
+          streams[addr].width = 0;
+        }
+        lastFrameCode = -1;
+        getIntegerParam(RecvMode, &recvMode);
+        setIntegerParam(GeometryChanges, 0);
+        setIntegerParam(DroppedFrames, 0);
+        setDoubleParam(RecvSkipped, 0.0);
+        setIntegerParam(ConnReconnects, 0);
+        getDoubleParam(ConnBackoffMin, &backoff);
+        // Discard a stop request left over from the previous acquisition
+        epicsEventTryWait(this->stopEventId);
       }
     }
     callParamCallbacks();
@@ -326,6 +658,18 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       // We are acquiring.
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: We are acquiring\n", driverName, functionName);
 
+      // (Re)connect the streams, the first frame received completes the connection
+      if (pollItems.empty()){
+        if (!this->openStreams()){
+          this->waitBackoff();
+          continue;
+        }
+        setIntegerParam(ConnState, ConnStateConnecting);
+        callParamCallbacks();
+        epicsTimeGetCurrent(&lastFrameTime);
+      }
+      getDoubleParam(ConnTimeout, &connTimeout);
+
       epicsTimeGetCurrent(&startTime);
 
       // Get the exposure parameters
@@ -335,15 +679,15 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       // Get the acquisition parameters
       getIntegerParam(ADNumImages, &numImages);
 
-      setIntegerParam(ADStatus, ADStatusAcquire);
-      setStringParam(ADStatusMessage, "Acquiring images");
-
-      // Get data type
-      getIntegerParam(NDDataType, (int *) &dataType);
-      //asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: dims[0] = %d, dims[1] = %d, datatype = %d\n", driverName, functionName, dims[0], dims[1], dataType);
-
-      // Allocate memory suitable for 2D data
-      pImage = this->pNDArrayPool->alloc(2, dims, dataType, 0, NULL);
+      getIntegerParam(ConnState, &connState);
+      if (connState == ConnStateConnected){
+        setIntegerParam(ADStatus, ADStatusAcquire);
+        setStringParam(ADStatusMessage, "Acquiring images");
+      } else {
+        setIntegerParam(ADStatus, ADStatusWaiting);
+        setStringParam(ADStatusMessage, "Waiting for frames from SES");
+      }
+      callParamCallbacks();
 
       // We release the mutex when acquire image, because this may take a long time and
       // we need to allow abort operations to get through
@@ -351,62 +695,161 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: Collecting data from electron analyser....\n", driverName, functionName);
       //status = this->acquireData(pImage->pData, steps);
 
+      stopped = false;
+      connectionLost = false;
       try
       {
-        int p = 0;
-        while (p == 0){
-          p = zmq::poll(items, 1, waitMsec);
-        }
-        if (p > 0){
-          if (items[0].revents == ZMQ_POLLIN){
-            frameSocket->recv(&msgHeader, ZMQ_RCVMORE);
-            frameSocket->recv(&msgData);
+        zmq::socket_t *frameSocket = streams[0].socket;
+        int numItems = (int)pollItems.size();
+        bool primaryReady = false;
+        // One poll covers every stream, the additional streams are published as
+        // their frames arrive whether or not the primary stream has a frame too
+        while (!primaryReady){
+          if (zmq::poll(&pollItems[0], numItems, waitMsec) > 0){
+            for (int item = 0; item < numItems; item++){
+              if (!(pollItems[item].revents & ZMQ_POLLIN)){
+                continue;
+              }
+              if (pollAddr[item] == 0){
+                primaryReady = true;
+              } else {
+                this->receiveStream(pollAddr[item]);
+                epicsTimeGetCurrent(&lastFrameTime);
+              }
+            }
+          }
+          // Leave the wait for a stop request, or reconnect when SES has gone quiet
+          if (!primaryReady){
+            if (epicsEventTryWait(this->stopEventId) == epicsEventWaitOK){
+              stopped = true;
+              break;
+            }
+            epicsTimeGetCurrent(&receiveTime);
+            if (connTimeout > 0.0 && epicsTimeDiffInSeconds(&receiveTime, &lastFrameTime) > connTimeout){
+              connectionLost = true;
+              break;
+            }
           }
         }
-        while (p > 0){
-          //printf("Processing...\n");
-          p = zmq::poll(items, 1, 0);
-          if (p > 0){
-            if (items[0].revents == ZMQ_POLLIN){
-              frameSocket->recv(&msgHeader, ZMQ_RCVMORE);
-              frameSocket->recv(&msgData);
+        if (primaryReady){
+          // In live mode drain the queue so that only the newest frame is published,
+          // in capture mode leave the queued frames for the following iterations.
+          // Every frame received is recorded, including those skipped here.
+          // Messages that are not a header and a frame are dropped.
+          skipped = 0;
+          malformed = 0;
+          for (;;){
+            received = this->receiveFrame(frameSocket, msgHeader, msgData);
+            epicsTimeGetCurrent(&receiveTime);
+            if (received < 0){
+              malformed++;
+            } else if (received > 0 && recorder.isOpen()){
+              // Record the frame exactly as it was received
+              recorder.append(msgHeader.data(), msgHeader.size(), msgData.data(), msgData.size(), &receiveTime);
+            }
+            if ((received > 0 && recvMode != RecvModeLive) || zmq::poll(&pollItems[0], 1, 0) <= 0){
+              break;
+            }
+            if (received > 0){
+              skipped++;
             }
           }
+          lastFrameTime = receiveTime;
         }
-        memcpy(pImage->pData, msgData.data(), length);
       }  catch (zmq::error_t &e)
       {
-        acquire = 0;
-        status = 1;
-        setIntegerParam(ADAcquire, 0);
-        setIntegerParam(ADStatus, ADStatusError);
-        setStringParam(ADStatusMessage, "Error during acquisition, aborted");
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: receive error: %s\n", driverName, functionName, e.what());
+        connectionLost = true;
+      }
+
+      this->lock();
+      // A stop request is handled at the top of the loop
+      if (stopped){
+        continue;
+      }
+      if (connectionLost){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, "%s:%s: no frames from SES, reconnecting\n", driverName, functionName);
+        this->waitBackoff();
+        continue;
+      }
+      if (connState != ConnStateConnected){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: receiving frames from SES\n", driverName, functionName);
+        setIntegerParam(ConnState, ConnStateConnected);
+        setIntegerParam(ADStatus, ADStatusAcquire);
+        setStringParam(ADStatusMessage, "Acquiring images");
+        setDoubleParam(ConnBackoff, 0.0);
+        getDoubleParam(ConnBackoffMin, &backoff);
+      }
+      if (skipped > 0){
+        getDoubleParam(RecvSkipped, &totalSkipped);
+        setDoubleParam(RecvSkipped, totalSkipped + skipped);
+      }
+      if (malformed > 0){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, "%s:%s: dropping %d messages that are not a header and a frame\n",
+                  driverName, functionName, malformed);
+        getIntegerParam(DroppedFrames, &droppedFrames);
+        setIntegerParam(DroppedFrames, droppedFrames + malformed);
+      }
+      if (received <= 0){
+        callParamCallbacks();
+        continue;
+      }
+
+      // Check the frame geometry against the cached header, a change of the camera
+      // geometry is applied here without restarting the acquisition
+      if (!this->checkHeader(0, msgHeader) || msgData.size() < (size_t)streams[0].length){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, "%s:%s: dropping frame of %d bytes, header is invalid or expects %d bytes\n",
+                  driverName, functionName, (int)msgData.size(), streams[0].length);
+        getIntegerParam(DroppedFrames, &droppedFrames);
+        setIntegerParam(DroppedFrames, droppedFrames + 1);
+        callParamCallbacks();
+        continue;
+      }
+      dims[0] = streams[0].width;
+      dims[1] = streams[0].height;
+      nbytes = streams[0].length;
+
+      // Get data type
+      getIntegerParam(NDDataType, (int *) &dataType);
+
+      // Allocate memory suitable for 2D data, the correction stage publishes Float32 frames
+      getIntegerParam(CorrEnable, &corrEnable);
+      pImage = this->pNDArrayPool->alloc(2, dims, corrEnable ? NDFloat32 : dataType, 0, NULL);
+      if (pImage == NULL){
+        asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: unable to allocate a %dx%d frame\n", driverName, functionName, (int)dims[0], (int)dims[1]);
+        getIntegerParam(DroppedFrames, &droppedFrames);
+        setIntegerParam(DroppedFrames, droppedFrames + 1);
+        callParamCallbacks();
+        continue;
+      }
+      if (nbytes > (int)pImage->dataSize){
+        nbytes = (int)pImage->dataSize;
       }
 
+      // Copy or correct the frame without holding the lock, captures use the raw frame
+      this->unlock();
+      captured = corrector.accumulate(msgData.data(), msgData.size(), dataType, (int)dims[0], (int)dims[1]);
+      if (corrEnable){
+        corrector.correct(msgData.data(), msgData.size(), dataType, (int)dims[0], (int)dims[1], (epicsFloat32 *)pImage->pData);
+      } else {
+        memcpy(pImage->pData, msgData.data(), nbytes);
+      }
       this->lock();
-      // If there was an error jump to bottom of the loop
-      if (status){
-        // Find out why there was a problem acquiring data
-        int ErrorStatus;
-        getIntegerParam(ADStatus, &ErrorStatus);
-        // User aborted acquisition
-        if(ErrorStatus == ADStatusAborted){
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Acquisition was aborted by the user\n",driverName, functionName);
-          setStringParam(ADStatusMessage, "Acquisition was aborted by the user");
-          acquire = 0;
-          setIntegerParam(ADAcquire, acquire);
+      if (captured){
+        char fileName[MAX_FILENAME_LEN];
+        getStringParam(CorrFile, sizeof(fileName), fileName);
+        if (fileName[0] == 0){
+          setStringParam(CorrMessage, "Captured, no file to save to");
+        } else if (corrector.save(fileName)){
+          setStringParam(CorrMessage, "Captured and saved");
         } else {
-          // The acquisition timed out
-          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: Acquisition timed out\n",driverName, functionName);
-          setStringParam(ADStatusMessage,"Acquisition timed out");
-          setIntegerParam(ADStatus, ADStatusError);
-          // Reset both acquire and ADAcquire back to zero
-          acquire = 0;
-          setIntegerParam(ADAcquire, acquire);
-          pImage->release();
-          continue;
+          asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, corrector.error());
+          setStringParam(CorrMessage, corrector.error());
         }
+        setIntegerParam(CorrCaptureDark, 0);
+        setIntegerParam(CorrCaptureFlat, 0);
       }
+      this->updateCorrectorStatus();
 
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: dims[0] = %d\n", driverName, functionName, (int)dims[0]);
       asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: dims[1] = %d\n", driverName, functionName, (int)dims[1]);
@@ -415,6 +858,20 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       pImage->dims[0].size = dims[0];
       pImage->dims[1].size = dims[1];
 
+      // Publish the energy and angle profiles of the raw frame
+      getIntegerParam(ProjEnable, &projEnable);
+      if (projEnable){
+        this->projectSpectrum(pImage);
+      }
+
+      // In counting mode the accumulated count image is published instead of the frame
+      getIntegerParam(CountEnable, &countEnable);
+      if (countEnable){
+        pImage = this->countElectrons(pImage);
+      }
+
+      this->updateRecorderStatus();
+
       // Set a bit of areadetector image/frame statistics...
       getIntegerParam(ADNumImages, &numImages);
       getIntegerParam(ADImageMode, &imageMode);
@@ -432,6 +889,15 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
       // Get any attributes that have been defined for this driver
       this->getAttributes(pImage->pAttributeList);
 
+      // Attach the receive time and the time spent in this driver, so that plugins
+      // can measure how long the frame has spent in the plugin chain
+      epicsTimeGetCurrent(&publishTime);
+      receiveSeconds = receiveTime.secPastEpoch + receiveTime.nsec / 1.e9;
+      processSeconds = epicsTimeDiffInSeconds(&publishTime, &receiveTime);
+      pImage->pAttributeList->add("SesCode", "Frame code from the SES header (-1 if absent)", NDAttrInt32, &frameCode);
+      pImage->pAttributeList->add("ReceiveTime", "Time the frame was received (s past EPICS epoch)", NDAttrFloat64, &receiveSeconds);
+      pImage->pAttributeList->add("ProcessLatency", "Receive to publish latency (s)", NDAttrFloat64, &processSeconds);
+
       if (arrayCallbacks){
         // Must release the lock here, or we can get into a deadlock, because we can
         // block on the plugin lock, and the plugin can be calling us
@@ -440,6 +906,8 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
         doCallbacksGenericPointer(pImage, NDArrayData, 0);
         this->lock();
       }
+      epicsTimeGetCurrent(&returnTime);
+      this->updateLatency(&receiveTime, &publishTime, &returnTime);
 
       // Free the image buffers
       pImage->release();
@@ -473,6 +941,516 @@ void ElectronAnalyserViewer::electronAnalyserViewerTask()
   }
 }
 
+/**
+ * Run the electron counter over a received frame and return a new NDArray
+ * containing the accumulated count image.  The lock is released while the
+ * frame is processed.  The frame passed in is released.
+ * \param[in] pImage The frame received from SES.
+ * \return The count image, or the frame itself if the count image could not be allocated.
+ */
+NDArray *ElectronAnalyserViewer::countElectrons(NDArray *pImage)
+{
+  const char *functionName = "countElectrons";
+  double threshold;
+  int minSize;
+  int maxSize;
+  int scale;
+  int hits;
+  size_t dims[2];
+  NDArray *pCounts;
+
+  getDoubleParam(CountThreshold, &threshold);
+  getIntegerParam(CountMinSize, &minSize);
+  getIntegerParam(CountMaxSize, &maxSize);
+  getIntegerParam(CountScale, &scale);
+  counter->configure(threshold, minSize, maxSize, scale);
+  if (countResetPending){
+    counter->reset();
+    countResetPending = false;
+  }
+
+  this->unlock();
+  hits = counter->process(pImage->pData, pImage->dataType, (int)pImage->dims[0].size, (int)pImage->dims[1].size);
+  this->lock();
+
+  setIntegerParam(CountHits, hits);
+  setDoubleParam(CountTotal, counter->totalHits());
+  setDoubleParam(CountMeanHits, counter->meanHitsPerFrame());
+  setDoubleParam(CountMeanSize, counter->meanBlobSize());
+
+  dims[0] = counter->countWidth();
+  dims[1] = counter->countHeight();
+  pCounts = this->pNDArrayPool->alloc(2, dims, NDUInt32, 0, NULL);
+  if (pCounts == NULL){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: unable to allocate count image\n", driverName, functionName);
+    return pImage;
+  }
+  memcpy(pCounts->pData, counter->counts(), dims[0] * dims[1] * sizeof(epicsUInt32));
+  pImage->release();
+  return pCounts;
+}
+
+/**
+ * Compare a received frame header with the cached header of a stream and
+ * apply any change of the frame geometry to the driver parameters of the
+ * stream's address.  The header is only decoded when its contents differ
+ * from the cached copy.  Must be called with the lock held.
+ * \param[in] addr The stream (and asyn address) the header was received on.
+ * \param[in] msgHeader The header message received with the frame.
+ * \return \c true if the header describes a valid frame.
+ */
+bool ElectronAnalyserViewer::checkHeader(int addr, zmq::message_t &msgHeader)
+{
+  const char *functionName = "checkHeader";
+  const char *pHeader = (const char *)msgHeader.data();
+  ViewerStream &stream = streams[addr];
+  int changes;
+
+  if (stream.cachedHeader.size() == msgHeader.size() && memcmp(stream.cachedHeader.data(), pHeader, msgHeader.size()) == 0){
+    return stream.width > 0 && stream.height > 0 && stream.length > 0;
+  }
+  stream.cachedHeader.assign(pHeader, msgHeader.size());
+
+  QByteArray header = QByteArray::fromRawData(pHeader, (int)msgHeader.size());
+  QJsonObject jHeader = QJsonDocument::fromBinaryData(header).object();
+  int width = jHeader["width"].toInt();
+  int height = jHeader["height"].toInt();
+  int length = jHeader["length"].toInt();
+  stream.code = jHeader["code"].toInt(-1);
+  if (addr == 0){
+    frameCode = stream.code;
+  }
+  if (width <= 0 || height <= 0 || length <= 0){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: invalid frame header on stream %d width=%d height=%d length=%d\n",
+              driverName, functionName, addr, width, height, length);
+    stream.width = 0;
+    stream.height = 0;
+    stream.length = 0;
+    return false;
+  }
+  if (width == stream.width && height == stream.height && length == stream.length){
+    return true;
+  }
+
+  if (stream.width != 0){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_FLOW, "%s:%s: frame geometry of stream %d changed from %dx%d to %dx%d\n",
+              driverName, functionName, addr, stream.width, stream.height, width, height);
+    getIntegerParam(addr, GeometryChanges, &changes);
+    setIntegerParam(addr, GeometryChanges, changes + 1);
+  }
+  stream.width = width;
+  stream.height = height;
+  stream.length = length;
+
+  // Follow the pixel depth of the stream for the common camera formats
+  if (length == width * height){
+    setIntegerParam(addr, NDDataType, NDUInt8);
+  } else if (length == 2 * width * height){
+    setIntegerParam(addr, NDDataType, NDUInt16);
+  }
+
+  setIntegerParam(addr, ADMaxSizeX, width);
+  setIntegerParam(addr, ADMaxSizeY, height);
+  setIntegerParam(addr, ADMinX, 0);
+  setIntegerParam(addr, ADMinY, 0);
+  setIntegerParam(addr, ADSizeX, width);
+  setIntegerParam(addr, ADSizeY, height);
+  setIntegerParam(addr, NDArraySizeX, width);
+  setIntegerParam(addr, NDArraySizeY, height);
+  setIntegerParam(addr, NDArraySize, (height*width));
+  callParamCallbacks(addr, addr);
+  return true;
+}
+
+/**
+ * Open the sockets of all streams that have a connection string and build
+ * the poll set.  Each stream opens on its own, a stream that cannot be
+ * connected is left out of the poll set.  When the primary stream is open
+ * it is always the first poll item.  Must be called with the lock held.
+ * \return \c false if no stream could be connected.
+ */
+bool ElectronAnalyserViewer::openStreams()
+{
+  int recvHwm;
+  int recvBuffer;
+  zmq::pollitem_t item;
+
+  // One context serves every connection made by this driver
+  if (context == 0){
+    context = new zmq::context_t;
+  }
+  getIntegerParam(RecvHwm, &recvHwm);
+  getIntegerParam(RecvBuffer, &recvBuffer);
+  // A multipart header and frame pair counts as two messages
+  recvHwm *= 2;
+
+  pollItems.clear();
+  pollAddr.clear();
+  for (size_t addr = 0; addr < streams.size(); addr++){
+    streams[addr].socket = this->connectStream((int)addr, recvHwm, recvBuffer);
+    if (streams[addr].socket != 0){
+      item.socket = *streams[addr].socket;
+      item.fd = 0;
+      item.events = ZMQ_POLLIN;
+      item.revents = 0;
+      pollItems.push_back(item);
+      pollAddr.push_back((int)addr);
+    }
+  }
+  return !pollItems.empty();
+}
+
+/**
+ * Close the sockets of all streams and clear the poll set.
+ */
+void ElectronAnalyserViewer::closeStreams()
+{
+  for (size_t addr = 0; addr < streams.size(); addr++){
+    delete streams[addr].socket;
+    streams[addr].socket = 0;
+  }
+  pollItems.clear();
+  pollAddr.clear();
+}
+
+/**
+ * Close the streams and wait before the next connection attempt.  The wait
+ * doubles on every attempt up to CONN_BACKOFF_MAX and is ended early by a
+ * stop request.  Called with the lock held, the lock is released during the
+ * wait so that parameter writes are not blocked.
+ */
+void ElectronAnalyserViewer::waitBackoff()
+{
+  int reconnects;
+  double backoffMax;
+  char message[64];
+
+  this->closeStreams();
+  getIntegerParam(ConnReconnects, &reconnects);
+  setIntegerParam(ConnReconnects, reconnects + 1);
+  setIntegerParam(ConnState, ConnStateBackoff);
+  setDoubleParam(ConnBackoff, backoff);
+  epicsSnprintf(message, sizeof(message), "SES not responding, retry in %.1f s", backoff);
+  setStringParam(ADStatusMessage, message);
+  setIntegerParam(ADStatus, ADStatusWaiting);
+  callParamCallbacks();
+
+  this->unlock();
+  epicsEventWaitWithTimeout(this->stopEventId, backoff);
+  this->lock();
+
+  getDoubleParam(ConnBackoffMax, &backoffMax);
+  backoff *= 2.0;
+  if (backoff > backoffMax){
+    backoff = backoffMax;
+  }
+}
+
+/**
+ * Create and connect the socket of a stream.  Must be called with the lock held.
+ * \param[in] addr The stream (and asyn address) to connect.
+ * \param[in] recvHwm Receive high water mark in messages, 0 for the default.
+ * \param[in] recvBuffer Receive buffer size in bytes, 0 for the default.
+ * \return The connected socket, or 0 if the stream has no connection string or could not connect.
+ */
+zmq::socket_t *ElectronAnalyserViewer::connectStream(int addr, int recvHwm, int recvBuffer)
+{
+  const char *functionName = "connectStream";
+  char connectionString[128];
+  zmq::socket_t *socket = 0;
+  int linger = 0;
+
+  getStringParam(addr, SesConnection, sizeof(connectionString), connectionString);
+  if (connectionString[0] == 0){
+    return 0;
+  }
+  try
+  {
+    socket = new zmq::socket_t(*context, ZMQ_SUB);
+    // Closing a socket must never wait for the network
+    socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    if (recvHwm > 0){
+      socket->setsockopt(ZMQ_RCVHWM, &recvHwm, sizeof(recvHwm));
+    }
+    if (recvBuffer > 0){
+      socket->setsockopt(ZMQ_RCVBUF, &recvBuffer, sizeof(recvBuffer));
+    }
+    socket->connect(connectionString);
+    socket->setsockopt(ZMQ_SUBSCRIBE, "", 0);
+  } catch (zmq::error_t &e)
+  {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: unable to connect stream %d to %s: %s\n",
+              driverName, functionName, addr, connectionString, e.what());
+    delete socket;
+    socket = 0;
+  }
+  return socket;
+}
+
+/**
+ * Receive one message from a stream without waiting.  A frame is a header
+ * part followed by a data part; anything else is read to its end and dropped,
+ * so a malformed message never blocks the receive thread.
+ * \param[in] socket The stream's socket.
+ * \param[out] msgHeader The header of the frame.
+ * \param[out] msgData The data of the frame.
+ * \return 1 if a frame was received, 0 if no message was queued, -1 if a message was dropped.
+ */
+int ElectronAnalyserViewer::receiveFrame(zmq::socket_t *socket, zmq::message_t &msgHeader, zmq::message_t &msgData)
+{
+  bool complete;
+
+  if (!socket->recv(&msgHeader, ZMQ_DONTWAIT)){
+    return 0;
+  }
+  if (!msgHeader.more()){
+    return -1;
+  }
+  // The parts of a message are delivered together, so the data is already queued
+  if (!socket->recv(&msgData, ZMQ_DONTWAIT)){
+    return -1;
+  }
+  complete = !msgData.more();
+  while (msgData.more()){
+    socket->recv(&msgData, ZMQ_DONTWAIT);
+  }
+  return complete ? 1 : -1;
+}
+
+/**
+ * Receive the newest frame of an additional stream and publish it as an
+ * NDArray on the stream's asyn address.  Older queued frames are counted in
+ * RECV_SKIPPED and malformed messages in DROPPED_FRAMES of that address.
+ * Called without the lock held.
+ * \param[in] addr The stream (and asyn address) with a frame waiting.
+ */
+void ElectronAnalyserViewer::receiveStream(int addr)
+{
+  const char *functionName = "receiveStream";
+  zmq::socket_t *socket = streams[addr].socket;
+  zmq::message_t msgHeader;
+  zmq::message_t msgData;
+  zmq::pollitem_t item;
+  epicsTimeStamp receiveTime;
+  size_t dims[2];
+  int dataType;
+  int arrayCallbacks;
+  int imageCounter;
+  int droppedFrames;
+  int received = 0;
+  int skipped = 0;
+  int malformed = 0;
+  double totalSkipped;
+  size_t nbytes;
+  NDArray *pArray;
+
+  // Always publish the newest queued frame of an additional stream
+  item.socket = *socket;
+  item.fd = 0;
+  item.events = ZMQ_POLLIN;
+  item.revents = 0;
+  try
+  {
+    for (;;){
+      received = this->receiveFrame(socket, msgHeader, msgData);
+      if (received < 0){
+        malformed++;
+      }
+      if (zmq::poll(&item, 1, 0) <= 0){
+        break;
+      }
+      if (received > 0){
+        skipped++;
+      }
+    }
+  } catch (zmq::error_t &e)
+  {
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: receive error on stream %d: %s\n", driverName, functionName, addr, e.what());
+    received = 0;
+  }
+  epicsTimeGetCurrent(&receiveTime);
+
+  this->lock();
+  if (skipped > 0){
+    getDoubleParam(addr, RecvSkipped, &totalSkipped);
+    setDoubleParam(addr, RecvSkipped, totalSkipped + skipped);
+  }
+  if (malformed > 0){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, "%s:%s: dropping %d messages on stream %d that are not a header and a frame\n",
+              driverName, functionName, malformed, addr);
+    getIntegerParam(addr, DroppedFrames, &droppedFrames);
+    setIntegerParam(addr, DroppedFrames, droppedFrames + malformed);
+  }
+  if (received <= 0){
+    callParamCallbacks(addr, addr);
+    this->unlock();
+    return;
+  }
+  if (!this->checkHeader(addr, msgHeader) || msgData.size() < (size_t)streams[addr].length){
+    getIntegerParam(addr, DroppedFrames, &droppedFrames);
+    setIntegerParam(addr, DroppedFrames, droppedFrames + 1);
+    callParamCallbacks(addr, addr);
+    this->unlock();
+    return;
+  }
+  dims[0] = streams[addr].width;
+  dims[1] = streams[addr].height;
+  getIntegerParam(addr, NDDataType, &dataType);
+  pArray = this->pNDArrayPool->alloc(2, dims, (NDDataType_t)dataType, 0, NULL);
+  if (pArray == NULL){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_ERROR, "%s:%s: unable to allocate a %dx%d frame for stream %d\n",
+              driverName, functionName, (int)dims[0], (int)dims[1], addr);
+    getIntegerParam(addr, DroppedFrames, &droppedFrames);
+    setIntegerParam(addr, DroppedFrames, droppedFrames + 1);
+    callParamCallbacks(addr, addr);
+    this->unlock();
+    return;
+  }
+  nbytes = streams[addr].length;
+  if (nbytes > pArray->dataSize){
+    nbytes = pArray->dataSize;
+  }
+  this->unlock();
+  memcpy(pArray->pData, msgData.data(), nbytes);
+  this->lock();
+
+  getIntegerParam(addr, NDArrayCounter, &imageCounter);
+  imageCounter++;
+  setIntegerParam(addr, NDArrayCounter, imageCounter);
+  setIntegerParam(addr, SesCode, streams[addr].code);
+  pArray->uniqueId = imageCounter;
+  pArray->timeStamp = receiveTime.secPastEpoch + receiveTime.nsec / 1.e9;
+  this->getAttributes(pArray->pAttributeList);
+  pArray->pAttributeList->add("SesCode", "Frame code from the SES header (-1 if absent)", NDAttrInt32, &streams[addr].code);
+  callParamCallbacks(addr, addr);
+
+  // The primary stream's NDArrayCallbacks setting applies to every stream
+  getIntegerParam(NDArrayCallbacks, &arrayCallbacks);
+  if (arrayCallbacks){
+    this->unlock();
+    doCallbacksGenericPointer(pArray, NDArrayData, addr);
+    this->lock();
+  }
+  pArray->release();
+  this->unlock();
+}
+
+/**
+ * Add the timing of one frame to the latency histograms and update the frame
+ * rate estimate and the SES frame code statistics.  Must be called with the lock held.
+ * \param[in] pReceive Time the frame was received.
+ * \param[in] pPublish Time the NDArray callbacks were started.
+ * \param[in] pReturn Time the NDArray callbacks returned.
+ */
+void ElectronAnalyserViewer::updateLatency(const epicsTimeStamp *pReceive, const epicsTimeStamp *pPublish, const epicsTimeStamp *pReturn)
+{
+  double gaps;
+
+  if (latencyResetPending){
+    processLatency.reset();
+    callbackLatency.reset();
+    totalLatency.reset();
+    setDoubleParam(SesCodeGaps, 0.0);
+    latencyResetPending = false;
+  }
+  processLatency.record(epicsTimeDiffInSeconds(pPublish, pReceive));
+  callbackLatency.record(epicsTimeDiffInSeconds(pReturn, pPublish));
+  totalLatency.record(epicsTimeDiffInSeconds(pReturn, pReceive));
+
+  // Exponentially weighted frame rate, restarted after a pause of more than 10 seconds
+  if (lastReceiveTime.secPastEpoch != 0){
+    double interval = epicsTimeDiffInSeconds(pReceive, &lastReceiveTime);
+    if (interval > 0.0 && interval < 10.0){
+      frameRate = (frameRate > 0.0) ? 0.9 * frameRate + 0.1 / interval : 1.0 / interval;
+    } else {
+      frameRate = 0.0;
+    }
+  }
+  lastReceiveTime = *pReceive;
+
+  // Count frames missing from the SES code sequence (skipped here or never received)
+  if (frameCode >= 0){
+    if (lastFrameCode >= 0 && frameCode > lastFrameCode + 1){
+      getDoubleParam(SesCodeGaps, &gaps);
+      setDoubleParam(SesCodeGaps, gaps + (frameCode - lastFrameCode - 1));
+    }
+    lastFrameCode = frameCode;
+  }
+
+  setDoubleParam(RecvFrameRate, frameRate);
+  setIntegerParam(SesCode, frameCode);
+  setDoubleParam(LatProcessP50, processLatency.percentile(50.0) * 1.0e3);
+  setDoubleParam(LatProcessP99, processLatency.percentile(99.0) * 1.0e3);
+  setDoubleParam(LatCallbackP50, callbackLatency.percentile(50.0) * 1.0e3);
+  setDoubleParam(LatCallbackP99, callbackLatency.percentile(99.0) * 1.0e3);
+  setDoubleParam(LatTotalP50, totalLatency.percentile(50.0) * 1.0e3);
+  setDoubleParam(LatTotalP99, totalLatency.percentile(99.0) * 1.0e3);
+  setDoubleParam(LatTotalMax, totalLatency.max() * 1.0e3);
+}
+
+/**
+ * Update the recorder and replay counters, and clear REPLAY_ENABLE once a
+ * replay has finished.  Must be called with the lock held.
+ */
+void ElectronAnalyserViewer::updateRecorderStatus()
+{
+  int replayEnable;
+
+  setDoubleParam(RecFrames, recorder.frames());
+  setDoubleParam(ReplayFrames, replayer.frames());
+  getIntegerParam(ReplayEnable, &replayEnable);
+  if (replayEnable && !replayer.isRunning()){
+    setIntegerParam(ReplayEnable, 0);
+    setStringParam(RecMessage, replayer.error()[0] ? replayer.error() : "Replay finished");
+  }
+}
+
+/**
+ * Update the correction parameters from the corrector.  Must be called
+ * with the lock held.
+ */
+void ElectronAnalyserViewer::updateCorrectorStatus()
+{
+  setIntegerParam(CorrCaptured, corrector.captured());
+  setIntegerParam(CorrDarkValid, corrector.hasDark() ? 1 : 0);
+  setIntegerParam(CorrFlatValid, corrector.hasFlat() ? 1 : 0);
+}
+
+/**
+ * Sum the configured detector region of a received frame into the energy and
+ * angle profiles and publish them as waveforms.  The lock is released while
+ * the frame is projected.
+ * \param[in] pImage The frame received from SES.
+ */
+void ElectronAnalyserViewer::projectSpectrum(NDArray *pImage)
+{
+  const char *functionName = "projectSpectrum";
+  int firstXChannel;
+  int lastXChannel;
+  int firstYChannel;
+  int lastYChannel;
+  int slices;
+  bool valid;
+
+  getIntegerParam(ProjFirstXChannel, &firstXChannel);
+  getIntegerParam(ProjLastXChannel, &lastXChannel);
+  getIntegerParam(ProjFirstYChannel, &firstYChannel);
+  getIntegerParam(ProjLastYChannel, &lastYChannel);
+  getIntegerParam(ProjSlices, &slices);
+  projector.setRegion(firstXChannel, lastXChannel, firstYChannel, lastYChannel, slices);
+
+  this->unlock();
+  valid = projector.project(pImage->pData, pImage->dataType, (int)pImage->dims[0].size, (int)pImage->dims[1].size);
+  this->lock();
+
+  if (!valid){
+    asynPrint(this->pasynUserSelf, ASYN_TRACE_WARNING, "%s:%s: projection region is outside the frame\n", driverName, functionName);
+    return;
+  }
+  doCallbacksFloat64Array(projector.energyProfile(), projector.numChannels(), ProjEnergy, 0);
+  doCallbacksFloat64Array(projector.angleProfile(), projector.numSlices(), ProjAngle, 0);
+}
+
 /**
  * Called when asyn clients call pasynInt32->write().
  * Write integer value to the drivers parameter table.
@@ -485,12 +1463,13 @@ asynStatus ElectronAnalyserViewer::writeInt32(asynUser *pasynUser, epicsInt32 va
   int status = asynSuccess;
   int function = pasynUser->reason;
   const char *functionName = "writeInt32";
-  int OldValue;
   int adstatus;
+  int addr;
 
-  getIntegerParam(function, &OldValue);
+  // Per-stream parameters are written on the address of their stream
+  this->getAddress(pasynUser, &addr);
   this->lock();
-  status = setIntegerParam(function, value);
+  status = setIntegerParam(addr, function, value);
   getIntegerParam(ADStatus, &adstatus);
 
   if (function == ADAcquire){
@@ -502,9 +1481,76 @@ asynStatus ElectronAnalyserViewer::writeInt32(asynUser *pasynUser, epicsInt32 va
       // Stop acquiring
       epicsEventSignal(this->stopEventId);
     }
+  } else if (function == CountReset){
+    // The counter belongs to the acquisition task, so only flag the reset here
+    if (value){
+      countResetPending = true;
+    }
+    setIntegerParam(CountReset, 0);
+  } else if (function == LatReset){
+    // The histograms belong to the acquisition task, so only flag the reset here
+    if (value){
+      latencyResetPending = true;
+    }
+    setIntegerParam(LatReset, 0);
+  } else if (function == RecEnable){
+    if (value){
+      char fileName[MAX_FILENAME_LEN];
+      int slots;
+      int slotSize;
+      getStringParam(RecFile, sizeof(fileName), fileName);
+      getIntegerParam(RecSlots, &slots);
+      getIntegerParam(RecSlotSize, &slotSize);
+      if (recorder.open(fileName, slots, (size_t)slotSize)){
+        setStringParam(RecMessage, "Recording");
+      } else {
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, recorder.error());
+        setStringParam(RecMessage, recorder.error());
+        setIntegerParam(RecEnable, 0);
+      }
+    } else {
+      recorder.close();
+      setStringParam(RecMessage, "Stopped");
+    }
+    this->updateRecorderStatus();
+  } else if (function == CorrCaptureDark || function == CorrCaptureFlat){
+    // The capture is fed by the acquisition task, which clears the command when it completes
+    if (value){
+      int frames;
+      getIntegerParam(CorrFrames, &frames);
+      corrector.startCapture(function == CorrCaptureDark ? CorrectionDark : CorrectionFlat, frames);
+      setIntegerParam(function == CorrCaptureDark ? CorrCaptureFlat : CorrCaptureDark, 0);
+      setStringParam(CorrMessage, "Capturing");
+      this->updateCorrectorStatus();
+    }
+  } else if (function == ReplayEnable){
+    if (value){
+      char fileName[MAX_FILENAME_LEN];
+      char endpoint[128];
+      double rate;
+      int loop;
+      getStringParam(RecFile, sizeof(fileName), fileName);
+      getStringParam(ReplayEndpoint, sizeof(endpoint), endpoint);
+      getDoubleParam(ReplayRate, &rate);
+      getIntegerParam(ReplayLoop, &loop);
+      if (!replayer.start(fileName, endpoint, rate, loop != 0)){
+        asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s:%s: %s\n", driverName, functionName, replayer.error());
+        setStringParam(RecMessage, replayer.error());
+        setIntegerParam(ReplayEnable, 0);
+      } else {
+        setStringParam(RecMessage, "Replaying");
+      }
+    } else {
+      replayer.stop();
+      setStringParam(RecMessage, "Stopped");
+    }
+    this->updateRecorderStatus();
   }
   // Do callbacks so higher layers see any changes
   callParamCallbacks();
+  if (addr != 0){
+    callParamCallbacks(addr, addr);
+  }
   this->unlock();
   if (status){
     asynPrint(pasynUser, ASYN_TRACE_ERROR,"%s:%s: error, status=%d function=%d, value=%d\n",driverName, functionName, status, function, value);
@@ -514,6 +1560,53 @@ asynStatus ElectronAnalyserViewer::writeInt32(asynUser *pasynUser, epicsInt32 va
   return asynSuccess;
 }
 
+/**
+ * Called when asyn clients call pasynOctet->write().
+ * Writing the correction file name loads the maps stored in it, so that the
+ * maps are restored when the file name is written at startup.
+ * \param[in] pasynUser pasynUser structure that encodes the reason and address.
+ * \param[in] value Address of the string to write.
+ * \param[in] nChars Number of characters to write.
+ * \param[out] nActual Number of characters actually written.
+ * \return asynStatus Either asynError or asynSuccess
+ */
+asynStatus ElectronAnalyserViewer::writeOctet(asynUser *pasynUser, const char *value, size_t nChars, size_t *nActual)
+{
+  int function = pasynUser->reason;
+  asynStatus status = asynSuccess;
+  const char *functionName = "writeOctet";
+  int addr;
+
+  if (function < FIRST_EEVIEWER_PARAM){
+    // If this parameter belongs to a base class call its method
+    return ADDriver::writeOctet(pasynUser, value, nChars, nActual);
+  }
+
+  // Connection strings are written on the address of their stream
+  this->getAddress(pasynUser, &addr);
+  this->lock();
+  status = setStringParam(addr, function, value);
+  if (function == CorrFile && value[0] != 0){
+    if (corrector.load(value)){
+      setStringParam(CorrMessage, "Loaded");
+    } else {
+      asynPrint(pasynUser, ASYN_TRACE_WARNING, "%s:%s: %s\n", driverName, functionName, corrector.error());
+      setStringParam(CorrMessage, corrector.error());
+    }
+    this->updateCorrectorStatus();
+    callParamCallbacks();
+  }
+  callParamCallbacks(addr, addr);
+  this->unlock();
+  *nActual = nChars;
+  if (status){
+    asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s:%s: error, status=%d function=%d, value=%s\n", driverName, functionName, status, function, value);
+    return asynError;
+  }
+  asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s:%s: function=%d, value=%s\n", driverName, functionName, function, value);
+  return asynSuccess;
+}
+
 /**
  * Report status of the driver for debugging/testing purpose. Can be invoked from ioc shell.
  * Prints details about the driver if details>0.
@@ -531,6 +1624,19 @@ void ElectronAnalyserViewer::report(FILE *fp, int details)
     getIntegerParam(NDDataType, &dataType);
     fprintf(fp, "  NX, NY:            %d  %d\n", nx, ny);
     fprintf(fp, "  Data type:         %d\n", dataType);
+    fprintf(fp, "  Frame rate:        %f Hz\n", frameRate);
+    int connState, reconnects;
+    getIntegerParam(ConnState, &connState);
+    getIntegerParam(ConnReconnects, &reconnects);
+    fprintf(fp, "  Connection state:  %d (%d reconnects)\n", connState, reconnects);
+    processLatency.report(fp, "Receive->publish");
+    callbackLatency.report(fp, "Callbacks");
+    totalLatency.report(fp, "Receive->return");
+    if (counter != 0){
+      fprintf(fp, "  Counting threads:  %d\n", counter->numThreads());
+      fprintf(fp, "  Counted hits:      %.0f\n", counter->totalHits());
+      fprintf(fp, "  Mean hits/frame:   %f\n", counter->meanHitsPerFrame());
+    }
   }
   // Invoke the base class method
   ADDriver::report(fp, details);
@@ -0,0 +1,386 @@
+/* electronCounter.cpp
+ *
+ * Electron event counting for live camera frames received by the
+ * electron analyser viewer.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+
+#include "electronCounter.h"
+
+/**
+ * ElectronCounter constructor
+ * \param[in] threads Number of threads used to process each frame.
+ */
+ElectronCounter::ElectronCounter(int threads) :
+  pFrame(0),
+  frameType(NDUInt8),
+  width(0),
+  height(0),
+  threshold(0.0),
+  minSize(1),
+  maxSize(0),
+  scale(1),
+  hits(0.0),
+  frames(0.0),
+  blobPixels(0.0)
+{
+  pool = new ViewerWorkerPool("ElectronCounter", threads);
+}
+
+/**
+ * ElectronCounter destructor
+ */
+ElectronCounter::~ElectronCounter()
+{
+  delete pool;
+}
+
+/**
+ * Set the counting parameters used for the next frame.
+ * \param[in] thresholdValue Pixels must be above this value to be part of a blob.
+ * \param[in] minBlobSize Smallest blob, in pixels, that is counted as a hit.
+ * \param[in] maxBlobSize Largest blob, in pixels, that is counted as a hit (0 for no limit).
+ * \param[in] countScale Oversampling factor of the count image in each direction.
+ */
+void ElectronCounter::configure(double thresholdValue, int minBlobSize, int maxBlobSize, int countScale)
+{
+  if (countScale < 1){
+    countScale = 1;
+  }
+  if (countScale != scale){
+    // The count image will be reallocated and cleared by the next frame
+    countImage.clear();
+  }
+  threshold = thresholdValue;
+  minSize = minBlobSize;
+  maxSize = maxBlobSize;
+  scale = countScale;
+}
+
+/**
+ * Clear the count image and the statistics.
+ */
+void ElectronCounter::reset()
+{
+  if (!countImage.empty()){
+    memset(&countImage[0], 0, countImage.size() * sizeof(epicsUInt32));
+  }
+  hits = 0.0;
+  frames = 0.0;
+  blobPixels = 0.0;
+}
+
+/**
+ * Count the electrons in one frame and add them to the count image.
+ * \param[in] pData Pointer to the frame data.
+ * \param[in] dataType Data type of the pixels.
+ * \param[in] frameWidth Number of pixels in a row.
+ * \param[in] frameHeight Number of rows.
+ * \return The number of hits found in the frame.
+ */
+int ElectronCounter::process(const void *pData, NDDataType_t dataType, int frameWidth, int frameHeight)
+{
+  int frameHits = 0;
+  size_t pixels = (size_t)frameWidth * frameHeight;
+
+  if (pData == 0 || frameWidth <= 0 || frameHeight <= 0){
+    return 0;
+  }
+
+  // Geometry changes restart the accumulation
+  if (frameWidth != width || frameHeight != height || countImage.empty()){
+    width = frameWidth;
+    height = frameHeight;
+    weights.resize(pixels);
+    labels.resize(pixels);
+    countImage.assign(pixels * scale * scale, 0);
+
+    int numBands = pool->size();
+    if (numBands > height){
+      numBands = height;
+    }
+    bands.resize(numBands);
+    for (int band = 0; band < numBands; band++){
+      bands[band].firstRow = (int)(((long)height * band) / numBands);
+      bands[band].lastRow = (int)(((long)height * (band + 1)) / numBands) - 1;
+    }
+  }
+
+  pFrame = pData;
+  frameType = dataType;
+  pool->run(thresholdBandC, this, (int)bands.size());
+  pool->run(labelBandC, this, (int)bands.size());
+  mergeBands();
+
+  // Accumulate the centroid of every blob that passes the size filter
+  int countWidth = width * scale;
+  for (size_t index = 0; index < allBlobs.size(); index++){
+    Blob *pBlob = allBlobs[index];
+    if (pBlob->parent != (int)index){
+      continue;
+    }
+    if (pBlob->pixels < minSize || (maxSize > 0 && pBlob->pixels > maxSize)){
+      continue;
+    }
+    double cx = pBlob->sumX / pBlob->sum;
+    double cy = pBlob->sumY / pBlob->sum;
+    int ix = (int)((cx + 0.5) * scale);
+    int iy = (int)((cy + 0.5) * scale);
+    if (ix >= countWidth){
+      ix = countWidth - 1;
+    }
+    if (iy >= height * scale){
+      iy = height * scale - 1;
+    }
+    countImage[(size_t)iy * countWidth + ix]++;
+    blobPixels += pBlob->pixels;
+    frameHits++;
+  }
+  hits += frameHits;
+  frames += 1.0;
+  pFrame = 0;
+  return frameHits;
+}
+
+/**
+ * \return The number of threads used to process a frame.
+ */
+int ElectronCounter::numThreads() const
+{
+  return pool->size();
+}
+
+/**
+ * \return The width of the count image.
+ */
+int ElectronCounter::countWidth() const
+{
+  return width * scale;
+}
+
+/**
+ * \return The height of the count image.
+ */
+int ElectronCounter::countHeight() const
+{
+  return height * scale;
+}
+
+/**
+ * \return Pointer to the accumulated count image, or 0 if no frame has been processed.
+ */
+const epicsUInt32 *ElectronCounter::counts() const
+{
+  return countImage.empty() ? 0 : &countImage[0];
+}
+
+/**
+ * \return The number of hits accumulated since the last reset.
+ */
+double ElectronCounter::totalHits() const
+{
+  return hits;
+}
+
+/**
+ * \return The average number of hits per frame since the last reset.
+ */
+double ElectronCounter::meanHitsPerFrame() const
+{
+  return frames > 0.0 ? hits / frames : 0.0;
+}
+
+/**
+ * \return The average size in pixels of the counted blobs since the last reset.
+ */
+double ElectronCounter::meanBlobSize() const
+{
+  return hits > 0.0 ? blobPixels / hits : 0.0;
+}
+
+void ElectronCounter::thresholdBandC(void *arg, int band, int /*numBands*/)
+{
+  ElectronCounter *pCounter = (ElectronCounter *)arg;
+  switch (pCounter->frameType){
+    case NDInt8:
+      pCounter->thresholdBand((const epicsInt8 *)pCounter->pFrame, band);
+      break;
+    case NDUInt8:
+      pCounter->thresholdBand((const epicsUInt8 *)pCounter->pFrame, band);
+      break;
+    case NDInt16:
+      pCounter->thresholdBand((const epicsInt16 *)pCounter->pFrame, band);
+      break;
+    case NDUInt16:
+      pCounter->thresholdBand((const epicsUInt16 *)pCounter->pFrame, band);
+      break;
+    case NDInt32:
+      pCounter->thresholdBand((const epicsInt32 *)pCounter->pFrame, band);
+      break;
+    case NDUInt32:
+      pCounter->thresholdBand((const epicsUInt32 *)pCounter->pFrame, band);
+      break;
+    case NDFloat32:
+      pCounter->thresholdBand((const epicsFloat32 *)pCounter->pFrame, band);
+      break;
+    case NDFloat64:
+      pCounter->thresholdBand((const epicsFloat64 *)pCounter->pFrame, band);
+      break;
+    default:
+      break;
+  }
+}
+
+void ElectronCounter::labelBandC(void *arg, int band, int /*numBands*/)
+{
+  ((ElectronCounter *)arg)->labelBand(band);
+}
+
+/**
+ * Convert the pixels of one band into weights above the threshold and clear
+ * their labels.  The loop is kept free of branches so that the compiler can
+ * vectorise it.
+ */
+template <typename T> void ElectronCounter::thresholdBand(const T *pData, int band)
+{
+  size_t first = (size_t)bands[band].firstRow * width;
+  size_t last = (size_t)(bands[band].lastRow + 1) * width;
+  const float level = (float)threshold;
+  float *pWeight = &weights[0];
+
+  for (size_t index = first; index < last; index++){
+    float value = (float)pData[index] - level;
+    pWeight[index] = value > 0.0f ? value : 0.0f;
+  }
+  memset(&labels[first], 0, (last - first) * sizeof(epicsInt32));
+}
+
+/**
+ * Label the 8-connected blobs of one band.  Labels are local to the band and
+ * start at 1, blobs are not followed across the band boundaries.
+ */
+void ElectronCounter::labelBand(int band)
+{
+  Band &b = bands[band];
+  const float *pWeight = &weights[0];
+  epicsInt32 *pLabel = &labels[0];
+
+  b.blobs.clear();
+  for (int row = b.firstRow; row <= b.lastRow; row++){
+    for (int col = 0; col < width; col++){
+      size_t seed = (size_t)row * width + col;
+      if (pWeight[seed] <= 0.0f || pLabel[seed] != 0){
+        continue;
+      }
+      Blob blob;
+      blob.sum = 0.0;
+      blob.sumX = 0.0;
+      blob.sumY = 0.0;
+      blob.pixels = 0;
+      blob.parent = (int)b.blobs.size();
+      epicsInt32 label = blob.parent + 1;
+
+      pLabel[seed] = label;
+      b.stack.push_back((int)seed);
+      while (!b.stack.empty()){
+        int pixel = b.stack.back();
+        b.stack.pop_back();
+        int y = pixel / width;
+        int x = pixel - y * width;
+        double w = pWeight[pixel];
+        blob.sum += w;
+        blob.sumX += w * x;
+        blob.sumY += w * y;
+        blob.pixels++;
+        for (int ny = y - 1; ny <= y + 1; ny++){
+          if (ny < b.firstRow || ny > b.lastRow){
+            continue;
+          }
+          for (int nx = x - 1; nx <= x + 1; nx++){
+            if (nx < 0 || nx >= width){
+              continue;
+            }
+            int neighbour = ny * width + nx;
+            if (pWeight[neighbour] > 0.0f && pLabel[neighbour] == 0){
+              pLabel[neighbour] = label;
+              b.stack.push_back(neighbour);
+            }
+          }
+        }
+      }
+      b.blobs.push_back(blob);
+    }
+  }
+}
+
+/**
+ * Join the blobs that touch across band boundaries and sum their moments
+ * into the root blob of each group.
+ */
+void ElectronCounter::mergeBands()
+{
+  allBlobs.clear();
+  for (size_t band = 0; band < bands.size(); band++){
+    bands[band].firstBlob = (int)allBlobs.size();
+    for (size_t index = 0; index < bands[band].blobs.size(); index++){
+      Blob &blob = bands[band].blobs[index];
+      blob.parent = (int)allBlobs.size();
+      allBlobs.push_back(&blob);
+    }
+  }
+
+  for (size_t band = 0; band + 1 < bands.size(); band++){
+    int upper = bands[band].lastRow;
+    int lower = bands[band + 1].firstRow;
+    const epicsInt32 *pUpper = &labels[(size_t)upper * width];
+    const epicsInt32 *pLower = &labels[(size_t)lower * width];
+    for (int col = 0; col < width; col++){
+      if (pUpper[col] == 0){
+        continue;
+      }
+      for (int nx = col - 1; nx <= col + 1; nx++){
+        if (nx >= 0 && nx < width && pLower[nx] != 0){
+          unite(bands[band].firstBlob + pUpper[col] - 1, bands[band + 1].firstBlob + pLower[nx] - 1);
+        }
+      }
+    }
+  }
+
+  for (size_t index = 0; index < allBlobs.size(); index++){
+    int root = findRoot((int)index);
+    if (root != (int)index){
+      Blob *pBlob = allBlobs[index];
+      Blob *pRoot = allBlobs[root];
+      pRoot->sum += pBlob->sum;
+      pRoot->sumX += pBlob->sumX;
+      pRoot->sumY += pBlob->sumY;
+      pRoot->pixels += pBlob->pixels;
+      pBlob->parent = root;
+    }
+  }
+}
+
+int ElectronCounter::findRoot(int blob)
+{
+  while (allBlobs[blob]->parent != blob){
+    allBlobs[blob]->parent = allBlobs[allBlobs[blob]->parent]->parent;
+    blob = allBlobs[blob]->parent;
+  }
+  return blob;
+}
+
+void ElectronCounter::unite(int blobA, int blobB)
+{
+  int rootA = findRoot(blobA);
+  int rootB = findRoot(blobB);
+  if (rootA < rootB){
+    allBlobs[rootB]->parent = rootA;
+  } else if (rootB < rootA){
+    allBlobs[rootA]->parent = rootB;
+  }
+}
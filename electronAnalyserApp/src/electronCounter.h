@@ -0,0 +1,92 @@
+/* electronCounter.h
+ *
+ * Electron event counting for live camera frames received by the
+ * electron analyser viewer.
+ *
+ */
+
+#ifndef ELECTRONCOUNTER_H
+#define ELECTRONCOUNTER_H
+
+#include <vector>
+
+#include <epicsTypes.h>
+#include "NDArray.h"
+
+#include "viewerWorkerPool.h"
+
+/**
+ * Thresholds each frame, labels the connected blobs of pixels above the
+ * threshold and accumulates the intensity weighted centroid of every blob
+ * into a count image.
+ *
+ * The frame is split into horizontal bands that are thresholded and
+ * labelled in parallel, blobs that straddle a band boundary are merged
+ * afterwards.  The count image can be oversampled by an integer factor so
+ * that the sub-pixel centroid position is kept.
+ */
+class ElectronCounter
+{
+  public:
+    ElectronCounter(int threads);
+    ~ElectronCounter();
+
+    void configure(double threshold, int minSize, int maxSize, int scale);
+    int process(const void *pData, NDDataType_t dataType, int width, int height);
+    void reset();
+
+    int numThreads() const;
+    int countWidth() const;
+    int countHeight() const;
+    const epicsUInt32 *counts() const;
+    double totalHits() const;
+    double meanHitsPerFrame() const;
+    double meanBlobSize() const;
+
+  private:
+    struct Blob
+    {
+      double sum;
+      double sumX;
+      double sumY;
+      int pixels;
+      int parent;
+    };
+
+    struct Band
+    {
+      int firstRow;
+      int lastRow;
+      int firstBlob;
+      std::vector<Blob> blobs;
+      std::vector<int> stack;
+    };
+
+    static void thresholdBandC(void *arg, int band, int numBands);
+    static void labelBandC(void *arg, int band, int numBands);
+    template <typename T> void thresholdBand(const T *pData, int band);
+    void labelBand(int band);
+    void mergeBands();
+    int findRoot(int blob);
+    void unite(int blobA, int blobB);
+
+    ViewerWorkerPool *pool;
+    std::vector<Band> bands;
+    std::vector<float> weights;
+    std::vector<epicsInt32> labels;
+    std::vector<Blob *> allBlobs;
+    std::vector<epicsUInt32> countImage;
+    const void *pFrame;
+    NDDataType_t frameType;
+    int width;
+    int height;
+    double threshold;
+    int minSize;
+    int maxSize;
+    int scale;
+    double hits;
+    double frames;
+    double blobPixels;
+};
+
+#endif
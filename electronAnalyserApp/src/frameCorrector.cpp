@@ -0,0 +1,451 @@
+/* frameCorrector.cpp
+ *
+ * Dark frame and flat field correction of live camera frames received by
+ * the electron analyser viewer.
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+
+#include "frameCorrector.h"
+
+/**
+ * \return The size in bytes of one pixel of the given type, 0 if unknown.
+ */
+static size_t pixelSize(NDDataType_t dataType)
+{
+  switch (dataType){
+    case NDInt8:
+    case NDUInt8:
+      return 1;
+    case NDInt16:
+    case NDUInt16:
+      return 2;
+    case NDInt32:
+    case NDUInt32:
+    case NDFloat32:
+      return 4;
+    case NDFloat64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * FrameCorrector constructor
+ */
+FrameCorrector::FrameCorrector() :
+  width(0),
+  height(0),
+  darkValid(false),
+  flatValid(false),
+  captureMap(CorrectionDark),
+  captureFrames(0),
+  captureCount(0),
+  captureWidth(0),
+  captureHeight(0)
+{
+  mutexId = epicsMutexMustCreate();
+}
+
+/**
+ * FrameCorrector destructor
+ */
+FrameCorrector::~FrameCorrector()
+{
+  epicsMutexDestroy(mutexId);
+}
+
+/**
+ * Start averaging the following frames into the dark or flat map.
+ * \param[in] map The map to capture.
+ * \param[in] frames Number of frames to average.
+ */
+void FrameCorrector::startCapture(CorrectionMap_t map, int frames)
+{
+  epicsMutexLock(mutexId);
+  captureMap = map;
+  captureFrames = frames < 1 ? 1 : frames;
+  captureCount = 0;
+  captureWidth = 0;
+  captureHeight = 0;
+  captureSum.clear();
+  epicsMutexUnlock(mutexId);
+}
+
+/**
+ * \return \c true while a capture is collecting frames.
+ */
+bool FrameCorrector::isCapturing()
+{
+  epicsMutexLock(mutexId);
+  bool capturing = captureFrames > 0;
+  epicsMutexUnlock(mutexId);
+  return capturing;
+}
+
+/**
+ * \return The number of frames collected by the current capture.
+ */
+int FrameCorrector::captured()
+{
+  epicsMutexLock(mutexId);
+  int count = captureCount;
+  epicsMutexUnlock(mutexId);
+  return count;
+}
+
+/**
+ * Add a raw frame to the capture in progress.  A change of the frame geometry
+ * restarts the capture.  When the last frame has been added the average
+ * replaces the map being captured, a map of a different geometry is discarded.
+ * \param[in] pData Pointer to the frame data.
+ * \param[in] bytes Number of bytes available at pData.
+ * \param[in] dataType Data type of the pixels.
+ * \param[in] frameWidth Number of pixels in a row.
+ * \param[in] frameHeight Number of rows.
+ * \return \c true if this frame completed the capture.
+ */
+bool FrameCorrector::accumulate(const void *pData, size_t bytes, NDDataType_t dataType, int frameWidth, int frameHeight)
+{
+  size_t pixels = (size_t)frameWidth * frameHeight;
+  bool complete = false;
+
+  epicsMutexLock(mutexId);
+  if (captureFrames == 0 || pixelSize(dataType) == 0 || bytes < pixels * pixelSize(dataType)){
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  if (frameWidth != captureWidth || frameHeight != captureHeight){
+    captureWidth = frameWidth;
+    captureHeight = frameHeight;
+    captureCount = 0;
+    captureSum.assign(pixels, 0.0);
+  }
+
+  switch (dataType){
+    case NDInt8:
+      accumulatePixels((const epicsInt8 *)pData, pixels);
+      break;
+    case NDUInt8:
+      accumulatePixels((const epicsUInt8 *)pData, pixels);
+      break;
+    case NDInt16:
+      accumulatePixels((const epicsInt16 *)pData, pixels);
+      break;
+    case NDUInt16:
+      accumulatePixels((const epicsUInt16 *)pData, pixels);
+      break;
+    case NDInt32:
+      accumulatePixels((const epicsInt32 *)pData, pixels);
+      break;
+    case NDUInt32:
+      accumulatePixels((const epicsUInt32 *)pData, pixels);
+      break;
+    case NDFloat32:
+      accumulatePixels((const epicsFloat32 *)pData, pixels);
+      break;
+    case NDFloat64:
+      accumulatePixels((const epicsFloat64 *)pData, pixels);
+      break;
+    default:
+      break;
+  }
+  captureCount++;
+
+  if (captureCount >= captureFrames){
+    // Maps of another geometry can no longer be applied
+    if (captureWidth != width || captureHeight != height){
+      darkValid = false;
+      flatValid = false;
+      width = captureWidth;
+      height = captureHeight;
+    }
+    std::vector<epicsFloat32> &map = (captureMap == CorrectionDark) ? dark : flat;
+    map.resize(pixels);
+    for (size_t index = 0; index < pixels; index++){
+      map[index] = (epicsFloat32)(captureSum[index] / captureCount);
+    }
+    if (captureMap == CorrectionDark){
+      darkValid = true;
+    } else {
+      flatValid = true;
+    }
+    updateGain();
+    captureFrames = 0;
+    captureSum.clear();
+    complete = true;
+  }
+  epicsMutexUnlock(mutexId);
+  return complete;
+}
+
+/**
+ * Convert a raw frame to Float32, subtracting the dark frame and applying the
+ * flat field gain when the maps match the frame geometry.  Without matching
+ * maps the pixels are only converted.
+ * \param[in] pData Pointer to the frame data.
+ * \param[in] bytes Number of bytes available at pData, missing pixels are set to 0.
+ * \param[in] dataType Data type of the pixels.
+ * \param[in] frameWidth Number of pixels in a row.
+ * \param[in] frameHeight Number of rows.
+ * \param[out] pOut Buffer for frameWidth*frameHeight Float32 pixels.
+ */
+void FrameCorrector::correct(const void *pData, size_t bytes, NDDataType_t dataType, int frameWidth, int frameHeight, epicsFloat32 *pOut)
+{
+  size_t pixels = (size_t)frameWidth * frameHeight;
+  size_t available = pixelSize(dataType) > 0 ? bytes / pixelSize(dataType) : 0;
+
+  if (available > pixels){
+    available = pixels;
+  }
+  epicsMutexLock(mutexId);
+  bool apply = (darkValid || flatValid) && frameWidth == width && frameHeight == height;
+
+  switch (dataType){
+    case NDInt8:
+      correctPixels((const epicsInt8 *)pData, available, apply, pOut);
+      break;
+    case NDUInt8:
+      correctPixels((const epicsUInt8 *)pData, available, apply, pOut);
+      break;
+    case NDInt16:
+      correctPixels((const epicsInt16 *)pData, available, apply, pOut);
+      break;
+    case NDUInt16:
+      correctPixels((const epicsUInt16 *)pData, available, apply, pOut);
+      break;
+    case NDInt32:
+      correctPixels((const epicsInt32 *)pData, available, apply, pOut);
+      break;
+    case NDUInt32:
+      correctPixels((const epicsUInt32 *)pData, available, apply, pOut);
+      break;
+    case NDFloat32:
+      correctPixels((const epicsFloat32 *)pData, available, apply, pOut);
+      break;
+    case NDFloat64:
+      correctPixels((const epicsFloat64 *)pData, available, apply, pOut);
+      break;
+    default:
+      available = 0;
+      break;
+  }
+  epicsMutexUnlock(mutexId);
+  if (available < pixels){
+    memset(pOut + available, 0, (pixels - available) * sizeof(epicsFloat32));
+  }
+}
+
+/**
+ * \return \c true if a dark frame is loaded.
+ */
+bool FrameCorrector::hasDark()
+{
+  epicsMutexLock(mutexId);
+  bool valid = darkValid;
+  epicsMutexUnlock(mutexId);
+  return valid;
+}
+
+/**
+ * \return \c true if a flat field is loaded.
+ */
+bool FrameCorrector::hasFlat()
+{
+  epicsMutexLock(mutexId);
+  bool valid = flatValid;
+  epicsMutexUnlock(mutexId);
+  return valid;
+}
+
+/**
+ * \return \c true if a loaded map has the given geometry.
+ */
+bool FrameCorrector::matches(int frameWidth, int frameHeight)
+{
+  epicsMutexLock(mutexId);
+  bool match = (darkValid || flatValid) && frameWidth == width && frameHeight == height;
+  epicsMutexUnlock(mutexId);
+  return match;
+}
+
+/**
+ * Replace the maps with those stored in a correction file.
+ * \param[in] fileName Name of the correction file.
+ * \return \c true if the file was read.
+ */
+bool FrameCorrector::load(const char *fileName)
+{
+  CorrectionFileHeader header;
+  std::vector<epicsFloat32> fileDark;
+  std::vector<epicsFloat32> fileFlat;
+  size_t pixels;
+
+  FILE *fp = fopen(fileName, "rb");
+  if (fp == NULL){
+    epicsMutexLock(mutexId);
+    lastError = std::string("Unable to open ") + fileName + ": " + strerror(errno);
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+            memcmp(header.magic, CORRECTION_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == CORRECTION_FILE_VERSION;
+  pixels = ok ? (size_t)header.width * header.height : 0;
+  if (ok && (header.flags & CORRECTION_HAS_DARK)){
+    fileDark.resize(pixels);
+    ok = fread(&fileDark[0], sizeof(epicsFloat32), pixels, fp) == pixels;
+  }
+  if (ok && (header.flags & CORRECTION_HAS_FLAT)){
+    fileFlat.resize(pixels);
+    ok = fread(&fileFlat[0], sizeof(epicsFloat32), pixels, fp) == pixels;
+  }
+  fclose(fp);
+
+  epicsMutexLock(mutexId);
+  if (!ok || pixels == 0){
+    lastError = std::string(fileName) + " is not a valid correction file";
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  width = header.width;
+  height = header.height;
+  dark.swap(fileDark);
+  flat.swap(fileFlat);
+  darkValid = !dark.empty();
+  flatValid = !flat.empty();
+  updateGain();
+  lastError.clear();
+  epicsMutexUnlock(mutexId);
+  return true;
+}
+
+/**
+ * Write the maps to a correction file.
+ * \param[in] fileName Name of the correction file, an existing file is replaced.
+ * \return \c true if the file was written.
+ */
+bool FrameCorrector::save(const char *fileName)
+{
+  CorrectionFileHeader header;
+  std::string tempName = std::string(fileName) + ".tmp";
+  bool ok;
+
+  epicsMutexLock(mutexId);
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CORRECTION_FILE_MAGIC, sizeof(header.magic));
+  header.version = CORRECTION_FILE_VERSION;
+  header.flags = (darkValid ? CORRECTION_HAS_DARK : 0) | (flatValid ? CORRECTION_HAS_FLAT : 0);
+  header.width = width;
+  header.height = height;
+  size_t pixels = (size_t)width * height;
+
+  // Write a temporary file and rename it, so a failed write never leaves a truncated file
+  FILE *fp = fopen(tempName.c_str(), "wb");
+  if (fp == NULL){
+    lastError = std::string("Unable to create ") + tempName + ": " + strerror(errno);
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+  if (ok && darkValid){
+    ok = fwrite(&dark[0], sizeof(epicsFloat32), pixels, fp) == pixels;
+  }
+  if (ok && flatValid){
+    ok = fwrite(&flat[0], sizeof(epicsFloat32), pixels, fp) == pixels;
+  }
+  ok = (fclose(fp) == 0) && ok;
+  if (ok && rename(tempName.c_str(), fileName) != 0){
+    ok = false;
+  }
+  if (!ok){
+    lastError = std::string("Unable to write ") + fileName + ": " + strerror(errno);
+    remove(tempName.c_str());
+  } else {
+    lastError.clear();
+  }
+  epicsMutexUnlock(mutexId);
+  return ok;
+}
+
+/**
+ * \return A description of the last error.
+ */
+const char *FrameCorrector::error()
+{
+  return lastError.c_str();
+}
+
+/**
+ * Correct the pixels with a single loop over the offset and gain maps, or
+ * only convert them when no map applies.  The loops have no branches so that
+ * the compiler can vectorise them.
+ */
+template <typename T> void FrameCorrector::correctPixels(const T *pData, size_t pixels, bool apply, epicsFloat32 *pOut)
+{
+  if (!apply){
+    for (size_t index = 0; index < pixels; index++){
+      pOut[index] = (epicsFloat32)pData[index];
+    }
+    return;
+  }
+
+  const epicsFloat32 *pOffset = &offset[0];
+  const epicsFloat32 *pGain = &gain[0];
+  for (size_t index = 0; index < pixels; index++){
+    pOut[index] = ((epicsFloat32)pData[index] - pOffset[index]) * pGain[index];
+  }
+}
+
+template <typename T> void FrameCorrector::accumulatePixels(const T *pData, size_t pixels)
+{
+  double *pSum = &captureSum[0];
+
+  for (size_t index = 0; index < pixels; index++){
+    pSum[index] += pData[index];
+  }
+}
+
+/**
+ * Rebuild the offset and gain maps applied by correct().  The gain scales each
+ * pixel of the dark subtracted flat field to the mean of the flat field, pixels
+ * that see no signal in the flat field are set to 0.  Called with the mutex held.
+ */
+void FrameCorrector::updateGain()
+{
+  size_t pixels = (size_t)width * height;
+
+  if (darkValid){
+    offset = dark;
+  } else {
+    offset.assign(pixels, 0.0f);
+  }
+  if (!flatValid){
+    gain.assign(pixels, 1.0f);
+    return;
+  }
+
+  double sum = 0.0;
+  size_t count = 0;
+  gain.resize(pixels);
+  for (size_t index = 0; index < pixels; index++){
+    epicsFloat32 signal = flat[index] - offset[index];
+    if (signal > 0.0f){
+      sum += signal;
+      count++;
+    }
+  }
+  epicsFloat32 mean = count > 0 ? (epicsFloat32)(sum / count) : 1.0f;
+  for (size_t index = 0; index < pixels; index++){
+    epicsFloat32 signal = flat[index] - offset[index];
+    gain[index] = signal > 0.0f ? mean / signal : 0.0f;
+  }
+}
@@ -0,0 +1,92 @@
+/* frameCorrector.h
+ *
+ * Dark frame and flat field correction of live camera frames received by
+ * the electron analyser viewer.
+ *
+ */
+
+#ifndef FRAMECORRECTOR_H
+#define FRAMECORRECTOR_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include "NDArray.h"
+
+/**
+ * Layout of a correction file.  The file starts with a CorrectionFileHeader,
+ * followed by the dark frame if CORRECTION_HAS_DARK is set and then the flat
+ * frame if CORRECTION_HAS_FLAT is set.  Each frame is width*height Float32
+ * values in row order.
+ */
+#define CORRECTION_FILE_MAGIC "EAVCOR01"
+#define CORRECTION_FILE_VERSION 1
+#define CORRECTION_HAS_DARK 0x1
+#define CORRECTION_HAS_FLAT 0x2
+
+struct CorrectionFileHeader
+{
+  char magic[8];
+  epicsUInt32 version;
+  epicsUInt32 flags;
+  epicsUInt32 width;
+  epicsUInt32 height;
+};
+
+/** Maps held by the corrector */
+typedef enum {
+  CorrectionDark,
+  CorrectionFlat
+} CorrectionMap_t;
+
+/**
+ * Subtracts a dark frame from each frame and multiplies it by a gain map
+ * derived from a flat field, converting the pixels to Float32 in the same
+ * pass.  Both maps are averages of frames captured from the live stream.
+ * All member functions are thread safe.
+ */
+class FrameCorrector
+{
+  public:
+    FrameCorrector();
+    ~FrameCorrector();
+
+    void startCapture(CorrectionMap_t map, int frames);
+    bool isCapturing();
+    int captured();
+    bool accumulate(const void *pData, size_t bytes, NDDataType_t dataType, int width, int height);
+    void correct(const void *pData, size_t bytes, NDDataType_t dataType, int width, int height, epicsFloat32 *pOut);
+    bool hasDark();
+    bool hasFlat();
+    bool matches(int width, int height);
+    bool load(const char *fileName);
+    bool save(const char *fileName);
+    const char *error();
+
+  private:
+    template <typename T> void correctPixels(const T *pData, size_t pixels, bool apply, epicsFloat32 *pOut);
+    template <typename T> void accumulatePixels(const T *pData, size_t pixels);
+    void updateGain();
+
+    epicsMutexId mutexId;
+    int width;
+    int height;
+    std::vector<epicsFloat32> dark;
+    std::vector<epicsFloat32> flat;
+    std::vector<epicsFloat32> offset;
+    std::vector<epicsFloat32> gain;
+    bool darkValid;
+    bool flatValid;
+    CorrectionMap_t captureMap;
+    int captureFrames;
+    int captureCount;
+    int captureWidth;
+    int captureHeight;
+    std::vector<double> captureSum;
+    std::string lastError;
+};
+
+#endif
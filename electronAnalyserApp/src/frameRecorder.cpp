@@ -0,0 +1,414 @@
+/* frameRecorder.cpp
+ *
+ * Recording of the SES live image stream to a memory-mapped ring file,
+ * and replay of a recording on a local ZeroMQ publisher.
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <vector>
+#include <algorithm>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+
+#include "zmq.hpp"
+#include "frameRecorder.h"
+
+/**
+ * FrameRecorder constructor
+ */
+FrameRecorder::FrameRecorder() :
+  fd(-1),
+  pMap(0),
+  mapSize(0),
+  pFileHeader(0),
+  pIndex(0)
+{
+  mutexId = epicsMutexMustCreate();
+}
+
+/**
+ * FrameRecorder destructor, closes the file if it is open.
+ */
+FrameRecorder::~FrameRecorder()
+{
+  close();
+  epicsMutexDestroy(mutexId);
+}
+
+/**
+ * Create (or overwrite) a recording file and map it into memory.  The whole
+ * file is allocated here so that no disk space is allocated while recording.
+ * \param[in] fileName Name of the recording file.
+ * \param[in] numSlots Number of frames held by the ring.
+ * \param[in] slotSize Maximum size in bytes of a header and frame pair.
+ * \return \c true if the file is ready for recording.
+ */
+bool FrameRecorder::open(const char *fileName, int numSlots, size_t slotSize)
+{
+  size_t dataOffset;
+
+  close();
+  epicsMutexLock(mutexId);
+  if (numSlots < 1 || slotSize == 0){
+    lastError = "Invalid number of slots or slot size";
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  // Keep the data slots page aligned
+  dataOffset = sizeof(FrameFileHeader) + numSlots * sizeof(FrameIndexEntry);
+  dataOffset = (dataOffset + 4095) & ~(size_t)4095;
+  mapSize = dataOffset + numSlots * slotSize;
+
+  fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0){
+    lastError = std::string("Unable to create ") + fileName + ": " + strerror(errno);
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  int err = posix_fallocate(fd, 0, (off_t)mapSize);
+  if (err != 0){
+    lastError = std::string("Unable to allocate ") + fileName + ": " + strerror(err);
+    ::close(fd);
+    fd = -1;
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  void *pAddr = mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (pAddr == MAP_FAILED){
+    lastError = std::string("Unable to map ") + fileName + ": " + strerror(errno);
+    ::close(fd);
+    fd = -1;
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  pMap = (char *)pAddr;
+  pFileHeader = (FrameFileHeader *)pMap;
+  pIndex = (FrameIndexEntry *)(pMap + sizeof(FrameFileHeader));
+
+  memset(pMap, 0, dataOffset);
+  memcpy(pFileHeader->magic, FRAME_FILE_MAGIC, sizeof(pFileHeader->magic));
+  pFileHeader->version = FRAME_FILE_VERSION;
+  pFileHeader->numSlots = numSlots;
+  pFileHeader->slotSize = slotSize;
+  pFileHeader->frames = 0;
+  pFileHeader->dataOffset = dataOffset;
+  lastError.clear();
+  epicsMutexUnlock(mutexId);
+  return true;
+}
+
+/**
+ * Flush and close the recording file.
+ */
+void FrameRecorder::close()
+{
+  epicsMutexLock(mutexId);
+  if (pMap != 0){
+    msync(pMap, mapSize, MS_SYNC);
+    munmap(pMap, mapSize);
+    pMap = 0;
+    pFileHeader = 0;
+    pIndex = 0;
+  }
+  if (fd >= 0){
+    ::close(fd);
+    fd = -1;
+  }
+  epicsMutexUnlock(mutexId);
+}
+
+/**
+ * \return \c true if a recording file is open.
+ */
+bool FrameRecorder::isOpen()
+{
+  epicsMutexLock(mutexId);
+  bool open = (pMap != 0);
+  epicsMutexUnlock(mutexId);
+  return open;
+}
+
+/**
+ * Append one header and frame pair to the ring, overwriting the oldest frame if the ring is full.
+ * \param[in] pHeader The header message.
+ * \param[in] headerSize Size of the header message.
+ * \param[in] pData The frame message.
+ * \param[in] dataSize Size of the frame message.
+ * \param[in] pTime Time the frame was received.
+ * \return \c false if no file is open or the frame does not fit in a slot.
+ */
+bool FrameRecorder::append(const void *pHeader, size_t headerSize, const void *pData, size_t dataSize, const epicsTimeStamp *pTime)
+{
+  epicsMutexLock(mutexId);
+  if (pMap == 0){
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  if (headerSize + dataSize > pFileHeader->slotSize){
+    lastError = "Frame is larger than the recording slot size";
+    epicsMutexUnlock(mutexId);
+    return false;
+  }
+  epicsUInt64 sequence = pFileHeader->frames + 1;
+  size_t slot = (size_t)(pFileHeader->frames % pFileHeader->numSlots);
+  char *pSlot = pMap + pFileHeader->dataOffset + slot * pFileHeader->slotSize;
+  FrameIndexEntry *pEntry = &pIndex[slot];
+
+  // Mark the slot empty while it is rewritten, so a reader never sees a torn frame as valid
+  pEntry->sequence = 0;
+  memcpy(pSlot, pHeader, headerSize);
+  memcpy(pSlot + headerSize, pData, dataSize);
+  pEntry->secPastEpoch = pTime->secPastEpoch;
+  pEntry->nsec = pTime->nsec;
+  pEntry->headerSize = (epicsUInt32)headerSize;
+  pEntry->dataSize = (epicsUInt32)dataSize;
+  pEntry->sequence = sequence;
+  pFileHeader->frames = sequence;
+  epicsMutexUnlock(mutexId);
+  return true;
+}
+
+/**
+ * \return The number of frames written to the current file.
+ */
+double FrameRecorder::frames()
+{
+  epicsMutexLock(mutexId);
+  double count = (pFileHeader != 0) ? (double)pFileHeader->frames : 0.0;
+  epicsMutexUnlock(mutexId);
+  return count;
+}
+
+/**
+ * \return A description of the last error.
+ */
+const char *FrameRecorder::error()
+{
+  return lastError.c_str();
+}
+
+/**
+ * Make use of a c thread to call into the object and run the replay.
+ */
+static void frameReplayTaskC(void *drvPvt)
+{
+  FrameReplayer *pPvt = (FrameReplayer *)drvPvt;
+  pPvt->replayTask();
+}
+
+/**
+ * FrameReplayer constructor
+ */
+FrameReplayer::FrameReplayer() :
+  rate(1.0),
+  loop(false),
+  running(false),
+  published(0.0)
+{
+  mutexId = epicsMutexMustCreate();
+  stopEventId = epicsEventCreate(epicsEventEmpty);
+  exitEventId = epicsEventCreate(epicsEventEmpty);
+}
+
+/**
+ * FrameReplayer destructor, stops a running replay.
+ */
+FrameReplayer::~FrameReplayer()
+{
+  stop();
+  epicsEventDestroy(exitEventId);
+  epicsEventDestroy(stopEventId);
+  epicsMutexDestroy(mutexId);
+}
+
+/**
+ * Start publishing a recording.
+ * \param[in] file Name of the recording file.
+ * \param[in] address ZeroMQ endpoint the PUB socket binds to, e.g. tcp://127.0.0.1:5556.
+ * \param[in] replayRate Speed relative to the recording, 0 publishes as fast as possible.
+ * \param[in] replayLoop Restart from the oldest frame when the end is reached.
+ * \return \c true if the replay thread was started.
+ */
+bool FrameReplayer::start(const char *file, const char *address, double replayRate, bool replayLoop)
+{
+  stop();
+  epicsMutexLock(mutexId);
+  fileName = file;
+  endpoint = address;
+  rate = replayRate;
+  loop = replayLoop;
+  published = 0.0;
+  lastError.clear();
+  epicsEventTryWait(stopEventId);
+  epicsEventTryWait(exitEventId);
+  running = (epicsThreadCreate("ElectronAnalyserReplay",
+                               epicsThreadPriorityMedium,
+                               epicsThreadGetStackSize(epicsThreadStackMedium),
+                               (EPICSTHREADFUNC)frameReplayTaskC,
+                               this) != NULL);
+  if (!running){
+    lastError = "Unable to create the replay thread";
+  }
+  bool started = running;
+  epicsMutexUnlock(mutexId);
+  return started;
+}
+
+/**
+ * Stop a running replay and wait for the replay thread to exit.
+ */
+void FrameReplayer::stop()
+{
+  epicsMutexLock(mutexId);
+  bool wasRunning = running;
+  epicsMutexUnlock(mutexId);
+  if (wasRunning){
+    epicsEventSignal(stopEventId);
+    epicsEventWait(exitEventId);
+  }
+}
+
+/**
+ * \return \c true while the replay thread is publishing frames.
+ */
+bool FrameReplayer::isRunning()
+{
+  epicsMutexLock(mutexId);
+  bool isRunning = running;
+  epicsMutexUnlock(mutexId);
+  return isRunning;
+}
+
+/**
+ * \return The number of frames published by the current or last replay.
+ */
+double FrameReplayer::frames()
+{
+  epicsMutexLock(mutexId);
+  double count = published;
+  epicsMutexUnlock(mutexId);
+  return count;
+}
+
+/**
+ * \return A description of the last error.
+ */
+const char *FrameReplayer::error()
+{
+  return lastError.c_str();
+}
+
+/**
+ * Task that publishes the recorded frames.  Runs until the recording has been
+ * published (once, or forever if looping) or stop() is called.
+ */
+void FrameReplayer::replayTask()
+{
+  std::string error;
+  struct stat info;
+  char *pMap = 0;
+  size_t mapSize = 0;
+  int fd;
+
+  epicsMutexLock(mutexId);
+  std::string file = fileName;
+  std::string address = endpoint;
+  double replayRate = rate;
+  bool replayLoop = loop;
+  epicsMutexUnlock(mutexId);
+
+  fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(FrameFileHeader)){
+    error = std::string("Unable to open ") + file;
+  } else {
+    mapSize = (size_t)info.st_size;
+    void *pAddr = mmap(0, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (pAddr == MAP_FAILED){
+      error = std::string("Unable to map ") + file;
+    } else {
+      pMap = (char *)pAddr;
+    }
+  }
+
+  if (pMap != 0){
+    const FrameFileHeader *pFileHeader = (const FrameFileHeader *)pMap;
+    const FrameIndexEntry *pIndex = (const FrameIndexEntry *)(pMap + sizeof(FrameFileHeader));
+    if (memcmp(pFileHeader->magic, FRAME_FILE_MAGIC, sizeof(pFileHeader->magic)) != 0 ||
+        pFileHeader->version != FRAME_FILE_VERSION ||
+        sizeof(FrameFileHeader) + pFileHeader->numSlots * (epicsUInt64)sizeof(FrameIndexEntry) > pFileHeader->dataOffset ||
+        pFileHeader->dataOffset + pFileHeader->numSlots * pFileHeader->slotSize > mapSize){
+      error = file + " is not a valid recording";
+    } else {
+      // Order the occupied slots from the oldest to the newest frame, skipping
+      // corrupt entries that claim more bytes than their slot holds
+      std::vector<std::pair<epicsUInt64, epicsUInt32> > order;
+      for (epicsUInt32 slot = 0; slot < pFileHeader->numSlots; slot++){
+        if (pIndex[slot].sequence != 0 &&
+            (epicsUInt64)pIndex[slot].headerSize + pIndex[slot].dataSize <= pFileHeader->slotSize){
+          order.push_back(std::make_pair(pIndex[slot].sequence, slot));
+        }
+      }
+      std::sort(order.begin(), order.end());
+
+      try
+      {
+        zmq::context_t ctx;
+        zmq::socket_t publisher(ctx, ZMQ_PUB);
+        int linger = 0;
+        publisher.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+        publisher.bind(address.c_str());
+        // Give subscribers a moment to connect before the first frame
+        bool stopped = (epicsEventWaitWithTimeout(stopEventId, 0.5) == epicsEventOK);
+        do {
+          const FrameIndexEntry *pLast = 0;
+          for (size_t index = 0; index < order.size() && !stopped; index++){
+            const FrameIndexEntry *pEntry = &pIndex[order[index].second];
+            if (pLast != 0 && replayRate > 0.0){
+              epicsTimeStamp last = {pLast->secPastEpoch, pLast->nsec};
+              epicsTimeStamp next = {pEntry->secPastEpoch, pEntry->nsec};
+              double delay = epicsTimeDiffInSeconds(&next, &last) / replayRate;
+              if (delay > 0.0 && epicsEventWaitWithTimeout(stopEventId, delay) == epicsEventOK){
+                stopped = true;
+                break;
+              }
+            } else if (epicsEventTryWait(stopEventId) == epicsEventOK){
+              stopped = true;
+              break;
+            }
+            const char *pSlot = pMap + pFileHeader->dataOffset + order[index].second * pFileHeader->slotSize;
+            publisher.send(pSlot, pEntry->headerSize, ZMQ_SNDMORE);
+            publisher.send(pSlot + pEntry->headerSize, pEntry->dataSize);
+            pLast = pEntry;
+            epicsMutexLock(mutexId);
+            published += 1.0;
+            epicsMutexUnlock(mutexId);
+          }
+        } while (replayLoop && !stopped && !order.empty());
+      } catch (zmq::error_t &e)
+      {
+        error = std::string("Replay publisher error: ") + e.what();
+      }
+    }
+    munmap(pMap, mapSize);
+  }
+  if (fd >= 0){
+    ::close(fd);
+  }
+
+  epicsMutexLock(mutexId);
+  lastError = error;
+  running = false;
+  epicsMutexUnlock(mutexId);
+  epicsEventSignal(exitEventId);
+}
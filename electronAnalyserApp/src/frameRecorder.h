@@ -0,0 +1,105 @@
+/* frameRecorder.h
+ *
+ * Recording of the SES live image stream to a memory-mapped ring file,
+ * and replay of a recording on a local ZeroMQ publisher.
+ *
+ */
+
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <stddef.h>
+#include <string>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+/**
+ * Layout of a recording file.  The file starts with a FrameFileHeader,
+ * followed by numSlots FrameIndexEntry records and then numSlots data slots
+ * of slotSize bytes each.  Each slot holds the header message immediately
+ * followed by the frame message, exactly as received from SES.
+ */
+#define FRAME_FILE_MAGIC "EAVREC01"
+#define FRAME_FILE_VERSION 1
+
+struct FrameFileHeader
+{
+  char magic[8];
+  epicsUInt32 version;
+  epicsUInt32 numSlots;
+  epicsUInt64 slotSize;
+  epicsUInt64 frames;     /**< Number of frames written since the file was created */
+  epicsUInt64 dataOffset; /**< Offset of the first data slot from the start of the file */
+};
+
+struct FrameIndexEntry
+{
+  epicsUInt64 sequence;   /**< Frame number since the file was created, starting from 1 (0 = empty slot) */
+  epicsUInt32 secPastEpoch;
+  epicsUInt32 nsec;
+  epicsUInt32 headerSize;
+  epicsUInt32 dataSize;
+};
+
+/**
+ * Appends received frames to a preallocated, memory-mapped ring file.  When
+ * the ring is full the oldest frame is overwritten.  All member functions
+ * are thread safe.
+ */
+class FrameRecorder
+{
+  public:
+    FrameRecorder();
+    ~FrameRecorder();
+
+    bool open(const char *fileName, int numSlots, size_t slotSize);
+    void close();
+    bool isOpen();
+    bool append(const void *pHeader, size_t headerSize, const void *pData, size_t dataSize, const epicsTimeStamp *pTime);
+    double frames();
+    const char *error();
+
+  private:
+    epicsMutexId mutexId;
+    int fd;
+    char *pMap;
+    size_t mapSize;
+    FrameFileHeader *pFileHeader;
+    FrameIndexEntry *pIndex;
+    std::string lastError;
+};
+
+/**
+ * Publishes the frames of a recording file on a ZeroMQ PUB socket from its own
+ * thread, oldest first, with the recorded frame spacing divided by a rate factor.
+ */
+class FrameReplayer
+{
+  public:
+    FrameReplayer();
+    ~FrameReplayer();
+
+    bool start(const char *fileName, const char *endpoint, double rate, bool loop);
+    void stop();
+    bool isRunning();
+    double frames();
+    const char *error();
+    void replayTask();
+
+  private:
+    epicsMutexId mutexId;
+    epicsEventId stopEventId;
+    epicsEventId exitEventId;
+    std::string fileName;
+    std::string endpoint;
+    std::string lastError;
+    double rate;
+    bool loop;
+    bool running;
+    double published;
+};
+
+#endif
@@ -0,0 +1,141 @@
+/* latencyHistogram.cpp
+ *
+ * Log-linear latency histogram used by the electron analyser drivers to
+ * report timing statistics.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+
+#include "latencyHistogram.h"
+
+/**
+ * LatencyHistogram constructor, the histogram starts empty.
+ */
+LatencyHistogram::LatencyHistogram()
+{
+  reset();
+}
+
+/**
+ * Add one latency to the histogram.
+ * \param[in] seconds The latency in seconds, negative values are recorded as 0.
+ */
+void LatencyHistogram::record(double seconds)
+{
+  if (seconds < 0.0){
+    seconds = 0.0;
+  }
+  buckets[bucketIndex((epicsUInt64)(seconds * 1.0e6))]++;
+  samples += 1.0;
+  sum += seconds;
+  if (seconds > maximum){
+    maximum = seconds;
+  }
+}
+
+/**
+ * Clear all recorded values.
+ */
+void LatencyHistogram::reset()
+{
+  memset(buckets, 0, sizeof(buckets));
+  samples = 0.0;
+  sum = 0.0;
+  maximum = 0.0;
+}
+
+/**
+ * \return The number of recorded values.
+ */
+double LatencyHistogram::count() const
+{
+  return samples;
+}
+
+/**
+ * \return The mean latency in seconds.
+ */
+double LatencyHistogram::mean() const
+{
+  return samples > 0.0 ? sum / samples : 0.0;
+}
+
+/**
+ * \return The largest recorded latency in seconds.
+ */
+double LatencyHistogram::max() const
+{
+  return maximum;
+}
+
+/**
+ * \param[in] percent The percentile to return, from 0 to 100.
+ * \return The latency in seconds below which the given percentage of the values lie.
+ */
+double LatencyHistogram::percentile(double percent) const
+{
+  double target = samples * percent / 100.0;
+  double seen = 0.0;
+
+  if (samples <= 0.0){
+    return 0.0;
+  }
+  for (int index = 0; index < LATENCY_RANGES * LATENCY_SUB_BUCKETS; index++){
+    seen += buckets[index];
+    if (buckets[index] != 0 && seen >= target){
+      double value = bucketValue(index) * 1.0e-6;
+      return value < maximum ? value : maximum;
+    }
+  }
+  return maximum;
+}
+
+/**
+ * Print a one line summary of the histogram.
+ * \param[in] fp File pointer passed by caller where the output is written to.
+ * \param[in] name Label printed in front of the statistics.
+ */
+void LatencyHistogram::report(FILE *fp, const char *name) const
+{
+  fprintf(fp, "  %-18s n=%.0f mean=%.3f p50=%.3f p90=%.3f p99=%.3f max=%.3f ms\n",
+          name, samples, mean() * 1.0e3, percentile(50.0) * 1.0e3, percentile(90.0) * 1.0e3,
+          percentile(99.0) * 1.0e3, maximum * 1.0e3);
+}
+
+/**
+ * Values below LATENCY_SUB_BUCKETS have a bucket each, above that every
+ * power of two range is split into LATENCY_SUB_BUCKETS linear buckets.
+ */
+int LatencyHistogram::bucketIndex(epicsUInt64 micros)
+{
+  if (micros < LATENCY_SUB_BUCKETS){
+    return (int)micros;
+  }
+  // Shift the value until it lies in [LATENCY_SUB_BUCKETS, 2*LATENCY_SUB_BUCKETS)
+  int shift = 0;
+  while ((micros >> shift) >= 2 * LATENCY_SUB_BUCKETS){
+    shift++;
+  }
+  if (shift + 1 >= LATENCY_RANGES){
+    return LATENCY_RANGES * LATENCY_SUB_BUCKETS - 1;
+  }
+  int sub = (int)(micros >> shift) - LATENCY_SUB_BUCKETS;
+  return (shift + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+/**
+ * \return The upper edge, in microseconds, of a bucket.
+ */
+double LatencyHistogram::bucketValue(int index)
+{
+  int range = index / LATENCY_SUB_BUCKETS;
+  int sub = index % LATENCY_SUB_BUCKETS;
+  if (range == 0){
+    return (double)(sub + 1);
+  }
+  return (double)(((epicsUInt64)(LATENCY_SUB_BUCKETS + sub + 1)) << (range - 1));
+}
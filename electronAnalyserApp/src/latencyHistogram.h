@@ -0,0 +1,49 @@
+/* latencyHistogram.h
+ *
+ * Log-linear latency histogram used by the electron analyser drivers to
+ * report timing statistics.
+ *
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdio.h>
+
+#include <epicsTypes.h>
+
+/**
+ * Records latencies in microseconds into buckets whose width doubles with
+ * every power of two, each power of two being split into a fixed number of
+ * linear sub-buckets (as in an HDR histogram).  This keeps the relative
+ * error of a percentile below 1/LATENCY_SUB_BUCKETS from 1 us to over an hour
+ * with a fixed, small amount of memory and no allocation when recording.
+ */
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_RANGES 32
+
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram();
+
+    void record(double seconds);
+    void reset();
+    double count() const;
+    double mean() const;
+    double max() const;
+    double percentile(double percent) const;
+    void report(FILE *fp, const char *name) const;
+
+  private:
+    static int bucketIndex(epicsUInt64 micros);
+    static double bucketValue(int index);
+
+    epicsUInt32 buckets[LATENCY_RANGES * LATENCY_SUB_BUCKETS];
+    double samples;
+    double sum;
+    double maximum;
+};
+
+#endif
@@ -0,0 +1,193 @@
+/* momentumMap.cpp
+ *
+ * Conversion of electron analyser energy-angle images to energy and
+ * parallel momentum.
+ *
+ */
+
+#include <stddef.h>
+#include <math.h>
+
+#include "momentumMap.h"
+
+#define DEGREES_TO_RADIANS (3.14159265358979323846 / 180.0)
+
+/**
+ * MomentumMap constructor
+ * \param[in] threads Number of threads used to convert each image.
+ */
+MomentumMap::MomentumMap(int threads) :
+  valid(false),
+  channels(0),
+  slices(0),
+  start(0.0),
+  step(0.0),
+  pIn(0),
+  pOut(0)
+{
+  pool = new ViewerWorkerPool("MomentumMap", threads);
+}
+
+/**
+ * MomentumMap destructor
+ */
+MomentumMap::~MomentumMap()
+{
+  delete pool;
+}
+
+/**
+ * \return The number of threads used to convert each image.
+ */
+int MomentumMap::numThreads() const
+{
+  return pool->size();
+}
+
+/**
+ * Build the map for the axes of a region.  The momentum axis has as many
+ * points as there are slices and covers the momenta reached by any channel.
+ *
+ * \param[in] kineticEnergy Kinetic energy (eV) of each channel.
+ * \param[in] angle Emission angle (degrees) of each slice, monotonic.
+ */
+void MomentumMap::build(const std::vector<double> &kineticEnergy, const std::vector<double> &angle)
+{
+  double minRoot, maxRoot, root, sinFirst, sinLast, sinMin, sinMax, k, s, theta;
+  bool reversed;
+  int i, j, p;
+
+  valid = false;
+  channels = (int)kineticEnergy.size();
+  slices = (int)angle.size();
+  if (channels < 1 || slices < 2){
+    return;
+  }
+
+  minRoot = maxRoot = sqrt(kineticEnergy[0] > 0.0 ? kineticEnergy[0] : 0.0);
+  for (i = 1; i < channels; i++){
+    root = sqrt(kineticEnergy[i] > 0.0 ? kineticEnergy[i] : 0.0);
+    if (root < minRoot) minRoot = root;
+    if (root > maxRoot) maxRoot = root;
+  }
+  sinFirst = sin(angle[0] * DEGREES_TO_RADIANS);
+  sinLast = sin(angle[slices - 1] * DEGREES_TO_RADIANS);
+  reversed = (sinFirst > sinLast);
+  sinMin = reversed ? sinLast : sinFirst;
+  sinMax = reversed ? sinFirst : sinLast;
+
+  // The largest momenta in either direction come from the highest energy unless the sign flips
+  start = MOMENTUM_FACTOR * (sinMin < 0.0 ? maxRoot : minRoot) * sinMin;
+  step = (MOMENTUM_FACTOR * (sinMax > 0.0 ? maxRoot : minRoot) * sinMax - start) / (slices - 1);
+
+  source0.assign((size_t)channels * slices, -1);
+  source1.assign((size_t)channels * slices, -1);
+  weight.assign((size_t)channels * slices, 0.0);
+  for (i = 0; i < channels; i++){
+    root = MOMENTUM_FACTOR * sqrt(kineticEnergy[i] > 0.0 ? kineticEnergy[i] : 0.0);
+    if (root <= 0.0){
+      continue;
+    }
+    p = 0;
+    for (j = 0; j < slices; j++){
+      k = start + j * step;
+      s = k / root;
+      if (s < sinMin || s > sinMax){
+        continue;
+      }
+      theta = asin(s) / DEGREES_TO_RADIANS;
+      // Find the pair of slices around theta, walking in increasing angle order
+      while (p < slices - 2 && angle[reversed ? slices - 2 - p : p + 1] < theta){
+        p++;
+      }
+      int s0 = reversed ? slices - 1 - p : p;
+      int s1 = reversed ? slices - 2 - p : p + 1;
+      double w = (angle[s1] != angle[s0]) ? (theta - angle[s0]) / (angle[s1] - angle[s0]) : 0.0;
+      if (w < 0.0) w = 0.0;
+      if (w > 1.0) w = 1.0;
+      size_t out = (size_t)j * channels + i;
+      source0[out] = s0 * channels + i;
+      source1[out] = s1 * channels + i;
+      weight[out] = w;
+    }
+  }
+  valid = true;
+}
+
+/**
+ * \return true if the map matches a region.
+ */
+bool MomentumMap::isValid() const
+{
+  return valid;
+}
+
+/**
+ * \return The number of channels of the region the map was built for.
+ */
+int MomentumMap::getChannels() const
+{
+  return channels;
+}
+
+/**
+ * \return The number of slices of the region the map was built for.
+ */
+int MomentumMap::getSlices() const
+{
+  return slices;
+}
+
+/**
+ * Convert an image of getChannels() x getSlices() to momentum.  Pixels
+ * outside the measured angles are 0.  pIn and pOut must not overlap.
+ */
+void MomentumMap::apply(const double *pInput, double *pOutput)
+{
+  pIn = pInput;
+  pOut = pOutput;
+  pool->run(applyBandC, this, slices < pool->size() * 4 ? slices : pool->size() * 4);
+}
+
+/**
+ * \return The momentum (1/Angstrom) of the first output slice.
+ */
+double MomentumMap::kStart() const
+{
+  return start;
+}
+
+/**
+ * \return The momentum step (1/Angstrom) between output slices.
+ */
+double MomentumMap::kStep() const
+{
+  return step;
+}
+
+void MomentumMap::applyBandC(void *arg, int band, int numBands)
+{
+  ((MomentumMap *)arg)->applyBand(band, numBands);
+}
+
+/**
+ * Convert the output slices of one band.
+ */
+void MomentumMap::applyBand(int band, int numBands)
+{
+  size_t first = (size_t)channels * (slices * band / numBands);
+  size_t last = (size_t)channels * (slices * (band + 1) / numBands);
+  const int *pSource0 = &source0[0];
+  const int *pSource1 = &source1[0];
+  const double *pWeight = &weight[0];
+
+  for (size_t out = first; out < last; out++){
+    int s0 = pSource0[out];
+    if (s0 < 0){
+      pOut[out] = 0.0;
+    } else {
+      double a = pIn[s0];
+      pOut[out] = a + pWeight[out] * (pIn[pSource1[out]] - a);
+    }
+  }
+}
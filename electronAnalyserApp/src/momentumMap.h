@@ -0,0 +1,57 @@
+/* momentumMap.h
+ *
+ * Conversion of electron analyser energy-angle images to energy and
+ * parallel momentum.
+ *
+ */
+
+#ifndef MOMENTUMMAP_H
+#define MOMENTUMMAP_H
+
+#include <vector>
+
+#include "viewerWorkerPool.h"
+
+/** k (1/Angstrom) = MOMENTUM_FACTOR * sqrt(kinetic energy (eV)) * sin(angle) */
+#define MOMENTUM_FACTOR 0.512317
+
+/**
+ * Precomputed gather map from an image of channels (energy) x slices (angle)
+ * to an image of the same size whose slices are on a uniform parallel
+ * momentum axis.  Each output pixel is interpolated between two slices of the
+ * same channel.  The map only depends on the energy and angle axes, so it is
+ * built once per region and applied to every image on several threads.
+ */
+class MomentumMap
+{
+  public:
+    MomentumMap(int threads);
+    ~MomentumMap();
+
+    int numThreads() const;
+    void build(const std::vector<double> &kineticEnergy, const std::vector<double> &angle);
+    bool isValid() const;
+    int getChannels() const;
+    int getSlices() const;
+    void apply(const double *pIn, double *pOut);
+    double kStart() const;
+    double kStep() const;
+
+  private:
+    static void applyBandC(void *arg, int band, int numBands);
+    void applyBand(int band, int numBands);
+
+    ViewerWorkerPool *pool;
+    bool valid;
+    int channels;
+    int slices;
+    double start;
+    double step;
+    std::vector<int> source0;   /**< Index of the lower source pixel of each output pixel, -1 outside the measured angles */
+    std::vector<int> source1;   /**< Index of the upper source pixel of each output pixel */
+    std::vector<double> weight; /**< Weight of the upper source pixel */
+    const double *pIn;
+    double *pOut;
+};
+
+#endif
@@ -0,0 +1,55 @@
+/* spectrumProjector.h
+ *
+ * Projection of live camera frames onto the energy and angle axes
+ * for the electron analyser viewer.
+ *
+ */
+
+#ifndef SPECTRUMPROJECTOR_H
+#define SPECTRUMPROJECTOR_H
+
+#include <vector>
+
+#include "NDArray.h"
+
+/**
+ * Sums the pixels of a detector region into a 1D energy profile (one value
+ * per column, summed over the rows) and a 1D angle profile (one value per
+ * slice, summed over the columns).
+ *
+ * The region uses the same 1-based, inclusive channel numbering as the
+ * FIRST_X_CHANNEL, LAST_X_CHANNEL, FIRST_Y_CHANNELS and LAST_Y_CHANNELS
+ * parameters of the main driver, and the rows are binned into a number of
+ * slices like DETECTOR_SLICES.
+ */
+class SpectrumProjector
+{
+  public:
+    SpectrumProjector();
+
+    void setRegion(int firstXChannel, int lastXChannel, int firstYChannel, int lastYChannel, int slices);
+    bool project(const void *pData, NDDataType_t dataType, int width, int height);
+
+    int numChannels() const;
+    int numSlices() const;
+    double *energyProfile();
+    double *angleProfile();
+
+  private:
+    template <typename T> void projectRows(const T *pData, int width);
+
+    std::vector<double> energy;
+    std::vector<double> angle;
+    int firstX;
+    int lastX;
+    int firstY;
+    int lastY;
+    int slices;
+    int x0;
+    int x1;
+    int y0;
+    int y1;
+    int numSlicesUsed;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/* viewerWorkerPool.cpp
+ *
+ * A small pool of EPICS threads used by the electron analyser viewer
+ * to process a frame in horizontal bands on several cores.
+ *
+ */
+
+#include <stdio.h>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsStdio.h>
+
+#include "viewerWorkerPool.h"
+
+/**
+ * Make use of a c thread to call into the pool and run the worker loop.
+ */
+static void viewerWorkerTaskC(void *drvPvt)
+{
+  ViewerWorkerPool::Worker *pWorker = (ViewerWorkerPool::Worker *)drvPvt;
+  pWorker->pool->workerTask(pWorker->index);
+}
+
+/**
+ * ViewerWorkerPool constructor. Creates numThreads-1 worker threads, the
+ * thread calling run() acts as the last worker.
+ * \param[in] name Prefix used for the worker thread names.
+ * \param[in] numThreads Total number of threads that process bands.
+ */
+ViewerWorkerPool::ViewerWorkerPool(const char *name, int numThreads) :
+  function(0),
+  arg(0),
+  numBands(0),
+  nextBand(0),
+  bandsDone(0),
+  running(0),
+  exiting(false)
+{
+  char threadName[64];
+
+  if (numThreads < 1){
+    numThreads = 1;
+  }
+  mutexId = epicsMutexMustCreate();
+  doneEventId = epicsEventCreate(epicsEventEmpty);
+  exitEventId = epicsEventCreate(epicsEventEmpty);
+
+  workers.resize(numThreads - 1);
+  for (size_t index = 0; index < workers.size(); index++){
+    workers[index].pool = this;
+    workers[index].index = (int)index;
+    workers[index].startEventId = epicsEventCreate(epicsEventEmpty);
+  }
+  for (size_t index = 0; index < workers.size(); index++){
+    epicsSnprintf(threadName, sizeof(threadName), "%s%d", name, (int)index);
+    if (epicsThreadCreate(threadName,
+                          epicsThreadPriorityMedium,
+                          epicsThreadGetStackSize(epicsThreadStackMedium),
+                          (EPICSTHREADFUNC)viewerWorkerTaskC,
+                          &workers[index]) != NULL){
+      running++;
+    }
+  }
+}
+
+/**
+ * ViewerWorkerPool destructor. Asks each worker to exit and waits for them.
+ */
+ViewerWorkerPool::~ViewerWorkerPool()
+{
+  epicsMutexLock(mutexId);
+  exiting = true;
+  epicsMutexUnlock(mutexId);
+  for (size_t index = 0; index < workers.size(); index++){
+    epicsEventSignal(workers[index].startEventId);
+  }
+  epicsMutexLock(mutexId);
+  while (running > 0){
+    epicsMutexUnlock(mutexId);
+    epicsEventWait(exitEventId);
+    epicsMutexLock(mutexId);
+  }
+  epicsMutexUnlock(mutexId);
+  for (size_t index = 0; index < workers.size(); index++){
+    epicsEventDestroy(workers[index].startEventId);
+  }
+  epicsEventDestroy(exitEventId);
+  epicsEventDestroy(doneEventId);
+  epicsMutexDestroy(mutexId);
+}
+
+/**
+ * \return The number of threads, including the caller, that process bands.
+ */
+int ViewerWorkerPool::size() const
+{
+  return (int)workers.size() + 1;
+}
+
+/**
+ * Calls function(arg, band, numBands) once for every band and returns when all
+ * bands have been processed.  Must only be called from one thread at a time.
+ */
+void ViewerWorkerPool::run(WorkFunction fn, void *fnArg, int bands)
+{
+  if (bands <= 0){
+    return;
+  }
+  epicsMutexLock(mutexId);
+  function = fn;
+  arg = fnArg;
+  numBands = bands;
+  nextBand = 0;
+  bandsDone = 0;
+  epicsMutexUnlock(mutexId);
+
+  for (size_t index = 0; index < workers.size() && (int)index < bands - 1; index++){
+    epicsEventSignal(workers[index].startEventId);
+  }
+  processBands();
+  epicsEventWait(doneEventId);
+}
+
+/**
+ * Loop run by each worker thread until the pool is destroyed.
+ */
+void ViewerWorkerPool::workerTask(int index)
+{
+  while (1){
+    epicsEventWait(workers[index].startEventId);
+    epicsMutexLock(mutexId);
+    bool exit = exiting;
+    epicsMutexUnlock(mutexId);
+    if (exit){
+      break;
+    }
+    processBands();
+  }
+  epicsMutexLock(mutexId);
+  running--;
+  epicsMutexUnlock(mutexId);
+  epicsEventSignal(exitEventId);
+}
+
+/**
+ * Takes bands from the shared counter until none are left.  The thread that
+ * completes the last band signals the caller of run().
+ */
+void ViewerWorkerPool::processBands()
+{
+  while (1){
+    epicsMutexLock(mutexId);
+    if (nextBand >= numBands){
+      epicsMutexUnlock(mutexId);
+      break;
+    }
+    int band = nextBand++;
+    WorkFunction fn = function;
+    void *fnArg = arg;
+    int bands = numBands;
+    epicsMutexUnlock(mutexId);
+
+    fn(fnArg, band, bands);
+
+    epicsMutexLock(mutexId);
+    bandsDone++;
+    if (bandsDone == numBands){
+      epicsEventSignal(doneEventId);
+    }
+    epicsMutexUnlock(mutexId);
+  }
+}
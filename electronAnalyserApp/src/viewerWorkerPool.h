@@ -0,0 +1,57 @@
+/* viewerWorkerPool.h
+ *
+ * A small pool of EPICS threads used by the electron analyser viewer
+ * to process a frame in horizontal bands on several cores.
+ *
+ */
+
+#ifndef VIEWERWORKERPOOL_H
+#define VIEWERWORKERPOOL_H
+
+#include <vector>
+
+#include <epicsThread.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+
+/**
+ * Runs a band processing function on a fixed set of worker threads.
+ *
+ * The caller of run() also processes bands, so a pool of size 1 creates
+ * no threads at all and runs the work inline.
+ */
+class ViewerWorkerPool
+{
+  public:
+    typedef void (*WorkFunction)(void *arg, int band, int numBands);
+
+    struct Worker
+    {
+      ViewerWorkerPool *pool;
+      int index;
+      epicsEventId startEventId;
+    };
+
+    ViewerWorkerPool(const char *name, int numThreads);
+    ~ViewerWorkerPool();
+    int size() const;
+    void run(WorkFunction function, void *arg, int numBands);
+    void workerTask(int index);
+
+  private:
+    void processBands();
+
+    std::vector<Worker> workers;
+    epicsMutexId mutexId;
+    epicsEventId doneEventId;
+    epicsEventId exitEventId;
+    WorkFunction function;
+    void *arg;
+    int numBands;
+    int nextBand;
+    int bandsDone;
+    int running;
+    bool exiting;
+};
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef __SESWRAPPER_C_FUNCTION_HPP__
 #define __SESWRAPPER_C_FUNCTION_HPP__
 
+#ifndef _WIN32
+#define __stdcall
+#endif
+
 class NoArg {};
 
 /*!
@@ -11,6 +11,7 @@
 namespace CommonNS
 {
   template<typename T> int split(std::string buffer, const std::string &delimiter, std::vector<T> &result);
+  template<typename T> int forEachQuoted(const char *buffer, int bufferSize, T &add);
   template<typename T> void copyString(const std::string &src, T trg, unsigned int trgSize);
   template<typename T> bool resolve(void *library, const char *name, T &function);
 }
@@ -24,19 +24,52 @@ namespace CommonNS
   template<typename T> int split(std::string buffer, const std::string &delimiter, std::vector<T> &result)
   {
     result.clear();
-    int pos = buffer.find(delimiter);
+    std::string::size_type start = 0;
+    std::string::size_type pos = buffer.find(delimiter);
     while (pos != buffer.npos)
     {
-      if (pos > 0)
-        result.push_back(buffer.substr(0, pos));
-      buffer = buffer.substr(pos + delimiter.length());
-      pos = buffer.find(delimiter);
+      if (pos > start)
+        result.push_back(buffer.substr(start, pos - start));
+      start = pos + delimiter.length();
+      pos = buffer.find(delimiter, start);
     }
-    if (buffer.length() > 0)
-      result.push_back(buffer);
+    if (start < buffer.length())
+      result.push_back(buffer.substr(start));
 
     return result.size();
   }
+
+  /*!
+   * This function scans a list as returned by the SESInstrument list functions, where each element is wrapped
+   * between quotation marks (") and separated with space (e.g. '"element 1" "element 2"'). The list is read in a
+   * single pass and \p add is called with the start and length of each element, which is not null-terminated.
+   *
+   * \param[in] buffer The list to be scanned.
+   * \param[in] bufferSize The maximum size of \p buffer, in case the list lacks the null termination.
+   * \param[in] add A function or function object called as <code>add(const char *element, int length)</code>.
+   *
+   * \return Returns the number of elements found.
+   */
+  template<typename T> int forEachQuoted(const char *buffer, int bufferSize, T &add)
+  {
+    int count = 0;
+    const char *end = buffer + bufferSize;
+    const char *pos = buffer;
+    while (pos < end && *pos != 0)
+    {
+      if (*pos++ != '"')
+        continue;
+      const char *element = pos;
+      while (pos < end && *pos != 0 && *pos != '"')
+        pos++;
+      add(element, int(pos - element));
+      count++;
+      if (pos < end && *pos == '"')
+        pos++;
+    }
+
+    return count;
+  }
 }
 
 #endif
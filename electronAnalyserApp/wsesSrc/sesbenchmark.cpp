@@ -0,0 +1,289 @@
+#include "wseswrappermain.h"
+#include "werror.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <new>
+#include <string>
+#include <vector>
+
+/*!
+ * \file sesbenchmark.cpp
+ * \brief Acquisition throughput benchmark.
+ *
+ * Runs swept acquisitions through WSESWrapperMain against an SESInstrument library (normally the simulator in
+ * sesinstrumentsim.cpp) over a matrix of region sizes, step counts, dwell times and iterations. Each acquisition
+ * follows the driver's acquireData(): every point is blocked, its spectrum, image and External I/O data are read
+ * with getAcquiredData() and the point is continued. When the region is ready the image of the iteration is copied
+ * into the array that is published. One JSON object is printed per configuration so that results can be compared
+ * between releases.
+ *
+ * \c bytes_per_image counts the bytes the getters and the final copy moved. \c allocations_per_image counts the
+ * C++ allocations made by the wrapper and the library while an iteration ran. The buffers the data are read into
+ * are allocated once per configuration, as the driver allocates them once per image, and are not counted.
+ *
+ * \c region_latency_us is the time from the RegionReady callback of the library until the published copy of the
+ * image is complete. The simulator reports when it made the callback with SIM_GetRegionReadyTime(), other libraries
+ * do not, in which case the latency is reported as null.
+ *
+ * Usage: <code>sesBenchmark [library] [maxSeconds]</code>. Configurations whose modelled acquisition time exceeds
+ * \c maxSeconds (default 5) are skipped.
+ */
+
+namespace
+{
+  volatile long allocations = 0;
+
+  typedef double (*RegionReadyTime)();
+
+  double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  struct Config
+  {
+    int channels;
+    int slices;
+    int windowChannels;
+    int dwellMs;
+    int iterations;
+  };
+
+  struct Result
+  {
+    int steps;
+    int points;
+    double seconds;
+    double modelledSeconds;
+    double latency;
+    double bytesPerImage;
+    double allocationsPerImage;
+  };
+
+  /*!
+   * Prepares a working directory with the simulator in the place of the instrument library.
+   */
+  std::string makeWorkingDir(const char *library)
+  {
+    char dir[] = "/tmp/sesBenchmarkXXXXXX";
+    if (mkdtemp(dir) == 0)
+      return "";
+    std::string path = dir;
+    mkdir((path + "/dll").c_str(), 0755);
+    std::string target = library;
+    if (target[0] != '/')
+    {
+      char *cwd = getcwd(0, 0);
+      target = std::string(cwd) + "/" + target;
+      free(cwd);
+    }
+    if (symlink(target.c_str(), (path + "/" INSTRUMENT_LIBRARY).c_str()) != 0)
+      return "";
+    return path;
+  }
+
+  /*!
+   * Reads the data of one point as the driver does.
+   *
+   * \return The number of bytes copied.
+   */
+  double readPoint(WSESWrapperMain *wrapper, std::vector<double> &spectrum, std::vector<double> &image,
+                   std::vector<double> &ioData, int ports)
+  {
+    double bytes = 0;
+    int size = (int)spectrum.size();
+    if (wrapper->getAcquiredData(WSESWrapperMain::ACQ_SPECTRUM, 0, &spectrum[0], size) == WError::ERR_OK)
+      bytes += size * sizeof(double);
+    size = (int)image.size();
+    if (wrapper->getAcquiredData(WSESWrapperMain::ACQ_IMAGE, 0, &image[0], size) == WError::ERR_OK)
+      bytes += size * sizeof(double);
+    size = (int)ioData.size();
+    if (ports > 0 && wrapper->getAcquiredData(WSESWrapperMain::ACQ_IO_DATA, 0, &ioData[0], size) == WError::ERR_OK)
+      bytes += size * sizeof(double);
+    return bytes;
+  }
+
+  /*!
+   * Runs one configuration. The region is swept so that it has \c channels channels and the detector window covers
+   * \c windowChannels of them, which gives channels + windowChannels - 1 steps.
+   */
+  bool run(WSESWrapperMain *wrapper, RegionReadyTime regionReadyTime, const Config &config, double maxSeconds,
+           Result &result)
+  {
+    const double passEnergy = 20; /* The pass energy the simulator starts with */
+    SESWrapperNS::DetectorRegion detector = {0, config.channels - 1, 0, config.slices - 1, config.slices, 1};
+    SESWrapperNS::AnalyzerRegion region;
+    region.fixed_ = false;
+    region.energyStep_ = 0.1 * passEnergy / config.windowChannels;
+    region.lowEnergy_ = 100;
+    region.highEnergy_ = region.lowEnergy_ + (config.channels - 1) * region.energyStep_;
+    region.centerEnergy_ = (region.lowEnergy_ + region.highEnergy_) / 2;
+    region.dwellTime_ = config.dwellMs;
+
+    int steps = 0;
+    double time_ms = 0, minEnergyStep = 0;
+    /* checkAnalyzerRegion() checks the region that has been set */
+    if (wrapper->setProperty("detector_region", 0, &detector) != WError::ERR_OK ||
+        wrapper->setProperty("analyzer_region", 0, &region) != WError::ERR_OK ||
+        wrapper->checkAnalyzerRegion(&region, &steps, &time_ms, &minEnergyStep) != WError::ERR_OK)
+      return false;
+    result.modelledSeconds = time_ms * config.iterations / 1000.0;
+    if (result.modelledSeconds > maxSeconds)
+      return false;
+
+    /* As the driver, block every point until its data have been read */
+    if (wrapper->initAcquisition(true, false) != WError::ERR_OK)
+      return false;
+
+    int channels = 0, slices = 0, ports = 0, ioSize = 0;
+    wrapper->getAcquiredData(WSESWrapperMain::ACQ_CHANNELS, channels);
+    wrapper->getAcquiredData(WSESWrapperMain::ACQ_SLICES, slices);
+    wrapper->getAcquiredData(WSESWrapperMain::ACQ_IO_PORTS, ports);
+    wrapper->getAcquiredData(WSESWrapperMain::ACQ_IO_SIZE, ioSize);
+    if (channels <= 0 || slices <= 0)
+      return false;
+    std::vector<double> spectrum(channels);
+    std::vector<double> image((size_t)channels * slices);
+    std::vector<double> published(image.size());
+    std::vector<double> ioData(ports > 0 ? (size_t)ports * (ioSize > steps ? ioSize : steps) : 1);
+
+    int timeout = config.dwellMs + 60000;
+    double bytes = 0, latency = 0;
+    long allocated = 0;
+    int points = 0;
+    double start = now();
+    for (int iteration = 0; iteration < config.iterations; iteration++)
+    {
+      long before = allocations;
+      if (wrapper->startAcquisition() != WError::ERR_OK)
+        return false;
+      for (int step = 0; step < steps; step++)
+      {
+        if (wrapper->waitForPointReady(timeout) != WError::ERR_OK)
+          return false;
+        int currentStep = 0;
+        wrapper->getAcquiredData(WSESWrapperMain::ACQ_CURRENT_STEP, currentStep);
+        points++;
+        /* The points of the lead in have no data */
+        if (currentStep > steps - channels)
+          bytes += readPoint(wrapper, spectrum, image, ioData, ports);
+        wrapper->continueAcquisition();
+      }
+      if (wrapper->waitForRegionReady(timeout) != WError::ERR_OK)
+        return false;
+
+      memcpy(&published[0], &image[0], image.size() * sizeof(double));
+      if (regionReadyTime != 0)
+        latency += now() - regionReadyTime();
+      bytes += image.size() * sizeof(double);
+      allocated += allocations - before;
+    }
+    result.seconds = now() - start;
+    result.steps = steps;
+    result.points = points;
+    result.latency = regionReadyTime != 0 ? latency / config.iterations : -1;
+    result.bytesPerImage = bytes / config.iterations;
+    result.allocationsPerImage = (double)allocated / config.iterations;
+    return true;
+  }
+}
+
+#if __cplusplus >= 201103L
+#define THROW_BAD_ALLOC
+#define THROW_NOTHING noexcept
+#else
+#define THROW_BAD_ALLOC throw(std::bad_alloc)
+#define THROW_NOTHING throw()
+#endif
+
+/* Count every allocation, including those of the wrapper and the library, so each iteration can report them */
+void *operator new(size_t size) THROW_BAD_ALLOC
+{
+  __sync_fetch_and_add(&allocations, 1);
+  void *p = malloc(size ? size : 1);
+  if (p == 0)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) THROW_BAD_ALLOC
+{
+  return operator new(size);
+}
+
+void operator delete(void *p) THROW_NOTHING
+{
+  free(p);
+}
+
+void operator delete[](void *p) THROW_NOTHING
+{
+  free(p);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *libraryName = argc > 1 ? argv[1] : "libSESInstrumentSim.so";
+  double maxSeconds = argc > 2 ? atof(argv[2]) : 5;
+  const int sizes[][2] = {{100, 1}, {100, 100}, {500, 100}, {1000, 900}};
+  const int windows[] = {1, 20};
+  const int dwells[] = {0, 10};
+  const int iterations[] = {1, 3};
+
+  /* Unless asked otherwise, time the driver rather than the detector */
+  setenv("SES_SIM_FRAME_RATE", "100000", 0);
+  setenv("SES_SIM_SETTLE_MS", "0", 0);
+  setenv("SES_SIM_SETTLE_MS_PER_EV", "0", 0);
+
+  std::string workingDir = makeWorkingDir(libraryName);
+  WSESWrapperMain *wrapper = WSESWrapperMain::instance();
+  if (workingDir.empty() || wrapper->setProperty("lib_working_dir", 0, workingDir.c_str()) != WError::ERR_OK ||
+      wrapper->initialize(0) != WError::ERR_OK || wrapper->loadInstrument("simulator") != WError::ERR_OK)
+  {
+    fprintf(stderr, "Could not load %s\n", libraryName);
+    return 1;
+  }
+
+  /* The wrapper has loaded the library, look up the simulator's callback time in it */
+  void *library = dlopen((workingDir + "/" INSTRUMENT_LIBRARY).c_str(), RTLD_NOW | RTLD_NOLOAD);
+  RegionReadyTime regionReadyTime = library != 0 ? (RegionReadyTime)dlsym(library, "SIM_GetRegionReadyTime") : 0;
+
+  for (int s = 0; s < int(sizeof(sizes) / sizeof(sizes[0])); s++)
+    for (int w = 0; w < int(sizeof(windows) / sizeof(windows[0])); w++)
+      for (int d = 0; d < int(sizeof(dwells) / sizeof(dwells[0])); d++)
+        for (int i = 0; i < int(sizeof(iterations) / sizeof(iterations[0])); i++)
+        {
+          Config config = {sizes[s][0], sizes[s][1], windows[w], dwells[d], iterations[i]};
+          Result result;
+          if (!run(wrapper, regionReadyTime, config, maxSeconds, result))
+            continue;
+          char latency[32] = "null";
+          if (result.latency >= 0)
+            snprintf(latency, sizeof(latency), "%.2f", 1e6 * result.latency);
+          printf("{\"channels\": %d, \"slices\": %d, \"steps\": %d, \"dwell_ms\": %d, \"iterations\": %d, "
+                 "\"points_per_s\": %.1f, \"overhead_us_per_point\": %.2f, \"region_latency_us\": %s, "
+                 "\"bytes_per_image\": %.0f, \"allocations_per_image\": %.1f}\n",
+                 config.channels, config.slices, result.steps, config.dwellMs, config.iterations,
+                 result.points / result.seconds,
+                 1e6 * (result.seconds - result.modelledSeconds) / (result.points > 0 ? result.points : 1),
+                 latency, result.bytesPerImage, result.allocationsPerImage);
+          fflush(stdout);
+        }
+
+  if (library != 0)
+    dlclose(library);
+  wrapper->finalize();
+  wrapper->release();
+  unlink((workingDir + "/" INSTRUMENT_LIBRARY).c_str());
+  rmdir((workingDir + "/dll").c_str());
+  rmdir(workingDir.c_str());
+  return 0;
+}
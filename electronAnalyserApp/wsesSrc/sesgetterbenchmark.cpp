@@ -0,0 +1,268 @@
+#include "wseswrappermain.h"
+#include "wsesinstrument.h"
+#include "werror.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+/*!
+ * \file sesgetterbenchmark.cpp
+ * \brief Microbenchmarks of the WSESWrapperMain data getters.
+ *
+ * An acquisition is made with the simulated SESInstrument library for each image size, so that the wrapper holds a
+ * real WSpectrum. The hot getters are then timed three times: called directly, through getAcquiredData() with its
+ * name lookup, and through getAcquiredData() with the DataParameterId of the getter, so the differences are the
+ * cost of the lookup and of the dispatch by ID. Each copy is compared with a memcpy of the same number
+ * of bytes between contiguous buffers, which is the roofline the getters can reach.
+ *
+ * The spectrum rows are timed in two layouts: contiguous, as the simulator allocates them, and scattered, with
+ * every row in an allocation of its own as a row-pointer matrix may be.
+ *
+ * Usage: <code>sesGetterBenchmark [library]</code>, where \c library is the simulator (default libSESInstrumentSim.so).
+ * One JSON object is printed per getter, size and layout.
+ */
+
+namespace
+{
+  double now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+  }
+
+  typedef int (WSESWrapperMain::*Getter)(int index, void *data, int &size);
+
+  struct GetterInfo
+  {
+    const char *name;
+    WSESWrapperMain::DataParameterId id;
+    Getter getter;
+    bool perSlice;
+  };
+
+  const GetterInfo getters[] =
+  {
+    {"acq_channels", WSESWrapperMain::ACQ_CHANNELS, &WSESWrapperMain::getAcqChannels, false},
+    {"acq_image", WSESWrapperMain::ACQ_IMAGE, &WSESWrapperMain::getAcqImage, false},
+    {"acq_spectrum", WSESWrapperMain::ACQ_SPECTRUM, &WSESWrapperMain::getAcqSpectrum, false},
+    {"acq_slice", WSESWrapperMain::ACQ_SLICE, &WSESWrapperMain::getAcqSlice, true},
+    {"acq_channel_intensity", WSESWrapperMain::ACQ_CHANNEL_INTENSITY, &WSESWrapperMain::getAcqChannelIntensity, true},
+    {"acq_io_data", WSESWrapperMain::ACQ_IO_DATA, &WSESWrapperMain::getAcqIOData, false}
+  };
+
+  volatile double sink = 0;
+
+  /*!
+   * Repeats \p call for at least \p seconds and returns the time of one call in seconds.
+   */
+  template<typename Call> double timeCall(Call &call, double seconds)
+  {
+    int repeats = 1;
+    while (true)
+    {
+      double start = now();
+      for (int i = 0; i < repeats; i++)
+        call();
+      double elapsed = now() - start;
+      if (elapsed >= seconds)
+        return elapsed / repeats;
+      repeats *= elapsed > 0 ? (int)(2 * seconds / elapsed) + 1 : 2;
+    }
+  }
+
+  struct DirectCall
+  {
+    WSESWrapperMain *wrapper;
+    Getter getter;
+    int index;
+    void *data;
+    int capacity;
+    int size;
+
+    void operator()()
+    {
+      size = capacity;
+      (wrapper->*getter)(index, data, size);
+      sink = *(double *)data;
+    }
+  };
+
+  struct LookupCall
+  {
+    WSESWrapperMain *wrapper;
+    const char *name;
+    int index;
+    void *data;
+    int capacity;
+    int size;
+
+    void operator()()
+    {
+      size = capacity;
+      wrapper->getAcquiredData(name, index, data, size);
+      sink = *(double *)data;
+    }
+  };
+
+  struct IdCall
+  {
+    WSESWrapperMain *wrapper;
+    WSESWrapperMain::DataParameterId id;
+    int index;
+    void *data;
+    int capacity;
+    int size;
+
+    void operator()()
+    {
+      size = capacity;
+      wrapper->getAcquiredData(id, index, data, size);
+      sink = *(double *)data;
+    }
+  };
+
+  struct MemcpyCall
+  {
+    char *source;
+    char *destination;
+    size_t bytes;
+
+    void operator()()
+    {
+      memcpy(destination, source, bytes);
+      sink = destination[0];
+    }
+  };
+
+  /*!
+   * Prepares a working directory with the simulator in the place of the instrument library.
+   */
+  std::string makeWorkingDir(const char *library)
+  {
+    char dir[] = "/tmp/sesGetterBenchmarkXXXXXX";
+    if (mkdtemp(dir) == 0)
+      return "";
+    std::string path = dir;
+    mkdir((path + "/dll").c_str(), 0755);
+    std::string target = library;
+    if (target[0] != '/')
+    {
+      char *cwd = getcwd(0, 0);
+      target = std::string(cwd) + "/" + target;
+      free(cwd);
+    }
+    if (symlink(target.c_str(), (path + "/" INSTRUMENT_LIBRARY).c_str()) != 0)
+      return "";
+    return path;
+  }
+
+  /*!
+   * Runs a fixed mode acquisition of \p channels x \p slices.
+   */
+  bool acquire(WSESWrapperMain *wrapper, int channels, int slices)
+  {
+    SESWrapperNS::DetectorRegion detector = {0, channels - 1, 0, slices - 1, slices, 1};
+    SESWrapperNS::AnalyzerRegion region = {true, 0, 0, 100, 0, 1};
+    if (wrapper->setProperty("detector_region", 0, &detector) != WError::ERR_OK ||
+        wrapper->setProperty("analyzer_region", 0, &region) != WError::ERR_OK ||
+        wrapper->initAcquisition(false, false) != WError::ERR_OK ||
+        wrapper->startAcquisition() != WError::ERR_OK)
+      return false;
+    return wrapper->waitForRegionReady(-1) == WError::ERR_OK;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const char *libraryName = argc > 1 ? argv[1] : "libSESInstrumentSim.so";
+  const int sizes[][2] = {{100, 1}, {1000, 1}, {200, 200}, {1000, 900}};
+  const double seconds = 0.1;
+
+  setenv("SES_SIM_FRAME_RATE", "100000", 0);
+  setenv("SES_SIM_SETTLE_MS", "0", 0);
+  setenv("SES_SIM_SETTLE_MS_PER_EV", "0", 0);
+
+  std::string workingDir = makeWorkingDir(libraryName);
+  WSESWrapperMain *wrapper = WSESWrapperMain::instance();
+  if (workingDir.empty() || wrapper->setProperty("lib_working_dir", 0, workingDir.c_str()) != WError::ERR_OK ||
+      wrapper->initialize(0) != WError::ERR_OK || wrapper->loadInstrument("simulator") != WError::ERR_OK)
+  {
+    fprintf(stderr, "Could not load %s\n", libraryName);
+    return 1;
+  }
+
+  /* The same library, so the benchmark can rearrange the rows of the spectrum the wrapper reads */
+  WSESInstrument lib;
+  lib.load((workingDir + "/" INSTRUMENT_LIBRARY).c_str());
+
+  for (int s = 0; s < int(sizeof(sizes) / sizeof(sizes[0])); s++)
+  {
+    int channels = sizes[s][0];
+    int slices = sizes[s][1];
+    SesNS::WSpectrum *spectrum = 0;
+    if (!acquire(wrapper, channels, slices) || lib.GDS_GetCurrSpectrum == 0 || (lib.GDS_GetCurrSpectrum(&spectrum), spectrum == 0))
+    {
+      fprintf(stderr, "Acquisition of %d x %d failed\n", channels, slices);
+      continue;
+    }
+
+    size_t imageSize = (size_t)spectrum->Channels * spectrum->Slices;
+    std::vector<double> data(imageSize > 1024 ? imageSize : 1024);
+    std::vector<char> source(imageSize * sizeof(double)), destination(imageSize * sizeof(double));
+
+    SesNS::Matrix contiguous = spectrum->Data;
+    std::vector<double *> scattered(spectrum->Slices);
+    for (int j = 0; j < spectrum->Slices; j++)
+    {
+      /* Separate allocations with some padding, so rows do not end up back to back */
+      scattered[j] = new double[spectrum->Channels + 64];
+      memcpy(scattered[j], contiguous[j], spectrum->Channels * sizeof(double));
+    }
+
+    for (int layout = 0; layout < 2; layout++)
+    {
+      spectrum->Data = layout == 0 ? contiguous : &scattered[0];
+      for (int g = 0; g < int(sizeof(getters) / sizeof(getters[0])); g++)
+      {
+        int index = getters[g].perSlice ? (strcmp(getters[g].name, "acq_slice") == 0 ? spectrum->Slices / 2 : spectrum->Channels / 2) : 0;
+        DirectCall direct = {wrapper, getters[g].getter, index, &data[0], (int)data.size(), 0};
+        LookupCall lookup = {wrapper, getters[g].name, index, &data[0], (int)data.size(), 0};
+        IdCall byId = {wrapper, getters[g].id, index, &data[0], (int)data.size(), 0};
+        double directTime = timeCall(direct, seconds);
+        double lookupTime = timeCall(lookup, seconds);
+        double idTime = timeCall(byId, seconds);
+
+        size_t bytes = getters[g].getter == &WSESWrapperMain::getAcqChannels ? sizeof(int) : direct.size * sizeof(double);
+        MemcpyCall roofline = {&source[0], &destination[0], bytes < source.size() ? bytes : source.size()};
+        double memcpyTime = timeCall(roofline, seconds);
+
+        printf("{\"getter\": \"%s\", \"channels\": %d, \"slices\": %d, \"layout\": \"%s\", \"bytes\": %lu, "
+               "\"direct_ns\": %.1f, \"lookup_ns\": %.1f, \"lookup_overhead_ns\": %.1f, \"id_ns\": %.1f, "
+               "\"id_overhead_ns\": %.1f, \"gb_per_s\": %.2f, \"memcpy_gb_per_s\": %.2f, \"fraction_of_memcpy\": %.3f}\n",
+               getters[g].name, spectrum->Channels, spectrum->Slices, layout == 0 ? "contiguous" : "scattered",
+               (unsigned long)bytes, 1e9 * directTime, 1e9 * lookupTime, 1e9 * (lookupTime - directTime),
+               1e9 * idTime, 1e9 * (idTime - directTime),               bytes / directTime * 1e-9, bytes / memcpyTime * 1e-9, memcpyTime / directTime);
+        fflush(stdout);
+      }
+    }
+
+    spectrum->Data = contiguous;
+    for (int j = 0; j < int(scattered.size()); j++)
+      delete[] scattered[j];
+  }
+
+  lib.unload();
+  wrapper->finalize();
+  wrapper->release();
+  unlink((workingDir + "/" INSTRUMENT_LIBRARY).c_str());
+  rmdir((workingDir + "/dll").c_str());
+  rmdir(workingDir.c_str());
+  return 0;
+}
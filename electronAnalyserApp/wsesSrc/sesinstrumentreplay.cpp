@@ -0,0 +1,945 @@
+#include "sestypes.h"
+#include "wcallstats.h"
+#include "wcapture.h"
+#include "wevent.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/*!
+ * \file sesinstrumentreplay.cpp
+ * \brief A SESInstrument library that replays a session captured with WCapture.
+ *
+ * This library exports the GDS_* functions imported by WSESInstrument::load(), so it can be loaded in place of
+ * SESInstrument.dll to run the wrapper and the IOC against a session recorded on the instrument, e.g. to compare
+ * the throughput and latency of two builds of the driver with the same input.
+ *
+ * Every function answers with the recorded calls of that function in turn: the outputs and the result of the
+ * recorded call are returned after waiting for its recorded duration, and the last recorded call keeps being
+ * answered once they have all been used. A function that was never called in the capture fails. GDS_Start() and
+ * GDS_StartAcquisition() play the callbacks of the acquisition they started in the capture, at their recorded
+ * times relative to the start, updating the spectrum and the signals before each callback. GDS_GetStatus() and
+ * GDS_Stop() follow the acquisitions being played rather than the capture.
+ *
+ * The replay is configured with environment variables read by GDS_Initialize():
+ *
+ * - \c SES_REPLAY_FILE The capture file, written by WCapture. Required.
+ * - \c SES_REPLAY_TIME_SCALE Factor applied to all recorded times: 1 replays with the original timing (default),
+ *   0.5 twice as fast, and 0 without waiting at all.
+ *
+ * The whole capture is read into memory when the library is initialized for the first time.
+ */
+
+using namespace SesNS;
+
+namespace
+{
+  typedef WCaptureReader::Record Record;
+  typedef WCaptureReader::Value Value;
+
+  /*!
+   * Waits for \p seconds, if positive.
+   */
+  void sleepFor(double seconds)
+  {
+    if (seconds <= 0)
+      return;
+    struct timespec ts;
+    ts.tv_sec = time_t(seconds);
+    ts.tv_nsec = long((seconds - ts.tv_sec) * 1e9);
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+      ;
+  }
+
+  /*!
+   * \brief The recorded call that answers one call of a replayed function.
+   */
+  class Reply
+  {
+  public:
+    Reply(const Record *record) : record_(record) {}
+
+    const Record *record() const
+    {
+      return record_;
+    }
+
+    /*!
+     * \return The recorded result, or \p missing if the function was never called in the capture.
+     */
+    template<typename T> T result(T missing) const
+    {
+      T value = missing;
+      if (record_ != 0 && record_->result.type == WCapture::VALUE_DATA && record_->result.bytes.size() == sizeof(T))
+        memcpy(&value, record_->result.bytes.data(), sizeof(T));
+      return value;
+    }
+
+    /*!
+     * \return The recorded string result, or an empty string.
+     */
+    const char *stringResult() const
+    {
+      return record_ != 0 && record_->result.type == WCapture::VALUE_STRING ? record_->result.bytes.c_str() : "";
+    }
+
+    /*!
+     * \return The argument at \p index if it was recorded as \p type, otherwise 0.
+     */
+    const Value *argument(int index, int type) const
+    {
+      if (record_ == 0 || index < 0 || index >= int(record_->arguments.size()) ||
+          record_->arguments[index].type != type)
+        return 0;
+      return &record_->arguments[index];
+    }
+
+    /*!
+     * Copies the recorded output of a pointer argument of a fixed size.
+     */
+    template<typename T> void output(int index, T *value) const
+    {
+      const Value *recorded = argument(index, WCapture::VALUE_OUTPUT);
+      if (value != 0 && recorded != 0 && recorded->bytes.size() == sizeof(T))
+        memcpy(value, recorded->bytes.data(), sizeof(T));
+    }
+
+    /*!
+     * Copies a recorded string output to a buffer of \p size characters, of which the last is the terminating null.
+     */
+    void output(int index, char *buffer, int size) const
+    {
+      const Value *recorded = argument(index, WCapture::VALUE_STRING);
+      if (buffer == 0 || recorded == 0 || size <= 0)
+        return;
+      size_t length = recorded->bytes.size() < size_t(size) ? recorded->bytes.size() : size_t(size - 1);
+      memcpy(buffer, recorded->bytes.data(), length);
+      buffer[length] = 0;
+    }
+
+    /*!
+     * Copies a recorded output buffer whose size depends on other arguments. The caller is trusted to pass a buffer
+     * of the size it passed in the capture.
+     */
+    void output(int index, void *buffer) const
+    {
+      const Value *recorded = argument(index, WCapture::VALUE_OUTPUT);
+      if (buffer != 0 && recorded != 0)
+        memcpy(buffer, recorded->bytes.data(), recorded->bytes.size());
+    }
+
+  private:
+    const Record *record_;
+  };
+
+  /*!
+   * \brief The recorded calls of one function, which answer the calls in turn.
+   */
+  struct Calls
+  {
+    Calls() : next(0) {}
+
+    std::vector<Record> records;
+    size_t next;
+  };
+
+  /*!
+   * \brief The state of the replayed instrument.
+   *
+   * There is one instance, as the real library also keeps its state in globals.
+   */
+  class SESInstrumentReplay
+  {
+  public:
+    SESInstrumentReplay();
+    ~SESInstrumentReplay();
+
+    bool load();
+    Reply call(const char *name);
+    int status();
+    void setCallbacks(PointReady pointReady, RegionReady regionReady);
+    void setSpectrum(const Value *value);
+    void setSignals(const Value *value);
+    void start(const Record *record);
+    void stop();
+
+    bool initialized_;
+    ErrorNotify errorNotify_;
+    WSpectrum spectrum_;
+    WSignals signals_;
+
+  private:
+    void layoutSpectrum(int slices, int channels, int length);
+    void layoutSignals(int count, int steps);
+    void run();
+    static void *runC(void *arg);
+    void join();
+
+    bool loaded_;
+    double timeScale_;
+    std::map<std::string, Calls> calls_;
+    std::map<int, std::vector<Record> > acquisitions_;
+
+    PointReady pointReady_;
+    RegionReady regionReady_;
+    const std::vector<Record> *acquisition_;
+    double acquisitionStart_;
+    bool running_;
+    WEvent abort_;
+    pthread_t thread_;
+    bool threadStarted_;
+    pthread_mutex_t mutex_;
+
+    std::vector<double> values_;
+    std::vector<double *> rows_;
+    std::vector<double> channelScale_;
+    std::vector<double> sliceScale_;
+    std::vector<double> signalValues_;
+    std::vector<double *> signalRows_;
+    std::vector<double> stepsScale_;
+    std::vector<char> signalNames_;
+  };
+
+  SESInstrumentReplay::SESInstrumentReplay()
+    : initialized_(false), errorNotify_(0), loaded_(false), timeScale_(1), pointReady_(0), regionReady_(0),
+      acquisition_(0), acquisitionStart_(0), running_(false), threadStarted_(false)
+  {
+    pthread_mutex_init(&mutex_, 0);
+  }
+
+  SESInstrumentReplay::~SESInstrumentReplay()
+  {
+    stop();
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  /*!
+   * Reads the capture named by \c SES_REPLAY_FILE, the first time it is called.
+   *
+   * \return \c true if the capture has been read.
+   */
+  bool SESInstrumentReplay::load()
+  {
+    if (loaded_)
+      return true;
+
+    const char *timeScale = getenv("SES_REPLAY_TIME_SCALE");
+    timeScale_ = (timeScale != 0 && *timeScale != 0) ? atof(timeScale) : 1;
+    if (timeScale_ < 0)
+      timeScale_ = 0;
+
+    WCaptureReader reader;
+    if (!reader.open(getenv("SES_REPLAY_FILE")))
+      return false;
+
+    std::vector<std::string> names(WCapture::MAX_FUNCTIONS);
+    Record record;
+    while (reader.next(record))
+    {
+      if (record.type == WCapture::RECORD_FUNCTION)
+        names[record.function] = record.name;
+      else if (record.type == WCapture::RECORD_CALL && record.function >= 0 &&
+               record.function < WCapture::MAX_FUNCTIONS && !names[record.function].empty())
+        calls_[names[record.function]].records.push_back(record);
+      else if (record.type == WCapture::RECORD_POINT_READY || record.type == WCapture::RECORD_REGION_READY)
+        acquisitions_[record.acquisition].push_back(record);
+    }
+    loaded_ = true;
+    return true;
+  }
+
+  /*!
+   * Takes the next recorded call of a function and waits for its recorded duration.
+   */
+  Reply SESInstrumentReplay::call(const char *name)
+  {
+    const Record *record = 0;
+    pthread_mutex_lock(&mutex_);
+    std::map<std::string, Calls>::iterator it = calls_.find(name);
+    if (it != calls_.end() && !it->second.records.empty())
+    {
+      Calls &calls = it->second;
+      record = &calls.records[calls.next];
+      if (calls.next + 1 < calls.records.size())
+        calls.next++;
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    if (record != 0)
+      sleepFor(record->duration * timeScale_);
+    return Reply(record);
+  }
+
+  /*!
+   * \return The status of the replayed instrument, one of SesNS::InstrumentStatus.
+   */
+  int SESInstrumentReplay::status()
+  {
+    pthread_mutex_lock(&mutex_);
+    int result = !initialized_ ? NotInitialized : (running_ ? Running : Normal);
+    pthread_mutex_unlock(&mutex_);
+    return result;
+  }
+
+  /*!
+   * Sets the callbacks of the following acquisitions. A null callback keeps the previous one, as GDS_Start() may be
+   * called without callbacks after GDS_InitAcquisition().
+   */
+  void SESInstrumentReplay::setCallbacks(PointReady pointReady, RegionReady regionReady)
+  {
+    pthread_mutex_lock(&mutex_);
+    if (pointReady != 0)
+      pointReady_ = pointReady;
+    if (regionReady != 0)
+      regionReady_ = regionReady;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /*!
+   * Sets the layout, units and scales of the spectrum from a recorded WSpectrum** argument.
+   */
+  void SESInstrumentReplay::setSpectrum(const Value *value)
+  {
+    if (value == 0)
+      return;
+    pthread_mutex_lock(&mutex_);
+    WSpectrum decoded = spectrum_;
+    std::vector<double> channelScale;
+    std::vector<double> sliceScale;
+    if (WCapture::decodeSpectrum(value->bytes, decoded, channelScale, sliceScale))
+    {
+      layoutSpectrum(decoded.Slices, decoded.Channels, (decoded.Slices + 1) * decoded.Channels);
+      decoded.Data = spectrum_.Data;
+      decoded.SumData = spectrum_.SumData;
+      spectrum_ = decoded;
+      channelScale_.swap(channelScale);
+      sliceScale_.swap(sliceScale);
+      spectrum_.ChannelScale = channelScale_.empty() ? 0 : &channelScale_[0];
+      spectrum_.SliceScale = sliceScale_.empty() ? 0 : &sliceScale_[0];
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /*!
+   * Sets the layout, unit, scale and names of the signals from a recorded WSignals** argument.
+   */
+  void SESInstrumentReplay::setSignals(const Value *value)
+  {
+    if (value == 0)
+      return;
+    pthread_mutex_lock(&mutex_);
+    WSignals decoded = signals_;
+    std::vector<double> stepsScale;
+    std::vector<char> names;
+    if (WCapture::decodeSignals(value->bytes, decoded, stepsScale, names))
+    {
+      layoutSignals(decoded.Count, decoded.Steps);
+      decoded.Data = signals_.Data;
+      signals_ = decoded;
+      stepsScale_.swap(stepsScale);
+      signalNames_.swap(names);
+      signals_.StepsScale = stepsScale_.empty() ? 0 : &stepsScale_[0];
+      signals_.Names = reinterpret_cast<Char32 *>(&signalNames_[0]);
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  /*!
+   * Sizes the spectrum for \p slices rows of \p channels values, followed by the sum data if \p length leaves room
+   * for it. The values are cleared if the size changes. Called with the mutex held.
+   */
+  void SESInstrumentReplay::layoutSpectrum(int slices, int channels, int length)
+  {
+    if (slices < 0 || channels < 0 || length < slices * channels)
+      slices = channels = length = 0;
+    if (int(values_.size()) != length || spectrum_.Slices != slices || spectrum_.Channels != channels ||
+        spectrum_.Data == 0)
+    {
+      values_.assign(length, 0.0);
+      rows_.assign(slices > 0 ? slices : 1, (double *)0);
+      for (int j = 0; j < slices; j++)
+        rows_[j] = &values_[size_t(j) * channels];
+      spectrum_.Slices = slices;
+      spectrum_.Channels = channels;
+      spectrum_.Data = length > 0 ? &rows_[0] : 0;
+      spectrum_.SumData = length > slices * channels ? &values_[size_t(slices) * channels] : 0;
+    }
+    if (int(channelScale_.size()) != channels)
+    {
+      channelScale_.resize(channels);
+      spectrum_.ChannelScale = channels > 0 ? &channelScale_[0] : 0;
+    }
+    if (int(sliceScale_.size()) != slices)
+    {
+      sliceScale_.resize(slices);
+      spectrum_.SliceScale = slices > 0 ? &sliceScale_[0] : 0;
+    }
+  }
+
+  /*!
+   * Sizes the signals for \p count rows of \p steps values. The values are cleared if the size changes. Called with
+   * the mutex held.
+   */
+  void SESInstrumentReplay::layoutSignals(int count, int steps)
+  {
+    if (count < 0 || steps < 0)
+      count = steps = 0;
+    if (int(signalValues_.size()) != count * steps || signals_.Count != count || signals_.Steps != steps ||
+        signals_.Data == 0)
+    {
+      signalValues_.assign(size_t(count) * steps, 0.0);
+      signalRows_.assign(count > 0 ? count : 1, (double *)0);
+      for (int j = 0; j < count; j++)
+        signalRows_[j] = &signalValues_[size_t(j) * steps];
+      signals_.Count = count;
+      signals_.Steps = steps;
+      signals_.Data = count * steps > 0 ? &signalRows_[0] : 0;
+    }
+    if (int(stepsScale_.size()) != steps)
+    {
+      stepsScale_.resize(steps);
+      signals_.StepsScale = steps > 0 ? &stepsScale_[0] : 0;
+    }
+    if (signalNames_.size() != size_t(count) * sizeof(Char32) + 1)
+    {
+      signalNames_.assign(size_t(count) * sizeof(Char32) + 1, char(0));
+      signals_.Names = reinterpret_cast<Char32 *>(&signalNames_[0]);
+    }
+  }
+
+  /*!
+   * Starts playing the callbacks of the acquisition started by a recorded call of GDS_Start() or
+   * GDS_StartAcquisition(). An acquisition without callbacks in the capture ends at once.
+   */
+  void SESInstrumentReplay::start(const Record *record)
+  {
+    stop();
+    std::map<int, std::vector<Record> >::const_iterator it = acquisitions_.find(record->acquisition);
+    if (it == acquisitions_.end() || it->second.empty())
+      return;
+
+    acquisition_ = &it->second;
+    acquisitionStart_ = record->time;
+    abort_.reset();
+    pthread_mutex_lock(&mutex_);
+    running_ = true;
+    pthread_mutex_unlock(&mutex_);
+    threadStarted_ = pthread_create(&thread_, 0, runC, this) == 0;
+    if (!threadStarted_)
+    {
+      pthread_mutex_lock(&mutex_);
+      running_ = false;
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+
+  /*!
+   * Aborts the acquisition being played and waits for its thread to finish. As with the real library, the thread is
+   * not released from a PointReady callback.
+   */
+  void SESInstrumentReplay::stop()
+  {
+    abort_.set();
+    join();
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  void SESInstrumentReplay::join()
+  {
+    if (threadStarted_)
+    {
+      pthread_join(thread_, 0);
+      threadStarted_ = false;
+    }
+  }
+
+  void *SESInstrumentReplay::runC(void *arg)
+  {
+    static_cast<SESInstrumentReplay *>(arg)->run();
+    return 0;
+  }
+
+  /*!
+   * The acquisition thread. Waits for the time of each recorded callback, applies the changes of the spectrum and
+   * the signals, and makes the callback. The values are cleared before the first callback, as in the capture.
+   */
+  void SESInstrumentReplay::run()
+  {
+    const std::vector<Record> &records = *acquisition_;
+    double begin = WCallStats::now();
+
+    for (size_t i = 0; i < records.size(); i++)
+    {
+      const Record &record = records[i];
+      double wait = (record.time - acquisitionStart_) * timeScale_ - (WCallStats::now() - begin);
+      if (abort_.wait(wait > 0 ? int(wait * 1000 + 0.5) : 0) == WEvent::ERR_OK)
+        return;
+
+      pthread_mutex_lock(&mutex_);
+      layoutSpectrum(record.spectrum.rows, record.spectrum.columns, record.spectrum.length);
+      layoutSignals(record.signals.rows, record.signals.columns);
+      if (i == 0)
+      {
+        values_.assign(values_.size(), 0.0);
+        signalValues_.assign(signalValues_.size(), 0.0);
+      }
+      if (int(values_.size()) == record.spectrum.length)
+        record.spectrum.apply(values_);
+      if (int(signalValues_.size()) == record.signals.length)
+        record.signals.apply(signalValues_);
+      spectrum_.Sweeps = record.spectrum.sweeps;
+      signals_.Sweeps = record.signals.sweeps;
+      if (record.type == WCapture::RECORD_REGION_READY)
+        running_ = false;
+      PointReady pointReady = pointReady_;
+      RegionReady regionReady = regionReady_;
+      pthread_mutex_unlock(&mutex_);
+
+      if (record.type == WCapture::RECORD_POINT_READY && pointReady != 0)
+        pointReady(record.point);
+      else if (record.type == WCapture::RECORD_REGION_READY && regionReady != 0)
+        regionReady();
+    }
+
+    pthread_mutex_lock(&mutex_);
+    running_ = false;
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  SESInstrumentReplay replay;
+}
+
+/*!
+ * Takes the recorded call that answers the exported function it is used in.
+ */
+#define REPLAY_CALL() \
+  Reply reply = replay.call(__FUNCTION__)
+
+extern "C"
+{
+
+int GDS_GetLastError()
+{
+  REPLAY_CALL();
+  return reply.result(0);
+}
+
+const char *GDS_GetLastErrorString()
+{
+  REPLAY_CALL();
+  return reply.stringResult();
+}
+
+int GDS_Initialize(ErrorNotify notify, void * /* hwnd */)
+{
+  if (!replay.load())
+    return -1;
+  REPLAY_CALL();
+  replay.stop();
+  replay.errorNotify_ = notify;
+  replay.initialized_ = reply.result(-1) == 0;
+  return reply.result(-1);
+}
+
+void GDS_Finalize()
+{
+  replay.call(__FUNCTION__);
+  replay.stop();
+  replay.initialized_ = false;
+}
+
+int GDS_LoadInstrument(const char * /* fileName */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SaveInstrument(const char * /* fileName */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_NewInstrument()
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_ResetInstrument()
+{
+  REPLAY_CALL();
+  replay.stop();
+  return reply.result(-1);
+}
+
+int GDS_ZeroSupplies()
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_TestCommunication()
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_GetOption(int /* option */, void *value)
+{
+  REPLAY_CALL();
+  reply.output(1, value);
+  return reply.result(-1);
+}
+
+int GDS_SetOption(int /* option */, const void * /* value */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_GetInstrumentInfo(WInstrumentInfo *info)
+{
+  REPLAY_CALL();
+  reply.output(0, info);
+  return reply.result(-1);
+}
+
+int GDS_GetDetectorInfo(WDetectorInfo *info)
+{
+  REPLAY_CALL();
+  reply.output(0, info);
+  return reply.result(-1);
+}
+
+bool GDS_HasSupplyLib()
+{
+  REPLAY_CALL();
+  return reply.result(false);
+}
+
+bool GDS_HasDetectorLib()
+{
+  REPLAY_CALL();
+  return reply.result(false);
+}
+
+bool GDS_HasSignalsLib()
+{
+  REPLAY_CALL();
+  return reply.result(false);
+}
+
+int GDS_GetElementSets(char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(0, buffer, size != 0 ? *size : 0);
+  reply.output(1, size);
+  return reply.result(-1);
+}
+
+int GDS_GetElements(char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(0, buffer, size != 0 ? *size : 0);
+  reply.output(1, size);
+  return reply.result(-1);
+}
+
+int GDS_GetLensModes(char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(0, buffer, size != 0 ? *size : 0);
+  reply.output(1, size);
+  return reply.result(-1);
+}
+
+int GDS_GetPassEnergies(const char * /* lensMode */, char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(1, buffer, size != 0 ? *size : 0);
+  reply.output(2, size);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrElementSet(char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(0, buffer, size != 0 ? *size : 0);
+  reply.output(1, size);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrLensMode(char *buffer, int *size)
+{
+  REPLAY_CALL();
+  reply.output(0, buffer, size != 0 ? *size : 0);
+  reply.output(1, size);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrPassEnergy(double *passEnergy)
+{
+  REPLAY_CALL();
+  reply.output(0, passEnergy);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrKineticEnergy(double *kineticEnergy)
+{
+  REPLAY_CALL();
+  reply.output(0, kineticEnergy);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrExcitationEnergy(double *excitationEnergy)
+{
+  REPLAY_CALL();
+  reply.output(0, excitationEnergy);
+  return reply.result(-1);
+}
+
+int GDS_GetCurrBindingEnergy(double *bindingEnergy)
+{
+  REPLAY_CALL();
+  reply.output(0, bindingEnergy);
+  return reply.result(-1);
+}
+
+int GDS_GetGlobalDetector(WDetector *detector)
+{
+  REPLAY_CALL();
+  reply.output(0, detector);
+  return reply.result(-1);
+}
+
+int GDS_GetElement(const char * /* name */, double *value)
+{
+  REPLAY_CALL();
+  reply.output(1, value);
+  return reply.result(-1);
+}
+
+int GDS_SetElementSet(const char * /* elementSet */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetLensMode(const char * /* lensMode */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetPassEnergy(double /* passEnergy */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetKineticEnergy(double /* kineticEnergy */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetExcitationEnergy(double /* excitationEnergy */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetBindingEnergy(double /* bindingEnergy */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetGlobalDetector(WDetector * /* detector */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_SetElement(const char * /* name */, double /* value */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_CheckRegion(WRegion * /* region */, int *steps, double *time, double *energyStep)
+{
+  REPLAY_CALL();
+  reply.output(1, steps);
+  reply.output(2, time);
+  reply.output(3, energyStep);
+  return reply.result(-1);
+}
+
+int GDS_InitAcquisition(WRegion * /* region */, WSpectrum **spectrum, WSignals **signals, const char * /* tempFile */,
+                        PointReady pointReady, RegionReady regionReady)
+{
+  REPLAY_CALL();
+  int result = reply.result(-1);
+  if (result == 0)
+  {
+    replay.stop();
+    replay.setCallbacks(pointReady, regionReady);
+    replay.setSpectrum(reply.argument(1, WCapture::VALUE_SPECTRUM));
+    replay.setSignals(reply.argument(2, WCapture::VALUE_SIGNALS));
+    if (spectrum != 0)
+      *spectrum = &replay.spectrum_;
+    if (signals != 0)
+      *signals = &replay.signals_;
+  }
+  return result;
+}
+
+int GDS_StartAcquisition(int /* sweep */)
+{
+  REPLAY_CALL();
+  int result = reply.result(-1);
+  if (result == 0)
+    replay.start(reply.record());
+  return result;
+}
+
+int GDS_Start(WRegion * /* region */, WSpectrum **spectrum, const char * /* tempFile */, int /* sweep */,
+              PointReady pointReady, RegionReady regionReady)
+{
+  REPLAY_CALL();
+  int result = reply.result(-1);
+  if (result == 0)
+  {
+    replay.stop();
+    replay.setCallbacks(pointReady, regionReady);
+    replay.setSpectrum(reply.argument(1, WCapture::VALUE_SPECTRUM));
+    if (spectrum != 0)
+      *spectrum = &replay.spectrum_;
+    replay.start(reply.record());
+  }
+  return result;
+}
+
+int GDS_Stop()
+{
+  REPLAY_CALL();
+  replay.stop();
+  return reply.result(0);
+}
+
+int GDS_GetStatus(int *status)
+{
+  REPLAY_CALL();
+  *status = replay.status();
+  return reply.result(0);
+}
+
+int GDS_GetDrift(double *totalDrift, double *deltaDrift)
+{
+  REPLAY_CALL();
+  reply.output(0, totalDrift);
+  reply.output(1, deltaDrift);
+  return reply.result(-1);
+}
+
+int GDS_CalibrateOffset(WRegion *, WSpectrum **, OffsetReady, RegionReady)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_GetOffset(double *offset)
+{
+  REPLAY_CALL();
+  reply.output(0, offset);
+  return reply.result(-1);
+}
+
+int GDS_UseDetector(bool /* on */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_UseSignals(bool /* on */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int GDS_GetCurrSpectrum(WSpectrum **spectrum)
+{
+  REPLAY_CALL();
+  replay.setSpectrum(reply.argument(0, WCapture::VALUE_SPECTRUM));
+  *spectrum = replay.spectrum_.Data != 0 ? &replay.spectrum_ : 0;
+  return reply.result(0);
+}
+
+int GDS_GetCurrSignals(WSignals **signals)
+{
+  REPLAY_CALL();
+  replay.setSignals(reply.argument(0, WCapture::VALUE_SIGNALS));
+  *signals = replay.signals_.Data != 0 ? &replay.signals_ : 0;
+  return reply.result(0);
+}
+
+/* The frame is only in the capture if SES_CAPTURE_RAW_IMAGES was set, otherwise only its geometry is */
+int GDS_GetRawImage(unsigned char *data, int *width, int *height, int *byteSize)
+{
+  REPLAY_CALL();
+  reply.output(0, static_cast<void *>(data));
+  reply.output(1, width);
+  reply.output(2, height);
+  reply.output(3, byteSize);
+  return reply.result(-1);
+}
+
+int GDS_InstallInstrument() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_InstallSupplies() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_InstallElements() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_InstallLensModes() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_SetupDetector(WDetector *) { REPLAY_CALL(); return reply.result(-1); }
+int GDS_SetupSignals() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_CalibrateVoltages() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_CalibrateDetector() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_ControlSupplies() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_SupplyInfo() { REPLAY_CALL(); return reply.result(-1); }
+int GDS_DetectorInfo() { REPLAY_CALL(); return reply.result(-1); }
+
+int SC_GetProperty(const char * /* property */, void *value, int *size)
+{
+  REPLAY_CALL();
+  reply.output(1, value);
+  reply.output(2, size);
+  return reply.result(-1);
+}
+
+int SC_SetProperty(const char * /* property */, const void * /* value */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int SC_SetPropertyEx(const char * /* property */, const void * /* value */, int /* size */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+int SC_LoadLensTable(const char * /* lensMode */, const char * /* fileName */)
+{
+  REPLAY_CALL();
+  return reply.result(-1);
+}
+
+}
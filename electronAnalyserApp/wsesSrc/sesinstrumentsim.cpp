@@ -0,0 +1,996 @@
+#include "sestypes.h"
+#include "wevent.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <map>
+
+/*!
+ * \file sesinstrumentsim.cpp
+ * \brief A simulated SESInstrument library.
+ *
+ * This library exports the GDS_* functions imported by WSESInstrument::load(), so it can be loaded in place of
+ * SESInstrument.dll to run the wrapper and the IOC without an analyser. Acquisitions run in a thread of their own
+ * that calls the PointReady and RegionReady callbacks, and the spectrum is filled with two peaks on a dispersing
+ * band over a flat background.
+ *
+ * The timing of an acquisition follows the detector: every step first waits for the voltages to settle after the
+ * change of kinetic energy, and then integrates a whole number of frames covering the step time of the region.
+ * The model is configured with environment variables read by GDS_Initialize():
+ *
+ * - \c SES_SIM_FRAME_RATE Detector frame rate in frames/s (default 25).
+ * - \c SES_SIM_SETTLE_MS Fixed settling time of the supplies for each step in ms (default 5).
+ * - \c SES_SIM_SETTLE_MS_PER_EV Additional settling time in ms for each eV of kinetic energy change (default 2).
+ * - \c SES_SIM_COUNT_RATE Count rate at the top of a peak in counts/s per pixel (default 1000).
+ * - \c SES_SIM_X_CHANNELS and \c SES_SIM_Y_CHANNELS Size of the detector (default 1000 x 900).
+ * - \c SES_SIM_SEED Seed of the counting noise (default 1).
+ *
+ * Besides the GDS_* functions, SIM_GetRegionReadyTime() reports when the last RegionReady callback was made, so
+ * that sesBenchmark can time the wrapper from the callback onwards.
+ */
+
+using namespace SesNS;
+
+namespace
+{
+  enum SimErrors
+  {
+    SIM_OK = 0,
+    SIM_NOT_INITIALIZED = 1,
+    SIM_BUSY = 2,
+    SIM_INVALID_ARGUMENT = 3,
+    SIM_INVALID_REGION = 4,
+    SIM_NOT_SUPPORTED = 5
+  };
+
+  const char *ELEMENT_SETS = "\"Low Pass (UPS)\" \"High Pass (XPS)\"";
+  const char *ELEMENT_NAMES = "\"Lens 1\" \"Lens 2\" \"Lens 3\" \"Focus\" \"Deflector X\" \"Deflector Y\"";
+  const char *LENS_MODES = "\"Transmission\" \"Angular14\" \"Angular30\"";
+  const char *PASS_ENERGIES = "\"2\" \"5\" \"10\" \"20\" \"50\" \"100\" \"200\"";
+  const double PASS_ENERGY_VALUES[] = {2, 5, 10, 20, 50, 100, 200};
+  const int PASS_ENERGY_COUNT = sizeof(PASS_ENERGY_VALUES) / sizeof(PASS_ENERGY_VALUES[0]);
+
+  /*! Fraction of the pass energy that is imaged across the detector channels */
+  const double ENERGY_WINDOW = 0.1;
+
+  /*!
+   * Reads a number from the environment, or returns \p defaultValue if the variable is not set.
+   */
+  double envValue(const char *name, double defaultValue)
+  {
+    const char *value = getenv(name);
+    return (value != 0 && *value != 0) ? atof(value) : defaultValue;
+  }
+
+  /*!
+   * Copies a SES list string to \p buffer. If \p buffer is 0, only the required size is returned in \p size.
+   */
+  int copyList(const char *list, char *buffer, int *size)
+  {
+    int length = (int)strlen(list) + 1;
+    if (buffer != 0)
+    {
+      if (*size < length)
+        return -1;
+      memcpy(buffer, list, length);
+    }
+    *size = length;
+    return 0;
+  }
+
+  /*!
+   * \brief The state of the simulated instrument.
+   *
+   * There is one instance, as the real library also keeps its state in globals.
+   */
+  class SESInstrumentSim
+  {
+  public:
+    SESInstrumentSim();
+    ~SESInstrumentSim();
+
+    int fail(int error, const char *message);
+    int succeed();
+    void initialize(ErrorNotify notify);
+    void finalize();
+    int checkRegion(const WRegion &region, int *steps, double *time, double *energyStep);
+    int initAcquisition(const WRegion &region, PointReady pointReady, RegionReady regionReady);
+    int startAcquisition(int sweep);
+    int stop();
+    void rawImage(unsigned char *data, int width, int height);
+
+    bool initialized_;
+    int status_;
+    int lastError_;
+    std::string lastErrorString_;
+    ErrorNotify errorNotify_;
+
+    std::string elementSet_;
+    std::string lensMode_;
+    double passEnergy_;
+    double kineticEnergy_;
+    double excitationEnergy_;
+    std::map<std::string, double> elements_;
+    bool options_[ActiveDetector + 1];
+    int activeDetector_;
+    WDetector detector_;
+    WDetectorInfo detectorInfo_;
+
+    double frameRate_;
+    double settleMs_;
+    double settleMsPerEV_;
+    double countRate_;
+    unsigned int seed_;
+    double regionReadyTime_; /*!< CLOCK_MONOTONIC time in s of the last RegionReady callback */
+
+    WSpectrum spectrum_;
+    WSignals signals_;
+
+  private:
+    struct Geometry
+    {
+      int channels;
+      int slices;
+      int steps;
+      int windowChannels;
+      double firstEnergy;
+      double energyStep;
+      double dwellMs;
+    };
+
+    bool geometry(const WRegion &region, Geometry &result);
+    double settleTime(double fromEnergy, double toEnergy) const;
+    double noise();
+    void acquireStep(int step);
+    void run();
+    static void *runC(void *arg);
+    void join();
+
+    WRegion region_;
+    Geometry geometry_;
+    PointReady pointReady_;
+    RegionReady regionReady_;
+    int sweep_;
+    WEvent abort_;
+    pthread_t thread_;
+    bool threadStarted_;
+    pthread_mutex_t mutex_;
+
+    std::vector<double> data_;
+    std::vector<double *> rows_;
+    std::vector<double> sumData_;
+    std::vector<double> channelScale_;
+    std::vector<double> sliceScale_;
+    std::vector<double> stepsScale_;
+    std::vector<double> signalData_;
+    double *signalRows_[1];
+    Char32 signalNames_[1];
+    std::vector<double> frame_;
+  };
+
+  SESInstrumentSim::SESInstrumentSim()
+    : initialized_(false), status_(NotInitialized), lastError_(SIM_OK), errorNotify_(0),
+      elementSet_("High Pass (XPS)"), lensMode_("Angular30"), passEnergy_(20), kineticEnergy_(0),
+      excitationEnergy_(0), activeDetector_(0), frameRate_(25), settleMs_(5), settleMsPerEV_(2),
+      countRate_(1000), seed_(1), regionReadyTime_(0), pointReady_(0), regionReady_(0), sweep_(0), threadStarted_(false)
+  {
+    memset(options_, 0, sizeof(options_));
+    memset(&geometry_, 0, sizeof(geometry_));
+    pthread_mutex_init(&mutex_, 0);
+    signalRows_[0] = 0;
+    strcpy(signalNames_[0], "Sample Current");
+  }
+
+  SESInstrumentSim::~SESInstrumentSim()
+  {
+    stop();
+    pthread_mutex_destroy(&mutex_);
+  }
+
+  /*!
+   * Records an error for GDS_GetLastError() and GDS_GetLastErrorString().
+   *
+   * \return -1, the return value of a failed GDS_* call.
+   */
+  int SESInstrumentSim::fail(int error, const char *message)
+  {
+    lastError_ = error;
+    lastErrorString_ = message;
+    return -1;
+  }
+
+  /*!
+   * Clears the last error.
+   *
+   * \return 0, the return value of a successful GDS_* call.
+   */
+  int SESInstrumentSim::succeed()
+  {
+    lastError_ = SIM_OK;
+    lastErrorString_.clear();
+    return 0;
+  }
+
+  /*!
+   * Reads the timing model from the environment and resets the instrument to its defaults.
+   */
+  void SESInstrumentSim::initialize(ErrorNotify notify)
+  {
+    stop();
+    errorNotify_ = notify;
+    frameRate_ = envValue("SES_SIM_FRAME_RATE", 25);
+    if (frameRate_ <= 0)
+      frameRate_ = 25;
+    settleMs_ = envValue("SES_SIM_SETTLE_MS", 5);
+    settleMsPerEV_ = envValue("SES_SIM_SETTLE_MS_PER_EV", 2);
+    countRate_ = envValue("SES_SIM_COUNT_RATE", 1000);
+    seed_ = (unsigned int)envValue("SES_SIM_SEED", 1);
+
+    detectorInfo_ = WDetectorInfo();
+    strcpy(detectorInfo_.Name, "Simulated Detector");
+    detectorInfo_.TimerControlled = false;
+    detectorInfo_.XChannels = (int)envValue("SES_SIM_X_CHANNELS", 1000);
+    detectorInfo_.YChannels = (int)envValue("SES_SIM_Y_CHANNELS", 900);
+    if (detectorInfo_.XChannels < 1)
+      detectorInfo_.XChannels = 1000;
+    if (detectorInfo_.YChannels < 1)
+      detectorInfo_.YChannels = 900;
+    detectorInfo_.MaxChannels = detectorInfo_.XChannels;
+    detectorInfo_.MaxSlices = detectorInfo_.YChannels;
+    detectorInfo_.FramesPerSec = (int)(frameRate_ + 0.5);
+    detectorInfo_.ADCPresent = true;
+    detectorInfo_.DiscPresent = true;
+
+    detector_ = WDetector();
+    detector_.FirstXChannel = 0;
+    detector_.LastXChannel = detectorInfo_.XChannels - 1;
+    detector_.FirstYChannel = 0;
+    detector_.LastYChannel = detectorInfo_.YChannels - 1;
+    detector_.Slices = detectorInfo_.YChannels;
+
+    const char *names[] = {"Lens 1", "Lens 2", "Lens 3", "Focus", "Deflector X", "Deflector Y"};
+    elements_.clear();
+    for (int i = 0; i < int(sizeof(names) / sizeof(names[0])); i++)
+      elements_[names[i]] = 0;
+
+    spectrum_ = WSpectrum();
+    signals_ = WSignals();
+    initialized_ = true;
+    status_ = Normal;
+  }
+
+  /*!
+   * Stops any acquisition and returns to the uninitialized state.
+   */
+  void SESInstrumentSim::finalize()
+  {
+    stop();
+    initialized_ = false;
+    status_ = NotInitialized;
+  }
+
+  /*!
+   * Works out the energy axis, the number of steps and the dwell time of a region.
+   *
+   * In fixed mode the detector images a window of ENERGY_WINDOW times the pass energy around the fixed energy in
+   * one step. In swept mode the window is moved across the region one energy step at a time, so every channel is
+   * seen by every detector channel; the sweep starts and ends half a window outside the region.
+   *
+   * \return \c false if the region is invalid.
+   */
+  bool SESInstrumentSim::geometry(const WRegion &region, Geometry &result)
+  {
+    WDetector detector = detector_;
+    if (region.UseRegionDetector)
+    {
+      detector.FirstXChannel = region.FirstXChannel;
+      detector.LastXChannel = region.LastXChannel;
+      detector.FirstYChannel = region.FirstYChannel;
+      detector.LastYChannel = region.LastYChannel;
+      detector.Slices = region.Slices;
+    }
+    int detectorChannels = detector.LastXChannel - detector.FirstXChannel + 1;
+    int detectorSlices = detector.LastYChannel - detector.FirstYChannel + 1;
+    double passEnergy = region.PassEnergy > 0 ? region.PassEnergy : passEnergy_;
+    double window = ENERGY_WINDOW * passEnergy;
+
+    if (detectorChannels < 1 || detectorChannels > detectorInfo_.XChannels ||
+        detectorSlices < 1 || detectorSlices > detectorInfo_.YChannels || window <= 0)
+      return false;
+
+    result.slices = detector.Slices > 0 && detector.Slices < detectorSlices ? detector.Slices : detectorSlices;
+    if (region.Fixed)
+    {
+      result.channels = detectorChannels;
+      result.steps = 1;
+      result.windowChannels = detectorChannels;
+      result.energyStep = window / detectorChannels;
+      result.firstEnergy = region.FixEnergy - window / 2 + result.energyStep / 2;
+    }
+    else
+    {
+      if (region.EnergyStep <= 0 || region.HighEnergy <= region.LowEnergy)
+        return false;
+      result.energyStep = region.EnergyStep;
+      result.channels = int((region.HighEnergy - region.LowEnergy) / region.EnergyStep + 0.5) + 1;
+      result.windowChannels = int(window / region.EnergyStep + 0.5);
+      if (result.windowChannels < 1)
+        result.windowChannels = 1;
+      result.steps = result.channels + result.windowChannels - 1;
+      result.firstEnergy = region.LowEnergy;
+    }
+
+    /* A step integrates whole frames, at least one */
+    double frameMs = 1000.0 / frameRate_;
+    int frames = int(ceil(region.StepTime / frameMs - 1e-9));
+    result.dwellMs = (frames > 1 ? frames : 1) * frameMs;
+    return true;
+  }
+
+  /*!
+   * \return The time in ms the supplies take to settle after a change of kinetic energy.
+   */
+  double SESInstrumentSim::settleTime(double fromEnergy, double toEnergy) const
+  {
+    return settleMs_ + settleMsPerEV_ * fabs(toEnergy - fromEnergy);
+  }
+
+  /*!
+   * Validates a region and estimates the time of one sweep.
+   */
+  int SESInstrumentSim::checkRegion(const WRegion &region, int *steps, double *time, double *energyStep)
+  {
+    Geometry g;
+    if (!geometry(region, g))
+      return fail(SIM_INVALID_REGION, "Invalid region");
+
+    double centre = g.firstEnergy + (region.Fixed ? 0 : g.energyStep * (1 - g.windowChannels) / 2.0);
+    double total = settleTime(kineticEnergy_, centre) + g.steps * (g.dwellMs + settleTime(0, g.energyStep));
+    if (steps != 0)
+      *steps = g.steps;
+    if (time != 0)
+      *time = total;
+    if (energyStep != 0)
+      *energyStep = ENERGY_WINDOW * (region.PassEnergy > 0 ? region.PassEnergy : passEnergy_) / detectorInfo_.XChannels;
+    return succeed();
+  }
+
+  /*!
+   * Allocates and clears the spectrum and signals for a region.
+   */
+  int SESInstrumentSim::initAcquisition(const WRegion &region, PointReady pointReady, RegionReady regionReady)
+  {
+    if (status_ == Running)
+      return fail(SIM_BUSY, "Acquisition running");
+    join();
+
+    Geometry g;
+    if (!geometry(region, g))
+      return fail(SIM_INVALID_REGION, "Invalid region");
+
+    region_ = region;
+    geometry_ = g;
+    pointReady_ = pointReady;
+    regionReady_ = regionReady;
+
+    data_.assign((size_t)g.channels * g.slices, 0.0);
+    rows_.resize(g.slices);
+    for (int j = 0; j < g.slices; j++)
+      rows_[j] = &data_[(size_t)j * g.channels];
+    sumData_.assign(g.channels, 0.0);
+    channelScale_.resize(g.channels);
+    for (int i = 0; i < g.channels; i++)
+      channelScale_[i] = g.firstEnergy + i * g.energyStep;
+
+    /* Angular modes image emission angle, transmission images position along the slit */
+    double halfRange = strstr(region.LensMode, "Angular14") != 0 ? 7 : (strstr(region.LensMode, "Transmission") != 0 ? 5 : 15);
+    sliceScale_.resize(g.slices);
+    for (int j = 0; j < g.slices; j++)
+      sliceScale_[j] = g.slices > 1 ? -halfRange + 2 * halfRange * j / (g.slices - 1) : 0;
+
+    stepsScale_.resize(g.steps);
+    for (int s = 0; s < g.steps; s++)
+      stepsScale_[s] = g.firstEnergy + (s - (g.windowChannels - 1) / 2.0) * g.energyStep;
+    signalData_.assign(g.steps, 0.0);
+    signalRows_[0] = &signalData_[0];
+    frame_.assign(g.windowChannels, 0.0);
+
+    spectrum_ = WSpectrum();
+    spectrum_.Channels = g.channels;
+    spectrum_.Slices = g.slices;
+    strcpy(spectrum_.CountUnit, "counts");
+    strcpy(spectrum_.ChannelUnit, region.Kinetic ? "Kinetic Energy [eV]" : "Binding Energy [eV]");
+    strcpy(spectrum_.SliceUnit, strstr(region.LensMode, "Transmission") != 0 ? "Position [mm]" : "Angle [deg]");
+    spectrum_.ChannelScale = &channelScale_[0];
+    spectrum_.SliceScale = &sliceScale_[0];
+    spectrum_.Data = &rows_[0];
+    spectrum_.SumData = &sumData_[0];
+
+    signals_ = WSignals();
+    signals_.Count = 1;
+    signals_.Steps = g.steps;
+    strcpy(signals_.StepsUnit, "eV");
+    signals_.StepsScale = &stepsScale_[0];
+    signals_.Names = signalNames_;
+    signals_.Data = signalRows_;
+
+    return succeed();
+  }
+
+  /*!
+   * Starts one sweep of the region prepared by initAcquisition(). The data is added to the previous sweeps.
+   */
+  int SESInstrumentSim::startAcquisition(int sweep)
+  {
+    if (spectrum_.Data == 0)
+      return fail(SIM_NOT_INITIALIZED, "Acquisition not initialized");
+    if (status_ == Running)
+      return fail(SIM_BUSY, "Acquisition running");
+    join();
+
+    sweep_ = sweep;
+    abort_.reset();
+    status_ = Running;
+    if (pthread_create(&thread_, 0, runC, this) != 0)
+    {
+      status_ = AcqError;
+      return fail(SIM_NOT_SUPPORTED, "Could not start acquisition thread");
+    }
+    threadStarted_ = true;
+    return succeed();
+  }
+
+  /*!
+   * Aborts the acquisition and waits for the acquisition thread to finish. The thread is released from a wait for
+   * settling or integration, but not from a PointReady callback; the wrapper releases that itself before calling
+   * GDS_Stop().
+   */
+  int SESInstrumentSim::stop()
+  {
+    abort_.set();
+    join();
+    if (status_ == Running)
+      status_ = Normal;
+    return succeed();
+  }
+
+  void SESInstrumentSim::join()
+  {
+    if (threadStarted_)
+    {
+      pthread_join(thread_, 0);
+      threadStarted_ = false;
+    }
+  }
+
+  void *SESInstrumentSim::runC(void *arg)
+  {
+    static_cast<SESInstrumentSim *>(arg)->run();
+    return 0;
+  }
+
+  /*!
+   * The acquisition thread. Settles, integrates and reports each step in turn, then reports the region.
+   */
+  void SESInstrumentSim::run()
+  {
+    double energy = kineticEnergy_;
+
+    for (int step = 0; step < geometry_.steps; step++)
+    {
+      double target = stepsScale_[step];
+      double wait = settleTime(energy, target) + geometry_.dwellMs;
+      if (abort_.wait(int(wait + 0.5)) == WEvent::ERR_OK)
+        return;
+      energy = target;
+      kineticEnergy_ = region_.Kinetic ? target : region_.ExcEnergy - target;
+
+      pthread_mutex_lock(&mutex_);
+      acquireStep(step);
+      pthread_mutex_unlock(&mutex_);
+
+      if (pointReady_ != 0)
+        pointReady_(step);
+      if (abort_.wait(0) == WEvent::ERR_OK)
+        return;
+    }
+
+    spectrum_.Sweeps = sweep_ + 1;
+    signals_.Sweeps = sweep_ + 1;
+    status_ = Normal;
+    if (regionReady_ != 0)
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      regionReadyTime_ = ts.tv_sec + ts.tv_nsec * 1e-9;
+      regionReady_();
+    }
+  }
+
+  /*!
+   * \return A noise sample with zero mean and unit variance.
+   */
+  double SESInstrumentSim::noise()
+  {
+    double sum = 0;
+    for (int i = 0; i < 4; i++)
+    {
+      seed_ = seed_ * 1103515245u + 12345u;
+      sum += ((seed_ >> 8) & 0xffff) / 65536.0;
+    }
+    return (sum - 2.0) * 1.7320508;
+  }
+
+  /*!
+   * Adds the counts of one step to the channels under the detector window.
+   *
+   * The model is a flat background and two Gaussian peaks at a third and two thirds of the region, whose energy
+   * disperses quadratically with the slice position like a band. The counts are scaled by the dwell time and carry
+   * counting noise.
+   */
+  void SESInstrumentSim::acquireStep(int step)
+  {
+    int channels = geometry_.channels;
+    int first = region_.Fixed ? 0 : step - geometry_.windowChannels + 1;
+    int last = region_.Fixed ? channels - 1 : step;
+    double low = channelScale_[0];
+    double range = channelScale_[channels - 1] - low;
+    double width = 0.01 * (region_.PassEnergy > 0 ? region_.PassEnergy : passEnergy_) + 2 * geometry_.energyStep;
+    double scale = countRate_ * geometry_.dwellMs / 1000.0;
+    double halfRange = fabs(sliceScale_[0]) > 0 ? fabs(sliceScale_[0]) : 1;
+    double total = 0;
+
+    if (first < 0)
+      first = 0;
+    if (last > channels - 1)
+      last = channels - 1;
+
+    for (int j = 0; j < geometry_.slices; j++)
+    {
+      double u = sliceScale_[j] / halfRange;
+      double shift = 0.1 * range * u * u;
+      double peak1 = low + range / 3 - shift;
+      double peak2 = low + 2 * range / 3 - shift / 2;
+      double *row = rows_[j];
+      for (int i = first; i <= last; i++)
+      {
+        double e = channelScale_[i];
+        double d1 = (e - peak1) / width;
+        double d2 = (e - peak2) / width;
+        double mean = scale * (0.05 + exp(-0.5 * d1 * d1) + 0.6 * exp(-0.5 * d2 * d2));
+        double counts = mean + sqrt(mean) * noise();
+        if (counts < 0)
+          counts = 0;
+        row[i] += counts;
+        sumData_[i] += counts;
+        total += counts;
+        if (j == geometry_.slices / 2)
+          frame_[i - first] = counts;
+      }
+    }
+    signalData_[step] += total / geometry_.slices;
+  }
+
+  /*!
+   * Fills a raw detector frame with the profile of the last step, scaled to 8 bits.
+   */
+  void SESInstrumentSim::rawImage(unsigned char *data, int width, int height)
+  {
+    pthread_mutex_lock(&mutex_);
+    double maximum = 0;
+    int count = int(frame_.size());
+    for (int i = 0; i < count; i++)
+      if (frame_[i] > maximum)
+        maximum = frame_[i];
+    for (int y = 0; y < height; y++)
+    {
+      double v = 2.0 * y / (height > 1 ? height - 1 : 1) - 1.0;
+      for (int x = 0; x < width; x++)
+      {
+        int i = count > 0 ? x * count / width : 0;
+        double value = (maximum > 0 && count > 0) ? frame_[i] / maximum : 0;
+        data[(size_t)y * width + x] = (unsigned char)(255 * value * (1 - 0.5 * v * v));
+      }
+    }
+    pthread_mutex_unlock(&mutex_);
+  }
+
+  SESInstrumentSim sim;
+
+  bool isPassEnergy(double passEnergy)
+  {
+    for (int i = 0; i < PASS_ENERGY_COUNT; i++)
+      if (fabs(PASS_ENERGY_VALUES[i] - passEnergy) < 1e-6)
+        return true;
+    return false;
+  }
+}
+
+#define SIM_REQUIRE_INITIALIZED() \
+  if (!sim.initialized_) \
+    return sim.fail(SIM_NOT_INITIALIZED, "Library not initialized")
+
+extern "C"
+{
+
+int GDS_GetLastError()
+{
+  return sim.lastError_;
+}
+
+const char *GDS_GetLastErrorString()
+{
+  return sim.lastErrorString_.c_str();
+}
+
+int GDS_Initialize(ErrorNotify notify, void * /* hwnd */)
+{
+  sim.initialize(notify);
+  return sim.succeed();
+}
+
+void GDS_Finalize()
+{
+  sim.finalize();
+}
+
+int GDS_LoadInstrument(const char * /* fileName */)
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.succeed();
+}
+
+int GDS_SaveInstrument(const char * /* fileName */)
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.succeed();
+}
+
+int GDS_NewInstrument()
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.succeed();
+}
+
+int GDS_ResetInstrument()
+{
+  SIM_REQUIRE_INITIALIZED();
+  sim.stop();
+  sim.status_ = Normal;
+  return sim.succeed();
+}
+
+int GDS_ZeroSupplies()
+{
+  SIM_REQUIRE_INITIALIZED();
+  sim.kineticEnergy_ = 0;
+  for (std::map<std::string, double>::iterator it = sim.elements_.begin(); it != sim.elements_.end(); ++it)
+    it->second = 0;
+  return sim.succeed();
+}
+
+int GDS_TestCommunication()
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.succeed();
+}
+
+int GDS_GetOption(int option, void *value)
+{
+  SIM_REQUIRE_INITIALIZED();
+  if (option < 0 || option > ActiveDetector || value == 0)
+    return sim.fail(SIM_INVALID_ARGUMENT, "Invalid option");
+  if (option == DetectorCount)
+    *reinterpret_cast<int *>(value) = 1;
+  else if (option == ActiveDetector)
+    *reinterpret_cast<unsigned short *>(value) = (unsigned short)sim.activeDetector_;
+  else
+    *reinterpret_cast<bool *>(value) = sim.options_[option];
+  return sim.succeed();
+}
+
+int GDS_SetOption(int option, const void *value)
+{
+  SIM_REQUIRE_INITIALIZED();
+  if (option < 0 || option > ActiveDetector || option == DetectorCount || value == 0)
+    return sim.fail(SIM_INVALID_ARGUMENT, "Invalid option");
+  if (option == ActiveDetector)
+    sim.activeDetector_ = *reinterpret_cast<const unsigned short *>(value);
+  else
+    sim.options_[option] = *reinterpret_cast<const bool *>(value);
+  return sim.succeed();
+}
+
+int GDS_GetInstrumentInfo(WInstrumentInfo *info)
+{
+  SIM_REQUIRE_INITIALIZED();
+  strcpy(info->Model, "SES Simulator");
+  strcpy(info->SerialNo, "SIM-0001");
+  return sim.succeed();
+}
+
+int GDS_GetDetectorInfo(WDetectorInfo *info)
+{
+  SIM_REQUIRE_INITIALIZED();
+  *info = sim.detectorInfo_;
+  return sim.succeed();
+}
+
+bool GDS_HasSupplyLib()
+{
+  return true;
+}
+
+bool GDS_HasDetectorLib()
+{
+  return true;
+}
+
+bool GDS_HasSignalsLib()
+{
+  return true;
+}
+
+int GDS_GetElementSets(char *buffer, int *size)
+{
+  return copyList(ELEMENT_SETS, buffer, size);
+}
+
+int GDS_GetElements(char *buffer, int *size)
+{
+  return copyList(ELEMENT_NAMES, buffer, size);
+}
+
+int GDS_GetLensModes(char *buffer, int *size)
+{
+  return copyList(LENS_MODES, buffer, size);
+}
+
+int GDS_GetPassEnergies(const char * /* lensMode */, char *buffer, int *size)
+{
+  return copyList(PASS_ENERGIES, buffer, size);
+}
+
+int GDS_GetCurrElementSet(char *buffer, int *size)
+{
+  return copyList(sim.elementSet_.c_str(), buffer, size);
+}
+
+int GDS_GetCurrLensMode(char *buffer, int *size)
+{
+  return copyList(sim.lensMode_.c_str(), buffer, size);
+}
+
+int GDS_GetCurrPassEnergy(double *passEnergy)
+{
+  *passEnergy = sim.passEnergy_;
+  return 0;
+}
+
+int GDS_GetCurrKineticEnergy(double *kineticEnergy)
+{
+  *kineticEnergy = sim.kineticEnergy_;
+  return 0;
+}
+
+int GDS_GetCurrExcitationEnergy(double *excitationEnergy)
+{
+  *excitationEnergy = sim.excitationEnergy_;
+  return 0;
+}
+
+int GDS_GetCurrBindingEnergy(double *bindingEnergy)
+{
+  *bindingEnergy = sim.excitationEnergy_ - sim.kineticEnergy_;
+  return 0;
+}
+
+int GDS_GetGlobalDetector(WDetector *detector)
+{
+  SIM_REQUIRE_INITIALIZED();
+  *detector = sim.detector_;
+  return sim.succeed();
+}
+
+int GDS_GetElement(const char *name, double *value)
+{
+  std::map<std::string, double>::const_iterator it = sim.elements_.find(name);
+  if (it == sim.elements_.end())
+    return sim.fail(SIM_INVALID_ARGUMENT, "Unknown element");
+  *value = it->second;
+  return sim.succeed();
+}
+
+int GDS_SetElementSet(const char *elementSet)
+{
+  if (strstr(ELEMENT_SETS, elementSet) == 0 || *elementSet == 0)
+    return sim.fail(SIM_INVALID_ARGUMENT, "Unknown element set");
+  sim.elementSet_ = elementSet;
+  return sim.succeed();
+}
+
+int GDS_SetLensMode(const char *lensMode)
+{
+  if (strstr(LENS_MODES, lensMode) == 0 || *lensMode == 0)
+    return sim.fail(SIM_INVALID_ARGUMENT, "Unknown lens mode");
+  sim.lensMode_ = lensMode;
+  return sim.succeed();
+}
+
+int GDS_SetPassEnergy(double passEnergy)
+{
+  if (!isPassEnergy(passEnergy))
+    return sim.fail(SIM_INVALID_ARGUMENT, "Invalid pass energy");
+  sim.passEnergy_ = passEnergy;
+  return sim.succeed();
+}
+
+int GDS_SetKineticEnergy(double kineticEnergy)
+{
+  if (sim.status_ == Running)
+    return sim.fail(SIM_BUSY, "Acquisition running");
+  sim.kineticEnergy_ = kineticEnergy;
+  return sim.succeed();
+}
+
+int GDS_SetExcitationEnergy(double excitationEnergy)
+{
+  sim.excitationEnergy_ = excitationEnergy;
+  return sim.succeed();
+}
+
+int GDS_SetBindingEnergy(double bindingEnergy)
+{
+  if (sim.status_ == Running)
+    return sim.fail(SIM_BUSY, "Acquisition running");
+  sim.kineticEnergy_ = sim.excitationEnergy_ - bindingEnergy;
+  return sim.succeed();
+}
+
+int GDS_SetGlobalDetector(WDetector *detector)
+{
+  SIM_REQUIRE_INITIALIZED();
+  if (detector->FirstXChannel < 0 || detector->LastXChannel >= sim.detectorInfo_.XChannels ||
+      detector->FirstXChannel > detector->LastXChannel || detector->FirstYChannel < 0 ||
+      detector->LastYChannel >= sim.detectorInfo_.YChannels || detector->FirstYChannel > detector->LastYChannel)
+    return sim.fail(SIM_INVALID_ARGUMENT, "Invalid detector region");
+  sim.detector_ = *detector;
+  return sim.succeed();
+}
+
+int GDS_SetElement(const char *name, double value)
+{
+  std::map<std::string, double>::iterator it = sim.elements_.find(name);
+  if (it == sim.elements_.end())
+    return sim.fail(SIM_INVALID_ARGUMENT, "Unknown element");
+  it->second = value;
+  return sim.succeed();
+}
+
+int GDS_CheckRegion(WRegion *region, int *steps, double *time, double *energyStep)
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.checkRegion(*region, steps, time, energyStep);
+}
+
+int GDS_InitAcquisition(WRegion *region, WSpectrum **spectrum, WSignals **signals, const char * /* tempFile */,
+                        PointReady pointReady, RegionReady regionReady)
+{
+  SIM_REQUIRE_INITIALIZED();
+  int result = sim.initAcquisition(*region, pointReady, regionReady);
+  if (result == 0)
+  {
+    if (spectrum != 0)
+      *spectrum = &sim.spectrum_;
+    if (signals != 0)
+      *signals = &sim.signals_;
+  }
+  return result;
+}
+
+int GDS_StartAcquisition(int sweep)
+{
+  SIM_REQUIRE_INITIALIZED();
+  return sim.startAcquisition(sweep);
+}
+
+int GDS_Start(WRegion *region, WSpectrum **spectrum, const char *tempFile, int sweep, PointReady pointReady,
+              RegionReady regionReady)
+{
+  SIM_REQUIRE_INITIALIZED();
+  if (sweep == 0)
+  {
+    int result = GDS_InitAcquisition(region, spectrum, 0, tempFile, pointReady, regionReady);
+    if (result != 0)
+      return result;
+  }
+  return sim.startAcquisition(sweep);
+}
+
+int GDS_Stop()
+{
+  return sim.stop();
+}
+
+int GDS_GetStatus(int *status)
+{
+  *status = sim.status_;
+  return 0;
+}
+
+int GDS_GetDrift(double *totalDrift, double *deltaDrift)
+{
+  *totalDrift = 0;
+  *deltaDrift = 0;
+  return 0;
+}
+
+int GDS_CalibrateOffset(WRegion *, WSpectrum **, OffsetReady, RegionReady)
+{
+  return sim.fail(SIM_NOT_SUPPORTED, "Offset calibration is not simulated");
+}
+
+int GDS_GetOffset(double *offset)
+{
+  *offset = 0;
+  return 0;
+}
+
+int GDS_UseDetector(bool /* on */)
+{
+  return 0;
+}
+
+int GDS_UseSignals(bool /* on */)
+{
+  return 0;
+}
+
+int GDS_GetCurrSpectrum(WSpectrum **spectrum)
+{
+  *spectrum = sim.spectrum_.Data != 0 ? &sim.spectrum_ : 0;
+  return 0;
+}
+
+int GDS_GetCurrSignals(WSignals **signals)
+{
+  *signals = sim.signals_.Data != 0 ? &sim.signals_ : 0;
+  return 0;
+}
+
+int GDS_GetRawImage(unsigned char *data, int *width, int *height, int *byteSize)
+{
+  SIM_REQUIRE_INITIALIZED();
+  *width = sim.detectorInfo_.XChannels;
+  *height = sim.detectorInfo_.YChannels;
+  *byteSize = 1;
+  if (data != 0)
+    sim.rawImage(data, *width, *height);
+  return sim.succeed();
+}
+
+/* The installation and setup dialogs of the real library have nothing to show here */
+int GDS_InstallInstrument() { return 0; }
+int GDS_InstallSupplies() { return 0; }
+int GDS_InstallElements() { return 0; }
+int GDS_InstallLensModes() { return 0; }
+int GDS_SetupDetector(WDetector *) { return 0; }
+int GDS_SetupSignals() { return 0; }
+int GDS_CalibrateVoltages() { return 0; }
+int GDS_CalibrateDetector() { return 0; }
+int GDS_ControlSupplies() { return 0; }
+int GDS_SupplyInfo() { return 0; }
+int GDS_DetectorInfo() { return 0; }
+
+/* Not part of SESInstrument, the time of the last RegionReady callback on CLOCK_MONOTONIC for sesBenchmark */
+double SIM_GetRegionReadyTime()
+{
+  return sim.regionReadyTime_;
+}
+
+}
@@ -0,0 +1,207 @@
+#include "wcallstats.h"
+
+#include "wlock.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+#include <string.h>
+
+namespace
+{
+  WCallStats::Function functions[WCallStats::MAX_FUNCTIONS];
+  int functionCount = 0;
+
+  /*!
+   * Constructed when the library is loaded, before any thunk can record a call.
+   */
+  WLock statsLock;
+
+  /*!
+   * Values below SUB_BUCKETS nanoseconds have a bucket each, above that every power of two is split into
+   * SUB_BUCKETS linear buckets.
+   */
+  int bucketIndex(unsigned long long nanoseconds)
+  {
+    if (nanoseconds < WCallStats::SUB_BUCKETS)
+      return (int)nanoseconds;
+    int shift = 0;
+    while ((nanoseconds >> shift) >= 2 * WCallStats::SUB_BUCKETS)
+      shift++;
+    if (shift + 1 >= WCallStats::RANGES)
+      return WCallStats::BUCKETS - 1;
+    return (shift + 1) * WCallStats::SUB_BUCKETS + (int)(nanoseconds >> shift) - WCallStats::SUB_BUCKETS;
+  }
+
+  /*!
+   * \return The upper edge of a bucket in nanoseconds.
+   */
+  double bucketValue(int index)
+  {
+    int range = index / WCallStats::SUB_BUCKETS;
+    int sub = index % WCallStats::SUB_BUCKETS;
+    if (range == 0)
+      return (double)(sub + 1);
+    return (double)((unsigned long long)(WCallStats::SUB_BUCKETS + sub + 1) << (range - 1));
+  }
+
+  void clearFunction(WCallStats::Function &function)
+  {
+    function.calls = 0;
+    function.totalTime = 0;
+    function.maxTime = 0;
+    memset(function.buckets, 0, sizeof(function.buckets));
+  }
+}
+
+/*!
+ * Registers a function. A function that is already registered keeps its slot and its statistics, so disabling
+ * and enabling the statistics again continues from where they were.
+ *
+ * \param[in] name The name of the function. Must stay valid for the lifetime of the program.
+ *
+ * \return The index of the slot of the function, or -1 if all slots are in use.
+ */
+int WCallStats::add(const char *name)
+{
+  int index = -1;
+  statsLock.lock();
+  for (int i = 0; i < functionCount && index < 0; i++)
+  {
+    if (strcmp(functions[i].name, name) == 0)
+      index = i;
+  }
+  if (index < 0 && functionCount < MAX_FUNCTIONS)
+  {
+    index = functionCount++;
+    functions[index].name = name;
+    clearFunction(functions[index]);
+  }
+  statsLock.unlock();
+  return index;
+}
+
+/*!
+ * Records one call.
+ *
+ * \param[in] index The slot returned by add(). Calls of a function without a slot are not recorded.
+ * \param[in] seconds The latency of the call.
+ */
+void WCallStats::record(int index, double seconds)
+{
+  if (index < 0 || index >= MAX_FUNCTIONS)
+    return;
+  if (seconds < 0)
+    seconds = 0;
+  int bucket = bucketIndex((unsigned long long)(seconds * 1e9));
+
+  statsLock.lock();
+  Function &function = functions[index];
+  function.calls++;
+  function.totalTime += seconds;
+  if (seconds > function.maxTime)
+    function.maxTime = seconds;
+  function.buckets[bucket]++;
+  statsLock.unlock();
+}
+
+/*!
+ * \return The number of registered functions. Their slots are 0 to count() - 1, in the order of registration.
+ */
+int WCallStats::count()
+{
+  statsLock.lock();
+  int result = functionCount;
+  statsLock.unlock();
+  return result;
+}
+
+/*!
+ * Copies the statistics of a function.
+ *
+ * \param[in] index 0 <= \p index < count().
+ * \param[out] function The statistics.
+ *
+ * \return \c true if successful, \c false if \p index is out of range.
+ */
+bool WCallStats::get(int index, Function &function)
+{
+  statsLock.lock();
+  bool valid = index >= 0 && index < functionCount;
+  if (valid)
+    function = functions[index];
+  statsLock.unlock();
+  return valid;
+}
+
+/*!
+ * Clears the statistics of all functions. The functions stay registered.
+ */
+void WCallStats::reset()
+{
+  statsLock.lock();
+  for (int i = 0; i < functionCount; i++)
+    clearFunction(functions[i]);
+  statsLock.unlock();
+}
+
+/*!
+ * Prints one line for each function that has been called, with the total latency in milliseconds and the
+ * others in microseconds.
+ *
+ * \param[in] fp The file the report is written to.
+ */
+void WCallStats::report(FILE *fp)
+{
+  int total = count();
+  Function function;
+  for (int i = 0; i < total; i++)
+  {
+    if (!get(i, function) || function.calls == 0)
+      continue;
+    fprintf(fp, "  %-28s n=%lld total=%.3f ms mean=%.1f p50=%.1f p99=%.1f max=%.1f us\n", function.name,
+            function.calls, function.totalTime * 1e3, function.totalTime * 1e6 / function.calls,
+            function.percentile(50) * 1e6, function.percentile(99) * 1e6, function.maxTime * 1e6);
+  }
+}
+
+/*!
+ * \return A monotonic time in seconds, for measuring intervals.
+ */
+double WCallStats::now()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*!
+ * \param[in] percent The percentile, from 0 to 100.
+ *
+ * \return The latency in seconds below which \p percent of the calls lie.
+ */
+double WCallStats::Function::percentile(double percent) const
+{
+  if (calls == 0)
+    return 0;
+  double target = calls * percent / 100.0;
+  double seen = 0;
+  for (int i = 0; i < BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (buckets[i] != 0 && seen >= target)
+    {
+      double value = bucketValue(i) * 1e-9;
+      return value < maxTime ? value : maxTime;
+    }
+  }
+  return maxTime;
+}
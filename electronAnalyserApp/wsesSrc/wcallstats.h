@@ -0,0 +1,66 @@
+#ifndef __SESWRAPPER_WCALLSTATS_H__
+#define __SESWRAPPER_WCALLSTATS_H__
+
+#include <stdio.h>
+
+/*!
+ * \brief Call counts and latencies of the functions imported from the SESInstrument library.
+ *
+ * WSESInstrument::setCallStatistics() replaces each imported function pointer with a thunk that times the call
+ * and records it here. Each function has a slot with its number of calls, the cumulative and the maximum latency
+ * and an HDR-style histogram: every power of two of nanoseconds is split into SUB_BUCKETS linear buckets, which
+ * keeps the relative error of a percentile below 1/SUB_BUCKETS with no allocation when recording.
+ *
+ * The statistics are shared by all threads and protected by a lock. While the statistics are disabled the
+ * function pointers are those of the library, so nothing is recorded and nothing is spent.
+ */
+class WCallStats
+{
+public:
+  enum
+  {
+    MAX_FUNCTIONS = 96, /*!< The maximum number of functions that can be recorded */
+    SUB_BUCKET_BITS = 4,
+    SUB_BUCKETS = 1 << SUB_BUCKET_BITS, /*!< The number of linear buckets in each power of two */
+    RANGES = 36, /*!< The number of powers of two, up to 2^39 ns or about 9 minutes */
+    BUCKETS = RANGES * SUB_BUCKETS
+  };
+
+  /*!
+   * The statistics of one function.
+   */
+  struct Function
+  {
+    const char *name; /*!< The name of the imported function */
+    long long calls; /*!< The number of calls */
+    double totalTime; /*!< The cumulative latency in seconds */
+    double maxTime; /*!< The largest latency in seconds */
+    unsigned int buckets[BUCKETS]; /*!< The latency histogram */
+
+    double percentile(double percent) const;
+  };
+
+  static int add(const char *name);
+  static void record(int index, double seconds);
+  static int count();
+  static bool get(int index, Function &function);
+  static void reset();
+  static void report(FILE *fp);
+  static double now();
+};
+
+/*!
+ * \brief Records the latency of one call, from its construction to its destruction.
+ */
+class WCallTimer
+{
+public:
+  WCallTimer(int index) : index_(index), start_(WCallStats::now()) {}
+  ~WCallTimer() { WCallStats::record(index_, WCallStats::now() - start_); }
+
+private:
+  int index_;
+  double start_;
+};
+
+#endif
@@ -0,0 +1,299 @@
+#include "wcapabilities.h"
+#include "common.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <istream>
+#include <ostream>
+
+namespace
+{
+  /*!
+   * Appends each element of a list to the names buffer, null-terminated, and records its offset.
+   */
+  struct NameAppender
+  {
+    std::vector<char> &names;
+    std::vector<int> &offsets;
+
+    void operator()(const char *element, int length)
+    {
+      offsets.push_back(int(names.size()));
+      names.insert(names.end(), element, element + length);
+      names.push_back(0);
+    }
+  };
+
+  /*!
+   * Converts each element of a list to a double and appends it to the pass energies.
+   */
+  struct EnergyAppender
+  {
+    std::vector<double> &energies;
+
+    void operator()(const char *element, int length)
+    {
+      /* The element is followed by the rest of the list, so convert a terminated copy of it */
+      char number[64];
+      if (length >= int(sizeof(number)))
+        length = int(sizeof(number)) - 1;
+      memcpy(number, element, length);
+      number[length] = 0;
+      energies.push_back(strtod(number, 0));
+    }
+  };
+
+  template<typename T> bool writeVector(std::ostream &stream, const std::vector<T> &values)
+  {
+    int size = int(values.size());
+    stream.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    if (size > 0)
+      stream.write(reinterpret_cast<const char *>(&values[0]), size * sizeof(T));
+    return stream.good();
+  }
+
+  template<typename T> bool readVector(std::istream &stream, std::vector<T> &values)
+  {
+    int size = 0;
+    if (!stream.read(reinterpret_cast<char *>(&size), sizeof(size)) || size < 0 || size > (1 << 24))
+      return false;
+    values.resize(size);
+    return size == 0 || stream.read(reinterpret_cast<char *>(&values[0]), size * sizeof(T));
+  }
+
+  /*!
+   * \return \c true if each offset starts a null-terminated name in \p names.
+   */
+  bool validNames(const std::vector<char> &names, const std::vector<int> &offsets)
+  {
+    if (!names.empty() && names.back() != 0)
+      return false;
+    for (int i = 0; i < int(offsets.size()); i++)
+    {
+      if (offsets[i] < 0 || offsets[i] >= int(names.size()))
+        return false;
+    }
+    return true;
+  }
+}
+
+/*!
+ * Constructs an empty WCapabilities object.
+ */
+WCapabilities::WCapabilities()
+{
+  clear();
+}
+
+/*!
+ * Removes all element sets, lens modes and pass energies. Called before loading a new instrument configuration.
+ */
+void WCapabilities::clear()
+{
+  names_.clear();
+  elementSets_.clear();
+  lensModes_.clear();
+  passEnergies_.clear();
+  passEnergyOffsets_.assign(1, 0);
+}
+
+/*!
+ * Adds the element sets of a list obtained from GDS_GetElementSets().
+ *
+ * \param[in] list The list of element sets.
+ * \param[in] size The maximum size of \p list.
+ *
+ * \return The number of element sets added.
+ */
+int WCapabilities::addElementSets(const char *list, int size)
+{
+  NameAppender add = {names_, elementSets_};
+  return CommonNS::forEachQuoted(list, size, add);
+}
+
+/*!
+ * Adds the lens modes of a list obtained from GDS_GetLensModes().
+ *
+ * \param[in] list The list of lens modes.
+ * \param[in] size The maximum size of \p list.
+ *
+ * \return The number of lens modes added.
+ */
+int WCapabilities::addLensModes(const char *list, int size)
+{
+  NameAppender add = {names_, lensModes_};
+  return CommonNS::forEachQuoted(list, size, add);
+}
+
+/*!
+ * Adds the pass energies of the next lens mode, from a list obtained from GDS_GetPassEnergies(). Must be called once
+ * for each lens mode, in the order of the lens modes; pass 0 as \p list for a lens mode without pass energies.
+ *
+ * \param[in] list The list of pass energies. Can be 0 (NULL).
+ * \param[in] size The maximum size of \p list.
+ *
+ * \return The number of pass energies added.
+ */
+int WCapabilities::addPassEnergies(const char *list, int size)
+{
+  int count = 0;
+  if (list != 0)
+  {
+    EnergyAppender add = {passEnergies_};
+    count = CommonNS::forEachQuoted(list, size, add);
+  }
+  passEnergyOffsets_.push_back(int(passEnergies_.size()));
+  return count;
+}
+
+/*!
+ * \return The number of element sets.
+ */
+int WCapabilities::elementSetCount() const
+{
+  return int(elementSets_.size());
+}
+
+/*!
+ * \param[in] index 0 <= \p index < elementSetCount().
+ *
+ * \return The name of the element set, or 0 (NULL) if \p index is out of range.
+ */
+const char *WCapabilities::elementSet(int index) const
+{
+  return index >= 0 && index < int(elementSets_.size()) ? &names_[elementSets_[index]] : 0;
+}
+
+/*!
+ * \return The index of the element set \p name, or -1 if there is no such element set.
+ */
+int WCapabilities::findElementSet(const char *name) const
+{
+  return find(elementSets_, name);
+}
+
+/*!
+ * \return The number of lens modes.
+ */
+int WCapabilities::lensModeCount() const
+{
+  return int(lensModes_.size());
+}
+
+/*!
+ * \param[in] index 0 <= \p index < lensModeCount().
+ *
+ * \return The name of the lens mode, or 0 (NULL) if \p index is out of range.
+ */
+const char *WCapabilities::lensMode(int index) const
+{
+  return index >= 0 && index < int(lensModes_.size()) ? &names_[lensModes_[index]] : 0;
+}
+
+/*!
+ * \return The index of the lens mode \p name, or -1 if there is no such lens mode.
+ */
+int WCapabilities::findLensMode(const char *name) const
+{
+  return find(lensModes_, name);
+}
+
+/*!
+ * \param[in] lensMode The index of a lens mode.
+ *
+ * \return The number of pass energies available in \p lensMode, or 0 if \p lensMode is out of range.
+ */
+int WCapabilities::passEnergyCount(int lensMode) const
+{
+  if (lensMode < 0 || lensMode + 1 >= int(passEnergyOffsets_.size()))
+    return 0;
+  return passEnergyOffsets_[lensMode + 1] - passEnergyOffsets_[lensMode];
+}
+
+/*!
+ * \param[in] lensMode The index of a lens mode.
+ * \param[in] index 0 <= \p index < passEnergyCount(\p lensMode).
+ *
+ * \return The pass energy, or 0 if either index is out of range.
+ */
+double WCapabilities::passEnergy(int lensMode, int index) const
+{
+  if (index < 0 || index >= passEnergyCount(lensMode))
+    return 0;
+  return passEnergies_[passEnergyOffsets_[lensMode] + index];
+}
+
+/*!
+ * \return \c true if \p passEnergy is available in the lens mode with index \p lensMode.
+ */
+bool WCapabilities::hasPassEnergy(int lensMode, double passEnergy) const
+{
+  int count = passEnergyCount(lensMode);
+  for (int i = 0; i < count; i++)
+  {
+    if (passEnergies_[passEnergyOffsets_[lensMode] + i] == passEnergy)
+      return true;
+  }
+  return false;
+}
+
+/*!
+ * \return \c true if both objects hold the same element sets, lens modes and pass energies.
+ */
+bool WCapabilities::operator==(const WCapabilities &other) const
+{
+  return names_ == other.names_ && elementSets_ == other.elementSets_ && lensModes_ == other.lensModes_ &&
+    passEnergies_ == other.passEnergies_ && passEnergyOffsets_ == other.passEnergyOffsets_;
+}
+
+/*!
+ * \return \c true if the objects differ.
+ */
+bool WCapabilities::operator!=(const WCapabilities &other) const
+{
+  return !(*this == other);
+}
+
+/*!
+ * Writes the lists to a binary stream in the native byte order, as read by read().
+ *
+ * \return \c true if successful.
+ */
+bool WCapabilities::write(std::ostream &stream) const
+{
+  return writeVector(stream, names_) && writeVector(stream, elementSets_) && writeVector(stream, lensModes_) &&
+    writeVector(stream, passEnergies_) && writeVector(stream, passEnergyOffsets_);
+}
+
+/*!
+ * Reads the lists written by write(). The object is left empty if the stream is truncated or inconsistent.
+ *
+ * \return \c true if successful.
+ */
+bool WCapabilities::read(std::istream &stream)
+{
+  bool success = readVector(stream, names_) && readVector(stream, elementSets_) && readVector(stream, lensModes_) &&
+    readVector(stream, passEnergies_) && readVector(stream, passEnergyOffsets_);
+
+  success = success && validNames(names_, elementSets_) && validNames(names_, lensModes_) &&
+    passEnergyOffsets_.size() == lensModes_.size() + 1 && passEnergyOffsets_.front() == 0 &&
+    passEnergyOffsets_.back() == int(passEnergies_.size());
+  for (int i = 1; success && i < int(passEnergyOffsets_.size()); i++)
+    success = passEnergyOffsets_[i] >= passEnergyOffsets_[i - 1];
+
+  if (!success)
+    clear();
+  return success;
+}
+
+int WCapabilities::find(const std::vector<int> &offsets, const char *name) const
+{
+  if (name == 0)
+    return -1;
+  for (int i = 0; i < int(offsets.size()); i++)
+  {
+    if (strcmp(&names_[offsets[i]], name) == 0)
+      return i;
+  }
+  return -1;
+}
@@ -0,0 +1,52 @@
+#ifndef __SESWRAPPER_WCAPABILITIES_H__
+#define __SESWRAPPER_WCAPABILITIES_H__
+
+#include <vector>
+#include <iosfwd>
+
+/*!
+ * \brief Holds the element sets, lens modes and pass energies of the loaded instrument.
+ *
+ * The lists are read from SESInstrument once, after the instrument configuration has been loaded, and are then
+ * served from here without calls into the library. The names are stored back to back in one buffer and the
+ * pass energies of all lens modes in one array, with the pass energies of lens mode \c i between
+ * <code>passEnergyOffsets_[i]</code> and <code>passEnergyOffsets_[i + 1]</code>.
+ */
+class WCapabilities
+{
+public:
+  WCapabilities();
+
+  void clear();
+  int addElementSets(const char *list, int size);
+  int addLensModes(const char *list, int size);
+  int addPassEnergies(const char *list, int size);
+
+  int elementSetCount() const;
+  const char *elementSet(int index) const;
+  int findElementSet(const char *name) const;
+
+  int lensModeCount() const;
+  const char *lensMode(int index) const;
+  int findLensMode(const char *name) const;
+
+  int passEnergyCount(int lensMode) const;
+  double passEnergy(int lensMode, int index) const;
+  bool hasPassEnergy(int lensMode, double passEnergy) const;
+
+  bool operator==(const WCapabilities &other) const;
+  bool operator!=(const WCapabilities &other) const;
+  bool write(std::ostream &stream) const;
+  bool read(std::istream &stream);
+
+private:
+  int find(const std::vector<int> &offsets, const char *name) const;
+
+  std::vector<char> names_;
+  std::vector<int> elementSets_;
+  std::vector<int> lensModes_;
+  std::vector<double> passEnergies_;
+  std::vector<int> passEnergyOffsets_;
+};
+
+#endif
@@ -0,0 +1,1106 @@
+#pragma warning(disable:4996)
+
+#include "wcapture.h"
+#include "wcallstats.h"
+#include "wlock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace SesNS;
+
+namespace
+{
+  const char MAGIC[8] = "SESCAPT";
+
+  /*! The largest buffer argument that is recorded, in bytes */
+  const long long MAX_BUFFER = 1 << 28;
+
+  enum FunctionFlags
+  {
+    HOOKS_CALLBACKS = 1,
+    STARTS_ACQUISITION = 2,
+    READS_FRAME = 4
+  };
+
+  /*!
+   * The header of a capture file. The structure sizes reject files written by a build with a different layout.
+   */
+  struct Header
+  {
+    char magic[8];
+    int version;
+    int regionSize;
+    int detectorSize;
+    int detectorInfoSize;
+    int instrumentInfoSize;
+    long long startTime;
+  };
+
+  const char *functionNames[WCapture::MAX_FUNCTIONS];
+  int functionFlags[WCapture::MAX_FUNCTIONS];
+  int functionCount = 0;
+
+  FILE *captureFile = 0;
+  bool captureFrames = false;
+  double openTime = 0;
+  int acquisitionCount = 0;
+  WSpectrum *currentSpectrum = 0;
+  WSignals *currentSignals = 0;
+  PointReady clientPointReady = 0;
+  RegionReady clientRegionReady = 0;
+  std::vector<double> previousSpectrum;
+  std::vector<double> previousSignals;
+  std::vector<double> scratch;
+
+  /*!
+   * Constructed when the library is loaded, before any thunk can record a call.
+   */
+  WLock captureLock;
+
+  Header currentHeader()
+  {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = WCapture::VERSION;
+    header.regionSize = sizeof(WRegion);
+    header.detectorSize = sizeof(WDetector);
+    header.detectorInfoSize = sizeof(WDetectorInfo);
+    header.instrumentInfoSize = sizeof(WInstrumentInfo);
+    return header;
+  }
+
+  template<typename T> void append(std::string &bytes, const T &value)
+  {
+    bytes.append(reinterpret_cast<const char *>(&value), sizeof(T));
+  }
+
+  void appendBytes(std::string &bytes, const void *data, size_t size)
+  {
+    if (size > 0)
+      bytes.append(static_cast<const char *>(data), size);
+  }
+
+  /*!
+   * Appends \p count doubles, or zeros if \p values is 0.
+   */
+  void appendVector(std::string &bytes, const double *values, int count)
+  {
+    if (values != 0)
+      appendBytes(bytes, values, count * sizeof(double));
+    else
+      bytes.append(count * sizeof(double), '\0');
+  }
+
+  /*!
+   * Reads values from the bytes of a recorded argument.
+   */
+  class Cursor
+  {
+  public:
+    Cursor(const std::string &bytes) : bytes_(bytes), position_(0) {}
+
+    template<typename T> bool read(T &value)
+    {
+      return read(&value, sizeof(T));
+    }
+
+    bool read(void *data, size_t size)
+    {
+      if (bytes_.size() - position_ < size)
+        return false;
+      memcpy(data, bytes_.data() + position_, size);
+      position_ += size;
+      return true;
+    }
+
+    bool readVector(std::vector<double> &values, int count)
+    {
+      if (count < 0 || (bytes_.size() - position_) / sizeof(double) < size_t(count))
+        return false;
+      values.resize(count);
+      return count == 0 || read(&values[0], count * sizeof(double));
+    }
+
+    bool atEnd() const
+    {
+      return position_ == bytes_.size();
+    }
+
+  private:
+    const std::string &bytes_;
+    size_t position_;
+  };
+
+  /*!
+   * Writes the record that gives a function its number. Called with the lock held and the file open.
+   */
+  void writeFunction(int id)
+  {
+    std::string record;
+    int length = int(strlen(functionNames[id]));
+    append(record, int(WCapture::RECORD_FUNCTION));
+    append(record, id);
+    append(record, length);
+    appendBytes(record, functionNames[id], length);
+    fwrite(record.data(), 1, record.size(), captureFile);
+  }
+
+  /*!
+   * Appends the values in \p current that differ from those in \p previous as runs of consecutive values, and then
+   * makes \p current the previous values. The values are compared bit for bit, so that a NaN is only written when
+   * it appears.
+   */
+  void appendChanges(std::string &record, int sweeps, int rows, int columns, std::vector<double> &current,
+                     std::vector<double> &previous)
+  {
+    int length = int(current.size());
+    append(record, sweeps);
+    append(record, rows);
+    append(record, columns);
+    append(record, length);
+    if (previous.size() != current.size())
+      previous.assign(current.size(), 0.0);
+
+    int i = 0;
+    while (i < length)
+    {
+      if (memcmp(&current[i], &previous[i], sizeof(double)) == 0)
+      {
+        i++;
+        continue;
+      }
+      int first = i;
+      while (i < length && memcmp(&current[i], &previous[i], sizeof(double)) != 0)
+        i++;
+      int count = i - first;
+      append(record, count);
+      append(record, first);
+      appendBytes(record, &current[first], count * sizeof(double));
+    }
+    append(record, int(0));
+    previous.swap(current);
+  }
+
+  /*!
+   * Appends the changes of a matrix of \p rows rows of \p columns values, followed by \p extra values if it is not 0.
+   */
+  void appendMatrixChanges(std::string &record, int sweeps, int rows, int columns, const double *const *data,
+                           const double *extra, std::vector<double> &previous)
+  {
+    if (data == 0 || rows <= 0 || columns <= 0)
+    {
+      rows = 0;
+      columns = 0;
+    }
+    size_t matrix = size_t(rows) * columns;
+    scratch.resize(matrix + (extra != 0 && columns > 0 ? columns : 0));
+    for (int j = 0; j < rows; j++)
+    {
+      if (data[j] != 0)
+        memcpy(&scratch[size_t(j) * columns], data[j], columns * sizeof(double));
+      else
+        memset(&scratch[size_t(j) * columns], 0, columns * sizeof(double));
+    }
+    if (scratch.size() > matrix)
+      memcpy(&scratch[matrix], extra, columns * sizeof(double));
+    appendChanges(record, sweeps, rows, columns, scratch, previous);
+  }
+}
+
+/*!
+ * Starts a capture to a new file. A capture already in progress is closed first.
+ *
+ * The detector frames read with GDS_GetRawImage() can be as large as the detector, so only their geometry is
+ * recorded unless the environment variable \c SES_CAPTURE_RAW_IMAGES is set to anything but 0 when the capture
+ * starts. A replay of a capture without them leaves the buffer of the frame as it was.
+ *
+ * \param[in] fileName The capture file. An existing file is replaced.
+ *
+ * \return \c true if successful.
+ */
+bool WCapture::open(const char *fileName)
+{
+  if (fileName == 0 || *fileName == 0)
+    return false;
+  FILE *file = fopen(fileName, "wb");
+  if (file == 0)
+    return false;
+  Header header = currentHeader();
+  header.startTime = (long long)time(0);
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+  {
+    fclose(file);
+    return false;
+  }
+
+  const char *frames = getenv("SES_CAPTURE_RAW_IMAGES");
+
+  captureLock.lock();
+  if (captureFile != 0)
+    fclose(captureFile);
+  captureFile = file;
+  captureFrames = frames != 0 && *frames != 0 && strcmp(frames, "0") != 0;
+  openTime = WCallStats::now();
+  acquisitionCount = 0;
+  previousSpectrum.clear();
+  previousSignals.clear();
+  for (int i = 0; i < functionCount; i++)
+    writeFunction(i);
+  captureLock.unlock();
+  return true;
+}
+
+/*!
+ * Ends the capture and closes the file.
+ */
+void WCapture::close()
+{
+  captureLock.lock();
+  if (captureFile != 0)
+    fclose(captureFile);
+  captureFile = 0;
+  previousSpectrum.clear();
+  previousSignals.clear();
+  captureLock.unlock();
+}
+
+/*!
+ * \return \c true if a capture is in progress.
+ */
+bool WCapture::isOpen()
+{
+  captureLock.lock();
+  bool result = captureFile != 0;
+  captureLock.unlock();
+  return result;
+}
+
+/*!
+ * Registers a function. A function keeps its number for the lifetime of the program, and every capture file starts
+ * with the names of all the functions registered so far.
+ *
+ * \param[in] name The name of the function. Must stay valid for the lifetime of the program.
+ *
+ * \return The number of the function, or -1 if all numbers are in use.
+ */
+int WCapture::add(const char *name)
+{
+  int id = -1;
+  captureLock.lock();
+  for (int i = 0; i < functionCount && id < 0; i++)
+  {
+    if (strcmp(functionNames[i], name) == 0)
+      id = i;
+  }
+  if (id < 0 && functionCount < MAX_FUNCTIONS)
+  {
+    id = functionCount++;
+    functionNames[id] = name;
+    functionFlags[id] = 0;
+    if (strcmp(name, "GDS_Start") == 0 || strcmp(name, "GDS_InitAcquisition") == 0)
+      functionFlags[id] |= HOOKS_CALLBACKS;
+    if (strcmp(name, "GDS_Start") == 0 || strcmp(name, "GDS_StartAcquisition") == 0)
+      functionFlags[id] |= STARTS_ACQUISITION;
+    if (strcmp(name, "GDS_GetRawImage") == 0)
+      functionFlags[id] |= READS_FRAME;
+    if (captureFile != 0)
+      writeFunction(id);
+  }
+  captureLock.unlock();
+  return id;
+}
+
+/*!
+ * \return \c true if the PointReady and RegionReady callbacks passed to the function are recorded.
+ */
+bool WCapture::hooksCallbacks(int id)
+{
+  return id >= 0 && id < functionCount && (functionFlags[id] & HOOKS_CALLBACKS) != 0;
+}
+
+/*!
+ * \return \c true if the contents of the buffers passed to the function are recorded, which for the detector frames
+ *         of GDS_GetRawImage() depends on \c SES_CAPTURE_RAW_IMAGES, see open().
+ */
+bool WCapture::recordsBuffers(int id)
+{
+  if (id < 0 || id >= functionCount || (functionFlags[id] & READS_FRAME) == 0)
+    return true;
+  captureLock.lock();
+  bool result = captureFrames;
+  captureLock.unlock();
+  return result;
+}
+
+/*!
+ * \return \c true if the function starts an acquisition, whose callbacks are then recorded with a new number.
+ */
+bool WCapture::startsAcquisition(int id)
+{
+  return id >= 0 && id < functionCount && (functionFlags[id] & STARTS_ACQUISITION) != 0;
+}
+
+/*!
+ * Gives the next acquisition a new number. The first callback of an acquisition records the whole spectrum and
+ * signals, the following ones the values that changed, so that each acquisition can be replayed on its own.
+ *
+ * \return The number of the acquisition.
+ */
+int WCapture::startAcquisition()
+{
+  captureLock.lock();
+  int result = ++acquisitionCount;
+  previousSpectrum.clear();
+  previousSignals.clear();
+  captureLock.unlock();
+  return result;
+}
+
+/*!
+ * \return The number of the last acquisition started, or 0 before the first one.
+ */
+int WCapture::acquisition()
+{
+  captureLock.lock();
+  int result = acquisitionCount;
+  captureLock.unlock();
+  return result;
+}
+
+/*!
+ * \return The time in seconds since the capture was opened.
+ */
+double WCapture::now()
+{
+  return WCallStats::now() - openTime;
+}
+
+/*!
+ * Appends a record to the capture file, if a capture is in progress.
+ */
+void WCapture::write(const std::string &record)
+{
+  captureLock.lock();
+  if (captureFile != 0)
+    fwrite(record.data(), 1, record.size(), captureFile);
+  captureLock.unlock();
+}
+
+/*!
+ * Sets the spectrum that is recorded at the callbacks, as returned by the library in a WSpectrum** argument.
+ */
+void WCapture::setSpectrum(WSpectrum *spectrum)
+{
+  captureLock.lock();
+  currentSpectrum = spectrum;
+  captureLock.unlock();
+}
+
+/*!
+ * Sets the signals that are recorded at the callbacks, as returned by the library in a WSignals** argument.
+ */
+void WCapture::setSignals(WSignals *signals)
+{
+  captureLock.lock();
+  currentSignals = signals;
+  captureLock.unlock();
+}
+
+/*!
+ * Keeps the PointReady callback of the caller and returns the callback that records the point and then calls it.
+ */
+PointReady WCapture::hookPointReady(PointReady pointReady)
+{
+  if (pointReady == 0 || pointReady == &WCapture::pointReady)
+    return pointReady;
+  captureLock.lock();
+  clientPointReady = pointReady;
+  captureLock.unlock();
+  return &WCapture::pointReady;
+}
+
+/*!
+ * Keeps the RegionReady callback of the caller and returns the callback that records the region and then calls it.
+ */
+RegionReady WCapture::hookRegionReady(RegionReady regionReady)
+{
+  if (regionReady == 0 || regionReady == &WCapture::regionReady)
+    return regionReady;
+  captureLock.lock();
+  clientRegionReady = regionReady;
+  captureLock.unlock();
+  return &WCapture::regionReady;
+}
+
+void __stdcall WCapture::pointReady(int point)
+{
+  recordCallback(RECORD_POINT_READY, point);
+  captureLock.lock();
+  PointReady client = clientPointReady;
+  captureLock.unlock();
+  if (client != 0)
+    client(point);
+}
+
+void __stdcall WCapture::regionReady()
+{
+  recordCallback(RECORD_REGION_READY, -1);
+  captureLock.lock();
+  RegionReady client = clientRegionReady;
+  captureLock.unlock();
+  if (client != 0)
+    client();
+}
+
+/*!
+ * Records a callback with the values of the spectrum and the signals that changed since the previous callback of
+ * the acquisition. The file is flushed at the end of each region.
+ */
+void WCapture::recordCallback(int type, int point)
+{
+  captureLock.lock();
+  if (captureFile != 0)
+  {
+    std::string record;
+    append(record, type);
+    append(record, acquisitionCount);
+    append(record, WCallStats::now() - openTime);
+    append(record, point);
+    if (currentSpectrum != 0)
+      appendMatrixChanges(record, currentSpectrum->Sweeps, currentSpectrum->Slices, currentSpectrum->Channels,
+                          currentSpectrum->Data, currentSpectrum->SumData, previousSpectrum);
+    else
+      appendMatrixChanges(record, 0, 0, 0, 0, 0, previousSpectrum);
+    if (currentSignals != 0)
+      appendMatrixChanges(record, currentSignals->Sweeps, currentSignals->Count, currentSignals->Steps,
+                          currentSignals->Data, 0, previousSignals);
+    else
+      appendMatrixChanges(record, 0, 0, 0, 0, 0, previousSignals);
+    fwrite(record.data(), 1, record.size(), captureFile);
+    if (type == RECORD_REGION_READY)
+      fflush(captureFile);
+  }
+  captureLock.unlock();
+}
+
+/*!
+ * Encodes the layout, the units and the scales of a spectrum.
+ */
+void WCapture::encodeSpectrum(std::string &bytes, const WSpectrum &spectrum)
+{
+  int channels = spectrum.Channels > 0 ? spectrum.Channels : 0;
+  int slices = spectrum.Slices > 0 ? spectrum.Slices : 0;
+  append(bytes, channels);
+  append(bytes, slices);
+  append(bytes, spectrum.Sweeps);
+  append(bytes, spectrum.CountUnit);
+  append(bytes, spectrum.ChannelUnit);
+  append(bytes, spectrum.SliceUnit);
+  appendVector(bytes, spectrum.ChannelScale, channels);
+  appendVector(bytes, spectrum.SliceScale, slices);
+}
+
+/*!
+ * Decodes a spectrum encoded by encodeSpectrum(). The pointers of \p spectrum are left as they are.
+ *
+ * \return \c true if successful.
+ */
+bool WCapture::decodeSpectrum(const std::string &bytes, WSpectrum &spectrum, std::vector<double> &channelScale,
+                              std::vector<double> &sliceScale)
+{
+  Cursor cursor(bytes);
+  WSpectrum decoded;
+  bool success = cursor.read(decoded.Channels) && cursor.read(decoded.Slices) && cursor.read(decoded.Sweeps) &&
+    cursor.read(decoded.CountUnit) && cursor.read(decoded.ChannelUnit) && cursor.read(decoded.SliceUnit) &&
+    cursor.readVector(channelScale, decoded.Channels) && cursor.readVector(sliceScale, decoded.Slices) &&
+    cursor.atEnd();
+  if (success)
+  {
+    spectrum.Channels = decoded.Channels;
+    spectrum.Slices = decoded.Slices;
+    spectrum.Sweeps = decoded.Sweeps;
+    memcpy(spectrum.CountUnit, decoded.CountUnit, sizeof(Char32));
+    memcpy(spectrum.ChannelUnit, decoded.ChannelUnit, sizeof(Char32));
+    memcpy(spectrum.SliceUnit, decoded.SliceUnit, sizeof(Char32));
+  }
+  return success;
+}
+
+/*!
+ * Encodes the layout, the units, the scale and the names of signals.
+ */
+void WCapture::encodeSignals(std::string &bytes, const WSignals &signals)
+{
+  int count = signals.Count > 0 ? signals.Count : 0;
+  int steps = signals.Steps > 0 ? signals.Steps : 0;
+  append(bytes, count);
+  append(bytes, steps);
+  append(bytes, signals.Sweeps);
+  append(bytes, signals.StepsUnit);
+  appendVector(bytes, signals.StepsScale, steps);
+  if (signals.Names != 0)
+    appendBytes(bytes, signals.Names, count * sizeof(Char32));
+  else
+    bytes.append(count * sizeof(Char32), '\0');
+}
+
+/*!
+ * Decodes signals encoded by encodeSignals(). The pointers of \p signals are left as they are.
+ *
+ * \param[out] names The names of the signals, \c sizeof(Char32) bytes each.
+ *
+ * \return \c true if successful.
+ */
+bool WCapture::decodeSignals(const std::string &bytes, WSignals &signals, std::vector<double> &stepsScale,
+                             std::vector<char> &names)
+{
+  Cursor cursor(bytes);
+  WSignals decoded;
+  bool success = cursor.read(decoded.Count) && cursor.read(decoded.Steps) && cursor.read(decoded.Sweeps) &&
+    cursor.read(decoded.StepsUnit) && cursor.readVector(stepsScale, decoded.Steps) && decoded.Count >= 0;
+  if (success)
+  {
+    names.resize(decoded.Count * sizeof(Char32) + 1);
+    success = cursor.read(&names[0], names.size() - 1) && cursor.atEnd();
+  }
+  if (success)
+  {
+    signals.Count = decoded.Count;
+    signals.Steps = decoded.Steps;
+    signals.Sweeps = decoded.Sweeps;
+    memcpy(signals.StepsUnit, decoded.StepsUnit, sizeof(Char32));
+  }
+  return success;
+}
+
+/*!
+ * \return The size in bytes of the value of an instrument option, as passed to GDS_GetOption() and
+ *         GDS_SetOption(), or -1 if it is not known.
+ */
+int WCapture::optionSize(int option)
+{
+  switch (option)
+  {
+  case FermiEdge:
+  case SmoothPoints:
+  case AlwaysDelayRegion:
+  case ZeroVoltages:
+  case ShowProgress:
+  case DelayDrawing:
+  case AllowSignalsWithDetector:
+  case AdjustRegionForSignalsWithDetector:
+    return sizeof(bool);
+  case DetectorCount:
+  case DetectorNamesSize:
+    return sizeof(int);
+  case ActiveDetector:
+    return sizeof(unsigned short);
+  default:
+    return -1;
+  }
+}
+
+/*!
+ * Starts the description of a call of the function \p id, which is only recorded if \p id is valid and a capture
+ * is in progress. A call of GDS_Start() or GDS_StartAcquisition() starts a new acquisition.
+ */
+WCaptureCall::WCaptureCall(int id)
+  : active_(id >= 0 && WCapture::isOpen()), id_(id), acquisition_(0), start_(0), duration_(0)
+{
+  if (active_)
+  {
+    acquisition_ = WCapture::startsAcquisition(id) ? WCapture::startAcquisition() : WCapture::acquisition();
+    start_ = WCapture::now();
+  }
+}
+
+/*!
+ * Passes the PointReady callback of an acquisition through WCapture.
+ */
+WCaptureCall &WCaptureCall::hook(PointReady &pointReady)
+{
+  if (active_ && WCapture::hooksCallbacks(id_))
+    pointReady = WCapture::hookPointReady(pointReady);
+  return *this;
+}
+
+/*!
+ * Passes the RegionReady callback of an acquisition through WCapture.
+ */
+WCaptureCall &WCaptureCall::hook(RegionReady &regionReady)
+{
+  if (active_ && WCapture::hooksCallbacks(id_))
+    regionReady = WCapture::hookRegionReady(regionReady);
+  return *this;
+}
+
+/*!
+ * Marks the end of the call.
+ */
+WCaptureCall &WCaptureCall::returned()
+{
+  if (active_)
+    duration_ = WCapture::now() - start_;
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::add(int value)
+{
+  if (active_)
+  {
+    Argument &argument = newArgument(WCapture::VALUE_DATA);
+    appendBytes(argument.bytes, &value, sizeof(value));
+    argument.isInt = true;
+    argument.intValue = value;
+  }
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::add(double value)
+{
+  return this->value(&value, sizeof(value));
+}
+
+WCaptureCall &WCaptureCall::add(bool value)
+{
+  return this->value(&value, sizeof(value));
+}
+
+WCaptureCall &WCaptureCall::add(const char *value)
+{
+  if (active_)
+  {
+    Argument &argument = newArgument(value != 0 ? WCapture::VALUE_STRING : WCapture::VALUE_NULL);
+    if (value != 0)
+      argument.bytes = value;
+  }
+  return *this;
+}
+
+/*!
+ * A string buffer filled by the call, whose size is given by the \c int* argument that follows it.
+ */
+WCaptureCall &WCaptureCall::add(char *value)
+{
+  return buffer(value, BUFFER_STRING);
+}
+
+/*!
+ * A raw image filled by the call, whose size is the product of the \c int* arguments that follow it.
+ */
+WCaptureCall &WCaptureCall::add(unsigned char *value)
+{
+  return buffer(value, BUFFER_OUTPUT);
+}
+
+/*!
+ * A value filled by the call, whose size is given by the \c int* argument that follows it or by the option before it.
+ */
+WCaptureCall &WCaptureCall::add(void *value)
+{
+  return buffer(value, BUFFER_OPTION);
+}
+
+/*!
+ * A value read by the call, whose size is given by the \c int argument that follows it or by the option before it.
+ */
+WCaptureCall &WCaptureCall::add(const void *value)
+{
+  return buffer(value, BUFFER_VALUE);
+}
+
+/*!
+ * An \c int output, which is also the size of a buffer argument before it.
+ */
+WCaptureCall &WCaptureCall::add(int *value)
+{
+  output(value, sizeof(int));
+  if (active_ && value != 0)
+  {
+    arguments_.back().isSize = true;
+    arguments_.back().intValue = *value;
+  }
+  return *this;
+}
+
+/*!
+ * The spectrum returned by the call. It is also the spectrum recorded at the callbacks from now on.
+ */
+WCaptureCall &WCaptureCall::add(WSpectrum **value)
+{
+  if (active_)
+  {
+    bool valid = value != 0 && *value != 0;
+    Argument &argument = newArgument(valid ? WCapture::VALUE_SPECTRUM : WCapture::VALUE_NULL);
+    if (valid)
+    {
+      WCapture::encodeSpectrum(argument.bytes, **value);
+      WCapture::setSpectrum(*value);
+    }
+  }
+  return *this;
+}
+
+/*!
+ * The signals returned by the call. They are also the signals recorded at the callbacks from now on.
+ */
+WCaptureCall &WCaptureCall::add(WSignals **value)
+{
+  if (active_)
+  {
+    bool valid = value != 0 && *value != 0;
+    Argument &argument = newArgument(valid ? WCapture::VALUE_SIGNALS : WCapture::VALUE_NULL);
+    if (valid)
+    {
+      WCapture::encodeSignals(argument.bytes, **value);
+      WCapture::setSignals(*value);
+    }
+  }
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::add(PointReady value)
+{
+  if (active_)
+    newArgument(value != 0 ? WCapture::VALUE_CALLBACK : WCapture::VALUE_NULL);
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::add(RegionReady value)
+{
+  if (active_)
+    newArgument(value != 0 ? WCapture::VALUE_CALLBACK : WCapture::VALUE_NULL);
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::add(OffsetReady value)
+{
+  if (active_)
+    newArgument(value != 0 ? WCapture::VALUE_CALLBACK : WCapture::VALUE_NULL);
+  return *this;
+}
+
+/*!
+ * Records a string result and writes the record of the call.
+ */
+const char *WCaptureCall::result(const char *value)
+{
+  if (active_)
+    finish(value != 0 ? WCapture::VALUE_STRING : WCapture::VALUE_NULL, value, value != 0 ? int(strlen(value)) : 0, true);
+  return value;
+}
+
+/*!
+ * Writes the record of a call without a result.
+ */
+void WCaptureCall::result()
+{
+  if (active_)
+    finish(WCapture::VALUE_NONE, 0, 0, true);
+}
+
+WCaptureCall &WCaptureCall::value(const void *pointer, int size)
+{
+  if (active_)
+    appendBytes(newArgument(WCapture::VALUE_DATA).bytes, pointer, size);
+  return *this;
+}
+
+WCaptureCall &WCaptureCall::output(const void *pointer, int size)
+{
+  if (active_)
+  {
+    Argument &argument = newArgument(pointer != 0 ? WCapture::VALUE_OUTPUT : WCapture::VALUE_NULL);
+    if (pointer != 0)
+      appendBytes(argument.bytes, pointer, size);
+  }
+  return *this;
+}
+
+/*!
+ * Adds a buffer argument, whose size is only known once all the arguments have been added.
+ */
+WCaptureCall &WCaptureCall::buffer(const void *pointer, int buffer)
+{
+  if (active_)
+  {
+    Argument &argument = newArgument(pointer != 0 ? WCapture::VALUE_UNSIZED : WCapture::VALUE_NULL);
+    if (pointer != 0)
+    {
+      argument.buffer = buffer;
+      argument.pointer = pointer;
+    }
+  }
+  return *this;
+}
+
+WCaptureCall::Argument &WCaptureCall::newArgument(int type)
+{
+  arguments_.push_back(Argument());
+  Argument &argument = arguments_.back();
+  argument.type = type;
+  argument.buffer = BUFFER_NONE;
+  argument.pointer = 0;
+  argument.isInt = false;
+  argument.isSize = false;
+  argument.intValue = 0;
+  return argument;
+}
+
+/*!
+ * \return The size in bytes of the buffer argument at \p index, or -1 if it is not known.
+ */
+long long WCaptureCall::bufferSize(size_t index) const
+{
+  const Argument &argument = arguments_[index];
+  long long size = -1;
+  for (size_t i = index + 1; i < arguments_.size(); i++)
+  {
+    const Argument &next = arguments_[i];
+    if (argument.buffer == BUFFER_VALUE ? next.isInt : next.isSize)
+    {
+      size = (size < 0 ? 1 : size) * next.intValue;
+      if (argument.buffer == BUFFER_VALUE || size < 0)
+        break;
+    }
+  }
+  if (size < 0 && (argument.buffer == BUFFER_VALUE || argument.buffer == BUFFER_OPTION) && index > 0 &&
+      arguments_[index - 1].isInt)
+    size = WCapture::optionSize(arguments_[index - 1].intValue);
+  if (size < 0 && argument.buffer == BUFFER_STRING)
+    size = (long long)strlen(static_cast<const char *>(argument.pointer));
+  return size <= MAX_BUFFER ? size : -1;
+}
+
+/*!
+ * Records the buffer arguments and the result, and writes the record of the call. The outputs of a call that
+ * failed are not recorded, as the buffers may not have been filled. Neither are the buffers of a function whose
+ * contents WCapture::recordsBuffers() leaves out, which stay VALUE_UNSIZED.
+ */
+void WCaptureCall::finish(int type, const void *result, int size, bool succeeded)
+{
+  bool buffers = WCapture::recordsBuffers(id_);
+  for (size_t i = 0; i < arguments_.size() && buffers; i++)
+  {
+    Argument &argument = arguments_[i];
+    if (argument.buffer == BUFFER_NONE)
+      continue;
+    long long length = succeeded || argument.buffer == BUFFER_VALUE ? bufferSize(i) : -1;
+    if (length < 0)
+      continue;
+    if (argument.buffer == BUFFER_STRING)
+    {
+      const void *end = memchr(argument.pointer, 0, size_t(length));
+      if (end != 0)
+        length = static_cast<const char *>(end) - static_cast<const char *>(argument.pointer);
+      argument.type = WCapture::VALUE_STRING;
+    }
+    else
+    {
+      argument.type = argument.buffer == BUFFER_VALUE ? WCapture::VALUE_DATA : WCapture::VALUE_OUTPUT;
+    }
+    appendBytes(argument.bytes, argument.pointer, size_t(length));
+  }
+
+  std::string record;
+  append(record, int(WCapture::RECORD_CALL));
+  append(record, id_);
+  append(record, acquisition_);
+  append(record, start_);
+  append(record, duration_);
+  append(record, int(arguments_.size()));
+  for (size_t i = 0; i < arguments_.size(); i++)
+  {
+    append(record, arguments_[i].type);
+    append(record, int(arguments_[i].bytes.size()));
+    appendBytes(record, arguments_[i].bytes.data(), arguments_[i].bytes.size());
+  }
+  append(record, type);
+  append(record, size);
+  appendBytes(record, result, size);
+  WCapture::write(record);
+}
+
+/*!
+ * \class WCaptureReader
+ *
+ * The file starts with a header: the magic "SESCAPT", the format version, the sizes of the SesNS structures and
+ * the time the capture was opened, in seconds since the epoch. Every record then starts with its type, an \c int:
+ *
+ * - \c RECORD_FUNCTION: the number of the function and the length and characters of its name.
+ * - \c RECORD_CALL: the number of the function and of the current acquisition, the start time and the duration in
+ *   seconds as doubles, the number of arguments, each argument and the result. A value is its WCapture::ValueType,
+ *   the number of bytes and the bytes.
+ * - \c RECORD_POINT_READY and \c RECORD_REGION_READY: the number of the acquisition, the time, the point (-1 for a
+ *   region), then the changes of the spectrum and of the signals. Changes are the number of sweeps, rows and
+ *   columns and values, then runs of changed values, each the number of values, the index of the first one and the
+ *   values, ended by a run of 0 values.
+ */
+
+/*!
+ * Applies the changes to \p target, which is cleared first if it has a different number of values.
+ */
+void WCaptureReader::Changes::apply(std::vector<double> &target) const
+{
+  if (int(target.size()) != length)
+    target.assign(length, 0.0);
+  size_t value = 0;
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    memcpy(&target[offsets[i]], &values[value], counts[i] * sizeof(double));
+    value += counts[i];
+  }
+}
+
+WCaptureReader::WCaptureReader()
+  : file_(0), startTime_(0)
+{
+}
+
+WCaptureReader::~WCaptureReader()
+{
+  close();
+}
+
+/*!
+ * Opens a capture file written by the current version of WCapture.
+ *
+ * \return \c true if successful.
+ */
+bool WCaptureReader::open(const char *fileName)
+{
+  close();
+  if (fileName == 0)
+    return false;
+  file_ = fopen(fileName, "rb");
+  if (file_ == 0)
+    return false;
+
+  Header header;
+  Header expected = currentHeader();
+  if (fread(&header, sizeof(header), 1, file_) != 1)
+  {
+    close();
+    return false;
+  }
+  startTime_ = header.startTime;
+  header.startTime = 0;
+  if (memcmp(&header, &expected, sizeof(header)) != 0)
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void WCaptureReader::close()
+{
+  if (file_ != 0)
+    fclose(file_);
+  file_ = 0;
+}
+
+/*!
+ * Reads the next record.
+ *
+ * \return \c true if successful, \c false at the end of the file or if the record is not valid. A capture that was
+ *         not closed may end with an incomplete record.
+ */
+bool WCaptureReader::next(Record &record)
+{
+  if (file_ == 0 || fread(&record.type, sizeof(int), 1, file_) != 1)
+    return false;
+
+  record.function = -1;
+  record.name.clear();
+  record.acquisition = 0;
+  record.time = 0;
+  record.duration = 0;
+  record.arguments.clear();
+  record.result.type = WCapture::VALUE_NONE;
+  record.result.bytes.clear();
+  record.point = -1;
+
+  if (record.type == WCapture::RECORD_FUNCTION)
+  {
+    int length = 0;
+    if (fread(&record.function, sizeof(int), 1, file_) != 1 || fread(&length, sizeof(int), 1, file_) != 1 ||
+        record.function < 0 || record.function >= WCapture::MAX_FUNCTIONS || length <= 0 || length > 256)
+      return false;
+    record.name.resize(length);
+    return fread(&record.name[0], 1, length, file_) == size_t(length);
+  }
+  if (record.type == WCapture::RECORD_CALL)
+  {
+    int count = 0;
+    if (fread(&record.function, sizeof(int), 1, file_) != 1 || fread(&record.acquisition, sizeof(int), 1, file_) != 1 ||
+        fread(&record.time, sizeof(double), 1, file_) != 1 || fread(&record.duration, sizeof(double), 1, file_) != 1 ||
+        fread(&count, sizeof(int), 1, file_) != 1 || count < 0 || count > 16)
+      return false;
+    record.arguments.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+      if (!readValue(record.arguments[i]))
+        return false;
+    }
+    return readValue(record.result);
+  }
+  if (record.type == WCapture::RECORD_POINT_READY || record.type == WCapture::RECORD_REGION_READY)
+  {
+    return fread(&record.acquisition, sizeof(int), 1, file_) == 1 && fread(&record.time, sizeof(double), 1, file_) == 1 &&
+      fread(&record.point, sizeof(int), 1, file_) == 1 && readChanges(record.spectrum) && readChanges(record.signals);
+  }
+  return false;
+}
+
+/*!
+ * \return The time the capture was opened, in seconds since the epoch.
+ */
+long long WCaptureReader::startTime() const
+{
+  return startTime_;
+}
+
+bool WCaptureReader::readValue(Value &value)
+{
+  int size = 0;
+  if (fread(&value.type, sizeof(int), 1, file_) != 1 || fread(&size, sizeof(int), 1, file_) != 1 || size < 0 ||
+      size > MAX_BUFFER)
+    return false;
+  value.bytes.resize(size);
+  return size == 0 || fread(&value.bytes[0], 1, size, file_) == size_t(size);
+}
+
+bool WCaptureReader::readChanges(Changes &changes)
+{
+  changes.offsets.clear();
+  changes.counts.clear();
+  changes.values.clear();
+  if (fread(&changes.sweeps, sizeof(int), 1, file_) != 1 || fread(&changes.rows, sizeof(int), 1, file_) != 1 ||
+      fread(&changes.columns, sizeof(int), 1, file_) != 1 || fread(&changes.length, sizeof(int), 1, file_) != 1 ||
+      changes.length < 0)
+    return false;
+
+  int end = 0;
+  for (;;)
+  {
+    int count = 0;
+    int offset = 0;
+    if (fread(&count, sizeof(int), 1, file_) != 1)
+      return false;
+    if (count == 0)
+      return true;
+    if (fread(&offset, sizeof(int), 1, file_) != 1 || count < 0 || offset < end || count > changes.length - offset)
+      return false;
+    size_t first = changes.values.size();
+    changes.values.resize(first + count);
+    if (fread(&changes.values[first], sizeof(double), count, file_) != size_t(count))
+      return false;
+    changes.offsets.push_back(offset);
+    changes.counts.push_back(count);
+    end = offset + count;
+  }
+}
@@ -0,0 +1,245 @@
+#ifndef __SESWRAPPER_WCAPTURE_H__
+#define __SESWRAPPER_WCAPTURE_H__
+
+#include "sestypes.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Records the calls into the SESInstrument library to a binary file, so that a session can be replayed
+ * away from the instrument by the SESInstrumentReplay library.
+ *
+ * WSESInstrument::setCapture() calls every imported function through a thunk that describes the call with a
+ * WCaptureCall: the arguments, the outputs left in the pointer arguments, the return value and the timing. The
+ * PointReady and RegionReady callbacks of an acquisition are also passed through WCapture, which records the
+ * values of the spectrum and the signals that changed since the previous callback.
+ *
+ * The file starts with a header and is then only appended to, one record at a time. All values are in the native
+ * byte order; see WCaptureReader for the layout of the records.
+ */
+class WCapture
+{
+public:
+  /*!
+   * The version of the file format. Increment it whenever the layout of the file or of the structures in it changes.
+   */
+  enum
+  {
+    VERSION = 1,
+    MAX_FUNCTIONS = 96 /*!< The maximum number of functions that can be recorded */
+  };
+
+  /*!
+   * The types of the records.
+   */
+  enum RecordType
+  {
+    RECORD_FUNCTION = 1, /*!< Gives a function its number */
+    RECORD_CALL = 2, /*!< One call of a function */
+    RECORD_POINT_READY = 3, /*!< A PointReady callback */
+    RECORD_REGION_READY = 4 /*!< A RegionReady callback */
+  };
+
+  /*!
+   * The ways an argument or a return value is recorded.
+   */
+  enum ValueType
+  {
+    VALUE_NONE = 0, /*!< No value, e.g. the result of a void function */
+    VALUE_DATA = 1, /*!< The bytes of a value passed or returned by value */
+    VALUE_STRING = 2, /*!< A string, without the terminating null */
+    VALUE_OUTPUT = 3, /*!< The bytes a pointer argument points to after the call */
+    VALUE_NULL = 4, /*!< A null pointer */
+    VALUE_CALLBACK = 5, /*!< A callback, of which nothing is recorded */
+    VALUE_SPECTRUM = 6, /*!< The layout and scales of a WSpectrum, see encodeSpectrum() */
+    VALUE_SIGNALS = 7, /*!< The layout and scales of a WSignals, see encodeSignals() */
+    VALUE_UNSIZED = 8 /*!< A buffer of unknown size, of which nothing is recorded */
+  };
+
+  static bool open(const char *fileName);
+  static void close();
+  static bool isOpen();
+  static int add(const char *name);
+  static bool hooksCallbacks(int id);
+  static bool startsAcquisition(int id);
+  static bool recordsBuffers(int id);
+  static int startAcquisition();
+  static int acquisition();
+  static double now();
+  static void write(const std::string &record);
+  static void setSpectrum(SesNS::WSpectrum *spectrum);
+  static void setSignals(SesNS::WSignals *signals);
+  static SesNS::PointReady hookPointReady(SesNS::PointReady pointReady);
+  static SesNS::RegionReady hookRegionReady(SesNS::RegionReady regionReady);
+
+  static void encodeSpectrum(std::string &bytes, const SesNS::WSpectrum &spectrum);
+  static bool decodeSpectrum(const std::string &bytes, SesNS::WSpectrum &spectrum, std::vector<double> &channelScale,
+                             std::vector<double> &sliceScale);
+  static void encodeSignals(std::string &bytes, const SesNS::WSignals &signals);
+  static bool decodeSignals(const std::string &bytes, SesNS::WSignals &signals, std::vector<double> &stepsScale,
+                            std::vector<char> &names);
+  static int optionSize(int option);
+
+private:
+  static void __stdcall pointReady(int point);
+  static void __stdcall regionReady();
+  static void recordCallback(int type, int point);
+};
+
+/*!
+ * \brief Describes one call for WCapture.
+ *
+ * The thunk of an imported function constructs a WCaptureCall before the call, lets it hook() the callbacks among
+ * the arguments, and after the call marks the time with returned(), passes each argument to add() and finally
+ * passes the return value to result(), which writes the record. Nothing is done while the function is not captured.
+ */
+class WCaptureCall
+{
+public:
+  WCaptureCall(int id);
+
+  template<typename T> WCaptureCall &hook(T &) { return *this; }
+  WCaptureCall &hook(SesNS::PointReady &pointReady);
+  WCaptureCall &hook(SesNS::RegionReady &regionReady);
+
+  WCaptureCall &returned();
+
+  template<typename T> WCaptureCall &add(T *value) { return output(value, sizeof(T)); }
+  WCaptureCall &add(int value);
+  WCaptureCall &add(double value);
+  WCaptureCall &add(bool value);
+  WCaptureCall &add(const char *value);
+  WCaptureCall &add(char *value);
+  WCaptureCall &add(unsigned char *value);
+  WCaptureCall &add(void *value);
+  WCaptureCall &add(const void *value);
+  WCaptureCall &add(int *value);
+  WCaptureCall &add(SesNS::WSpectrum **value);
+  WCaptureCall &add(SesNS::WSignals **value);
+  WCaptureCall &add(SesNS::PointReady value);
+  WCaptureCall &add(SesNS::RegionReady value);
+  WCaptureCall &add(SesNS::OffsetReady value);
+
+  template<typename R> R result(R value)
+  {
+    if (active_)
+      finish(WCapture::VALUE_DATA, &value, sizeof(R), succeeded(value));
+    return value;
+  }
+  const char *result(const char *value);
+  void result();
+
+private:
+  /*!
+   * How the bytes of a buffer argument are found once all the arguments are known.
+   */
+  enum Buffer
+  {
+    BUFFER_NONE, /*!< Not a buffer */
+    BUFFER_STRING, /*!< A string output, bounded by the size arguments that follow it */
+    BUFFER_OUTPUT, /*!< An output of the size given by the size arguments that follow it */
+    BUFFER_VALUE, /*!< An input of the size given by the int that follows it, or by the option before it */
+    BUFFER_OPTION /*!< An output of the size given by the size arguments that follow it, or by the option before it */
+  };
+
+  struct Argument
+  {
+    int type;
+    std::string bytes;
+    int buffer;
+    const void *pointer;
+    bool isInt;
+    bool isSize;
+    int intValue;
+  };
+
+  template<typename T> static bool succeeded(const T &) { return true; }
+  static bool succeeded(int value) { return value == 0; }
+
+  WCaptureCall &value(const void *pointer, int size);
+  WCaptureCall &output(const void *pointer, int size);
+  WCaptureCall &buffer(const void *pointer, int buffer);
+  Argument &newArgument(int type);
+  long long bufferSize(size_t index) const;
+  void finish(int type, const void *result, int size, bool succeeded);
+
+  bool active_;
+  int id_;
+  int acquisition_;
+  double start_;
+  double duration_;
+  std::vector<Argument> arguments_;
+};
+
+/*!
+ * \brief Reads the records of a file written by WCapture.
+ */
+class WCaptureReader
+{
+public:
+  /*!
+   * A recorded argument or return value.
+   */
+  struct Value
+  {
+    int type; /*!< One of WCapture::ValueType */
+    std::string bytes; /*!< The recorded bytes */
+  };
+
+  /*!
+   * The values of the spectrum or the signals that changed at a callback. The values are those of the rows of the
+   * data matrix, one after the other, followed for the spectrum by the sum data.
+   */
+  struct Changes
+  {
+    int sweeps; /*!< The number of sweeps */
+    int rows; /*!< The number of slices of the spectrum, or the number of signals */
+    int columns; /*!< The number of channels of the spectrum, or the number of steps of the signals */
+    int length; /*!< The number of values */
+    std::vector<int> offsets; /*!< The index of the first value of each run of changed values */
+    std::vector<int> counts; /*!< The number of values in each run */
+    std::vector<double> values; /*!< The values of all the runs */
+
+    void apply(std::vector<double> &target) const;
+  };
+
+  /*!
+   * One record. Which members are set depends on the type.
+   */
+  struct Record
+  {
+    int type; /*!< One of WCapture::RecordType */
+    int function; /*!< The number of the function, for function and call records */
+    std::string name; /*!< The name of the function, for function records */
+    int acquisition; /*!< The number of the acquisition, for call and callback records */
+    double time; /*!< The time in seconds since the capture was opened that a call started or a callback came */
+    double duration; /*!< The duration of a call in seconds */
+    std::vector<Value> arguments; /*!< The arguments of a call */
+    Value result; /*!< The return value of a call */
+    int point; /*!< The point of a PointReady callback */
+    Changes spectrum; /*!< The spectrum at a callback */
+    Changes signals; /*!< The signals at a callback */
+  };
+
+  WCaptureReader();
+  ~WCaptureReader();
+
+  bool open(const char *fileName);
+  void close();
+  bool next(Record &record);
+  long long startTime() const;
+
+private:
+  WCaptureReader(const WCaptureReader &);
+  WCaptureReader &operator=(const WCaptureReader &);
+
+  bool readValue(Value &value);
+  bool readChanges(Changes &changes);
+
+  FILE *file_;
+  long long startTime_;
+};
+
+#endif
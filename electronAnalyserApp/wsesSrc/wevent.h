@@ -1,9 +1,15 @@
 #ifndef __SESWRAPPER_WEVENT_H__
 #define __SESWRAPPER_WEVENT_H__
 
+#ifdef _WIN32
 #define NOMINMAX
 #define _WIN32_WINNT 0x0502
 #include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#endif
 
 class WEvent
 {
@@ -20,12 +26,25 @@ public:
   void set();
   void reset();
   int wait(int timeout = -1) const;
+  static int waitAny(const WEvent &first, const WEvent &second, int timeout = -1);
+#ifdef _WIN32
   HANDLE handle() const;
 
 private:
   HANDLE event_;
+#else
+
+private:
+  static pthread_mutex_t *mutex();
+  static pthread_cond_t *condition();
+  static int waitUntil(const WEvent *const *events, int count, int timeout);
+
+  bool signalled_;
+#endif
 };
 
+#ifdef _WIN32
+
 /*!
   *  Constructs a WEvent object that contains an event handle.
   */
@@ -81,4 +100,146 @@ inline HANDLE WEvent::handle() const
   return event_;
 }
 
+/*!
+* Waits for either of two event objects to be in a signalled state.
+*
+* @param[in] first The first event.
+* @param[in] second The second event.
+* @param[in] timeout The number of milliseconds to wait before time-out. The default is
+*                    to never time out.
+*
+* @return 0 if \p first is signalled, 1 if only \p second is signalled, otherwise ERR_TIMEOUT.
+*/
+inline int WEvent::waitAny(const WEvent &first, const WEvent &second, int timeout)
+{
+  const HANDLE handles[] = {first.event_, second.event_};
+  DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout);
+  return result == WAIT_OBJECT_0 ? 0 : (result == WAIT_OBJECT_0 + 1 ? 1 : ERR_TIMEOUT);
+}
+
+#else
+
+/*
+ * Without WaitForMultipleObjects(), all events share one mutex and condition variable, so that a thread can wait
+ * for any of several events. Events are set rarely enough for the extra wake-ups not to matter.
+ */
+inline pthread_mutex_t *WEvent::mutex()
+{
+  static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  return &mutex;
+}
+
+inline pthread_cond_t *WEvent::condition()
+{
+  static pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
+  return &condition;
+}
+
+/*!
+  *  Constructs a manual-reset WEvent object in the unsignalled state.
+  */
+inline WEvent::WEvent()
+  : signalled_(false)
+{
+}
+
+/*!
+  * Destroys an event object.
+  */
+inline WEvent::~WEvent()
+{
+}
+
+/*!
+  * Signals the contained event object. All waiting threads are released and the event stays signalled
+  * until reset() is called.
+  */
+inline void WEvent::set()
+{
+  pthread_mutex_lock(mutex());
+  signalled_ = true;
+  pthread_cond_broadcast(condition());
+  pthread_mutex_unlock(mutex());
+}
+
+/*!
+  * Places the contained event object in an unsignalled state.
+  */
+inline void WEvent::reset()
+{
+  pthread_mutex_lock(mutex());
+  signalled_ = false;
+  pthread_mutex_unlock(mutex());
+}
+
+/*!
+  * Waits until one of \p count events is signalled.
+  *
+  * @return The index of the first signalled event, or ERR_TIMEOUT.
+  */
+inline int WEvent::waitUntil(const WEvent *const *events, int count, int timeout)
+{
+  struct timespec deadline;
+  int result = 0;
+
+  if (timeout >= 0)
+  {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+  }
+
+  pthread_mutex_lock(mutex());
+  int signalled = ERR_TIMEOUT;
+  while (true)
+  {
+    for (int i = 0; i < count && signalled == ERR_TIMEOUT; i++)
+      if (events[i]->signalled_)
+        signalled = i;
+    if (signalled != ERR_TIMEOUT || result == ETIMEDOUT)
+      break;
+    result = timeout >= 0 ? pthread_cond_timedwait(condition(), mutex(), &deadline) : pthread_cond_wait(condition(), mutex());
+  }
+  pthread_mutex_unlock(mutex());
+
+  return signalled;
+}
+
+/*!
+* Waits for the contained event object to be in a signalled state.
+*
+* @param[in] timeout The number of milliseconds to wait before time-out. A negative value
+*                    never times out.
+*
+* @return ERR_OK if the current event is signalled. otherwise ERR_TIMEOUT.
+*/
+inline int WEvent::wait(int timeout) const
+{
+  const WEvent *events[] = {this};
+  return waitUntil(events, 1, timeout) == 0 ? ERR_OK : ERR_TIMEOUT;
+}
+
+/*!
+* Waits for either of two event objects to be in a signalled state.
+*
+* @param[in] first The first event.
+* @param[in] second The second event.
+* @param[in] timeout The number of milliseconds to wait before time-out. A negative value
+*                    never times out.
+*
+* @return 0 if \p first is signalled, 1 if only \p second is signalled, otherwise ERR_TIMEOUT.
+*/
+inline int WEvent::waitAny(const WEvent &first, const WEvent &second, int timeout)
+{
+  const WEvent *events[] = {&first, &second};
+  return waitUntil(events, 2, timeout);
+}
+
+#endif
+
 #endif
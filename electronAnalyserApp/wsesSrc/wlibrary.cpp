@@ -1,8 +1,13 @@
 #include "wlibrary.h"
 #include "common.hpp"
 
+#ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
+#else
+#include <dlfcn.h>
+typedef void *HMODULE;
+#endif
 #include <string>
 
 class WLibrary_P
@@ -22,7 +27,8 @@ public:
   * \brief This is a generic class for importing shared libraries dynamically.
   *
   * It should be subclassed to include the C functions exported from the library it contains. Each function will
-  * then be added as a callback function within the subclass.
+  * then be added as a callback function within the subclass. On Windows the library is loaded with LoadLibrary(),
+  * elsewhere with dlopen().
   */
 
 /*!
@@ -57,7 +63,11 @@ bool WLibrary::load(const char *fileName)
 
   if (p_->lib_ == 0)
   {
+#ifdef _WIN32
     p_->lib_ = LoadLibrary(fileName);
+#else
+    p_->lib_ = dlopen(fileName, RTLD_NOW | RTLD_LOCAL);
+#endif
     
     if (p_->lib_ != 0)
       p_->path_ = fileName;
@@ -72,7 +82,11 @@ bool WLibrary::load(const char *fileName)
   */
 void WLibrary::unload()
 {
+#ifdef _WIN32
   if (FreeLibrary(p_->lib_) == TRUE)
+#else
+  if (p_->lib_ != 0 && dlclose(p_->lib_) == 0)
+#endif
   {
     p_->lib_ = 0;
     p_->path_.clear();
@@ -116,5 +130,9 @@ int WLibrary::path(char *buffer, int size) const
   */
 void *WLibrary::import(const char *functionName)
 {
+#ifdef _WIN32
   return GetProcAddress(p_->lib_, functionName);
+#else
+  return p_->lib_ != 0 ? dlsym(p_->lib_, functionName) : 0;
+#endif
 }
@@ -0,0 +1,136 @@
+#ifndef __SESWRAPPER_WLOCK_H__
+#define __SESWRAPPER_WLOCK_H__
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/*!
+ * \brief A non-recursive mutex for state shared by all threads calling the instrument library, such as WCallStats
+ * and WCapture.
+ */
+class WLock
+{
+public:
+  WLock();
+  ~WLock();
+
+  void lock();
+  void unlock();
+
+private:
+  WLock(const WLock &);
+  WLock &operator=(const WLock &);
+
+#ifdef _WIN32
+  CRITICAL_SECTION section_;
+#else
+  pthread_mutex_t mutex_;
+#endif
+};
+
+#ifdef _WIN32
+
+inline WLock::WLock()
+{
+  InitializeCriticalSection(&section_);
+}
+
+inline WLock::~WLock()
+{
+  DeleteCriticalSection(&section_);
+}
+
+inline void WLock::lock()
+{
+  EnterCriticalSection(&section_);
+}
+
+inline void WLock::unlock()
+{
+  LeaveCriticalSection(&section_);
+}
+
+#else
+
+inline WLock::WLock()
+{
+  pthread_mutex_init(&mutex_, 0);
+}
+
+inline WLock::~WLock()
+{
+  pthread_mutex_destroy(&mutex_);
+}
+
+inline void WLock::lock()
+{
+  pthread_mutex_lock(&mutex_);
+}
+
+inline void WLock::unlock()
+{
+  pthread_mutex_unlock(&mutex_);
+}
+
+#endif
+
+/*!
+ * \brief An int read and written by several threads without a lock, such as the slots of the thunks of
+ * WSESInstrument, which are read at every call into the library. It is an aggregate, so that a static one is
+ * initialised before any code runs: <tt>WAtomicInt value = {-1};</tt>
+ */
+struct WAtomicInt
+{
+  int load() const;
+  void store(int value);
+
+  volatile long value_;
+};
+
+#ifdef _WIN32
+
+inline int WAtomicInt::load() const
+{
+  return (int)InterlockedCompareExchange(const_cast<volatile long *>(&value_), 0, 0);
+}
+
+inline void WAtomicInt::store(int value)
+{
+  InterlockedExchange(&value_, value);
+}
+
+#else
+
+inline int WAtomicInt::load() const
+{
+  return (int)__atomic_load_n(&value_, __ATOMIC_ACQUIRE);
+}
+
+inline void WAtomicInt::store(int value)
+{
+  __atomic_store_n(&value_, value, __ATOMIC_RELEASE);
+}
+
+#endif
+
+/*!
+ * \brief Holds a WLock for the lifetime of the guard.
+ */
+class WLockGuard
+{
+public:
+  explicit WLockGuard(WLock &lock) : lock_(lock) { lock_.lock(); }
+  ~WLockGuard() { lock_.unlock(); }
+
+private:
+  WLockGuard(const WLockGuard &);
+  WLockGuard &operator=(const WLockGuard &);
+
+  WLock &lock_;
+};
+
+#endif
@@ -1,14 +1,294 @@
 #include "wsesinstrument.h"
+#include "wcallstats.h"
+#include "wcapture.h"
+#include "wlock.h"
 #include "common.hpp"
 
+#ifdef _WIN32
 #define NOMINMAX
 #include <Windows.h>
+#endif
 
 #include <sstream>
+#include <stdlib.h>
+#include <string.h>
 
 using namespace SesNS;
 using namespace CommonNS;
 
+namespace
+{
+  /*!
+   * Points \p function to the thunk \c Thunk if \p install is set, which calls the function of the library through
+   * Thunk::original. A thunk in place records the call in the slot Thunk::index of WCallStats and describes it to
+   * WCapture as function Thunk::id, or does neither when they are -1. Both are atomic, as they change while other
+   * threads call through the thunk.
+   */
+  template<typename Thunk, typename Function> void replace(Function &function, const char *name, bool install, bool statistics, bool capture)
+  {
+    if (function == 0)
+      return;
+    if (install)
+    {
+      Thunk::original = function;
+      function = &Thunk::call;
+    }
+    if (function == &Thunk::call)
+    {
+      Thunk::index.store(statistics ? WCallStats::add(name) : -1);
+      Thunk::id.store(capture ? WCapture::add(name) : -1);
+    }
+  }
+
+  /*
+   * One thunk template per number of arguments, as in C_Function. The overloads of interpose() deduce the return
+   * and argument types from the C_Function pointer of each imported function, so the thunks follow the
+   * declarations in wsesinstrument.h. \c Id gives every imported function an instantiation of its own. The
+   * library is called from timed(), so that the latency in WCallStats does not include the capture.
+   */
+  template<int Id, typename R> struct WCallThunk0
+  {
+    static R (__stdcall *original)();
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call()
+    {
+      WCaptureCall capture(id.load());
+      R result = timed();
+      return capture.returned().result(result);
+    }
+
+    static R timed()
+    {
+      WCallTimer timer(index.load());
+      return original();
+    }
+  };
+  template<int Id, typename R> R (__stdcall *WCallThunk0<Id, R>::original)() = 0;
+  template<int Id, typename R> WAtomicInt WCallThunk0<Id, R>::index = {-1};
+  template<int Id, typename R> WAtomicInt WCallThunk0<Id, R>::id = {-1};
+
+  template<int Id, typename R> void interpose(R (__stdcall *&function)(), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk0<Id, R> >(function, name, install, statistics, capture);
+  }
+
+  /*
+   * GDS_Finalize() returns nothing.
+   */
+  template<int Id> struct WCallThunk0<Id, void>
+  {
+    static void (__stdcall *original)();
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static void __stdcall call()
+    {
+      WCaptureCall capture(id.load());
+      timed();
+      capture.returned().result();
+    }
+
+    static void timed()
+    {
+      WCallTimer timer(index.load());
+      original();
+    }
+  };
+  template<int Id> void (__stdcall *WCallThunk0<Id, void>::original)() = 0;
+  template<int Id> WAtomicInt WCallThunk0<Id, void>::index = {-1};
+  template<int Id> WAtomicInt WCallThunk0<Id, void>::id = {-1};
+
+  template<int Id, typename R, typename A1> struct WCallThunk1
+  {
+    static R (__stdcall *original)(A1);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1);
+      R result = timed(a1);
+      return capture.returned().add(a1).result(result);
+    }
+
+    static R timed(A1 a1)
+    {
+      WCallTimer timer(index.load());
+      return original(a1);
+    }
+  };
+  template<int Id, typename R, typename A1> R (__stdcall *WCallThunk1<Id, R, A1>::original)(A1) = 0;
+  template<int Id, typename R, typename A1> WAtomicInt WCallThunk1<Id, R, A1>::index = {-1};
+  template<int Id, typename R, typename A1> WAtomicInt WCallThunk1<Id, R, A1>::id = {-1};
+
+  template<int Id, typename R, typename A1> void interpose(R (__stdcall *&function)(A1), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk1<Id, R, A1> >(function, name, install, statistics, capture);
+  }
+
+  template<int Id, typename R, typename A1, typename A2> struct WCallThunk2
+  {
+    static R (__stdcall *original)(A1, A2);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1, A2 a2)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1).hook(a2);
+      R result = timed(a1, a2);
+      return capture.returned().add(a1).add(a2).result(result);
+    }
+
+    static R timed(A1 a1, A2 a2)
+    {
+      WCallTimer timer(index.load());
+      return original(a1, a2);
+    }
+  };
+  template<int Id, typename R, typename A1, typename A2> R (__stdcall *WCallThunk2<Id, R, A1, A2>::original)(A1, A2) = 0;
+  template<int Id, typename R, typename A1, typename A2> WAtomicInt WCallThunk2<Id, R, A1, A2>::index = {-1};
+  template<int Id, typename R, typename A1, typename A2> WAtomicInt WCallThunk2<Id, R, A1, A2>::id = {-1};
+
+  template<int Id, typename R, typename A1, typename A2> void interpose(R (__stdcall *&function)(A1, A2), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk2<Id, R, A1, A2> >(function, name, install, statistics, capture);
+  }
+
+  template<int Id, typename R, typename A1, typename A2, typename A3> struct WCallThunk3
+  {
+    static R (__stdcall *original)(A1, A2, A3);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1, A2 a2, A3 a3)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1).hook(a2).hook(a3);
+      R result = timed(a1, a2, a3);
+      return capture.returned().add(a1).add(a2).add(a3).result(result);
+    }
+
+    static R timed(A1 a1, A2 a2, A3 a3)
+    {
+      WCallTimer timer(index.load());
+      return original(a1, a2, a3);
+    }
+  };
+  template<int Id, typename R, typename A1, typename A2, typename A3> R (__stdcall *WCallThunk3<Id, R, A1, A2, A3>::original)(A1, A2, A3) = 0;
+  template<int Id, typename R, typename A1, typename A2, typename A3> WAtomicInt WCallThunk3<Id, R, A1, A2, A3>::index = {-1};
+  template<int Id, typename R, typename A1, typename A2, typename A3> WAtomicInt WCallThunk3<Id, R, A1, A2, A3>::id = {-1};
+
+  template<int Id, typename R, typename A1, typename A2, typename A3> void interpose(R (__stdcall *&function)(A1, A2, A3), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk3<Id, R, A1, A2, A3> >(function, name, install, statistics, capture);
+  }
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4> struct WCallThunk4
+  {
+    static R (__stdcall *original)(A1, A2, A3, A4);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1, A2 a2, A3 a3, A4 a4)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1).hook(a2).hook(a3).hook(a4);
+      R result = timed(a1, a2, a3, a4);
+      return capture.returned().add(a1).add(a2).add(a3).add(a4).result(result);
+    }
+
+    static R timed(A1 a1, A2 a2, A3 a3, A4 a4)
+    {
+      WCallTimer timer(index.load());
+      return original(a1, a2, a3, a4);
+    }
+  };
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4> R (__stdcall *WCallThunk4<Id, R, A1, A2, A3, A4>::original)(A1, A2, A3, A4) = 0;
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4> WAtomicInt WCallThunk4<Id, R, A1, A2, A3, A4>::index = {-1};
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4> WAtomicInt WCallThunk4<Id, R, A1, A2, A3, A4>::id = {-1};
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4> void interpose(R (__stdcall *&function)(A1, A2, A3, A4), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk4<Id, R, A1, A2, A3, A4> >(function, name, install, statistics, capture);
+  }
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5> struct WCallThunk5
+  {
+    static R (__stdcall *original)(A1, A2, A3, A4, A5);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1, A2 a2, A3 a3, A4 a4, A5 a5)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1).hook(a2).hook(a3).hook(a4).hook(a5);
+      R result = timed(a1, a2, a3, a4, a5);
+      return capture.returned().add(a1).add(a2).add(a3).add(a4).add(a5).result(result);
+    }
+
+    static R timed(A1 a1, A2 a2, A3 a3, A4 a4, A5 a5)
+    {
+      WCallTimer timer(index.load());
+      return original(a1, a2, a3, a4, a5);
+    }
+  };
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5> R (__stdcall *WCallThunk5<Id, R, A1, A2, A3, A4, A5>::original)(A1, A2, A3, A4, A5) = 0;
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5> WAtomicInt WCallThunk5<Id, R, A1, A2, A3, A4, A5>::index = {-1};
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5> WAtomicInt WCallThunk5<Id, R, A1, A2, A3, A4, A5>::id = {-1};
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5> void interpose(R (__stdcall *&function)(A1, A2, A3, A4, A5), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk5<Id, R, A1, A2, A3, A4, A5> >(function, name, install, statistics, capture);
+  }
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6> struct WCallThunk6
+  {
+    static R (__stdcall *original)(A1, A2, A3, A4, A5, A6);
+    static WAtomicInt index;
+    static WAtomicInt id;
+
+    static R __stdcall call(A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+    {
+      WCaptureCall capture(id.load());
+      capture.hook(a1).hook(a2).hook(a3).hook(a4).hook(a5).hook(a6);
+      R result = timed(a1, a2, a3, a4, a5, a6);
+      return capture.returned().add(a1).add(a2).add(a3).add(a4).add(a5).add(a6).result(result);
+    }
+
+    static R timed(A1 a1, A2 a2, A3 a3, A4 a4, A5 a5, A6 a6)
+    {
+      WCallTimer timer(index.load());
+      return original(a1, a2, a3, a4, a5, a6);
+    }
+  };
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6> R (__stdcall *WCallThunk6<Id, R, A1, A2, A3, A4, A5, A6>::original)(A1, A2, A3, A4, A5, A6) = 0;
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6> WAtomicInt WCallThunk6<Id, R, A1, A2, A3, A4, A5, A6>::index = {-1};
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6> WAtomicInt WCallThunk6<Id, R, A1, A2, A3, A4, A5, A6>::id = {-1};
+
+  template<int Id, typename R, typename A1, typename A2, typename A3, typename A4, typename A5, typename A6> void interpose(R (__stdcall *&function)(A1, A2, A3, A4, A5, A6), const char *name, bool install, bool statistics, bool capture)
+  {
+    replace<WCallThunk6<Id, R, A1, A2, A3, A4, A5, A6> >(function, name, install, statistics, capture);
+  }
+}
+
+namespace
+{
+  /*!
+   * Numbers the imported functions, so that each has thunks of its own.
+   */
+  enum FunctionId
+  {
+#define SES_FUNCTION_ID(name, option, type) FUNCTION_##name,
+    SES_INSTRUMENT_FUNCTIONS(SES_FUNCTION_ID)
+#undef SES_FUNCTION_ID
+    FUNCTION_COUNT
+  };
+}
+
 /*!
  * \brief Contains the C functions imported from the SESInstrument library.
  *
@@ -17,11 +297,19 @@ using namespace CommonNS;
  */
 
 /*!
- * Creates a WSESInstrument instance.
+ * Creates a WSESInstrument instance. If the environment variable \c SES_CAPTURE_FILE is set, the calls into the
+ * library are captured to that file from the moment it is loaded, see setCapture(). If \c SES_CALL_STATISTICS is set
+ * to anything but 0, the calls are recorded in WCallStats from the moment it is loaded, see setCallStatistics().
  */
 WSESInstrument::WSESInstrument()
+  : callStatistics_(false), capture_(false), interposed_(false)
 {
   resetFunctions();
+  const char *statistics = getenv("SES_CALL_STATISTICS");
+  callStatistics_ = statistics != 0 && *statistics != 0 && strcmp(statistics, "0") != 0;
+  const char *captureFile = getenv("SES_CAPTURE_FILE");
+  if (captureFile != 0 && *captureFile != 0)
+    capture_ = WCapture::open(captureFile);
 }
 
 /*!
@@ -47,72 +335,9 @@ bool WSESInstrument::load(const char *fileName)
 
   try
   {
-    ::import(*this, "GDS_GetLastError", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetLastError);
-    ::import(*this, "GDS_GetLastErrorString", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetLastErrorString);
-    ::import(*this, "GDS_Initialize", SESWrapperNS::FUNCTION_REQUIRED, GDS_Initialize);
-    ::import(*this, "GDS_Finalize", SESWrapperNS::FUNCTION_REQUIRED, GDS_Finalize);
-    ::import(*this, "GDS_LoadInstrument", SESWrapperNS::FUNCTION_REQUIRED, GDS_LoadInstrument);
-    ::import(*this, "GDS_SaveInstrument", SESWrapperNS::FUNCTION_REQUIRED, GDS_SaveInstrument);
-    ::import(*this, "GDS_NewInstrument", SESWrapperNS::FUNCTION_REQUIRED, GDS_NewInstrument);
-    ::import(*this, "GDS_ResetInstrument", SESWrapperNS::FUNCTION_REQUIRED, GDS_ResetInstrument);
-    ::import(*this, "GDS_ZeroSupplies", SESWrapperNS::FUNCTION_REQUIRED, GDS_ZeroSupplies);
-    ::import(*this, "GDS_TestCommunication", SESWrapperNS::FUNCTION_REQUIRED, GDS_TestCommunication);
-    ::import(*this, "GDS_GetOption", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetOption);
-    ::import(*this, "GDS_SetOption", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetOption);
-    ::import(*this, "GDS_GetInstrumentInfo", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetInstrumentInfo);
-    ::import(*this, "GDS_GetDetectorInfo", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetDetectorInfo);
-    ::import(*this, "GDS_HasSupplyLib", SESWrapperNS::FUNCTION_OPTIONAL, GDS_HasSupplyLib);
-    ::import(*this, "GDS_HasDetectorLib", SESWrapperNS::FUNCTION_OPTIONAL, GDS_HasDetectorLib);
-    ::import(*this, "GDS_HasSignalsLib", SESWrapperNS::FUNCTION_OPTIONAL, GDS_HasSignalsLib);
-    ::import(*this, "GDS_GetElementSets", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetElementSets);
-    ::import(*this, "GDS_GetLensModes", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetLensModes);
-    ::import(*this, "GDS_GetPassEnergies", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetPassEnergies);
-    ::import(*this, "GDS_GetCurrElementSet", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrElementSet);
-    ::import(*this, "GDS_GetCurrLensMode", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrLensMode);
-    ::import(*this, "GDS_GetCurrPassEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrPassEnergy);
-    ::import(*this, "GDS_GetCurrKineticEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrKineticEnergy);
-    ::import(*this, "GDS_GetCurrExcitationEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrExcitationEnergy);
-    ::import(*this, "GDS_GetCurrBindingEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetCurrBindingEnergy);
-    ::import(*this, "GDS_GetGlobalDetector", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetGlobalDetector);
-    ::import(*this, "GDS_GetElement", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetElement);
-    ::import(*this, "GDS_GetElements", SESWrapperNS::FUNCTION_OPTIONAL, GDS_GetElements);
-    ::import(*this, "GDS_SetElementSet", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetElementSet);
-    ::import(*this, "GDS_SetLensMode", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetLensMode);
-    ::import(*this, "GDS_SetPassEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetPassEnergy);
-    ::import(*this, "GDS_SetKineticEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetKineticEnergy);
-    ::import(*this, "GDS_SetExcitationEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetExcitationEnergy);
-    ::import(*this, "GDS_SetBindingEnergy", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetBindingEnergy);
-    ::import(*this, "GDS_SetGlobalDetector", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetGlobalDetector);
-    ::import(*this, "GDS_SetElement", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetElement);
-    ::import(*this, "GDS_CheckRegion", SESWrapperNS::FUNCTION_REQUIRED, GDS_CheckRegion);
-    ::import(*this, "GDS_Start", SESWrapperNS::FUNCTION_REQUIRED, GDS_Start);
-    ::import(*this, "GDS_Stop", SESWrapperNS::FUNCTION_REQUIRED, GDS_Stop);
-    ::import(*this, "GDS_GetStatus", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetStatus);
-    ::import(*this, "GDS_GetDrift", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetDrift);
-    ::import(*this, "GDS_CalibrateOffset", SESWrapperNS::FUNCTION_REQUIRED, GDS_CalibrateOffset);
-    ::import(*this, "GDS_GetOffset", SESWrapperNS::FUNCTION_REQUIRED, GDS_GetOffset);
-    ::import(*this, "GDS_UseDetector", SESWrapperNS::FUNCTION_OPTIONAL, GDS_UseDetector);
-    ::import(*this, "GDS_UseSignals", SESWrapperNS::FUNCTION_OPTIONAL, GDS_UseSignals);
-    ::import(*this, "GDS_GetCurrSpectrum", SESWrapperNS::FUNCTION_OPTIONAL, GDS_GetCurrSpectrum);
-    ::import(*this, "GDS_GetCurrSignals", SESWrapperNS::FUNCTION_OPTIONAL, GDS_GetCurrSignals);
-    ::import(*this, "GDS_InstallInstrument", SESWrapperNS::FUNCTION_REQUIRED, GDS_InstallInstrument);
-    ::import(*this, "GDS_InstallSupplies", SESWrapperNS::FUNCTION_REQUIRED, GDS_InstallSupplies);
-    ::import(*this, "GDS_InstallElements", SESWrapperNS::FUNCTION_REQUIRED, GDS_InstallElements);
-    ::import(*this, "GDS_InstallLensModes", SESWrapperNS::FUNCTION_REQUIRED, GDS_InstallLensModes);
-    ::import(*this, "GDS_SetupDetector", SESWrapperNS::FUNCTION_REQUIRED, GDS_SetupDetector);
-    ::import(*this, "GDS_SetupSignals", SESWrapperNS::FUNCTION_OPTIONAL, GDS_SetupSignals);
-    ::import(*this, "GDS_CalibrateVoltages", SESWrapperNS::FUNCTION_REQUIRED, GDS_CalibrateVoltages);
-    ::import(*this, "GDS_CalibrateDetector", SESWrapperNS::FUNCTION_REQUIRED, GDS_CalibrateDetector);
-    ::import(*this, "GDS_ControlSupplies", SESWrapperNS::FUNCTION_REQUIRED, GDS_ControlSupplies);
-    ::import(*this, "GDS_SupplyInfo", SESWrapperNS::FUNCTION_REQUIRED, GDS_SupplyInfo);
-    ::import(*this, "GDS_DetectorInfo", SESWrapperNS::FUNCTION_REQUIRED, GDS_DetectorInfo);
-    ::import(*this, "GDS_GetRawImage", SESWrapperNS::FUNCTION_OPTIONAL, GDS_GetRawImage);
-    ::import(*this, "GDS_InitAcquisition", SESWrapperNS::FUNCTION_REQUIRED, GDS_InitAcquisition);
-    ::import(*this, "GDS_StartAcquisition", SESWrapperNS::FUNCTION_REQUIRED, GDS_StartAcquisition);
-    ::import(*this, "SC_GetProperty", SESWrapperNS::FUNCTION_OPTIONAL, SC_GetProperty);
-    ::import(*this, "SC_SetProperty", SESWrapperNS::FUNCTION_OPTIONAL, SC_SetProperty);
-	::import(*this, "SC_SetPropertyEx", SESWrapperNS::FUNCTION_OPTIONAL, SC_SetPropertyEx);
-	::import(*this, "SC_LoadLensTable", SESWrapperNS::FUNCTION_OPTIONAL, SC_LoadLensTable);
+#define SES_IMPORT_FUNCTION(name, option, type) ::import(*this, #name, SESWrapperNS::option, name);
+    SES_INSTRUMENT_FUNCTIONS(SES_IMPORT_FUNCTION)
+#undef SES_IMPORT_FUNCTION
   }
   catch (WFunctionException &)
   {
@@ -120,6 +345,13 @@ bool WSESInstrument::load(const char *fileName)
     return false;
   }
 
+  /* The only place the function pointers are replaced, before any other thread can call them */
+  if (callStatistics_ || capture_)
+  {
+    interposeFunctions(true);
+    interposed_ = true;
+  }
+
   return true;
 }
 
@@ -133,72 +365,97 @@ void WSESInstrument::unload()
   resetFunctions();
 }
 
+/*!
+ * Enables or disables the call statistics. While enabled, every imported function is called through a thunk that
+ * records the number of calls and the latency of the call in WCallStats. The setting is kept when the library is
+ * reloaded.
+ *
+ * The function pointers are only replaced by load(), as they cannot be swapped safely while other threads call
+ * through them. The thunks are put in place if the statistics or the capture are enabled when the library is
+ * loaded, otherwise the pointers are those imported from the library, so a call costs nothing more. Once loaded,
+ * this function only changes what the thunks in place record: enabling the statistics when there are none takes
+ * effect when the library is next loaded, and disabling them leaves the thunks in place, recording nothing.
+ *
+ * \param[in] enable \c true to record the calls.
+ */
+void WSESInstrument::setCallStatistics(bool enable)
+{
+  callStatistics_ = enable;
+  interposeFunctions(false);
+}
+
+/*!
+ * \return \c true if the calls are recorded in WCallStats.
+ */
+bool WSESInstrument::callStatistics() const
+{
+  return callStatistics_;
+}
+
+/*!
+ * Starts or ends a capture of the calls into the library with WCapture. While capturing, every imported function is
+ * called through a thunk that records its arguments, outputs, result and timing, and the callbacks of acquisitions
+ * record the spectrum and the signals. The capture continues when the library is reloaded.
+ *
+ * A capture that is to be replayed with the SESInstrumentReplay library must start before the library is
+ * initialized, e.g. with \c SES_CAPTURE_FILE, as the replay can only answer calls that were captured. As with
+ * setCallStatistics(), the thunks are only put in place by load(), so once the library is loaded without them a
+ * capture records nothing until it is reloaded. The detector frames are only recorded if \c SES_CAPTURE_RAW_IMAGES
+ * is set, see WCapture::open().
+ *
+ * \param[in] fileName The capture file, which is replaced if it exists. 0 or an empty string ends the capture.
+ *
+ * \return \c true if successful, \c false if the file could not be created.
+ */
+bool WSESInstrument::setCapture(const char *fileName)
+{
+  bool success = true;
+  if (fileName != 0 && *fileName != 0)
+  {
+    success = WCapture::open(fileName);
+    capture_ = success;
+  }
+  else
+  {
+    WCapture::close();
+    capture_ = false;
+  }
+  interposeFunctions(false);
+  return success;
+}
+
+/*!
+ * \return \c true if the calls are being captured.
+ */
+bool WSESInstrument::capture() const
+{
+  return capture_;
+}
+
+/*!
+ * \return \c true if load() put the thunks in place, so that setCallStatistics() and setCapture() take effect
+ *         without loading the library again.
+ */
+bool WSESInstrument::interposed() const
+{
+  return interposed_;
+}
+
+/*!
+ * Points the thunks of the imported functions at the slots of the current settings. With \p install set, the
+ * function pointers are first replaced by the thunks, which must only be done by load().
+ */
+void WSESInstrument::interposeFunctions(bool install)
+{
+#define SES_INTERPOSE_FUNCTION(name, option, type) interpose<FUNCTION_##name>(name, #name, install, callStatistics_, capture_);
+  SES_INSTRUMENT_FUNCTIONS(SES_INTERPOSE_FUNCTION)
+#undef SES_INTERPOSE_FUNCTION
+}
+
 void WSESInstrument::resetFunctions()
 {
-  GDS_GetLastError = 0;
-  GDS_GetLastErrorString = 0;
-  GDS_Initialize = 0;
-  GDS_Finalize = 0;
-  GDS_LoadInstrument = 0;
-  GDS_SaveInstrument = 0;
-  GDS_NewInstrument = 0;
-  GDS_ResetInstrument = 0;
-  GDS_ZeroSupplies = 0;
-  GDS_TestCommunication = 0;
-  GDS_GetOption = 0;
-  GDS_SetOption = 0;
-  GDS_GetInstrumentInfo = 0;
-  GDS_GetDetectorInfo = 0;
-  GDS_HasSupplyLib = 0;
-  GDS_HasDetectorLib = 0;
-  GDS_HasSignalsLib = 0;
-  GDS_GetElements = 0;
-  GDS_GetElementSets = 0;
-  GDS_GetLensModes = 0;
-  GDS_GetPassEnergies = 0;
-  GDS_GetCurrElementSet = 0;
-  GDS_GetCurrLensMode = 0;
-  GDS_GetCurrPassEnergy = 0;
-  GDS_GetCurrKineticEnergy = 0;
-  GDS_GetCurrExcitationEnergy = 0;
-  GDS_GetCurrBindingEnergy = 0;
-  GDS_GetGlobalDetector = 0;
-  GDS_GetElement = 0;
-  GDS_SetElementSet = 0;
-  GDS_SetLensMode = 0;
-  GDS_SetPassEnergy = 0;
-  GDS_SetKineticEnergy = 0;
-  GDS_SetExcitationEnergy = 0;
-  GDS_SetBindingEnergy = 0;
-  GDS_SetGlobalDetector = 0;
-  GDS_SetElement = 0;
-  GDS_CheckRegion = 0;
-  GDS_Start = 0;
-  GDS_Stop = 0;
-  GDS_GetStatus = 0;
-  GDS_GetDrift = 0;
-  GDS_CalibrateOffset = 0;
-  GDS_GetOffset = 0;
-  GDS_UseDetector = 0;
-  GDS_UseSignals = 0;
-  GDS_GetCurrSpectrum = 0;
-  GDS_GetCurrSignals = 0;
-  GDS_InstallInstrument = 0;
-  GDS_InstallSupplies = 0;
-  GDS_InstallElements = 0;
-  GDS_InstallLensModes = 0;
-  GDS_SetupDetector = 0;
-  GDS_SetupSignals = 0;
-  GDS_CalibrateVoltages = 0;
-  GDS_CalibrateDetector = 0;
-  GDS_ControlSupplies = 0;
-  GDS_SupplyInfo = 0;
-  GDS_DetectorInfo = 0;
-  GDS_GetRawImage = 0;
-  GDS_InitAcquisition = 0;
-  GDS_StartAcquisition = 0;
-  SC_GetProperty = 0;
-  SC_SetProperty = 0;
-  SC_SetPropertyEx = 0;
-  SC_LoadLensTable = 0;
+#define SES_RESET_FUNCTION(name, option, type) name = 0;
+  SES_INSTRUMENT_FUNCTIONS(SES_RESET_FUNCTION)
+#undef SES_RESET_FUNCTION
+  interposed_ = false;
 }
@@ -7,6 +7,89 @@
 #include <string>
 #include <vector>
 
+/*!
+ * Lists the functions imported from the SESInstrument library as X(name, option, type): \c option tells whether
+ * the library must export the function and \c type is the C_Function of its signature, in parentheses so that its
+ * commas do not split the arguments. The function pointers of WSESInstrument and everything in wsesinstrument.cpp
+ * that goes through all of them are generated from this list, so a function is added in one place.
+ */
+#define SES_INSTRUMENT_FUNCTIONS(X) \
+  X(GDS_GetLastError, FUNCTION_REQUIRED, (C_Function<int>)) /* Retrieves the last reported error code */ \
+  X(GDS_GetLastErrorString, FUNCTION_REQUIRED, (C_Function<const char *>)) /* Retrieves the las reported error string */ \
+  X(GDS_Initialize, FUNCTION_REQUIRED, (C_Function<int, SesNS::ErrorNotify, void * /* HWND */>)) /* Initializes the library */ \
+  X(GDS_Finalize, FUNCTION_REQUIRED, (C_Function<>)) /* Finalizes the library */ \
+  X(GDS_LoadInstrument, FUNCTION_REQUIRED, (C_Function<int, const char * /* File Name */>)) /* Loads an instrument configuration */ \
+  X(GDS_SaveInstrument, FUNCTION_REQUIRED, (C_Function<int, const char * /* File Name */>)) /* Saves the instrument configuration */ \
+  X(GDS_NewInstrument, FUNCTION_REQUIRED, (C_Function<int>)) /* Creates a default instrument configuration */ \
+  X(GDS_ResetInstrument, FUNCTION_REQUIRED, (C_Function<int>)) /* Resets the instrument */ \
+  X(GDS_ZeroSupplies, FUNCTION_REQUIRED, (C_Function<int>)) /* Sets all voltage elements to a zero level */ \
+  X(GDS_TestCommunication, FUNCTION_REQUIRED, (C_Function<int>)) /* Validates communication with the HW. */ \
+  X(GDS_GetOption, FUNCTION_REQUIRED, (C_Function<int, int /* Option */, void * /* Value */>)) /* Retrieves an instrument option */ \
+  X(GDS_SetOption, FUNCTION_REQUIRED, (C_Function<int, int /* Option */, const void * /* Value */>)) /* Sets an instrument option */ \
+  X(GDS_GetInstrumentInfo, FUNCTION_REQUIRED, (C_Function<int, SesNS::WInstrumentInfo *>)) /* Retrieves instrument information */ \
+  X(GDS_GetDetectorInfo, FUNCTION_REQUIRED, (C_Function<int, SesNS::WDetectorInfo *>)) /* Retrieves detector information */ \
+  X(GDS_HasSupplyLib, FUNCTION_OPTIONAL, (C_Function<bool>)) /* Checks for presence of a supply library */ \
+  X(GDS_HasDetectorLib, FUNCTION_OPTIONAL, (C_Function<bool>)) /* Checks for presence of a detector library */ \
+  X(GDS_HasSignalsLib, FUNCTION_OPTIONAL, (C_Function<bool>)) /* Checks for presence of a signal library */ \
+  X(GDS_GetElementSets, FUNCTION_REQUIRED, (C_Function<int, char * /* Element Sets */, int * /* Buffer Length */>)) /* Retrieves the list of element sets, or the required size of the string buffer to store the element sets */ \
+  X(GDS_GetElements, FUNCTION_OPTIONAL, (C_Function<int, char * /* Element Names */, int * /* Buffer Length */>)) /* Retrievs a the list of element names, or the required size of the string buffer to store the element names */ \
+  X(GDS_GetLensModes, FUNCTION_REQUIRED, (C_Function<int, char * /* Lens Modes */, int * /* Buffer Length */>)) /* Retrieves the list of lens modes, or the required size of the string buffer to store the lens modes */ \
+  X(GDS_GetPassEnergies, FUNCTION_REQUIRED, (C_Function<int, const char * /* Lens Mode */, char * /* Pass Energies */, int * /* Buffer Length */>)) /* Retrieves the list of pass energies for the current lens mode, or the required size of the string buffer to store the pass energies */ \
+  X(GDS_GetCurrElementSet, FUNCTION_REQUIRED, (C_Function<int, char * /* Element Set */, int * /* Buffer Length */>)) /* Retrieves the name of the currently selected element set */ \
+  X(GDS_GetCurrLensMode, FUNCTION_REQUIRED, (C_Function<int, char * /* Lens Mode */, int * /* Buffer Length */>)) /* Retrieves the name of the currently selected lens mode */ \
+  X(GDS_GetCurrPassEnergy, FUNCTION_REQUIRED, (C_Function<int, double * /* Pass Energy */>)) /* Retrieves the currently selected pass energy */ \
+  X(GDS_GetCurrKineticEnergy, FUNCTION_REQUIRED, (C_Function<int, double * /* Kinetic Energy */>)) /* Retrieves the currently selected kinetic energy */ \
+  X(GDS_GetCurrExcitationEnergy, FUNCTION_REQUIRED, (C_Function<int, double * /* Excitation Energy */>)) /* Retrieves the currently selected excitation energy */ \
+  X(GDS_GetCurrBindingEnergy, FUNCTION_REQUIRED, (C_Function<int, double * /* Binding Energy */>)) /* Retrieves the currently selected binding energy */ \
+  X(GDS_GetGlobalDetector, FUNCTION_REQUIRED, (C_Function<int, SesNS::WDetector * /* Detecor Region */>)) /* Retrieves the global detector region */ \
+  X(GDS_GetElement, FUNCTION_REQUIRED, (C_Function<int, const char * /* Element Name */, double * /* Value */>)) /* Retrieves the voltage currently applied to an element */ \
+  X(GDS_SetElementSet, FUNCTION_REQUIRED, (C_Function<int, const char * /* Element Set */>)) /* Selects element set */ \
+  X(GDS_SetLensMode, FUNCTION_REQUIRED, (C_Function<int, const char * /* Lens Mode */>)) /* Selects lens mode */ \
+  X(GDS_SetPassEnergy, FUNCTION_REQUIRED, (C_Function<int, double /* Pass Energy */>)) /* Selects pass energy. The lens mode and element set must be selected before this. */ \
+  X(GDS_SetKineticEnergy, FUNCTION_REQUIRED, (C_Function<int, double /* Kinetic Energy */>)) /* Changes kinetic energy. */ \
+  X(GDS_SetExcitationEnergy, FUNCTION_REQUIRED, (C_Function<int, double /* Excitation Energy */>)) /* Changes excitation energy */ \
+  X(GDS_SetBindingEnergy, FUNCTION_REQUIRED, (C_Function<int, double /* Binding Energy */>)) /* Changes binding energy */ \
+  X(GDS_SetGlobalDetector, FUNCTION_REQUIRED, (C_Function<int, SesNS::WDetector *>)) /* Modifies the global detector region */ \
+  X(GDS_SetElement, FUNCTION_REQUIRED, (C_Function<int, const char * /* Element Name */, double /* Value */>)) /* Changes element voltage */ \
+  X(GDS_CheckRegion, FUNCTION_REQUIRED, (C_Function<int, SesNS::WRegion *, int * /* Steps */, double * /* Time */, double * /* Energy Step */>)) /* Validates a region */ \
+  X(GDS_Start, FUNCTION_REQUIRED, (C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, const char * /* Temporary File */, int /* Sweep */, SesNS::PointReady, SesNS::RegionReady>)) /* Starts an acquisition */ \
+  X(GDS_Stop, FUNCTION_REQUIRED, (C_Function<int>)) /* Aborts the current acquisition */ \
+  X(GDS_GetStatus, FUNCTION_REQUIRED, (C_Function<int, int * /* Status */>)) /* Retrieves the current status of the library */ \
+  X(GDS_GetDrift, FUNCTION_REQUIRED, (C_Function<int, double * /* Total Drift */, double * /* Delta-drift */>)) /* Retrieves the energy drift. Used in conjunction to a drift region */ \
+  X(GDS_CalibrateOffset, FUNCTION_REQUIRED, (C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, SesNS::OffsetReady, SesNS::RegionReady>)) /* Starts an energy offset calibration */ \
+  X(GDS_GetOffset, FUNCTION_REQUIRED, (C_Function<int, double * /* Offset */>)) /* Retrieves an energy offset */ \
+  X(GDS_UseDetector, FUNCTION_OPTIONAL, (C_Function<int, bool /* On */>)) /* Use the detector */ \
+  X(GDS_UseSignals, FUNCTION_OPTIONAL, (C_Function<int, bool /* On */>)) /* Use signals */ \
+  X(GDS_GetCurrSpectrum, FUNCTION_OPTIONAL, (C_Function<int, SesNS::WSpectrum **>)) /* Retrieve the current spectrum */ \
+  X(GDS_GetCurrSignals, FUNCTION_OPTIONAL, (C_Function<int, SesNS::WSignals **>)) /* Retrieve the current signals */ \
+  X(GDS_InstallInstrument, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens an installation dialog */ \
+  X(GDS_InstallSupplies, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens a supply installation dialog */ \
+  X(GDS_InstallElements, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens an element installation dialog */ \
+  X(GDS_InstallLensModes, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens a lens mode installation dialog */ \
+  X(GDS_SetupDetector, FUNCTION_REQUIRED, (C_Function<int, SesNS::WDetector *>)) /* Opens the Global Detector Setup dialog */ \
+  X(GDS_SetupSignals, FUNCTION_OPTIONAL, (C_Function<int>)) /* Opens a signals setup dialog */ \
+  X(GDS_CalibrateVoltages, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens the Voltage Calibration dialog */ \
+  X(GDS_CalibrateDetector, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens the Detector Calibrartion dialog */ \
+  X(GDS_ControlSupplies, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens a supply control dialog */ \
+  X(GDS_SupplyInfo, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens a supply information dialog */ \
+  X(GDS_DetectorInfo, FUNCTION_REQUIRED, (C_Function<int>)) /* Opens a detector info dialog */ \
+  X(GDS_GetRawImage, FUNCTION_OPTIONAL, (C_Function<int, unsigned char * /* Data */, int * /* Width */, int * /* Height */, int * /* Byte Size */>)) /* Retrieves a raw image from the detector */ \
+  X(GDS_InitAcquisition, FUNCTION_REQUIRED, (C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, SesNS::WSignals **, const char * /* Temporary File */, SesNS::PointReady, SesNS::RegionReady>)) /* Initializing acquisition. Replaces Start(). Introduced in SESInstrument version 1.2.5-rc6 */ \
+  X(GDS_StartAcquisition, FUNCTION_REQUIRED, (C_Function<int, int /* Sweep */>)) /* Starts acquisition. Replaces Start(). Introduced in SESInstrument version 1.2.5-rc6. */ \
+  X(SC_GetProperty, FUNCTION_OPTIONAL, (C_Function<int, const char * /* Property */, void * /* Value Buffer */, int * /* Size */>)) /* Reads a property from  the instrument library */ \
+  X(SC_SetProperty, FUNCTION_OPTIONAL, (C_Function<int, const char * /* Property */, const void * /* Value Buffer */>)) /* Sets an instrument library property */ \
+  X(SC_SetPropertyEx, FUNCTION_OPTIONAL, (C_Function<int, const char * /* Property */, const void * /* Value Buffer */, int /* Buffer Size */>)) /* Sets an instrument library property. This function also contains the size (in bytes) of the data block. */ \
+  X(SC_LoadLensTable, FUNCTION_OPTIONAL, (C_Function<int, const char* /* LensMode Name */, const char* /* File Path */>)) /* Load Lens Table */
+
+/*!
+ * Removes the parentheses around a type passed to a macro: WMacroType<void (T)>::Type is \c T.
+ */
+template<typename T> struct WMacroType;
+template<typename T> struct WMacroType<void (T)>
+{
+  typedef T Type;
+};
+
 class WSESInstrument : public WLibrary
 {
 public:
@@ -16,82 +99,22 @@ public:
   bool load(const char *fileName);
   void unload();
   void resetFunctions();
+  void setCallStatistics(bool enable);
+  bool callStatistics() const;
+  bool setCapture(const char *fileName);
+  bool capture() const;
+  bool interposed() const;
 
-  C_Function<int>::Pointer GDS_GetLastError; /*!< Retrieves the last reported error code */
-  C_Function<const char *>::Pointer GDS_GetLastErrorString; /*!< Retrieves the las reported error string */
-  C_Function<int, SesNS::ErrorNotify, void * /* HWND */>::Pointer GDS_Initialize; /*!< Initializes the library */
-  C_Function<>::Pointer GDS_Finalize; /*!< Finalizes the library */
-  C_Function<int, const char * /* File Name */>::Pointer GDS_LoadInstrument; /*!< Loads an instrument configuration */
-  C_Function<int, const char * /* File Name */>::Pointer GDS_SaveInstrument; /*!< Saves the instrument configuration */
-  C_Function<int>::Pointer GDS_NewInstrument; /*!< Creates a default instrument configuration */
-  C_Function<int>::Pointer GDS_ResetInstrument; /*!< Resets the instrument */
-  C_Function<int>::Pointer GDS_ZeroSupplies; /*!< Sets all voltage elements to a zero level */
-  C_Function<int>::Pointer GDS_TestCommunication; /*!< Validates communication with the HW. */
-  C_Function<int, int /* Option */, void * /* Value */>::Pointer GDS_GetOption; /*!< Retrieves an instrument option */
-  C_Function<int, int /* Option */, const void * /* Value */>::Pointer GDS_SetOption; /*!< Sets an instrument option */
-  C_Function<int, SesNS::WInstrumentInfo *>::Pointer GDS_GetInstrumentInfo; /*!< Retrieves instrument information */
-  C_Function<int, SesNS::WDetectorInfo *>::Pointer GDS_GetDetectorInfo; /*!< Retrieves detector information */
-  C_Function<bool>::Pointer GDS_HasSupplyLib; /*!< Checks for presence of a supply library */
-  C_Function<bool>::Pointer GDS_HasDetectorLib; /*!< Checks for presence of a detector library */
-  C_Function<bool>::Pointer GDS_HasSignalsLib; /*!< Checks for presence of a signal library */
-  C_Function<int, char * /* Element Sets */, int * /* Buffer Length */>::Pointer GDS_GetElementSets; /*!< Retrieves the list of element sets, or the required size of the string buffer to store the element sets */
-  C_Function<int, char * /* Element Names */, int * /* Buffer Length */>::Pointer GDS_GetElements; /*!< Retrievs a the list of element names, or the required size of the string buffer to store the element names */
-  C_Function<int, char * /* Lens Modes */, int * /* Buffer Length */>::Pointer GDS_GetLensModes; /*!< Retrieves the list of lens modes, or the required size of the string buffer to store the lens modes */
-  C_Function<int, const char * /* Lens Mode */, char * /* Pass Energies */, int * /* Buffer Length */>::Pointer GDS_GetPassEnergies; /*!< Retrieves the list of pass energies for the current lens mode, or the required size of the string buffer to store the pass energies */
-  C_Function<int, char * /* Element Set */, int * /* Buffer Length */>::Pointer GDS_GetCurrElementSet; /*!< Retrieves the name of the currently selected element set */
-  C_Function<int, char * /* Lens Mode */, int * /* Buffer Length */>::Pointer GDS_GetCurrLensMode; /*!< Retrieves the name of the currently selected lens mode */
+#define SES_DECLARE_FUNCTION(name, option, type) WMacroType<void type>::Type::Pointer name;
+  SES_INSTRUMENT_FUNCTIONS(SES_DECLARE_FUNCTION)
+#undef SES_DECLARE_FUNCTION
 
-  C_Function<int, double * /* Pass Energy */>::Pointer GDS_GetCurrPassEnergy; /*!< Retrieves the currently selected pass energy */
-  C_Function<int, double * /* Kinetic Energy */>::Pointer GDS_GetCurrKineticEnergy; /*!< Retrieves the currently selected kinetic energy */
-  C_Function<int, double * /* Excitation Energy */>::Pointer GDS_GetCurrExcitationEnergy; /*!< Retrieves the currently selected excitation energy */
-  C_Function<int, double * /* Binding Energy */>::Pointer GDS_GetCurrBindingEnergy; /*!< Retrieves the currently selected binding energy */
-  C_Function<int, SesNS::WDetector * /* Detecor Region */>::Pointer GDS_GetGlobalDetector; /*!< Retrieves the global detector region */
-  
-  C_Function<int, const char * /* Element Name */, double * /* Value */>::Pointer GDS_GetElement; /*!< Retrieves the voltage currently applied to an element */
-  C_Function<int, const char * /* Element Set */>::Pointer GDS_SetElementSet; /*!< Selects element set */
-  C_Function<int, const char * /* Lens Mode */>::Pointer GDS_SetLensMode; /*!< Selects lens mode */
-  C_Function<int, double /* Pass Energy */>::Pointer GDS_SetPassEnergy; /*!< Selects pass energy. The lens mode and element set must be selected before this. */
-  C_Function<int, double /* Kinetic Energy */>::Pointer GDS_SetKineticEnergy; /*!< Changes kinetic energy. */
-  
-  C_Function<int, double /* Excitation Energy */>::Pointer GDS_SetExcitationEnergy; /*!< Changes excitation energy */
-  C_Function<int, double /* Binding Energy */>::Pointer GDS_SetBindingEnergy; /*!< Changes binding energy */
-  C_Function<int, SesNS::WDetector *>::Pointer GDS_SetGlobalDetector; /*!< Modifies the global detector region */
-  C_Function<int, const char * /* Element Name */, double /* Value */>::Pointer GDS_SetElement; /*!< Changes element voltage */
-  C_Function<int, SesNS::WRegion *, int * /* Steps */, double * /* Time */, double * /* Energy Step */>::Pointer GDS_CheckRegion; /*!< Validates a region */
-  C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, const char * /* Temporary File */, int /* Sweep */, SesNS::PointReady, SesNS::RegionReady>::Pointer GDS_Start; /*!< Starts an acquisition */
-  
-  C_Function<int>::Pointer GDS_Stop; /*!< Aborts the current acquisition */
-  C_Function<int, int * /* Status */>::Pointer GDS_GetStatus; /*!< Retrieves the current status of the library */
-  C_Function<int, double * /* Total Drift */, double * /* Delta-drift */>::Pointer GDS_GetDrift; /*!< Retrieves the energy drift. Used in conjunction to a drift region */
-  C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, SesNS::OffsetReady, SesNS::RegionReady>::Pointer GDS_CalibrateOffset; /*!< Starts an energy offset calibration */
-  C_Function<int, double * /* Offset */>::Pointer GDS_GetOffset; /*!< Retrieves an energy offset */
-  C_Function<int, bool /* On */>::Pointer GDS_UseDetector; /*!< Use the detector */
-  
-  C_Function<int, bool /* On */>::Pointer GDS_UseSignals; /*!< Use signals */
-  C_Function<int, SesNS::WSpectrum **>::Pointer GDS_GetCurrSpectrum; /*!< Retrieve the current spectrum */
-  C_Function<int, SesNS::WSignals **>::Pointer GDS_GetCurrSignals; /*!< Retrieve the current signals */
-  C_Function<int>::Pointer GDS_InstallInstrument; /*!< Opens an installation dialog */
-  C_Function<int>::Pointer GDS_InstallSupplies; /*!< Opens a supply installation dialog */
-  
-  C_Function<int>::Pointer GDS_InstallElements; /*!< Opens an element installation dialog */
-  C_Function<int>::Pointer GDS_InstallLensModes; /*!< Opens a lens mode installation dialog*/
-  C_Function<int, SesNS::WDetector *>::Pointer GDS_SetupDetector; /*!< Opens the Global Detector Setup dialog */
-  C_Function<int>::Pointer GDS_SetupSignals; /*!< Opens a signals setup dialog */
-  C_Function<int>::Pointer GDS_CalibrateVoltages; /*!< Opens the Voltage Calibration dialog */
-  C_Function<int>::Pointer GDS_CalibrateDetector; /*!< Opens the Detector Calibrartion dialog */
-  
-  C_Function<int>::Pointer GDS_ControlSupplies; /*!< Opens a supply control dialog */
-  C_Function<int>::Pointer GDS_SupplyInfo; /*!< Opens a supply information dialog */
-  C_Function<int>::Pointer GDS_DetectorInfo; /*!< Opens a detector info dialog */
-  C_Function<int, unsigned char * /* Data */, int * /* Width */, int * /* Height */, int * /* Byte Size */>::Pointer GDS_GetRawImage; /*!< Retrieves a raw image from the detector */
-  C_Function<int, SesNS::WRegion *, SesNS::WSpectrum **, SesNS::WSignals **, const char * /* Temporary File */, SesNS::PointReady, SesNS::RegionReady>::Pointer  GDS_InitAcquisition; /*!< Initializing acquisition. Replaces Start(). Introduced in SESInstrument version 1.2.5-rc6 */
-  
-  C_Function<int, int /* Sweep */>::Pointer GDS_StartAcquisition; /*!< Starts acquisition. Replaces Start(). Introduced in SESInstrument version 1.2.5-rc6. */
-  C_Function<int, const char * /* Property */, void * /* Value Buffer */, int * /* Size */>::Pointer SC_GetProperty; /*!< Reads a property from  the instrument library */
-  C_Function<int, const char * /* Property */, const void * /* Value Buffer */>::Pointer SC_SetProperty; /*!< Sets an instrument library property */
-  C_Function<int, const char * /* Property */, const void * /* Value Buffer */, int /* Buffer Size */>::Pointer SC_SetPropertyEx; /*!< Sets an instrument library property. This function also contains the size (in bytes) of the data block. */
+private:
+  void interposeFunctions(bool install);
 
-  C_Function<int, const char* /* LensMode Name */, const char* /* File Path */>::Pointer SC_LoadLensTable; /*!< Load Lens Table */
+  bool callStatistics_;
+  bool capture_;
+  bool interposed_; /*!< The thunks were put in place by load() */
 };
 
 #endif
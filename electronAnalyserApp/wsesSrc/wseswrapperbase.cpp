@@ -6,8 +6,10 @@
 #include "common.hpp"
 #include "constants.h"
 
+#ifdef _WIN32
 #define NOMINMAX
 #include <windows.h>
+#endif
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -15,12 +17,87 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <string.h>
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#define _chdir chdir
+#endif
 
 #include <fstream>
 
 using namespace SESWrapperNS;
 
+namespace
+{
+  /*!
+   * Calls GDS_GetPassEnergies() for one lens mode with the arguments of the other list functions.
+   */
+  struct PassEnergyList
+  {
+    C_Function<int, const char *, char *, int *>::Pointer getPassEnergies;
+    const char *lensMode;
+
+    int operator()(char *buffer, int *size) const
+    {
+      return getPassEnergies(lensMode, buffer, size);
+    }
+  };
+
+  /*!
+   * Reads a list from SESInstrument into \p buffer, which keeps its capacity between calls, so the list is normally
+   * read in a single call. The required size is only queried if \p buffer is too small.
+   *
+   * \return \c true if successful.
+   */
+  template<typename ListCall>
+  bool readSESList(ListCall getList, std::vector<char> &buffer)
+  {
+    int size = int(buffer.size());
+    if (getList(&buffer[0], &size) == 0 && size <= int(buffer.size()))
+      return true;
+
+    size = 0;
+    if (getList(0, &size) != 0 || size <= 0)
+      return false;
+    buffer.resize(size);
+    return getList(&buffer[0], &size) == 0;
+  }
+
+  /*!
+   * Copies \p name into \p buffer the way std::string::copy() is used by the string property getters: at most
+   * \p size characters followed by a null termination.
+   *
+   * \return The length of \p name.
+   */
+  int copyName(const char *name, char *buffer, int size)
+  {
+    int length = int(strlen(name));
+    if (buffer != 0)
+    {
+      int count = length < size ? length : size;
+      memcpy(buffer, name, count);
+      buffer[count] = 0;
+    }
+    return length;
+  }
+
+  /*!
+   * Appends each element of a list to a string vector.
+   */
+  struct NameVectorAppender
+  {
+    WSESWrapperBase::NameVector &names;
+
+    void operator()(const char *element, int length)
+    {
+      names.push_back(std::string(element, length));
+    }
+  };
+}
+
 /*!
  * \class WSESWrapperBase
  * This class collects all variables and objects for SESWrapper. 
@@ -28,6 +105,42 @@ using namespace SESWrapperNS;
  * It serves as a container for property callbacks used when "setting" or "getting" values for the \ref properties_sec properties.
  */
 
+/*!
+ * The \ref properties_sec properties, in the order of the PropertyId enums. The string API looks the names up
+ * in properties_, which is built from this table, while the ID based API indexes it directly.
+ */
+const WSESWrapperBase::PropertyInfo WSESWrapperBase::propertyTable_[PROPERTY_COUNT] =
+{
+  {"lib_description", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibDescription, Property::TYPE_STRING},
+  {"lib_version", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibVersion, Property::TYPE_STRING},
+  {"lib_error", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibError, Property::TYPE_STRING},
+  {"lib_working_dir", &WSESWrapperBase::setLibWorkingDir, &WSESWrapperBase::getLibWorkingDir, Property::TYPE_STRING},
+  {"instrument_library", &WSESWrapperBase::setInstrumentLibrary, &WSESWrapperBase::getInstrumentLibrary, Property::TYPE_STRING},
+  {"instrument_status", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentStatus, Property::TYPE_INT32},
+  {"always_delay_region", &WSESWrapperBase::setAlwaysDelayRegion, &WSESWrapperBase::getAlwaysDelayRegion, Property::TYPE_BOOL},
+  {"allow_io_with_detector", &WSESWrapperBase::setAllowIOWithDetector, &WSESWrapperBase::getAllowIOWithDetector, Property::TYPE_BOOL},
+  {"instrument_model", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentModel, Property::TYPE_STRING},
+  {"instrument_serial_no", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentSerialNo, Property::TYPE_STRING},
+  {"detector_info", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getDetectorInfo, Property::TYPE_DETECTORINFO},
+  {"detector_region", &WSESWrapperBase::setDetectorRegion, &WSESWrapperBase::getDetectorRegion, Property::TYPE_DETECTORREGION},
+  {"element_set_count", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementSetCount, Property::TYPE_INT32},
+  {"element_set", &WSESWrapperBase::setElementSet, &WSESWrapperBase::getElementSet, Property::TYPE_STRING},
+  {"element_name_count", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementNameCount, Property::TYPE_INT32},
+  {"element_name", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementName, Property::TYPE_STRING},
+  {"lens_mode_count", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLensModeCount, Property::TYPE_INT32},
+  {"lens_mode", &WSESWrapperBase::setLensMode, &WSESWrapperBase::getLensMode, Property::TYPE_STRING},
+  {"pass_energy_count", &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getPassEnergyCount, Property::TYPE_INT32},
+  {"pass_energy", &WSESWrapperBase::setPassEnergy, &WSESWrapperBase::getPassEnergy, Property::TYPE_DOUBLE},
+  {"analyzer_region", &WSESWrapperBase::setAnalyzerRegion, &WSESWrapperBase::getAnalyzerRegion, Property::TYPE_ANALYZERREGION},
+  {"use_external_io", &WSESWrapperBase::setUseExternalIO, &WSESWrapperBase::getUseExternalIO, Property::TYPE_BOOL},
+  {"use_detector", &WSESWrapperBase::setUseDetector, &WSESWrapperBase::getUseDetector, Property::TYPE_BOOL},
+  {"use_spin", &WSESWrapperBase::setUseSpin, &WSESWrapperBase::getUseSpin, Property::TYPE_BOOL},
+  {"region_name", &WSESWrapperBase::setRegionName, &WSESWrapperBase::getRegionName, Property::TYPE_STRING},
+  {"temp_file_name", &WSESWrapperBase::setTempFileName, &WSESWrapperBase::getTempFileName, Property::TYPE_STRING},
+  {"reset_data_between_iterations", &WSESWrapperBase::setResetDataBetweenIterations, &WSESWrapperBase::getResetDataBetweenIterations, Property::TYPE_BOOL},
+  {"use_binding_energy", &WSESWrapperBase::setUseBindingEnergy, &WSESWrapperBase::getUseBindingEnergy, Property::TYPE_BOOL}
+};
+
 /*!
  * Creates  a WSESWrapperBase instance. Also creates the hash table for the \ref properties_sec, where the property
  * names are linked to their corresponding callbacks through instances of the WVariable template class.
@@ -36,46 +149,25 @@ using namespace SESWrapperNS;
  */
 WSESWrapperBase::WSESWrapperBase()
 : lib_(new WSESInstrument), instrumentLoaded_(false),
-  activeDetectors_(0x0001), iteration_(0), startTime_(0),workingDir_(""),
+  activeDetectors_(0x0001), iteration_(0), startTime_(0),workingDir_(""), lensModeIndex_(0),
   blockPointReady_(false), blockRegionReady_(false), resetDataBetweenIterations_(false)
 { 
   errors_ = WError::instance();
   
   instrumentLibraryName_ = "dll\\SESInstrument.dll";
 
+  // Large enough for the lists of most instruments, grows if needed
+  listBuffer_.resize(4096);
+
   *sesInstrumentInfo_.Model = 0;
   *sesInstrumentInfo_.SerialNo = 0;
 
   // Create property database
-  properties_.insert(PropertyKeyValue("lib_description", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibDescription, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("lib_version", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibVersion, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("lib_error", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLibError, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("lib_working_dir", Property(this, &WSESWrapperBase::setLibWorkingDir, &WSESWrapperBase::getLibWorkingDir, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("instrument_library", Property(this, &WSESWrapperBase::setInstrumentLibrary, &WSESWrapperBase::getInstrumentLibrary, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("instrument_status", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentStatus, Property::TYPE_INT32)));
-  properties_.insert(PropertyKeyValue("always_delay_region", Property(this, &WSESWrapperBase::setAlwaysDelayRegion, &WSESWrapperBase::getAlwaysDelayRegion, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("allow_io_with_detector", Property(this, &WSESWrapperBase::setAllowIOWithDetector, &WSESWrapperBase::getAllowIOWithDetector, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("instrument_model", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentModel, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("instrument_serial_no", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getInstrumentSerialNo, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("detector_info", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getDetectorInfo, Property::TYPE_DETECTORINFO)));
-  properties_.insert(PropertyKeyValue("detector_region", Property(this, &WSESWrapperBase::setDetectorRegion, &WSESWrapperBase::getDetectorRegion, Property::TYPE_DETECTORREGION)));
-  properties_.insert(PropertyKeyValue("element_set_count", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementSetCount, Property::TYPE_INT32)));
-  properties_.insert(PropertyKeyValue("element_set", Property(this, &WSESWrapperBase::setElementSet, &WSESWrapperBase::getElementSet, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("element_name_count", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementNameCount, Property::TYPE_INT32)));
-  properties_.insert(PropertyKeyValue("element_name", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getElementName, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("lens_mode_count", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getLensModeCount, Property::TYPE_INT32)));
-  properties_.insert(PropertyKeyValue("lens_mode", Property(this, &WSESWrapperBase::setLensMode, &WSESWrapperBase::getLensMode, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("pass_energy_count", Property(this, &WSESWrapperBase::readOnlyStub, &WSESWrapperBase::getPassEnergyCount, Property::TYPE_INT32)));
-  properties_.insert(PropertyKeyValue("pass_energy", Property(this, &WSESWrapperBase::setPassEnergy, &WSESWrapperBase::getPassEnergy, Property::TYPE_DOUBLE)));
-
-  properties_.insert(PropertyKeyValue("analyzer_region", Property(this, &WSESWrapperBase::setAnalyzerRegion, &WSESWrapperBase::getAnalyzerRegion, Property::TYPE_ANALYZERREGION)));
-  properties_.insert(PropertyKeyValue("use_external_io", Property(this, &WSESWrapperBase::setUseExternalIO, &WSESWrapperBase::getUseExternalIO, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("use_detector", Property(this, &WSESWrapperBase::setUseDetector, &WSESWrapperBase::getUseDetector, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("use_spin", Property(this, &WSESWrapperBase::setUseSpin, &WSESWrapperBase::getUseSpin, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("region_name", Property(this, &WSESWrapperBase::setRegionName, &WSESWrapperBase::getRegionName, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("temp_file_name", Property(this, &WSESWrapperBase::setTempFileName, &WSESWrapperBase::getTempFileName, Property::TYPE_STRING)));
-  properties_.insert(PropertyKeyValue("reset_data_between_iterations", Property(this, &WSESWrapperBase::setResetDataBetweenIterations, &WSESWrapperBase::getResetDataBetweenIterations, Property::TYPE_BOOL)));
-  properties_.insert(PropertyKeyValue("use_binding_energy", Property(this, &WSESWrapperBase::setUseBindingEnergy, &WSESWrapperBase::getUseBindingEnergy, Property::TYPE_BOOL)));
+  for (int id = 0; id < PROPERTY_COUNT; id++)
+  {
+    const PropertyInfo &info = propertyTable_[id];
+    properties_.insert(PropertyKeyValue(info.name, Property(this, info.set, info.get, info.valueType)));
+  }
 }
 
 /*!
@@ -87,6 +179,78 @@ WSESWrapperBase::~WSESWrapperBase()
   errors_->release();
 }
 
+/*!
+ * \return \c true once WSESWrapperMain::loadInstrument() has loaded an instrument configuration.
+ */
+bool WSESWrapperBase::isInstrumentLoaded() const
+{
+  return instrumentLoaded_;
+}
+
+/*!
+ * Gives access to the element sets, lens modes and pass energies of the loaded instrument, which are read once by
+ * WSESWrapperMain::loadInstrument(). Lookups in the returned object make no calls into the instrument library.
+ */
+const WCapabilities &WSESWrapperBase::capabilities() const
+{
+  return capabilities_;
+}
+
+/*!
+ * \return The index in capabilities() of the current lens mode, which selects the pass energies reported by the
+ *         \c pass_energy_count and \c pass_energy properties.
+ */
+int WSESWrapperBase::lensModeIndex() const
+{
+  return lensModeIndex_;
+}
+
+/*!
+ * Enables or disables the recording of the calls into the instrument library in WCallStats.
+ *
+ * \see WSESInstrument::setCallStatistics()
+ */
+void WSESWrapperBase::setCallStatistics(bool enable)
+{
+  lib_->setCallStatistics(enable);
+}
+
+/*!
+ * \return \c true if the calls into the instrument library are recorded in WCallStats.
+ */
+bool WSESWrapperBase::callStatistics() const
+{
+  return lib_->callStatistics();
+}
+
+/*!
+ * Starts or ends a capture of the calls into the instrument library for replay.
+ *
+ * \see WSESInstrument::setCapture()
+ */
+bool WSESWrapperBase::setCapture(const char *fileName)
+{
+  return lib_->setCapture(fileName);
+}
+
+/*!
+ * \return \c true if the calls into the instrument library are being captured.
+ */
+bool WSESWrapperBase::capture() const
+{
+  return lib_->capture();
+}
+
+/*!
+ * \return \c true if setCallStatistics() and setCapture() take effect while the instrument library is loaded.
+ *
+ * \see WSESInstrument::interposed()
+ */
+bool WSESWrapperBase::interposed() const
+{
+  return lib_->interposed();
+}
+
 /*!
  * Getter for the \c instrument_library property. If the \p value parameter is 0, \p size will be 
  * modified to return the required buffer length for the description.
@@ -383,7 +547,7 @@ int WSESWrapperBase::getElementSetCount(int index, void *value, int &size)
   int *intValue = reinterpret_cast<int *>(value);
 
   if (intValue != 0)
-    *intValue = elementSets_.size();
+    *intValue = capabilities_.elementSetCount();
 
 	return WError::ERR_OK;
 }
@@ -413,12 +577,8 @@ int WSESWrapperBase::getElementSet(int index, void *value, int &size)
     if (lib_->GDS_GetCurrElementSet(strValue, &size) != 0)
 	    errorCode =  WError::ERR_FAIL;
   }
-  else if (index >= 0 && index < int(elementSets_.size()))
-  {
-    if (strValue != 0)
-      strValue[elementSets_[index].copy(strValue, size)] = 0;
-    size = elementSets_[index].length();
-  }
+  else if (index >= 0 && index < capabilities_.elementSetCount())
+    size = copyName(capabilities_.elementSet(index), strValue, size);
   else
     errorCode = WError::ERR_INDEX;
 
@@ -503,7 +663,7 @@ int WSESWrapperBase::getLensModeCount(int index, void *value, int &size)
   int *intValue = reinterpret_cast<int *>(value);
 
   if (intValue != 0)
-    *intValue = lensModes_.size();
+    *intValue = capabilities_.lensModeCount();
 
 	return WError::ERR_OK;
 }
@@ -533,12 +693,8 @@ int WSESWrapperBase::getLensMode(int index, void *value, int &size)
     if (lib_->GDS_GetCurrLensMode(strValue, &size) != 0)
 	    errorCode =  WError::ERR_FAIL;
   }
-  else if (index >= 0 && index < int(lensModes_.size()))
-  {
-    if (strValue != 0)
-      strValue[lensModes_[index].copy(strValue, size)] = 0;
-    size = lensModes_[index].length();
-  }
+  else if (index >= 0 && index < capabilities_.lensModeCount())
+    size = copyName(capabilities_.lensMode(index), strValue, size);
   else
     errorCode = WError::ERR_INDEX;
 
@@ -548,11 +704,12 @@ int WSESWrapperBase::getLensMode(int index, void *value, int &size)
 /*!
  * Getter for the \c pass_energy_count property. The \p value parameter must be a pointer to a 32-bit integer.
  * \note The number of available pass energies is dependent on the current lens mode. If you change the lens
- *       mode, you need to update your internal list of pass energies, beginning with this function.
+ *       mode, you need to update your internal list of pass energies, beginning with this function. The pass
+ *       energies of every lens mode are read when the instrument is loaded, so this makes no library calls.
  *
  * \param[in] index Not used.
- * \param[out] value A 32-bit integer that will contain the number of available lens modes. This value can later be used
- *              as an index to the \c lens_mode_from_index property getter.
+ * \param[out] value A 32-bit integer that will contain the number of pass energies available in the current lens mode.
+ *              This value can later be used as an index to the \c pass_energy property getter.
  * \param[in,out] size Not used.
  *
  * \return WError::ERR_NO_INSTRUMENT if WSESWrapperMain::loadInstrument() has not been called,
@@ -569,7 +726,7 @@ int WSESWrapperBase::getPassEnergyCount(int index, void *value, int &size)
   int errorCode = WError::ERR_OK;
 
   if (intValue != 0)
-    *intValue = passEnergies_.size();
+    *intValue = capabilities_.passEnergyCount(lensModeIndex_);
 
 	return WError::ERR_OK;
 }
@@ -578,7 +735,8 @@ int WSESWrapperBase::getPassEnergyCount(int index, void *value, int &size)
  * Getter for the \c pass_energy property. The \p value parameter must be a pointer to a \c double (8-byte floating
  * point).
  *
- * \param[in] index If set to -1, obtains the current pass energy. If 0 <= \p index < \c pass_energy_count, obtains the pass energy for that index.
+ * \param[in] index If set to -1, obtains the current pass energy. If 0 <= \p index < \c pass_energy_count, obtains the pass energy for that
+ *              index in the current lens mode.
  * \param[out] value A pointer to a \c double to be filled with the current pass energy.
  * \param[in,out] size Not used.
  *
@@ -598,10 +756,10 @@ int WSESWrapperBase::getPassEnergy(int index, void *value, int &size)
     if (lib_->GDS_GetCurrPassEnergy(doubleValue) != 0)
 	    errorCode =  WError::ERR_FAIL;
   }
-  else if (index >= 0 && index < int(passEnergies_.size()))
+  else if (index >= 0 && index < capabilities_.passEnergyCount(lensModeIndex_))
   {
     if (doubleValue != 0)
-      *doubleValue = passEnergies_[index];
+      *doubleValue = capabilities_.passEnergy(lensModeIndex_, index);
   }
   else
     errorCode = WError::ERR_INDEX;
@@ -831,9 +989,13 @@ int WSESWrapperBase::setLibWorkingDir(int index, const void *value)
 			_chdir(strValue);
 			char *buffer = getcwd(0, 0);
 			workingDir_ = buffer;
-			workingDir_.append("\\");
+			workingDir_.append(PATH_SEPARATOR);
 			free(buffer);
+#ifdef _WIN32
 			SetEnvironmentVariable("SES_BASE_DIR", workingDir_.c_str());
+#else
+			setenv("SES_BASE_DIR", workingDir_.c_str(), 1);
+#endif
 		}
 	}
 	return WError::ERR_OK;
@@ -953,8 +1115,8 @@ int WSESWrapperBase::setElementSet(int index, const void *value)
 }
 
 /*!
- * Setter for the \c element_set property. This function reloads the pass energy list when successful.
- * This requires updates for the pass energy lists for the calling application.
+ * Setter for the \c lens_mode property. When successful, the \c pass_energy_count and \c pass_energy properties
+ * report the pass energies of the new lens mode. This requires updates for the pass energy lists for the calling application.
  *
  * \param[in] index  Must be set to -1. Values between 0 and \c element_set_count - 1 are index for future use.
  * \param[in] value A null-terminated string that specifies the name of the new lens mode.
@@ -970,7 +1132,12 @@ int WSESWrapperBase::setLensMode(int index, const void *value)
   const std::string strValue = reinterpret_cast<const char *>(value);
   int errorCode = lib_->GDS_SetLensMode(strValue.c_str()) == 0 ? WError::ERR_OK : WError::ERR_INCORRECT_LENS_MODE;
   if (errorCode == WError::ERR_OK)
+  {
     sesRegion_.LensMode[strValue.copy(sesRegion_.LensMode, 32)] = 0;
+    int lensMode = capabilities_.findLensMode(strValue.c_str());
+    if (lensMode >= 0)
+      lensModeIndex_ = lensMode;
+  }
 	return errorCode;
 }
 
@@ -1159,92 +1326,45 @@ int WSESWrapperBase::setResetDataBetweenIterations(int index, const void *value)
 }
 
 /*!
- * Reloads the elemet sets. Called after loading a new instrument configuration.
+ * Reloads the element sets, the lens modes and the pass energies of every lens mode into capabilities_. Called after
+ * loading a new instrument configuration, so that the lists can later be served without library calls.
  *
  * \return \c true if successful.
  */
-bool WSESWrapperBase::loadElementSets()
+bool WSESWrapperBase::loadCapabilities()
 {
-  elementSets_.clear();
+  capabilities_.clear();
+  lensModeIndex_ = 0;
 
   if (!instrumentLoaded_)
     return false;
 
-  char *buffer = 0;
-  int bufferSize = 0;
-  
-  bool success = (lib_->GDS_GetElementSets(buffer, &bufferSize) == 0);
-  if (success)
-  {
-    buffer = new char[bufferSize];
-    success = (lib_->GDS_GetElementSets(buffer, &bufferSize) == 0);
-    splitSESList(buffer, bufferSize, elementSets_);
-    delete[] buffer;
-  }
-
-  return success;
-}
-
-/*!
- * Loads the lens modes. Called after loading a new instrument configuration.
- *
- * \return \c true if successful.
- */
-bool WSESWrapperBase::loadLensModes()
-{
-  lensModes_.clear();
+  if (!readSESList(lib_->GDS_GetElementSets, listBuffer_))
+    return false;
+  capabilities_.addElementSets(&listBuffer_[0], int(listBuffer_.size()));
 
-  if (!instrumentLoaded_)
+  if (!readSESList(lib_->GDS_GetLensModes, listBuffer_))
     return false;
+  capabilities_.addLensModes(&listBuffer_[0], int(listBuffer_.size()));
 
-  char *buffer = 0;
-  int bufferSize = 0;
-  
-  bool success = (lib_->GDS_GetLensModes(buffer, &bufferSize) == 0);
-  if (success)
+  for (int i = 0; i < capabilities_.lensModeCount(); i++)
   {
-    buffer = new char[bufferSize];
-    success = (lib_->GDS_GetLensModes(buffer, &bufferSize) == 0);
-    splitSESList(buffer, bufferSize, lensModes_);
-    delete[] buffer;
+    PassEnergyList getList = {lib_->GDS_GetPassEnergies, capabilities_.lensMode(i)};
+    if (readSESList(getList, listBuffer_))
+      capabilities_.addPassEnergies(&listBuffer_[0], int(listBuffer_.size()));
+    else
+      capabilities_.addPassEnergies(0, 0);
   }
 
-  return success;
-}
-
-/*!
- * Reloads the Pass energies. Called after loading a new instrument configuration.
- *
- * \return \c true if successful.
- */
-bool WSESWrapperBase::loadPassEnergies(const std::string &lensMode, DoubleVector &result)
-{
-  passEnergies_.clear();
-
-  if (!instrumentLoaded_)
-    return false;
-
-  char *buffer = 0;
-  int bufferSize = 0;
-
-  result.clear();
-  bool success = (lib_->GDS_GetPassEnergies(lensMode.c_str(), buffer, &bufferSize) == 0);
-
-  if (success)
+  int size = int(listBuffer_.size());
+  if (lib_->GDS_GetCurrLensMode(&listBuffer_[0], &size) == 0 && size <= int(listBuffer_.size()))
   {
-    buffer = new char[bufferSize];
-    success = (lib_->GDS_GetPassEnergies(lensMode.c_str(), buffer, &bufferSize) == 0 && buffer[0] != 0);
-    if (success)
-    {
-      NameVector strResult;
-      splitSESList(buffer, bufferSize, strResult);
-      for (int i = 0; i < int(strResult.size()); i++)
-        result.push_back(atof(strResult[i].c_str()));
-    }
-    delete[] buffer;
+    int lensMode = capabilities_.findLensMode(&listBuffer_[0]);
+    if (lensMode >= 0)
+      lensModeIndex_ = lensMode;
   }
 
-  return success;
+  return true;
 }
 
 /*!
@@ -1262,13 +1382,8 @@ bool WSESWrapperBase::loadElementNames()
   if (lib_->GDS_GetElements == 0)
     return true; // Optional function, should not generate errors.
 
-  char *buffer = 0;
-  int size = 0;
-  int result = lib_->GDS_GetElements(0, &size);
-  buffer = new char[size];
-  result = lib_->GDS_GetElements(buffer, &size);
-  splitSESList(buffer, size, elementNames_);
-  delete[] buffer;
+  if (readSESList(lib_->GDS_GetElements, listBuffer_))
+    splitSESList(&listBuffer_[0], int(listBuffer_.size()), elementNames_);
   return true;
 }
 
@@ -1282,17 +1397,6 @@ bool WSESWrapperBase::loadElementNames()
  */
 void WSESWrapperBase::splitSESList(const char *buffer, int bufferSize, NameVector &result)
 {
-  std::istringstream istr(buffer);
-  while (istr.good())
-  {
-    std::string item;
-    if (istr.peek() == '"')
-    {
-      istr.get();
-      std::getline(istr, item, '"');
-      result.push_back(item);
-    }
-    istr.get();
-    istr >> std::ws;
-  }
+  NameVectorAppender add = {result};
+  CommonNS::forEachQuoted(buffer, bufferSize, add);
 }
@@ -2,12 +2,22 @@
 #define __SESWRAPPER_WSESWRAPPERBASE_H__
 
 #include "wvariable.hpp"
+#include "wtypedvariable.hpp"
+#include "wcapabilities.h"
 #include "sestypes.h"
 
 #include <map>
 #include <vector>
 #include <string>
 
+#ifdef _WIN32
+#define PATH_SEPARATOR "\\"
+#define INSTRUMENT_LIBRARY "dll\\SESInstrument.dll"
+#else
+#define PATH_SEPARATOR "/"
+#define INSTRUMENT_LIBRARY "dll/libSESInstrument.so"
+#endif
+
 class WSESInstrument;
 class WError;
 
@@ -20,12 +30,82 @@ public:
   typedef std::vector<std::string> NameVector;
   typedef std::vector<double> DoubleVector;
 
+  /*!
+   * The extents of the string properties and data parameters: names such as lens modes and units are SesNS::Char32,
+   * the rest are up to 256 characters.
+   */
+  enum
+  {
+    NAME_EXTENT = sizeof(SesNS::Char32),
+    TEXT_EXTENT = 256
+  };
+  typedef WFixedString<NAME_EXTENT> Name;
+  typedef WFixedString<TEXT_EXTENT> Text;
+
+  /*!
+   * Identifies the \ref properties_sec properties without a name lookup. Each value indexes propertyTable_,
+   * so the ID based overloads of WSESWrapperMain::getProperty() and WSESWrapperMain::setProperty() call the
+   * property callbacks directly.
+   */
+  enum PropertyId
+  {
+    PROPERTY_LIB_DESCRIPTION,
+    PROPERTY_LIB_VERSION,
+    PROPERTY_LIB_ERROR,
+    PROPERTY_LIB_WORKING_DIR,
+    PROPERTY_INSTRUMENT_LIBRARY,
+    PROPERTY_INSTRUMENT_STATUS,
+    PROPERTY_ALWAYS_DELAY_REGION,
+    PROPERTY_ALLOW_IO_WITH_DETECTOR,
+    PROPERTY_INSTRUMENT_MODEL,
+    PROPERTY_INSTRUMENT_SERIAL_NO,
+    PROPERTY_DETECTOR_INFO,
+    PROPERTY_DETECTOR_REGION,
+    PROPERTY_ELEMENT_SET_COUNT,
+    PROPERTY_ELEMENT_SET,
+    PROPERTY_ELEMENT_NAME_COUNT,
+    PROPERTY_ELEMENT_NAME,
+    PROPERTY_LENS_MODE_COUNT,
+    PROPERTY_LENS_MODE,
+    PROPERTY_PASS_ENERGY_COUNT,
+    PROPERTY_PASS_ENERGY,
+    PROPERTY_ANALYZER_REGION,
+    PROPERTY_USE_EXTERNAL_IO,
+    PROPERTY_USE_DETECTOR,
+    PROPERTY_USE_SPIN,
+    PROPERTY_REGION_NAME,
+    PROPERTY_TEMP_FILE_NAME,
+    PROPERTY_RESET_DATA_BETWEEN_ITERATIONS,
+    PROPERTY_USE_BINDING_ENERGY,
+    PROPERTY_COUNT /*!< The number of properties */
+  };
+
+  /*!
+   * Describes one property: the name used by the string API, its callbacks and its value type.
+   */
+  struct PropertyInfo
+  {
+    const char *name;
+    Property::SetCallback set;
+    Property::GetCallback get;
+    Property::ValueType valueType;
+  };
+
   typedef int (*guiCallback)();
   typedef std::map<std::string, guiCallback> SesGuiMap;
 
   WSESWrapperBase();
   ~WSESWrapperBase();
 
+  bool isInstrumentLoaded() const;
+  const WCapabilities &capabilities() const;
+  int lensModeIndex() const;
+  void setCallStatistics(bool enable);
+  bool callStatistics() const;
+  bool setCapture(const char *fileName);
+  bool capture() const;
+  bool interposed() const;
+
 protected:
   // Property getters
   int getLibDescription(int index, void *value, int &size);
@@ -76,13 +156,12 @@ protected:
   int setUseSpin(int index, const void *value);
   int setUseBindingEnergy(int index, const void *value);
 
-  bool loadElementSets();
-  bool loadLensModes();
-  bool loadPassEnergies(const std::string &lensMode, DoubleVector &result);
+  bool loadCapabilities();
   bool loadElementNames();
 
   void splitSESList(const char *buffer, int bufferSize, NameVector &result);
 
+  static const PropertyInfo propertyTable_[PROPERTY_COUNT];
   PropertyMap properties_;
 
   WSESInstrument *lib_;
@@ -97,10 +176,10 @@ protected:
   std::string tempFileName_;
   unsigned short activeDetectors_;
 
-  NameVector elementSets_;
-  NameVector lensModes_;
-  DoubleVector passEnergies_;
+  WCapabilities capabilities_;
+  int lensModeIndex_;
   NameVector elementNames_;
+  std::vector<char> listBuffer_;
   unsigned int startTime_;
 
   SesGuiMap sesGUI_;
@@ -112,4 +191,43 @@ protected:
   WError *errors_;
 };
 
+/*!
+ * Declares the value type of each property for the typed WSESWrapperMain::getProperty<Id>(). The strings are
+ * WFixedString buffers of the longest value the property can have, so they are read in a single call.
+ */
+template<int Id> struct WPropertyTraits;
+
+#define PROPERTY_VALUE(id, type) template<> struct WPropertyTraits<WSESWrapperBase::id> { typedef type Value; }
+
+PROPERTY_VALUE(PROPERTY_LIB_DESCRIPTION, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_LIB_VERSION, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_LIB_ERROR, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_LIB_WORKING_DIR, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_INSTRUMENT_LIBRARY, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_INSTRUMENT_STATUS, int);
+PROPERTY_VALUE(PROPERTY_ALWAYS_DELAY_REGION, bool);
+PROPERTY_VALUE(PROPERTY_ALLOW_IO_WITH_DETECTOR, bool);
+PROPERTY_VALUE(PROPERTY_INSTRUMENT_MODEL, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_INSTRUMENT_SERIAL_NO, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_DETECTOR_INFO, SESWrapperNS::DetectorInfo);
+PROPERTY_VALUE(PROPERTY_DETECTOR_REGION, SESWrapperNS::DetectorRegion);
+PROPERTY_VALUE(PROPERTY_ELEMENT_SET_COUNT, int);
+PROPERTY_VALUE(PROPERTY_ELEMENT_SET, WSESWrapperBase::Name);
+PROPERTY_VALUE(PROPERTY_ELEMENT_NAME_COUNT, int);
+PROPERTY_VALUE(PROPERTY_ELEMENT_NAME, WSESWrapperBase::Name);
+PROPERTY_VALUE(PROPERTY_LENS_MODE_COUNT, int);
+PROPERTY_VALUE(PROPERTY_LENS_MODE, WSESWrapperBase::Name);
+PROPERTY_VALUE(PROPERTY_PASS_ENERGY_COUNT, int);
+PROPERTY_VALUE(PROPERTY_PASS_ENERGY, double);
+PROPERTY_VALUE(PROPERTY_ANALYZER_REGION, SESWrapperNS::AnalyzerRegion);
+PROPERTY_VALUE(PROPERTY_USE_EXTERNAL_IO, bool);
+PROPERTY_VALUE(PROPERTY_USE_DETECTOR, bool);
+PROPERTY_VALUE(PROPERTY_USE_SPIN, bool);
+PROPERTY_VALUE(PROPERTY_REGION_NAME, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_TEMP_FILE_NAME, WSESWrapperBase::Text);
+PROPERTY_VALUE(PROPERTY_RESET_DATA_BETWEEN_ITERATIONS, bool);
+PROPERTY_VALUE(PROPERTY_USE_BINDING_ENERGY, bool);
+
+#undef PROPERTY_VALUE
+
 #endif
@@ -6,7 +6,14 @@
 #include "common.hpp"
 #include "werror.h"
 
+#ifdef _WIN32
 #include <direct.h>
+#else
+#include <unistd.h>
+#include <strings.h>
+#define _chdir chdir
+#define _getcwd getcwd
+#endif
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -18,9 +25,81 @@
 using namespace SESWrapperNS;
 using namespace std;
 
+#ifndef _WIN32
+typedef unsigned long DWORD;
+
+/*!
+ * Reads a value from an ini file in the same way as the Win32 function of the same name. Section and key
+ * names are not case sensitive.
+ *
+ * \return The length of the string copied to \p result.
+ */
+static DWORD GetPrivateProfileString(const char *section, const char *key, const char *defaultValue, char *result, DWORD size, const char *fileName)
+{
+  std::ifstream file(fileName);
+  std::string line, value = defaultValue;
+  bool inSection = false;
+
+  while (std::getline(file, line))
+  {
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+    if (!line.empty() && line[0] == '[')
+    {
+      std::string name = line.substr(1, line.find(']') - 1);
+      inSection = (strcasecmp(name.c_str(), section) == 0);
+      continue;
+    }
+    std::string::size_type equals = line.find('=');
+    if (inSection && equals != std::string::npos && strcasecmp(line.substr(0, equals).c_str(), key) == 0)
+    {
+      value = line.substr(equals + 1);
+      break;
+    }
+  }
+
+  DWORD length = value.copy(result, size > 0 ? size - 1 : 0);
+  if (size > 0)
+    result[length] = 0;
+  return length;
+}
+#endif
+
 WSESWrapperMain *WSESWrapperMain::this_ = 0;
 int WSESWrapperMain::references_ = 0;
 
+/*!
+ * The data parameters, in the order of the DataParameterId enums. All of them are read-only.
+ */
+const WSESWrapperMain::DataParameterInfo WSESWrapperMain::dataParameterTable_[DATA_PARAMETER_COUNT] =
+{
+  {"acq_channels", &WSESWrapperMain::getAcqChannels, DataParameter::TYPE_INT32},
+  {"acq_slices", &WSESWrapperMain::getAcqSlices, DataParameter::TYPE_INT32},
+  {"acq_iterations", &WSESWrapperMain::getAcqIterations, DataParameter::TYPE_INT32},
+  {"acq_intensity_unit", &WSESWrapperMain::getAcqIntensityUnit, DataParameter::TYPE_STRING},
+  {"acq_channel_unit", &WSESWrapperMain::getAcqChannelUnit, DataParameter::TYPE_STRING},
+  {"acq_slice_unit", &WSESWrapperMain::getAcqSliceUnit, DataParameter::TYPE_STRING},
+  {"acq_spectrum", &WSESWrapperMain::getAcqSpectrum, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_image", &WSESWrapperMain::getAcqImage, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_slice", &WSESWrapperMain::getAcqSlice, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_channel_scale", &WSESWrapperMain::getAcqChannelScale, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_slice_scale", &WSESWrapperMain::getAcqSliceScale, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_raw_image", &WSESWrapperMain::getAcqRawImage, DataParameter::TYPE_VECTOR_INT32},
+  {"acq_current_step", &WSESWrapperMain::getAcqCurrentStep, DataParameter::TYPE_INT32},
+  {"acq_elapsed_time", &WSESWrapperMain::getAcqElapsedTime, DataParameter::TYPE_DOUBLE},
+  {"acq_io_ports", &WSESWrapperMain::getAcqIOPorts, DataParameter::TYPE_INT32},
+  {"acq_io_size", &WSESWrapperMain::getAcqIOSize, DataParameter::TYPE_INT32},
+  {"acq_io_iterations", &WSESWrapperMain::getAcqIOIterations, DataParameter::TYPE_INT32},
+  {"acq_io_unit", &WSESWrapperMain::getAcqIOUnit, DataParameter::TYPE_STRING},
+  {"acq_io_scale", &WSESWrapperMain::getAcqIOScale, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_io_spectrum", &WSESWrapperMain::getAcqIOSpectrum, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_io_data", &WSESWrapperMain::getAcqIOData, DataParameter::TYPE_VECTOR_DOUBLE},
+  {"acq_io_port_name", &WSESWrapperMain::getAcqIOPortName, DataParameter::TYPE_STRING},
+  {"acq_current_point", &WSESWrapperMain::getAcqCurrentPoint, DataParameter::TYPE_INT32},
+  {"acq_point_intensity", &WSESWrapperMain::getAcqPointIntensity, DataParameter::TYPE_DOUBLE},
+  {"acq_channel_intensity", &WSESWrapperMain::getAcqChannelIntensity, DataParameter::TYPE_VECTOR_DOUBLE}
+};
+
 /*! \class WSESWrapperMain
  *
  * This is the main class for the SESWrapper library.
@@ -34,34 +113,15 @@ int WSESWrapperMain::references_ = 0;
  * \param[in] workingDir The current working directory
  */
 WSESWrapperMain::WSESWrapperMain()
-: initialized_(false), currentStep_(0), currentPoint_(std::numeric_limits<int>::min()), sesSpectrum_(0), sesSignals_(0)
+: initialized_(false), currentStep_(0), currentPoint_(std::numeric_limits<int>::min()), sesSpectrum_(0), sesSignals_(0),
+  rawImageWidth_(0), rawImageHeight_(0), rawImageByteSize_(2)
 {
   // Create data parameter database
-  dataParameters_.insert(DataParameterKeyValue("acq_channels", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqChannels, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_slices", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqSlices, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_iterations", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIterations, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_intensity_unit", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIntensityUnit, DataParameter::TYPE_STRING)));
-  dataParameters_.insert(DataParameterKeyValue("acq_channel_unit", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqChannelUnit, DataParameter::TYPE_STRING)));
-  dataParameters_.insert(DataParameterKeyValue("acq_slice_unit", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqSliceUnit, DataParameter::TYPE_STRING)));
-  dataParameters_.insert(DataParameterKeyValue("acq_spectrum", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqSpectrum, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_image", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqImage, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_slice", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqSlice, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_channel_scale", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqChannelScale, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_slice_scale", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqSliceScale, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_raw_image", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqRawImage, DataParameter::TYPE_VECTOR_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_current_step", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqCurrentStep, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_elapsed_time", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqElapsedTime, DataParameter::TYPE_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_ports", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOPorts, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_size", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOSize, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_iterations", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIterations, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_unit", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOUnit, DataParameter::TYPE_STRING)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_scale", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOScale, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_spectrum", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOSpectrum, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_data", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOData, DataParameter::TYPE_VECTOR_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_io_port_name", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqIOPortName, DataParameter::TYPE_STRING)));
-  dataParameters_.insert(DataParameterKeyValue("acq_current_point", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqCurrentPoint, DataParameter::TYPE_INT32)));
-  dataParameters_.insert(DataParameterKeyValue("acq_point_intensity", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqPointIntensity, DataParameter::TYPE_DOUBLE)));
-  dataParameters_.insert(DataParameterKeyValue("acq_channel_intensity", DataParameter(this, &WSESWrapperMain::readOnlyStub, &WSESWrapperMain::getAcqChannelIntensity, DataParameter::TYPE_VECTOR_DOUBLE)));
+  for (int id = 0; id < DATA_PARAMETER_COUNT; id++)
+  {
+    const DataParameterInfo &info = dataParameterTable_[id];
+    dataParameters_.insert(DataParameterKeyValue(info.name, DataParameter(this, &WSESWrapperMain::readOnlyStub, info.get, info.valueType)));
+  }
 }
 
 /*!
@@ -134,35 +194,24 @@ bool WSESWrapperMain::isInitialized()
 }
 
 /*!
- * Opens the SESInstrument.dll library and imports the functions of that library.
- *
- * When SESWrapper loads, it tries to load the SESInstrument library and run GDS_Initialize automatically.
- * If successful, initialize() should not be called. However, if the SESInstrument library was not found during
- * startup, the user needs to change the working directory to the SES software (using the \c lib_working_dir
- * property) and then call initialize(). In that case, the user assumes the responsibility for calling the
- * finalize() member function as well.
+ * Opens the SESInstrument.dll library and imports the functions of that library, without running GDS_Initialize.
+ * initialize() calls this if the library has not been loaded, so it only needs to be called separately to tell the
+ * two steps apart, e.g. to report the progress of a slow startup.
  *
- * \param[in,out] reserved This parameter is reserved for future use. It must be set to 0.
+ * \return Possible return codes: WError::ERR_OK on success, WError::ERR_QT_RUNNING if the detector graph viewer is
+ *         configured to run, WError::ERR_LOAD_LIBRARY if the instrument library could not be loaded.
  *
- * \return Possible return codes: WError::ERR_OK on success, WError::ERR_LOAD_LIBRARY if the instrument library
- *         could not be loaded, WError::ERR_INITIALIZE_FAIL if the initialization failed.
- *
- * \see finalize()
+ * \see initialize()
  */
-int WSESWrapperMain::initialize(void *reserved)
+int WSESWrapperMain::loadLibrary()
 {
   int errorCode = WError::ERR_OK;
 
-  if (initialized_)
-    return WError::ERR_OK;
-
-  instrumentLoaded_ = false;
-  
   instrumentLibraryName_ = workingDir_;
   if (workingDir_.empty())
-    instrumentLibraryName_ = "dll\\SESInstrument.dll";
+    instrumentLibraryName_ = INSTRUMENT_LIBRARY;
   else
-    instrumentLibraryName_.append("\\dll\\SESInstrument.dll");
+    instrumentLibraryName_.append(PATH_SEPARATOR INSTRUMENT_LIBRARY);
 
   std:string path = workingDir_;
   path.append("/ini/Ses.ini");
@@ -190,6 +239,43 @@ int WSESWrapperMain::initialize(void *reserved)
   if (!lib_->isLoaded() && !lib_->load(instrumentLibraryName_.c_str()))
     errorCode = WError::ERR_LOAD_LIBRARY;
 
+  _chdir(tmpDir);
+  free(tmpDir);
+
+  return errorCode;
+}
+
+/*!
+ * Opens the SESInstrument.dll library and imports the functions of that library.
+ *
+ * When SESWrapper loads, it tries to load the SESInstrument library and run GDS_Initialize automatically.
+ * If successful, initialize() should not be called. However, if the SESInstrument library was not found during
+ * startup, the user needs to change the working directory to the SES software (using the \c lib_working_dir
+ * property) and then call initialize(). In that case, the user assumes the responsibility for calling the
+ * finalize() member function as well.
+ *
+ * \param[in,out] reserved This parameter is reserved for future use. It must be set to 0.
+ *
+ * \return Possible return codes: WError::ERR_OK on success, WError::ERR_LOAD_LIBRARY if the instrument library
+ *         could not be loaded, WError::ERR_INITIALIZE_FAIL if the initialization failed.
+ *
+ * \see loadLibrary(), finalize()
+ */
+int WSESWrapperMain::initialize(void *reserved)
+{
+  int errorCode = WError::ERR_OK;
+
+  if (initialized_)
+    return WError::ERR_OK;
+
+  instrumentLoaded_ = false;
+
+  errorCode = loadLibrary();
+  if (errorCode == WError::ERR_QT_RUNNING)
+    return errorCode;
+
+	char *tmpDir = _getcwd(0, 0);
+
   if (errorCode == WError::ERR_OK && lib_->GDS_Initialize(errorNotify, 0) != 0)
     errorCode = WError::ERR_INITIALIZE_FAIL;
 
@@ -323,6 +409,89 @@ int WSESWrapperMain::setProperty(const char *property, int size, const void *val
   return it->second.set(size, value);
 }
 
+/*!
+ * Obtains the value of a property from its ID. This is equivalent to the string version of getProperty(),
+ * but calls the getter of the property directly without looking up its name. Only the properties of the
+ * WSESWrapperBase class have IDs, so there is no fallback to SC_GetProperty.
+ *
+ * \return WError::ERR_PARAMETER_NOT_FOUND if \p id is not a valid property ID, otherwise the return code
+ *         is dependent on the type of variable.
+ *
+ * \see getProperty(const char *property, int index, void *value, int &size)
+ */
+int WSESWrapperMain::getProperty(PropertyId id, int index, void *value, int &size)
+{
+  if (id < 0 || id >= PROPERTY_COUNT)
+    return WError::ERR_PARAMETER_NOT_FOUND;
+  return (this->*propertyTable_[id].get)(index, value, size);
+}
+
+/*!
+ * This is a convenience member function that can be used when the \p size parameter is not required.
+ *
+ * \see getProperty(PropertyId id, int index, void *value, int &size)
+ */
+int WSESWrapperMain::getProperty(PropertyId id, int index, void *value)
+{
+  int size = 0;
+  return getProperty(id, index, value, size);
+}
+
+/*!
+ * Obtains the value of a property of type WVariable::TYPE_BOOL.
+ *
+ * \return WError::ERR_WRONG_SIZE if the property \p id is not of type WVariable::TYPE_BOOL, otherwise the
+ *         return code of the getter.
+ */
+int WSESWrapperMain::getProperty(PropertyId id, int index, bool &value)
+{
+  if (id >= 0 && id < PROPERTY_COUNT && propertyTable_[id].valueType != Property::TYPE_BOOL)
+    return WError::ERR_WRONG_SIZE;
+  return getProperty(id, index, &value);
+}
+
+/*!
+ * Obtains the value of a property of type WVariable::TYPE_INT32.
+ *
+ * \return WError::ERR_WRONG_SIZE if the property \p id is not of type WVariable::TYPE_INT32, otherwise the
+ *         return code of the getter.
+ */
+int WSESWrapperMain::getProperty(PropertyId id, int index, int &value)
+{
+  if (id >= 0 && id < PROPERTY_COUNT && propertyTable_[id].valueType != Property::TYPE_INT32)
+    return WError::ERR_WRONG_SIZE;
+  return getProperty(id, index, &value);
+}
+
+/*!
+ * Obtains the value of a property of type WVariable::TYPE_DOUBLE.
+ *
+ * \return WError::ERR_WRONG_SIZE if the property \p id is not of type WVariable::TYPE_DOUBLE, otherwise the
+ *         return code of the getter.
+ */
+int WSESWrapperMain::getProperty(PropertyId id, int index, double &value)
+{
+  if (id >= 0 && id < PROPERTY_COUNT && propertyTable_[id].valueType != Property::TYPE_DOUBLE)
+    return WError::ERR_WRONG_SIZE;
+  return getProperty(id, index, &value);
+}
+
+/*!
+ * Modifies the value of a property from its ID, calling the setter of the property directly without looking
+ * up its name.
+ *
+ * \return WError::ERR_PARAMETER_NOT_FOUND if \p id is not a valid property ID, otherwise the return code of
+ *         the setter.
+ *
+ * \see setProperty(const char *property, int size, const void *value)
+ */
+int WSESWrapperMain::setProperty(PropertyId id, int index, const void *value)
+{
+  if (id < 0 || id >= PROPERTY_COUNT)
+    return WError::ERR_PARAMETER_NOT_FOUND;
+  return (this->*propertyTable_[id].set)(index, value);
+}
+
 /*!
  * Validates the element set, lens mode, pass energy and kinetic energy (the kinetic energy is currently not checked and will thus always
  * result in success). This member function will return WError::ERR_OK if the supplied combination of \p elementSet, \p lensMode, \p passEnergy
@@ -342,17 +511,14 @@ int WSESWrapperMain::validate(const char *elementSet, const char *lensMode, doub
   if (!instrumentLoaded_)
     return WError::ERR_NO_INSTRUMENT;
 
-  int i = 0; 
-
-  if (std::find(elementSets_.begin(), elementSets_.end(), elementSet) == elementSets_.end())
+  if (capabilities_.findElementSet(elementSet) < 0)
     return WError::ERR_INCORRECT_ELEMENT_SET;
 
-  if (std::find(lensModes_.begin(), lensModes_.end(), lensMode) == lensModes_.end())
+  int lensModeIndex = capabilities_.findLensMode(lensMode);
+  if (lensModeIndex < 0)
     return WError::ERR_INCORRECT_LENS_MODE;
 
-  DoubleVector passEnergies;
-  loadPassEnergies(lensMode, passEnergies);
-  if (std::find(passEnergies.begin(), passEnergies.end(), passEnergy) == passEnergies.end())
+  if (!capabilities_.hasPassEnergy(lensModeIndex, passEnergy))
     return WError::ERR_INCORRECT_PASS_ENERGY;
 
   return WError::ERR_OK;
@@ -410,8 +576,8 @@ int WSESWrapperMain::loadInstrument(const char* fileName)
 		memset(fromFileResult, 0, bufferLength);
 		DWORD length = GetPrivateProfileString("Global", "Instrument Prefs", "None", fromFileResult, bufferLength, path.c_str());
 		path = workingDir_;
-		if (path.back() != '\\')
-			path.append("\\");
+		if (path.back() != PATH_SEPARATOR[0])
+			path.append(PATH_SEPARATOR);
 		path.append(fromFileResult);
 		delete[] fromFileResult;
 		return loadInstrument(path.c_str());
@@ -435,10 +601,7 @@ int WSESWrapperMain::loadInstrument(const char* fileName)
 		sesInstrumentInfo_.SerialNo[length] = 0;
 		instrumentLoaded_ = true;
 
-		loadElementSets();
-		loadLensModes();
-		if (lensModes_.size() > 0)
-			loadPassEnergies(lensModes_[0], passEnergies_);
+		loadCapabilities();
 		loadElementNames();
 		if (elementNames_.size() == 0)
 			errorCode = WError::ERR_FAIL;
@@ -708,8 +871,8 @@ int WSESWrapperMain::initAcquisition(const bool blockPointReady, const bool bloc
   int result = 0;
 
   if (tempFileName_.empty())
-    tempFileName_ = "work\\seswrapper";
-  DeleteFile(tempFileName_.c_str());
+    tempFileName_ = "work" PATH_SEPARATOR "seswrapper";
+  remove(tempFileName_.c_str());
 
   if (lib_->GDS_InitAcquisition != 0)
   {
@@ -744,6 +907,7 @@ int WSESWrapperMain::startAcquisition()
   if (!instrumentLoaded_)
     return WError::ERR_NO_INSTRUMENT;
 
+  WLockGuard guard(libraryLock_);
   int sesStatus = SesNS::NonOperational;
   lib_->GDS_GetStatus(&sesStatus);
   if (sesStatus == SesNS::Running)
@@ -792,6 +956,7 @@ int WSESWrapperMain::stopAcquisition()
   pointReadyEvent_.reset();
   regionReadyEvent_.reset();
 
+  WLockGuard guard(libraryLock_);
   return lib_->GDS_Stop() == 0 ? WError::ERR_OK : WError::ERR_FAIL;
 }
 
@@ -815,9 +980,60 @@ int WSESWrapperMain::getAcquiredData(const char *variable, int index, void *data
   if (it == dataParameters_.end())
     return WError::ERR_PARAMETER_NOT_FOUND;
 
+  WLockGuard guard(libraryLock_);
   return it->second.get(index, data, size);
 }
 
+/*!
+ * Obtains acquired data from the ID of the variable. This is equivalent to the string version of
+ * getAcquiredData(), but calls the getter directly without looking up its name, which makes it suitable for
+ * the data that is read at every point.
+ *
+ * \return WError::ERR_PARAMETER_NOT_FOUND if \p id was not a valid variable ID, otherwise the return code
+ *         depends on the type of variable.
+ *
+ * \see getAcquiredData(const char *variable, int index, void *data, int &size)
+ */
+int WSESWrapperMain::getAcquiredData(DataParameterId id, int index, void *data, int &size)
+{
+  if (id < 0 || id >= DATA_PARAMETER_COUNT)
+    return WError::ERR_PARAMETER_NOT_FOUND;
+  WLockGuard guard(libraryLock_);
+  return (this->*dataParameterTable_[id].get)(index, data, size);
+}
+
+/*!
+ * Obtains a variable of type WVariable::TYPE_INT32, e.g. \c acq_channels or \c acq_current_step.
+ *
+ * \return WError::ERR_WRONG_SIZE if the variable \p id is not of type WVariable::TYPE_INT32, otherwise the
+ *         return code of the getter.
+ */
+int WSESWrapperMain::getAcquiredData(DataParameterId id, int &value)
+{
+  if (id >= 0 && id < DATA_PARAMETER_COUNT && dataParameterTable_[id].valueType != DataParameter::TYPE_INT32)
+    return WError::ERR_WRONG_SIZE;
+  int size = 0;
+  return getAcquiredData(id, 0, &value, size);
+}
+
+/*!
+ * Obtains a variable of type WVariable::TYPE_VECTOR_DOUBLE, e.g. \c acq_image or \c acq_slice.
+ *
+ * \param[in] id The ID of the variable.
+ * \param[in] index Used to query a specific element, e.g. the slice of \c acq_slice.
+ * \param[out] data An array to be filled with the variable. Can be 0 (NULL) to obtain the required size.
+ * \param[in,out] size The number of elements of \p data. After completion, the length of the variable.
+ *
+ * \return WError::ERR_WRONG_SIZE if the variable \p id is not of type WVariable::TYPE_VECTOR_DOUBLE, otherwise
+ *         the return code of the getter.
+ */
+int WSESWrapperMain::getAcquiredData(DataParameterId id, int index, double *data, int &size)
+{
+  if (id >= 0 && id < DATA_PARAMETER_COUNT && dataParameterTable_[id].valueType != DataParameter::TYPE_VECTOR_DOUBLE)
+    return WError::ERR_WRONG_SIZE;
+  return getAcquiredData(id, index, static_cast<void *>(data), size);
+}
+
 /*!
  * Blocks execution of the callers thread until the current point has been completed during a swept mode acquisition.
  * If \p timeout_ms is set to -1, there is no time-out. Do not use -1 when running fixed mode acquisitions, as there
@@ -841,14 +1057,15 @@ int WSESWrapperMain::waitForPointReady(int timeout_ms)
     return WError::ERR_NO_INSTRUMENT;
 
   int sesStatus = SesNS::NonOperational;
+  libraryLock_.lock();
   lib_->GDS_GetStatus(&sesStatus);
+  libraryLock_.unlock();
 
   if (sesStatus != SesNS::Running)
     return WError::ERR_OK;
 
-  const HANDLE handles[] = {pointReadyEvent_.handle(), abortAcquisitionEvent_.handle()};
-  DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout_ms);
-  return result == WAIT_TIMEOUT ? WError::ERR_TIMEOUT : WError::ERR_OK;
+  int result = WEvent::waitAny(pointReadyEvent_, abortAcquisitionEvent_, timeout_ms);
+  return result == WEvent::ERR_TIMEOUT ? WError::ERR_TIMEOUT : WError::ERR_OK;
 }
 
 /*!
@@ -873,14 +1090,15 @@ int WSESWrapperMain::waitForRegionReady(int timeout_ms)
     return WError::ERR_NO_INSTRUMENT;
 
   int sesStatus = SesNS::NonOperational;
+  libraryLock_.lock();
   lib_->GDS_GetStatus(&sesStatus);
+  libraryLock_.unlock();
 
   if (sesStatus != SesNS::Running)
     return WError::ERR_OK;
 
-  const HANDLE handles[] = {regionReadyEvent_.handle(), abortAcquisitionEvent_.handle()};
-  DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout_ms);
-  return result == WAIT_TIMEOUT ? WError::ERR_TIMEOUT : WError::ERR_OK;
+  int result = WEvent::waitAny(regionReadyEvent_, abortAcquisitionEvent_, timeout_ms);
+  return result == WEvent::ERR_TIMEOUT ? WError::ERR_TIMEOUT : WError::ERR_OK;
 }
 
 /*!
@@ -1131,7 +1349,8 @@ int WSESWrapperMain::getAcqSliceUnit(int index, void *data, int &size)
  * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
- * \return WError::ERR_FAIL if no acquisition has been performed, otherwise WError::ERR_OK.
+ * \return WError::ERR_FAIL if no acquisition has been performed, WError::ERR_WRONG_SIZE if \p size is smaller than
+ *         the spectrum, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqSpectrum(int index, void *data, int &size)
 {
@@ -1139,7 +1358,14 @@ int WSESWrapperMain::getAcqSpectrum(int index, void *data, int &size)
     return WError::ERR_FAIL;
 
   if (data != 0)
+  {
+    if (size < sesSpectrum_->Channels)
+    {
+      size = sesSpectrum_->Channels;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSpectrum_->SumData, sesSpectrum_->Channels * sizeof(double));
+  }
   size = sesSpectrum_->Channels;
 	return WError::ERR_OK;
 }
@@ -1151,6 +1377,9 @@ int WSESWrapperMain::getAcqSpectrum(int index, void *data, int &size)
  * \param[out] data An array of doubles that will be filled with the acquired image. Can be 0 (NULL).
  * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
+ *
+ * \return WError::ERR_FAIL if no acquisition has been performed, WError::ERR_WRONG_SIZE if \p size is smaller than
+ *         the image, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqImage(int index, void *data, int &size)
 {
@@ -1159,6 +1388,11 @@ int WSESWrapperMain::getAcqImage(int index, void *data, int &size)
 
   if (data != 0)
   {
+    if (size < sesSpectrum_->Channels * sesSpectrum_->Slices)
+    {
+      size = sesSpectrum_->Channels * sesSpectrum_->Slices;
+      return WError::ERR_WRONG_SIZE;
+    }
     double *doubleData = reinterpret_cast<double *>(data);
     int sliceSize = sesSpectrum_->Channels * sizeof(double);
       for (int slice = 0; slice < sesSpectrum_->Slices; slice++, doubleData += sesSpectrum_->Channels)
@@ -1177,7 +1411,7 @@ int WSESWrapperMain::getAcqImage(int index, void *data, int &size)
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
  * \return WError::ERR_FAIL if no acquisition has been performed, WError::ERR_INDEX if \p index is out-of-bounds,
- *         otherwise WError::ERR_OK.
+ *         WError::ERR_WRONG_SIZE if \p size is smaller than the slice, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqSlice(int index, void *data, int &size)
 {
@@ -1188,7 +1422,14 @@ int WSESWrapperMain::getAcqSlice(int index, void *data, int &size)
     return WError::ERR_INDEX;
 
   if (data != 0)
+  {
+    if (size < sesSpectrum_->Channels)
+    {
+      size = sesSpectrum_->Channels;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSpectrum_->Data[index], sesSpectrum_->Channels * sizeof(double));
+  }
 
   size = sesSpectrum_->Channels;
   return WError::ERR_OK;
@@ -1203,7 +1444,8 @@ int WSESWrapperMain::getAcqSlice(int index, void *data, int &size)
  * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
- * \return WError::ERR_FAIL if no acquisition has been performed, otherwise WError::ERR_OK.
+ * \return WError::ERR_FAIL if no acquisition has been performed, WError::ERR_WRONG_SIZE if \p size is smaller than
+ *         the scale, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqChannelScale(int index, void *data, int &size)
 {
@@ -1211,7 +1453,14 @@ int WSESWrapperMain::getAcqChannelScale(int index, void *data, int &size)
     return WError::ERR_FAIL;
 
   if (data != 0)
+  {
+    if (size < sesSpectrum_->Channels)
+    {
+      size = sesSpectrum_->Channels;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSpectrum_->ChannelScale, sesSpectrum_->Channels * sizeof(double));
+  }
   size = sesSpectrum_->Channels;
   return WError::ERR_OK;
 }
@@ -1225,7 +1474,8 @@ int WSESWrapperMain::getAcqChannelScale(int index, void *data, int &size)
  * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
- * \return WError::ERR_FAIL if no acquisition has been performed, otherwise WError::ERR_OK.
+ * \return WError::ERR_FAIL if no acquisition has been performed, WError::ERR_WRONG_SIZE if \p size is smaller than
+ *         the scale, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqSliceScale(int index, void *data, int &size)
 {
@@ -1233,7 +1483,14 @@ int WSESWrapperMain::getAcqSliceScale(int index, void *data, int &size)
     return WError::ERR_FAIL;
 
   if (data != 0)
+  {
+    if (size < sesSpectrum_->Slices)
+    {
+      size = sesSpectrum_->Slices;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSpectrum_->SliceScale, sesSpectrum_->Slices * sizeof(double));
+  }
   size = sesSpectrum_->Slices;
   return WError::ERR_OK;
 }
@@ -1247,37 +1504,65 @@ int WSESWrapperMain::getAcqSliceScale(int index, void *data, int &size)
  * which is 1 for 8-bit images, or 2 for 16-bit images. To get the byteSize, call this function with \p data set to
  * 0 (NULL) and then divide the \p size parameter obtained with xChannels * yChannels.
  *
+ * The frame size is cached and only computed again when the detector info changes, so a call with \p data set to 0
+ * does not call the library. Only the reads report the byte size, so until the first frame has been read the size
+ * assumes 2 bytes per pixel, which is large enough for either depth. A read that reports another geometry updates
+ * the cache and returns the new \p size, and a failed read refreshes the detector info.
+ *
  * \param[in] index Not used.
  * \param[out] data An array of bytes (unsigned char*) that will be filled with a snapshot of the detector image.
  *             Can be 0 (NULL).
- * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
- *             buffer. After completion, \p size is always modified to contain the length of the resulting array
+ * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the size of the buffer in bytes.
+ *             After completion, \p size is always modified to contain the length of the resulting array
  *             (xChannels * yChannels * byteSize).
  *
  * \return WError::ERR_NOT_INITIALIZED if the wrapped library is not properly initialized, WError::ERR_FAIL if the
- *         raw image could not be obtained (possibly because the detector does not support 2D-frames), otherwise
- *         WError::ERR_OK on success.
+ *         raw image could not be obtained (possibly because the detector does not support 2D-frames),
+ *         WError::ERR_INCORRECT_DETECTOR_REGION if \p size is smaller than the frame, otherwise WError::ERR_OK on
+ *         success.
  *
  * \see WSESWrapperBase::getDetectorInfo()
  */
 int WSESWrapperMain::getAcqRawImage(int index, void *data, int &size)
 {
   unsigned char *uCharData = reinterpret_cast<unsigned char *>(data);
-  int errorCode = lib_->GDS_GetRawImage != 0 ? WError::ERR_OK : WError::ERR_NOT_INITIALIZED;
-  int width = sesDetectorInfo_.XChannels;
-  int height = sesDetectorInfo_.YChannels;
-  int byteSize = 1;
 
-  if (size < width * height * byteSize)
-	  errorCode = WError::ERR_INCORRECT_DETECTOR_REGION;
-  
-  if (errorCode == WError::ERR_OK)
+  if (lib_->GDS_GetRawImage == 0)
+    return WError::ERR_NOT_INITIALIZED;
+
+  if (rawImageWidth_ != sesDetectorInfo_.XChannels || rawImageHeight_ != sesDetectorInfo_.YChannels)
   {
-    if (data != 0)
-      errorCode = lib_->GDS_GetRawImage(uCharData, &width, &height, &byteSize) == 0 ? WError::ERR_OK : WError::ERR_FAIL;
-    size = width * height * byteSize;
+    rawImageWidth_ = sesDetectorInfo_.XChannels;
+    rawImageHeight_ = sesDetectorInfo_.YChannels;
+    rawImageByteSize_ = 2;
   }
-	return errorCode;
+
+  int bytes = rawImageWidth_ * rawImageHeight_ * rawImageByteSize_;
+  if (data == 0 || size < bytes)
+  {
+    size = bytes;
+    return data == 0 ? WError::ERR_OK : WError::ERR_INCORRECT_DETECTOR_REGION;
+  }
+
+  int width = rawImageWidth_;
+  int height = rawImageHeight_;
+  int byteSize = rawImageByteSize_;
+  if (lib_->GDS_GetRawImage(uCharData, &width, &height, &byteSize) != 0)
+  {
+    // The detector may have changed, take its geometry again before the next frame
+    lib_->GDS_GetDetectorInfo(&sesDetectorInfo_);
+    size = bytes;
+    return WError::ERR_FAIL;
+  }
+  if (width != rawImageWidth_ || height != rawImageHeight_)
+  {
+    lib_->GDS_GetDetectorInfo(&sesDetectorInfo_);
+    size = bytes;
+    return WError::ERR_INCORRECT_DETECTOR_REGION;
+  }
+  rawImageByteSize_ = byteSize;
+  size = width * height * byteSize;
+  return WError::ERR_OK;
 }
 
 /*!
@@ -1307,7 +1592,7 @@ int WSESWrapperMain::getAcqCurrentStep(int index, void *data, int &size)
  * since the last call of startAcquisition().
  *
  * \param[in] index Not used.
- * \param[out] data A pointer to a 32-bit unsigned integer that will be modified to the number of millisecondes elapsed
+ * \param[out] data A pointer to a double that will be modified to the number of milliseconds elapsed
  *             since the last call of startAcquisition().
  * \param[in,out] size Not used.
  *
@@ -1317,8 +1602,9 @@ int WSESWrapperMain::getAcqElapsedTime(int index, void *data, int &size)
 {
   if (data != 0)
   {
-    unsigned int *intData = reinterpret_cast<unsigned int *>(data);
-    *intData = clock() - startTime_;
+    // The variable is declared as TYPE_DOUBLE, as are the other times of the wrapper
+    double *doubleData = reinterpret_cast<double *>(data);
+    *doubleData = (clock() - startTime_) * 1000.0 / CLOCKS_PER_SEC;
   }
 	return WError::ERR_OK;
 }
@@ -1426,8 +1712,8 @@ int WSESWrapperMain::getAcqIOUnit(int index, void *data, int &size)
  * \param[in,out] size If \p data is non-null, this parameter is assumed to contain the maximum number of elements in the
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
- * \return WError::ERR_FAIL if External I/O is not available or if no acquisition has been initialized, otherwise
- *         WError::ERR_OK.
+ * \return WError::ERR_FAIL if External I/O is not available or if no acquisition has been initialized,
+ *         WError::ERR_WRONG_SIZE if \p size is smaller than the scale, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqIOScale(int index, void *data, int &size)
 {
@@ -1435,7 +1721,14 @@ int WSESWrapperMain::getAcqIOScale(int index, void *data, int &size)
     return WError::ERR_FAIL;
   
   if (data != 0)
+  {
+    if (size < sesSignals_->Steps)
+    {
+      size = sesSignals_->Steps;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSignals_->StepsScale, sesSignals_->Steps * sizeof(double));
+  }
   size = sesSignals_->Steps;
 	return WError::ERR_OK;
 }
@@ -1450,8 +1743,8 @@ int WSESWrapperMain::getAcqIOScale(int index, void *data, int &size)
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array.
  *
  * \return WError::ERR_FAIL if External I/O is not available or if no acquisition has been initialized,
-           WError::ERR_INDEX if \p index is out-of-bounds, otherwise
- *         WError::ERR_OK.
+           WError::ERR_INDEX if \p index is out-of-bounds, WError::ERR_WRONG_SIZE if \p size is smaller
+ *         than the spectrum, otherwise WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqIOSpectrum(int index, void *data, int &size)
 {
@@ -1462,7 +1755,14 @@ int WSESWrapperMain::getAcqIOSpectrum(int index, void *data, int &size)
     return WError::ERR_INDEX;
 
   if (data != 0)
+  {
+    if (size < sesSignals_->Steps)
+    {
+      size = sesSignals_->Steps;
+      return WError::ERR_WRONG_SIZE;
+    }
     memcpy(data, sesSignals_->Data[index], sesSignals_->Steps * sizeof(double));
+  }
   size = sesSignals_->Steps;
 	return WError::ERR_OK;
 }
@@ -1476,7 +1776,8 @@ int WSESWrapperMain::getAcqIOSpectrum(int index, void *data, int &size)
  *             buffer. After completion, \p size is always modified to contain the length of the resulting array
  *             (\c acq_io_ports * \c acq_io_size).
  *
- * \return WError::ERR_FAIL if External I/O is not available or if no acquisition has been initialized, otherwise
+ * \return WError::ERR_FAIL if External I/O is not available or if no acquisition has been initialized,
+ *         WError::ERR_WRONG_SIZE if \p size is smaller than the data, otherwise
  *         WError::ERR_OK.
  */
 int WSESWrapperMain::getAcqIOData(int index, void *data, int &size)
@@ -1484,14 +1785,23 @@ int WSESWrapperMain::getAcqIOData(int index, void *data, int &size)
   if (!readSignalsObject())
     return WError::ERR_FAIL;
 
+  int steps = sesSignals_->Steps;
+  int total = sesSignals_->Count * steps;
+
   if (data != 0)
   {
+    if (size < total)
+    {
+      size = total;
+      return WError::ERR_WRONG_SIZE;
+    }
+
+    // Each port is a separate row of Steps doubles, copy them one after the other
     double *doubleData = reinterpret_cast<double *>(data);
-    int channelSize = sesSignals_->Steps * sizeof(double);
-      for (int channel = 0; channel < sesSignals_->Count; channel++, doubleData += channelSize)
-        memcpy(doubleData, sesSignals_->Data[channel], channelSize);
+    for (int channel = 0; channel < sesSignals_->Count; channel++, doubleData += steps)
+      memcpy(doubleData, sesSignals_->Data[channel], steps * sizeof(double));
   }
-  size = sesSignals_->Count * sesSignals_->Steps;
+  size = total;
   return WError::ERR_OK;
 }
 
@@ -1587,6 +1897,7 @@ int WSESWrapperMain::getAcqPointIntensity(int index, void *data, int &size)
  *
  * \return WError::ERR_OK on success,
  *         WError::ERR_NOT_INITIALIZED if no acquisition has been performed,
+ *         WError::ERR_WRONG_SIZE if \p size is smaller than \c acq_slices.
  */
 int WSESWrapperMain::getAcqChannelIntensity(int index, void *data, int &size)
 {
@@ -1595,6 +1906,11 @@ int WSESWrapperMain::getAcqChannelIntensity(int index, void *data, int &size)
 
   if (data != 0)
   {
+    if (size < sesSpectrum_->Slices)
+    {
+      size = sesSpectrum_->Slices;
+      return WError::ERR_WRONG_SIZE;
+    }
     double *doubleVector = reinterpret_cast<double *>(data);
     double *p = doubleVector;
 
@@ -1667,8 +1983,7 @@ void WSESWrapperMain::pointReadyHandler(int point)
 
   if (blockPointReady_)
   {
-    HANDLE handles[] = {continueAcquisitionEvent_.handle(), abortAcquisitionEvent_.handle()};
-    WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    WEvent::waitAny(continueAcquisitionEvent_, abortAcquisitionEvent_);
     continueAcquisitionEvent_.reset();
   }
 }
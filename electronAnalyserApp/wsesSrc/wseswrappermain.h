@@ -4,8 +4,12 @@
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 #include "wseswrapperbase.h"
 #include "wevent.h"
+#include "werror.h"
+#include "wlock.h"
 #endif /* DOXYGEN_SHOULD_SKIP_THIS */
 
+template<int Id> struct WDataParameterTraits;
+
 class WSESWrapperMain : public WSESWrapperBase
 {
   WSESWrapperMain();
@@ -16,16 +20,68 @@ public:
   typedef std::pair<std::string, DataParameter> DataParameterKeyValue;
   typedef std::map<std::string, DataParameter> DataParameterMap;
 
+  /*!
+   * Identifies the data parameters without a name lookup. Each value indexes dataParameterTable_, so the ID
+   * based overloads of getAcquiredData() call the getters directly.
+   */
+  enum DataParameterId
+  {
+    ACQ_CHANNELS,
+    ACQ_SLICES,
+    ACQ_ITERATIONS,
+    ACQ_INTENSITY_UNIT,
+    ACQ_CHANNEL_UNIT,
+    ACQ_SLICE_UNIT,
+    ACQ_SPECTRUM,
+    ACQ_IMAGE,
+    ACQ_SLICE,
+    ACQ_CHANNEL_SCALE,
+    ACQ_SLICE_SCALE,
+    ACQ_RAW_IMAGE,
+    ACQ_CURRENT_STEP,
+    ACQ_ELAPSED_TIME,
+    ACQ_IO_PORTS,
+    ACQ_IO_SIZE,
+    ACQ_IO_ITERATIONS,
+    ACQ_IO_UNIT,
+    ACQ_IO_SCALE,
+    ACQ_IO_SPECTRUM,
+    ACQ_IO_DATA,
+    ACQ_IO_PORT_NAME,
+    ACQ_CURRENT_POINT,
+    ACQ_POINT_INTENSITY,
+    ACQ_CHANNEL_INTENSITY,
+    DATA_PARAMETER_COUNT /*!< The number of data parameters */
+  };
+
+  /*!
+   * Describes one data parameter: the name used by the string API, its getter and its value type.
+   */
+  struct DataParameterInfo
+  {
+    const char *name;
+    DataParameter::GetCallback get;
+    DataParameter::ValueType valueType;
+  };
+
   static WSESWrapperMain *instance();
   void release();
   int references() const;
 
   bool isInitialized();
+  int loadLibrary();
   int initialize(void *);
   int finalize();
   int getProperty(const char *name, int index, void *value, int &size);
   int getProperty(const char *name, int index, void *value);
   int setProperty(const char *name, int index, const void *value);
+  int getProperty(PropertyId id, int index, void *value, int &size);
+  int getProperty(PropertyId id, int index, void *value);
+  int getProperty(PropertyId id, int index, bool &value);
+  int getProperty(PropertyId id, int index, int &value);
+  int getProperty(PropertyId id, int index, double &value);
+  int setProperty(PropertyId id, int index, const void *value);
+  template<int Id> int getProperty(int index, typename WPropertyTraits<Id>::Value &value);
   int validate(const char *elementSet, const char *lensMode, double passEnergy, double kineticEnergy);
   int resetHW();
   int testHW();
@@ -45,6 +101,10 @@ public:
   int startAcquisition();
   int stopAcquisition();
   int getAcquiredData(const char *name, int index, void *data, int &size);
+  int getAcquiredData(DataParameterId id, int index, void *data, int &size);
+  int getAcquiredData(DataParameterId id, int &value);
+  int getAcquiredData(DataParameterId id, int index, double *data, int &size);
+  template<int Id> int getAcquiredData(int index, typename WDataParameterTraits<Id>::Value &value);
   int waitForPointReady(int timeout_ms);
   int waitForRegionReady(int timeout_ms);
   int continueAcquisition();
@@ -99,13 +159,87 @@ private:
   SesNS::WSpectrum *sesSpectrum_;
   SesNS::WSignals *sesSignals_;
   std::string currentInstrumentFile_;
+  int rawImageWidth_; /*!< The detector geometry the raw frame size was cached for */
+  int rawImageHeight_;
+  int rawImageByteSize_; /*!< The bytes per pixel, learned from the last frame read */
 
+  static const DataParameterInfo dataParameterTable_[DATA_PARAMETER_COUNT];
   DataParameterMap dataParameters_;
 
   WEvent pointReadyEvent_; 
   WEvent regionReadyEvent_; 
   WEvent continueAcquisitionEvent_; 
   WEvent abortAcquisitionEvent_;
+  WLock libraryLock_; /*!< Serialises the acquisition calls into the library, which is not re-entrant */
 };
 
+/*!
+ * Declares the value type of each data parameter for the typed WSESWrapperMain::getAcquiredData<Id>(). Vectors are
+ * WSpan views of arrays owned by the caller.
+ */
+#define DATA_PARAMETER_VALUE(id, type) template<> struct WDataParameterTraits<WSESWrapperMain::id> { typedef type Value; }
+
+DATA_PARAMETER_VALUE(ACQ_CHANNELS, int);
+DATA_PARAMETER_VALUE(ACQ_SLICES, int);
+DATA_PARAMETER_VALUE(ACQ_ITERATIONS, int);
+DATA_PARAMETER_VALUE(ACQ_INTENSITY_UNIT, WSESWrapperBase::Name);
+DATA_PARAMETER_VALUE(ACQ_CHANNEL_UNIT, WSESWrapperBase::Name);
+DATA_PARAMETER_VALUE(ACQ_SLICE_UNIT, WSESWrapperBase::Name);
+DATA_PARAMETER_VALUE(ACQ_SPECTRUM, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_IMAGE, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_SLICE, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_CHANNEL_SCALE, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_SLICE_SCALE, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_RAW_IMAGE, WSpan<unsigned char>);
+DATA_PARAMETER_VALUE(ACQ_CURRENT_STEP, int);
+DATA_PARAMETER_VALUE(ACQ_ELAPSED_TIME, double);
+DATA_PARAMETER_VALUE(ACQ_IO_PORTS, int);
+DATA_PARAMETER_VALUE(ACQ_IO_SIZE, int);
+DATA_PARAMETER_VALUE(ACQ_IO_ITERATIONS, int);
+DATA_PARAMETER_VALUE(ACQ_IO_UNIT, WSESWrapperBase::Name);
+DATA_PARAMETER_VALUE(ACQ_IO_SCALE, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_IO_SPECTRUM, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_IO_DATA, WSpan<double>);
+DATA_PARAMETER_VALUE(ACQ_IO_PORT_NAME, WSESWrapperBase::Name);
+DATA_PARAMETER_VALUE(ACQ_CURRENT_POINT, int);
+DATA_PARAMETER_VALUE(ACQ_POINT_INTENSITY, double);
+DATA_PARAMETER_VALUE(ACQ_CHANNEL_INTENSITY, WSpan<double>);
+
+#undef DATA_PARAMETER_VALUE
+
+/*!
+ * Obtains the value of property \p Id in a single call. The type of \p value is declared by WPropertyTraits, so
+ * numbers and structures are checked at compile time, and strings are read into a WFixedString of the longest value
+ * the property can have.
+ *
+ * \return WError::ERR_WRONG_SIZE if the value did not fit in \p value, otherwise the return code of the getter.
+ */
+template<int Id>
+int WSESWrapperMain::getProperty(int index, typename WPropertyTraits<Id>::Value &value)
+{
+  typedef WTypedValue<typename WPropertyTraits<Id>::Value> Access;
+  int size = Access::capacity(value);
+  int error = getProperty(PropertyId(Id), index, Access::data(value), size);
+  if (error == WError::ERR_OK && !Access::finish(value, size))
+    error = WError::ERR_WRONG_SIZE;
+  return error;
+}
+
+/*!
+ * Obtains data parameter \p Id in a single call. Vectors are copied into the WSpan \p value if they fit, otherwise
+ * WError::ERR_WRONG_SIZE is returned and the size of the span is the number of elements required.
+ *
+ * \return WError::ERR_WRONG_SIZE if the value did not fit in \p value, otherwise the return code of the getter.
+ */
+template<int Id>
+int WSESWrapperMain::getAcquiredData(int index, typename WDataParameterTraits<Id>::Value &value)
+{
+  typedef WTypedValue<typename WDataParameterTraits<Id>::Value> Access;
+  int size = Access::capacity(value);
+  int error = getAcquiredData(DataParameterId(Id), index, Access::data(value), size);
+  if ((error == WError::ERR_OK || error == WError::ERR_WRONG_SIZE) && !Access::finish(value, size))
+    error = WError::ERR_WRONG_SIZE;
+  return error;
+}
+
 #endif
@@ -0,0 +1,201 @@
+#pragma warning(disable:4996)
+
+#include "wsnapshot.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+
+namespace
+{
+  const char MAGIC[8] = "SESSNAP";
+
+  /*!
+   * The header of a snapshot file. The structure sizes reject files written by a build with a different layout.
+   */
+  struct Header
+  {
+    char magic[8];
+    int version;
+    int detectorInfoSize;
+    int detectorRegionSize;
+    int analyzerRegionSize;
+  };
+
+  template<typename T> bool writeValue(std::ostream &stream, const T &value)
+  {
+    return stream.write(reinterpret_cast<const char *>(&value), sizeof(T)).good();
+  }
+
+  template<typename T> bool readValue(std::istream &stream, T &value)
+  {
+    return stream.read(reinterpret_cast<char *>(&value), sizeof(T)).good();
+  }
+
+  Header currentHeader()
+  {
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = WSnapshot::VERSION;
+    header.detectorInfoSize = sizeof(SESWrapperNS::WDetectorInfo);
+    header.detectorRegionSize = sizeof(SESWrapperNS::WDetectorRegion);
+    header.analyzerRegionSize = sizeof(SESWrapperNS::WAnalyzerRegion);
+    return header;
+  }
+
+  /* The structures are compared member by member, their padding bytes are not part of the settings */
+  bool sameDetectorInfo(const SESWrapperNS::WDetectorInfo &a, const SESWrapperNS::WDetectorInfo &b)
+  {
+    return a.timerControlled_ == b.timerControlled_ && a.xChannels_ == b.xChannels_ &&
+      a.yChannels_ == b.yChannels_ && a.maxSlices_ == b.maxSlices_ && a.maxChannels_ == b.maxChannels_ &&
+      a.frameRate_ == b.frameRate_ && a.adcPresent_ == b.adcPresent_ && a.discPresent_ == b.discPresent_;
+  }
+
+  bool sameDetectorRegion(const SESWrapperNS::WDetectorRegion &a, const SESWrapperNS::WDetectorRegion &b)
+  {
+    return a.firstXChannel_ == b.firstXChannel_ && a.lastXChannel_ == b.lastXChannel_ &&
+      a.firstYChannel_ == b.firstYChannel_ && a.lastYChannel_ == b.lastYChannel_ && a.slices_ == b.slices_ &&
+      a.adcMode_ == b.adcMode_;
+  }
+
+  bool sameAnalyzerRegion(const SESWrapperNS::WAnalyzerRegion &a, const SESWrapperNS::WAnalyzerRegion &b)
+  {
+    return a.fixed_ == b.fixed_ && a.highEnergy_ == b.highEnergy_ && a.lowEnergy_ == b.lowEnergy_ &&
+      a.centerEnergy_ == b.centerEnergy_ && a.energyStep_ == b.energyStep_ && a.dwellTime_ == b.dwellTime_;
+  }
+}
+
+/*!
+ * \class WSnapshot
+ *
+ * The file is written in the native byte order: a header with the format version, the instrument file path and
+ * modification time, the capabilities as written by WCapabilities::write(), then the detector information, the
+ * detector and analyzer regions and the lens mode index.
+ */
+
+/*!
+ * Constructs an empty snapshot.
+ */
+WSnapshot::WSnapshot()
+{
+  clear();
+}
+
+/*!
+ * Empties the snapshot.
+ */
+void WSnapshot::clear()
+{
+  instrumentFile_.clear();
+  instrumentTime_ = 0;
+  capabilities_.clear();
+  memset(&detectorInfo_, 0, sizeof(detectorInfo_));
+  memset(&detectorRegion_, 0, sizeof(detectorRegion_));
+  memset(&analyzerRegion_, 0, sizeof(analyzerRegion_));
+  lensMode_ = 0;
+}
+
+/*!
+ * Loads a snapshot taken from \p instrumentFile in its current version.
+ *
+ * \param[in] fileName The snapshot file.
+ * \param[in] instrumentFile The instrument configuration file that the snapshot must belong to.
+ *
+ * \return \c true if successful. If the snapshot file is missing, of another format version, or was taken from
+ *         another instrument file or an earlier version of it, the snapshot is left empty and \c false is returned.
+ */
+bool WSnapshot::load(const char *fileName, const char *instrumentFile)
+{
+  clear();
+
+  long long time = 0;
+  if (fileName == 0 || instrumentFile == 0 || !instrumentTime(instrumentFile, time))
+    return false;
+
+  std::ifstream stream(fileName, std::ios::in | std::ios::binary);
+  Header header;
+  Header expected = currentHeader();
+  if (!readValue(stream, header) || memcmp(&header, &expected, sizeof(header)) != 0)
+    return false;
+
+  int length = 0;
+  bool success = readValue(stream, length) && length > 0 && length < 4096;
+  if (success)
+  {
+    instrumentFile_.resize(length);
+    success = stream.read(&instrumentFile_[0], length).good() && readValue(stream, instrumentTime_);
+  }
+  success = success && instrumentFile_ == instrumentFile && instrumentTime_ == time;
+  success = success && capabilities_.read(stream) && readValue(stream, detectorInfo_) &&
+    readValue(stream, detectorRegion_) && readValue(stream, analyzerRegion_) && readValue(stream, lensMode_);
+
+  if (!success)
+    clear();
+  return success;
+}
+
+/*!
+ * Saves the snapshot. It is written to a temporary file that then replaces \p fileName, so that an interrupted
+ * save never leaves a truncated snapshot behind.
+ *
+ * \param[in] fileName The snapshot file.
+ *
+ * \return \c true if successful.
+ */
+bool WSnapshot::save(const char *fileName) const
+{
+  if (fileName == 0 || instrumentFile_.empty())
+    return false;
+
+  std::string tempName = std::string(fileName) + ".tmp";
+  {
+    std::ofstream stream(tempName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    int length = int(instrumentFile_.length());
+    bool success = writeValue(stream, currentHeader()) && writeValue(stream, length) &&
+      stream.write(instrumentFile_.c_str(), length).good() && writeValue(stream, instrumentTime_) &&
+      capabilities_.write(stream) && writeValue(stream, detectorInfo_) && writeValue(stream, detectorRegion_) &&
+      writeValue(stream, analyzerRegion_) && writeValue(stream, lensMode_);
+    stream.close();
+    if (!success || stream.fail())
+    {
+      remove(tempName.c_str());
+      return false;
+    }
+  }
+
+  // rename() does not replace an existing file on Windows
+  remove(fileName);
+  return rename(tempName.c_str(), fileName) == 0;
+}
+
+/*!
+ * \return \c true if \p other holds the same instrument file, capabilities and settings as this snapshot.
+ */
+bool WSnapshot::sameSettings(const WSnapshot &other) const
+{
+  return instrumentFile_ == other.instrumentFile_ && instrumentTime_ == other.instrumentTime_ &&
+    capabilities_ == other.capabilities_ &&
+    sameDetectorInfo(detectorInfo_, other.detectorInfo_) && sameDetectorRegion(detectorRegion_, other.detectorRegion_) &&
+    sameAnalyzerRegion(analyzerRegion_, other.analyzerRegion_) &&
+    lensMode_ == other.lensMode_;
+}
+
+/*!
+ * Obtains the modification time of an instrument configuration file, which is part of the key of a snapshot.
+ *
+ * \param[in] instrumentFile The instrument configuration file.
+ * \param[out] time The modification time, in seconds since the epoch.
+ *
+ * \return \c true if successful.
+ */
+bool WSnapshot::instrumentTime(const char *instrumentFile, long long &time)
+{
+  struct stat status;
+  if (stat(instrumentFile, &status) != 0)
+    return false;
+  time = (long long)status.st_mtime;
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef __SESWRAPPER_WSNAPSHOT_H__
+#define __SESWRAPPER_WSNAPSHOT_H__
+
+#include "wcapabilities.h"
+#include "types.h"
+
+#include <string>
+
+/*!
+ * \brief The capabilities and the last-known settings of an instrument, saved to a binary file so that they are
+ * available before the instrument library has been initialised.
+ *
+ * A snapshot belongs to one instrument configuration file: it is only loaded if the path and the modification time
+ * of that file are those it was saved with.
+ */
+class WSnapshot
+{
+public:
+  /*!
+   * The version of the file format. Increment it whenever the layout of the file or of the structures in it changes.
+   */
+  enum
+  {
+    VERSION = 1
+  };
+
+  WSnapshot();
+
+  void clear();
+  bool load(const char *fileName, const char *instrumentFile);
+  bool save(const char *fileName) const;
+  bool sameSettings(const WSnapshot &other) const;
+
+  static bool instrumentTime(const char *instrumentFile, long long &time);
+
+  std::string instrumentFile_; /*!< The instrument configuration file the snapshot was taken from */
+  long long instrumentTime_; /*!< The modification time of \c instrumentFile_ */
+  WCapabilities capabilities_; /*!< The element sets, lens modes and pass energies */
+  SESWrapperNS::WDetectorInfo detectorInfo_; /*!< The detector information */
+  SESWrapperNS::WDetectorRegion detectorRegion_; /*!< The last-known detector region */
+  SESWrapperNS::WAnalyzerRegion analyzerRegion_; /*!< The last-known analyzer region */
+  int lensMode_; /*!< The index in \c capabilities_ of the last-known lens mode */
+};
+
+#endif
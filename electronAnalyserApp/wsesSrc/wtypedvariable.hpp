@@ -0,0 +1,80 @@
+#ifndef __SESWRAPPER_WTYPEDVARIABLE_HPP__
+#define __SESWRAPPER_WTYPEDVARIABLE_HPP__
+
+#include <string.h>
+
+/*!
+ * A string of at most \p Extent characters that a typed getter fills in a single call. There is room for the
+ * null termination after the last character.
+ */
+template<int Extent>
+class WFixedString
+{
+public:
+  enum { extent = Extent };
+
+  WFixedString() : length_(0) { data_[0] = 0; }
+
+  const char *c_str() const { return data_; }
+  int length() const { return length_; }
+
+  char *data() { return data_; }
+  void terminate() { data_[Extent] = 0; length_ = int(strlen(data_)); }
+
+private:
+  char data_[Extent + 1];
+  int length_;
+};
+
+/*!
+ * An array of up to \p capacity elements owned by the caller, which a typed getter fills in a single call. After
+ * the call, size() is the number of elements of the variable, which is larger than capacity() if the array was too
+ * small to hold it.
+ */
+template<typename T>
+class WSpan
+{
+public:
+  WSpan(T *data, int capacity) : data_(data), capacity_(capacity), size_(0) {}
+
+  T *data() const { return data_; }
+  int capacity() const { return capacity_; }
+  int size() const { return size_; }
+  void setSize(int size) { size_ = size; }
+
+private:
+  T *data_;
+  int capacity_;
+  int size_;
+};
+
+/*!
+ * Adapts a typed value to the <code>void *</code> and size arguments of the WVariable getters. The primary template
+ * covers numbers and structures, which have no extent.
+ */
+template<typename T>
+struct WTypedValue
+{
+  static void *data(T &value) { return &value; }
+  static int capacity(const T &) { return 0; }
+  /*! Takes the size reported by the getter, returns \c false if the value did not fit. */
+  static bool finish(T &, int) { return true; }
+};
+
+template<int Extent>
+struct WTypedValue<WFixedString<Extent> >
+{
+  static void *data(WFixedString<Extent> &value) { return value.data(); }
+  static int capacity(const WFixedString<Extent> &) { return Extent; }
+  static bool finish(WFixedString<Extent> &value, int size) { value.terminate(); return size <= Extent; }
+};
+
+template<typename T>
+struct WTypedValue<WSpan<T> >
+{
+  static void *data(WSpan<T> &value) { return value.data(); }
+  static int capacity(const WSpan<T> &value) { return value.capacity(); }
+  static bool finish(WSpan<T> &value, int size) { value.setSize(size); return size <= value.capacity(); }
+};
+
+#endif
@@ -89,7 +89,7 @@ class electronAnalyserViewer(AsynPort):
     # This tells xmlbuilder to use PORT instead of name as the row ID
     UniqueName = "PORT"
     _SpecificTemplate = electronAnalyserViewerTemplate
-    def __init__(self, PORT, BUFFERS = 50, MEMORY = -1, **args):
+    def __init__(self, PORT, BUFFERS = 50, MEMORY = -1, STREAMS = 1, **args):
         # Init the superclass (AsynPort)
         self.__super.__init__(PORT)
         # Update the attributes of self from the commandline args
@@ -101,14 +101,20 @@ class electronAnalyserViewer(AsynPort):
     ArgInfo = ADBaseTemplate.ArgInfo + _SpecificTemplate.ArgInfo + makeArgInfo(__init__,
         PORT = Simple('Port name for the detector', str),
         BUFFERS = Simple('Maximum number of NDArray buffers to be created for plugin callbacks', int),
-        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins', int))
+        MEMORY = Simple('Max memory to allocate, should be maxw*maxh*nbuffer for driver and all attached plugins', int),
+        STREAMS = Simple('Number of SES live image streams, each published on its own asyn address', int))
 
     LibFileList = ['electronAnalyserViewerSupport']
     DbdFileList = ['electronAnalyserViewerSupport']
 
     def Initialise(self):
-        print '# electronAnalyserViewerConfig(portName, maxBuffers, maxMemory)'
-        print 'electronAnalyserViewerConfig("%(PORT)s", %(BUFFERS)d, %(MEMORY)d)' % self.__dict__
+        print '# electronAnalyserViewerConfig(portName, maxBuffers, maxMemory, priority, stackSize, maxStreams)'
+        print 'electronAnalyserViewerConfig("%(PORT)s", %(BUFFERS)d, %(MEMORY)d, 0, 0, %(STREAMS)d)' % self.__dict__
+
+
+class electronAnalyserViewerStream(AutoSubstitution):
+    '''Connection and status of an additional SES live image stream of a viewer port'''
+    TemplateFile="electronAnalyserViewerStream.template"
 
 
 